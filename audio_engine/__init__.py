@@ -9,8 +9,24 @@ from .audio_fingerprint_engine import (
     # Main functions
     generate_fingerprint,
     batch_process_songs,
+    batch_process_files,
+    io_uring_available,
     preprocess_audio,
     compute_spectrogram,
+    profiles_compatible,
+    read_query_log,
+    sparse_profile,
+    mp3_decoder_available,
+    mp3_stream_info,
+    decode_mp3,
+    define_cpu_pool,
+    cpu_pool_stats,
+    reset_cpu_pool_stats,
+    cpu_placement_supported,
+    audit_stream_push,
+    realtime_allocation_tracking,
+    cancellation_stats,
+    reset_cancellation_stats,
     
     # Classes
     AudioSample,
@@ -20,6 +36,21 @@ from .audio_fingerprint_engine import (
     FFTProcessor,
     PeakDetector,
     HashGenerator,
+    EnginePool,
+    FingerprintIndex,
+    FingerprintPruner,
+    FingerprintProfile,
+    ProfileSet,
+    QueryLog,
+    TieredQueryProcessor,
+    StreamingFingerprinter,
+    CancellationToken,
+    OperationCancelled,
+    MatcherSidecar,
+    MatcherClient,
+    SyntheticCatalog,
+    EngineTuning,
+    autotune,
     
     # Version
     __version__
@@ -28,8 +59,24 @@ from .audio_fingerprint_engine import (
 __all__ = [
     'generate_fingerprint',
     'batch_process_songs', 
+    'batch_process_files',
+    'io_uring_available',
     'preprocess_audio',
     'compute_spectrogram',
+    'profiles_compatible',
+    'read_query_log',
+    'sparse_profile',
+    'mp3_decoder_available',
+    'mp3_stream_info',
+    'decode_mp3',
+    'define_cpu_pool',
+    'cpu_pool_stats',
+    'reset_cpu_pool_stats',
+    'cpu_placement_supported',
+    'audit_stream_push',
+    'realtime_allocation_tracking',
+    'cancellation_stats',
+    'reset_cancellation_stats',
     'AudioSample',
     'AudioFingerprint',
     'SpectralPeak',
@@ -37,5 +84,20 @@ __all__ = [
     'FFTProcessor',
     'PeakDetector',
     'HashGenerator',
+    'EnginePool',
+    'FingerprintIndex',
+    'FingerprintPruner',
+    'FingerprintProfile',
+    'ProfileSet',
+    'QueryLog',
+    'TieredQueryProcessor',
+    'StreamingFingerprinter',
+    'CancellationToken',
+    'OperationCancelled',
+    'MatcherSidecar',
+    'MatcherClient',
+    'SyntheticCatalog',
+    'EngineTuning',
+    'autotune',
     '__version__'
 ]
\ No newline at end of file
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+One-time autotuning of engine kernel and scheduling parameters.
+
+Benchmarks candidate values for the fused pipeline's tile size, the posting
+prefetch distance, query and worker thread counts and the write-ahead log
+commit window on this machine (see engine_tuning.h), and writes the winners
+to this host's wisdom file. The engine loads the file the first time it
+needs a tuned value; without one, or with one tuned on another host or for
+another core count, it uses the defaults.
+
+The wisdom file is $FINGERPRINT_WISDOM if set, otherwise
+wisdom-<host>.conf in the user's cache directory. Rerun after hardware
+changes.
+
+Usage:
+    python autotune.py run [--work-dir DIR] [--output WISDOM] [--repetitions N] [--quick] [--dry-run]
+    python autotune.py show
+"""
+
+import argparse
+import json
+import logging
+import sys
+import tempfile
+from dataclasses import dataclass, field, asdict
+from typing import Dict, List, Optional
+
+try:
+    from . import audio_fingerprint_engine as afe
+except ImportError:
+    import audio_fingerprint_engine as afe
+
+TUNED_FIELDS = ("tile_frames", "prefetch_distance", "parallel_query_min_hashes", "query_threads",
+                "pool_workers", "commit_window_us")
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass
+class AutotuneReport:
+    """Outcome of an autotuning run"""
+    host: str
+    wisdom_path: str                # Empty if the winners were not saved
+    elapsed_ms: float
+    tuning: Dict[str, int]
+    defaults: Dict[str, int]
+    trials: List[Dict] = field(default_factory=list)
+
+
+def tuning_to_dict(tuning) -> Dict[str, int]:
+    return {name: getattr(tuning, name) for name in TUNED_FIELDS}
+
+
+def run_autotune(work_dir: Optional[str] = None, output: Optional[str] = None, repetitions: int = 5,
+                 tolerance: float = 0.03, quick: bool = False, save: bool = True) -> AutotuneReport:
+    """
+    Benchmark candidate settings and persist the winners.
+
+    Args:
+        work_dir: Scratch directory for the index and log trials (a temporary one if None)
+        output: Wisdom file to write (this host's wisdom path if None)
+        repetitions: Timed runs per candidate
+        tolerance: Relative slack within which the default or a cheaper candidate wins
+        quick: Smaller workloads, for a first estimate
+        save: Write the wisdom file and install the winners in this process
+
+    Raises:
+        RuntimeError: If no wisdom path is known and output is not given
+    """
+    output = output or afe.EngineTuning.wisdom_path()
+    if save and not output:
+        raise RuntimeError("No wisdom path; set FINGERPRINT_WISDOM or pass an output path")
+
+    with tempfile.TemporaryDirectory(dir=work_dir) as scratch:
+        logger.info(f"Autotuning on {afe.EngineTuning.host_name()}{' (quick)' if quick else ''}")
+        result = afe.autotune(scratch, repetitions, tolerance, quick)
+
+    tuning = result["tuning"]
+    if save:
+        tuning.save(output)
+        afe.EngineTuning.install(tuning, output)
+        logger.info(f"Wrote wisdom to {output}")
+
+    return AutotuneReport(
+        host=afe.EngineTuning.host_name(),
+        wisdom_path=output if save else "",
+        elapsed_ms=result["elapsed_ms"],
+        tuning=tuning_to_dict(tuning),
+        defaults=tuning_to_dict(afe.EngineTuning()),
+        trials=result["trials"],
+    )
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Tune engine parameters for this host")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    run_parser = subparsers.add_parser("run", help="Benchmark candidate settings and write the wisdom file")
+    run_parser.add_argument("--work-dir", help="Parent of the scratch directory (system temp if omitted)")
+    run_parser.add_argument("--output", help="Wisdom file to write (this host's wisdom path if omitted)")
+    run_parser.add_argument("--repetitions", type=int, default=5, help="Timed runs per candidate")
+    run_parser.add_argument("--tolerance", type=float, default=0.03,
+                            help="Relative slack within which the default or a cheaper candidate wins")
+    run_parser.add_argument("--quick", action="store_true", help="Smaller workloads")
+    run_parser.add_argument("--dry-run", action="store_true", help="Report the winners without saving them")
+
+    subparsers.add_parser("show", help="Print the settings in effect and where they came from")
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "run":
+        report = run_autotune(args.work_dir, args.output, args.repetitions, args.tolerance, args.quick,
+                              save=not args.dry_run)
+        print(json.dumps(asdict(report)))
+        return 0
+
+    print(json.dumps({
+        "host": afe.EngineTuning.host_name(),
+        "wisdom_path": afe.EngineTuning.wisdom_path(),
+        "source": afe.EngineTuning.source(),
+        "tuning": tuning_to_dict(afe.EngineTuning.current()),
+    }))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
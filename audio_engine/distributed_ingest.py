@@ -0,0 +1,512 @@
+#!/usr/bin/env python3
+"""
+Distributed bulk ingest of a reference catalog into a segmented index.
+
+A coordinator splits a file manifest (JSON lines of song_id, path and
+optional title, artist, album, duration_ms) into chunks inside a job
+directory. Worker processes on any node that can see the job directory
+lease chunks, fingerprint their files and commit each chunk as a small
+index directory of its own. Collecting the job copies the chunk segments
+into one index in chunk order and merges them; since a segment's content
+depends only on its postings and song table, the merged segment is the
+same byte for byte whatever the number of workers, the chunk size or the
+order chunks finished in.
+
+Leases are files in the job directory, so a shared file system is the only
+coordination service. Attempt n of chunk c is the file leases/<c>.<n>,
+created with O_EXCL so exactly one worker wins it. The holder refreshes
+its modification time while it works. A lease not refreshed for
+lease_seconds belongs to a dead or stuck worker, and the chunk is retried
+as attempt n + 1; after max_attempts the chunk is marked failed. Files
+that fail to decode are recorded per chunk and are not retried.
+
+Job directory layout:
+    job.json                  Plan parameters
+    chunks/<c>.json           Manifest entries of each chunk, sorted by song ID
+    leases/<c>.<n>            Lease of attempt n
+    errors/<c>.<n>.txt        Why attempt n failed
+    output/<c>/               Committed chunk: index directory and result.json
+    failed/<c>.json           Chunk that ran out of attempts
+
+Usage:
+    python distributed_ingest.py plan MANIFEST JOB_DIR [--chunk-size N] [--lease-seconds S] [--max-attempts K]
+    python distributed_ingest.py worker JOB_DIR [--worker-id ID] [--compute-threads N]
+    python distributed_ingest.py run JOB_DIR [--workers N]
+    python distributed_ingest.py status JOB_DIR
+    python distributed_ingest.py collect JOB_DIR INDEX_DIR
+"""
+
+import argparse
+import json
+import logging
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import threading
+import time
+import zlib
+from dataclasses import dataclass, field, asdict
+from typing import Dict, List, Optional
+
+try:
+    from . import audio_fingerprint_engine as afe
+    from .index_replication import Manifest, SegmentInfo, read_manifest, write_manifest
+except ImportError:
+    import audio_fingerprint_engine as afe
+    from index_replication import Manifest, SegmentInfo, read_manifest, write_manifest
+
+JOB_FILE = "job.json"
+RESULT_FILE = "result.json"
+DEFAULT_CHUNK_SIZE = 500
+DEFAULT_LEASE_SECONDS = 120.0
+DEFAULT_MAX_ATTEMPTS = 3
+DEFAULT_POLL_SECONDS = 1.0
+COPY_CHUNK_BYTES = 1 << 20
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass
+class JobPlan:
+    """Parameters of an ingest job, stored as job.json"""
+    chunk_count: int
+    chunk_size: int
+    total_songs: int
+    lease_seconds: float = DEFAULT_LEASE_SECONDS
+    max_attempts: int = DEFAULT_MAX_ATTEMPTS
+
+
+@dataclass
+class JobStatus:
+    """Progress of an ingest job"""
+    chunks: int = 0
+    done: int = 0
+    failed: int = 0
+    leased: int = 0
+    pending: int = 0
+    attempts: int = 0         # Leases taken so far, retries included
+    retried_chunks: int = 0   # Chunks that needed more than one attempt
+
+    @property
+    def finished(self) -> bool:
+        return self.done + self.failed == self.chunks
+
+
+@dataclass
+class CollectReport:
+    """Outcome of merging the committed chunks into an index"""
+    chunks: int = 0
+    songs: int = 0
+    postings: int = 0
+    failed_files: List[Dict] = field(default_factory=list)
+    segment_file: str = ""
+    segment_crc32: int = 0
+    duration_ms: float = 0.0
+
+
+def chunk_name(chunk: int) -> str:
+    return f"chunk_{chunk:06d}"
+
+
+def load_plan(job_dir: str) -> JobPlan:
+    with open(os.path.join(job_dir, JOB_FILE)) as f:
+        return JobPlan(**json.load(f))
+
+
+def _write_json_atomically(path: str, value) -> None:
+    tmp_path = f"{path}.{os.getpid()}.tmp"
+    with open(tmp_path, "w") as f:
+        json.dump(value, f)
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(tmp_path, path)
+
+
+def read_file_manifest(path: str) -> List[Dict]:
+    """Read a JSON-lines file manifest; every entry needs a unique integer song_id and a path"""
+    entries = []
+    seen = set()
+    with open(path) as f:
+        for line_number, line in enumerate(f, 1):
+            if not line.strip():
+                continue
+            entry = json.loads(line)
+            if not isinstance(entry.get("song_id"), int) or not (0 <= entry["song_id"] < 2**32) or "path" not in entry:
+                raise ValueError(f"{path}:{line_number}: entries need an unsigned 32-bit song_id and a path")
+            if entry["song_id"] in seen:
+                raise ValueError(f"{path}:{line_number}: duplicate song_id {entry['song_id']}")
+            seen.add(entry["song_id"])
+            entries.append(entry)
+    return entries
+
+
+def plan_job(manifest_path: str, job_dir: str, chunk_size: int = DEFAULT_CHUNK_SIZE,
+             lease_seconds: float = DEFAULT_LEASE_SECONDS, max_attempts: int = DEFAULT_MAX_ATTEMPTS) -> JobPlan:
+    """
+    Split a file manifest into chunks in a new job directory.
+
+    Entries are sorted by song ID first, so the chunks do not depend on the
+    order of the manifest.
+    """
+    if chunk_size <= 0 or lease_seconds <= 0 or max_attempts <= 0:
+        raise ValueError("Chunk size, lease time and attempts must be positive")
+    if os.path.exists(os.path.join(job_dir, JOB_FILE)):
+        raise ValueError(f"{job_dir} already holds an ingest job")
+
+    entries = sorted(read_file_manifest(manifest_path), key=lambda entry: entry["song_id"])
+    for sub_dir in ("chunks", "leases", "errors", "output", "failed"):
+        os.makedirs(os.path.join(job_dir, sub_dir), exist_ok=True)
+
+    chunk_count = (len(entries) + chunk_size - 1) // chunk_size
+    for chunk in range(chunk_count):
+        _write_json_atomically(os.path.join(job_dir, "chunks", chunk_name(chunk) + ".json"),
+                               entries[chunk * chunk_size:(chunk + 1) * chunk_size])
+
+    plan = JobPlan(chunk_count=chunk_count, chunk_size=chunk_size, total_songs=len(entries),
+                   lease_seconds=lease_seconds, max_attempts=max_attempts)
+    _write_json_atomically(os.path.join(job_dir, JOB_FILE), asdict(plan))
+    return plan
+
+
+def _lease_attempts(job_dir: str, chunk: int) -> Dict[int, str]:
+    """Existing lease files of a chunk by attempt number"""
+    prefix = chunk_name(chunk) + "."
+    attempts = {}
+    for name in os.listdir(os.path.join(job_dir, "leases")):
+        if name.startswith(prefix) and name[len(prefix):].isdigit():
+            attempts[int(name[len(prefix):])] = os.path.join(job_dir, "leases", name)
+    return attempts
+
+
+def _is_done(job_dir: str, chunk: int) -> bool:
+    return os.path.isdir(os.path.join(job_dir, "output", chunk_name(chunk)))
+
+
+def _is_failed(job_dir: str, chunk: int) -> bool:
+    return os.path.exists(os.path.join(job_dir, "failed", chunk_name(chunk) + ".json"))
+
+
+def _lease_is_fresh(path: str, lease_seconds: float) -> bool:
+    try:
+        return time.time() - os.path.getmtime(path) < lease_seconds
+    except FileNotFoundError:
+        return False
+
+
+def _mark_failed(job_dir: str, chunk: int, attempts: int) -> None:
+    path = os.path.join(job_dir, "failed", chunk_name(chunk) + ".json")
+    try:
+        fd = os.open(path, os.O_CREAT | os.O_EXCL | os.O_WRONLY, 0o644)
+    except FileExistsError:
+        return
+    with os.fdopen(fd, "w") as f:
+        json.dump({"chunk": chunk, "attempts": attempts}, f)
+    logger.error(f"{chunk_name(chunk)} failed after {attempts} attempts")
+
+
+def try_lease(job_dir: str, plan: JobPlan, chunk: int, worker_id: str) -> Optional[int]:
+    """
+    Take the next attempt of a chunk if it is neither finished nor held by a live lease.
+
+    Returns:
+        The attempt number, or None if the chunk is not available
+    """
+    if _is_done(job_dir, chunk) or _is_failed(job_dir, chunk):
+        return None
+
+    attempts = _lease_attempts(job_dir, chunk)
+    latest = max(attempts) if attempts else 0
+    if latest:
+        if _lease_is_fresh(attempts[latest], plan.lease_seconds):
+            return None
+        if latest >= plan.max_attempts:
+            _mark_failed(job_dir, chunk, latest)
+            return None
+
+    attempt = latest + 1
+    path = os.path.join(job_dir, "leases", f"{chunk_name(chunk)}.{attempt}")
+    try:
+        fd = os.open(path, os.O_CREAT | os.O_EXCL | os.O_WRONLY, 0o644)
+    except FileExistsError:
+        return None  # Another worker took this attempt first
+    with os.fdopen(fd, "w") as f:
+        json.dump({"worker": worker_id, "host": socket.gethostname(), "pid": os.getpid()}, f)
+    return attempt
+
+
+class _Heartbeat:
+    """Refreshes a lease file while its chunk is processed"""
+
+    def __init__(self, path: str, interval: float):
+        self.path = path
+        self.interval = interval
+        self.stopped = threading.Event()
+        self.thread = threading.Thread(target=self._run, daemon=True)
+
+    def _run(self):
+        while not self.stopped.wait(self.interval):
+            try:
+                os.utime(self.path)
+            except OSError as e:
+                logger.warning(f"Lease refresh failed for {self.path}: {e}")
+
+    def __enter__(self):
+        self.thread.start()
+        return self
+
+    def __exit__(self, *exc_info):
+        self.stopped.set()
+        self.thread.join()
+
+
+def process_chunk(job_dir: str, chunk: int, attempt: int, worker_id: str, compute_threads: int = 0) -> bool:
+    """
+    Fingerprint one leased chunk and commit it as output/<chunk>.
+
+    Returns:
+        False if another attempt committed the chunk first
+    """
+    with open(os.path.join(job_dir, "chunks", chunk_name(chunk) + ".json")) as f:
+        entries = json.load(f)
+
+    work_dir = os.path.join(job_dir, "output", f".{chunk_name(chunk)}.{attempt}.tmp")
+    shutil.rmtree(work_dir, ignore_errors=True)
+
+    try:
+        output = afe.batch_process_files([entry["path"] for entry in entries],
+                                         [str(entry["song_id"]) for entry in entries],
+                                         compute_threads)
+
+        index = afe.FingerprintIndex(work_dir)
+        failed_files = []
+        for entry, result in zip(entries, output["results"]):
+            if not result["success"]:
+                failed_files.append({"song_id": entry["song_id"], "path": entry["path"],
+                                     "error": result.get("error_message") or ""})
+                continue
+            index.add_song(entry["song_id"], result["hash_values"], result["time_offsets"],
+                           title=entry.get("title", ""), artist=entry.get("artist", ""),
+                           album=entry.get("album", ""), duration_ms=int(entry.get("duration_ms", 0)))
+        index.flush()
+        del index
+
+        _write_json_atomically(os.path.join(work_dir, RESULT_FILE), {
+            "chunk": chunk, "attempt": attempt, "worker": worker_id,
+            "songs": len(entries) - len(failed_files), "failed_files": failed_files,
+        })
+    except Exception:
+        shutil.rmtree(work_dir, ignore_errors=True)
+        raise
+
+    try:
+        os.rename(work_dir, os.path.join(job_dir, "output", chunk_name(chunk)))
+    except OSError:
+        # A retry of a lease we were too slow to refresh got there first
+        shutil.rmtree(work_dir, ignore_errors=True)
+        return False
+    return True
+
+
+def run_worker(job_dir: str, worker_id: Optional[str] = None, compute_threads: int = 0,
+               poll_seconds: float = DEFAULT_POLL_SECONDS) -> int:
+    """
+    Process chunks until every chunk is committed or failed.
+
+    Returns:
+        Number of chunks this worker committed
+    """
+    worker_id = worker_id or f"{socket.gethostname()}-{os.getpid()}"
+    plan = load_plan(job_dir)
+    committed = 0
+
+    while True:
+        leased_any = False
+        for chunk in range(plan.chunk_count):
+            attempt = try_lease(job_dir, plan, chunk, worker_id)
+            if attempt is None:
+                continue
+            leased_any = True
+            lease_path = os.path.join(job_dir, "leases", f"{chunk_name(chunk)}.{attempt}")
+
+            logger.info(f"{worker_id}: {chunk_name(chunk)} attempt {attempt}")
+            try:
+                with _Heartbeat(lease_path, plan.lease_seconds / 3.0):
+                    if process_chunk(job_dir, chunk, attempt, worker_id, compute_threads):
+                        committed += 1
+            except Exception as e:
+                logger.error(f"{worker_id}: {chunk_name(chunk)} attempt {attempt} failed: {e}")
+                with open(os.path.join(job_dir, "errors", f"{chunk_name(chunk)}.{attempt}.txt"), "w") as f:
+                    f.write(f"{worker_id}: {e}\n")
+                os.utime(lease_path, (0, 0))  # Expire the lease so the retry starts now
+
+        if job_status(job_dir).finished:
+            return committed
+        if not leased_any:
+            time.sleep(poll_seconds)
+
+
+def job_status(job_dir: str) -> JobStatus:
+    """Count chunks by state"""
+    plan = load_plan(job_dir)
+    status = JobStatus(chunks=plan.chunk_count)
+
+    for chunk in range(plan.chunk_count):
+        attempts = _lease_attempts(job_dir, chunk)
+        status.attempts += len(attempts)
+        if len(attempts) > 1:
+            status.retried_chunks += 1
+
+        if _is_done(job_dir, chunk):
+            status.done += 1
+        elif _is_failed(job_dir, chunk):
+            status.failed += 1
+        elif attempts and _lease_is_fresh(attempts[max(attempts)], plan.lease_seconds):
+            status.leased += 1
+        else:
+            status.pending += 1
+    return status
+
+
+def run_local_workers(job_dir: str, workers: int, compute_threads: int = 0) -> JobStatus:
+    """Run a job to completion with worker processes on this machine"""
+    command = [sys.executable, os.path.abspath(__file__), "worker", job_dir,
+               "--compute-threads", str(compute_threads)]
+    processes = [subprocess.Popen(command + ["--worker-id", f"local-{i}"]) for i in range(workers)]
+    for process in processes:
+        if process.wait() != 0:
+            logger.warning(f"Worker exited with status {process.returncode}")
+    return job_status(job_dir)
+
+
+def _copy_verified(source: str, target: str, segment: SegmentInfo) -> None:
+    crc = 0
+    size = 0
+    with open(source, "rb") as src, open(target, "wb") as dst:
+        while True:
+            block = src.read(COPY_CHUNK_BYTES)
+            if not block:
+                break
+            crc = zlib.crc32(block, crc)
+            size += len(block)
+            dst.write(block)
+        dst.flush()
+        os.fsync(dst.fileno())
+    if size != segment.size_bytes or (crc & 0xFFFFFFFF) != segment.crc32:
+        raise IOError(f"Segment {source} failed verification")
+
+
+def collect(job_dir: str, index_dir: str) -> CollectReport:
+    """
+    Merge the committed chunks of a finished job into a new index directory.
+
+    Raises:
+        RuntimeError: If chunks are still pending or have failed
+    """
+    start = time.perf_counter()
+    status = job_status(job_dir)
+    if status.done != status.chunks:
+        raise RuntimeError(f"Job is not complete: {status.done}/{status.chunks} chunks done, "
+                           f"{status.failed} failed")
+    if read_manifest(index_dir).segments:
+        raise ValueError(f"{index_dir} already holds an index")
+    os.makedirs(index_dir, exist_ok=True)
+
+    report = CollectReport(chunks=status.chunks)
+    manifest = Manifest(generation=1, committed_at_ms=int(time.time() * 1000))
+    for chunk in range(status.chunks):
+        chunk_dir = os.path.join(job_dir, "output", chunk_name(chunk))
+        with open(os.path.join(chunk_dir, RESULT_FILE)) as f:
+            report.failed_files.extend(json.load(f)["failed_files"])
+
+        chunk_manifest = read_manifest(chunk_dir)
+        if chunk_manifest.hash_signature:
+            if manifest.hash_signature and manifest.hash_signature != chunk_manifest.hash_signature:
+                raise RuntimeError(f"{chunk_name(chunk)} was fingerprinted with hashes "
+                                   f"{chunk_manifest.hash_signature}, others with {manifest.hash_signature}")
+            manifest.profile_set = chunk_manifest.profile_set
+            manifest.hash_signature = chunk_manifest.hash_signature
+
+        for segment in chunk_manifest.segments:
+            segment_id = manifest.next_segment_id
+            file_name = f"seg_{segment_id:016x}.afs"
+            _copy_verified(os.path.join(chunk_dir, segment.file_name), os.path.join(index_dir, file_name), segment)
+            manifest.segments.append(SegmentInfo(segment_id, file_name, segment.size_bytes, segment.crc32,
+                                                 segment.song_count, segment.posting_count))
+            manifest.next_segment_id += 1
+
+    write_manifest(index_dir, manifest)
+
+    index = afe.FingerprintIndex(index_dir)
+    index.merge_segments()
+    stats = index.get_stats()
+    report.songs = stats["segment_songs"]
+    report.postings = stats["segment_postings"]
+    del index
+
+    final = read_manifest(index_dir)
+    if final.segments:
+        report.segment_file = final.segments[0].file_name
+        report.segment_crc32 = final.segments[0].crc32
+    report.duration_ms = (time.perf_counter() - start) * 1000.0
+    return report
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Distributed bulk ingest into a fingerprint index")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    plan_parser = subparsers.add_parser("plan", help="Split a file manifest into leased chunks")
+    plan_parser.add_argument("manifest")
+    plan_parser.add_argument("job_dir")
+    plan_parser.add_argument("--chunk-size", type=int, default=DEFAULT_CHUNK_SIZE)
+    plan_parser.add_argument("--lease-seconds", type=float, default=DEFAULT_LEASE_SECONDS)
+    plan_parser.add_argument("--max-attempts", type=int, default=DEFAULT_MAX_ATTEMPTS)
+
+    worker_parser = subparsers.add_parser("worker", help="Process chunks until the job is finished")
+    worker_parser.add_argument("job_dir")
+    worker_parser.add_argument("--worker-id")
+    worker_parser.add_argument("--compute-threads", type=int, default=0, help="Fingerprinting threads (0 = one per core)")
+    worker_parser.add_argument("--poll-seconds", type=float, default=DEFAULT_POLL_SECONDS)
+
+    run_parser = subparsers.add_parser("run", help="Run a job with local worker processes")
+    run_parser.add_argument("job_dir")
+    run_parser.add_argument("--workers", type=int, default=os.cpu_count() or 1)
+    run_parser.add_argument("--compute-threads", type=int, default=1)
+
+    status_parser = subparsers.add_parser("status", help="Report chunk states")
+    status_parser.add_argument("job_dir")
+
+    collect_parser = subparsers.add_parser("collect", help="Merge the committed chunks into an index")
+    collect_parser.add_argument("job_dir")
+    collect_parser.add_argument("index_dir")
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "plan":
+        plan = plan_job(args.manifest, args.job_dir, args.chunk_size, args.lease_seconds, args.max_attempts)
+        print(json.dumps(asdict(plan)))
+        return 0
+
+    if args.command == "worker":
+        committed = run_worker(args.job_dir, args.worker_id, args.compute_threads, args.poll_seconds)
+        print(json.dumps({"committed_chunks": committed}))
+        return 0
+
+    if args.command == "run":
+        status = run_local_workers(args.job_dir, args.workers, args.compute_threads)
+        print(json.dumps(asdict(status)))
+        return 0 if status.failed == 0 else 1
+
+    if args.command == "status":
+        print(json.dumps(asdict(job_status(args.job_dir))))
+        return 0
+
+    print(json.dumps(asdict(collect(args.job_dir, args.index_dir))))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
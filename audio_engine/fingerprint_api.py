@@ -7,6 +7,7 @@ fingerprinting engine for use by the backend API.
 
 import numpy as np
 import logging
+import os
 from typing import Dict, List, Optional, Tuple, Union
 from dataclasses import dataclass
 
@@ -18,6 +19,14 @@ except ImportError:
 
 logger = logging.getLogger(__name__)
 
+# Pipelines of a profile set: sparse for catalog songs, denser for queries
+FINGERPRINT_PROFILES = ('reference', 'query')
+
+# Cancellation handle accepted by the fingerprinting and matching calls, and
+# the error they raise once it is cancelled or its deadline passes
+CancellationToken = afe.CancellationToken
+OperationCancelled = afe.OperationCancelled
+
 
 @dataclass
 class FingerprintResult:
@@ -29,6 +38,9 @@ class FingerprintResult:
     time_deltas: List[int]
     count: int
     processing_time_ms: Optional[int] = None
+    peak_strengths: Optional[List[float]] = None
+    processing_mode: Optional[str] = None
+    queue_wait_ms: Optional[float] = None
 
 
 @dataclass
@@ -44,6 +56,14 @@ class BatchProcessingResult:
     time_offsets: Optional[List[int]] = None
 
 
+class EngineOverloadedError(RuntimeError):
+    """Raised when admission control rejects a request because the engine is overloaded"""
+    
+    def __init__(self, message: str, retry_after_ms: int):
+        super().__init__(message)
+        self.retry_after_ms = retry_after_ms
+
+
 class AudioFingerprintEngine:
     """
     High-level interface to the C++ audio fingerprinting engine.
@@ -51,16 +71,57 @@ class AudioFingerprintEngine:
     Provides error handling, logging, and a clean API for the backend.
     """
     
-    def __init__(self):
-        """Initialize the fingerprinting engine"""
+    def __init__(
+        self,
+        pool_workers: int = 0,
+        interactive_slo_ms: int = 2000,
+        batch_slo_ms: int = 60000,
+        profiles_path: Optional[str] = None,
+        query_log_path: Optional[str] = None,
+        query_log_sample_rate: float = 0.01
+    ):
+        """
+        Initialize the fingerprinting engine.
+        
+        Args:
+            pool_workers: Worker threads for prioritized requests (0 = one per core)
+            interactive_slo_ms: Latency objective for interactive queries
+            batch_slo_ms: Latency objective for batch ingest
+            profiles_path: Profile set file with the reference and query profiles;
+                           None uses the built-in default set
+            query_log_path: Binary log that sampled identification queries are
+                            captured to for offline replay; None disables capture
+            query_log_sample_rate: Fraction of queries captured to the query log
+        """
         self.logger = logging.getLogger(f"{__name__}.{self.__class__.__name__}")
-        self.logger.info("Audio fingerprinting engine initialized")
+        self.profiles = afe.ProfileSet.load(profiles_path) if profiles_path else afe.ProfileSet()
+        self._pool_config = {
+            'num_workers': pool_workers,
+            'interactive_slo_ms': interactive_slo_ms,
+            'batch_slo_ms': batch_slo_ms,
+        }
+        self._pool = None
+        self.query_log = (
+            afe.QueryLog(query_log_path, query_log_sample_rate) if query_log_path else None
+        )
+        self.logger.info(f"Audio fingerprinting engine initialized with profile set {self.profiles.id()}, "
+                         f"tuning from {afe.EngineTuning.source()}")
+    
+    @property
+    def pool(self):
+        """Worker pool with admission control, created on first use"""
+        if self._pool is None:
+            self._pool = afe.EnginePool(**self._pool_config)
+        return self._pool
     
     def generate_fingerprint(
         self, 
         audio_data: Union[np.ndarray, List[float]], 
         sample_rate: int, 
-        channels: int = 1
+        channels: int = 1,
+        priority: Optional[str] = None,
+        profile: Optional[str] = None,
+        cancel_token: Optional[CancellationToken] = None
     ) -> FingerprintResult:
         """
         Generate audio fingerprint from audio data.
@@ -69,12 +130,20 @@ class AudioFingerprintEngine:
             audio_data: Audio samples as numpy array or list
             sample_rate: Sample rate in Hz
             channels: Number of audio channels (1 or 2)
+            priority: 'interactive' or 'batch' to run through the admission-controlled
+                      worker pool; None fingerprints on the calling thread
+            profile: 'reference' for catalog songs or 'query' for identification,
+                     taken from the engine's profile set; None uses the original
+                     symmetric settings
+            cancel_token: Abandons the work, queued or running, once cancelled
             
         Returns:
             FingerprintResult containing hash values and metadata
             
         Raises:
             ValueError: If audio data is invalid
+            EngineOverloadedError: If the pool rejects the request
+            OperationCancelled: If cancel_token is cancelled or its deadline passes
             RuntimeError: If fingerprinting fails
         """
         try:
@@ -94,13 +163,23 @@ class AudioFingerprintEngine:
             if channels not in [1, 2]:
                 raise ValueError("Only mono (1) and stereo (2) audio supported")
             
+            pipeline_profile = self.get_profile(profile) if profile is not None else None
+            
             self.logger.debug(
                 f"Generating fingerprint for {len(audio_data)} samples "
                 f"at {sample_rate} Hz, {channels} channel(s)"
             )
             
             # Generate fingerprint using C++ engine
-            result = afe.generate_fingerprint(audio_data, sample_rate, channels)
+            if priority is None:
+                result = afe.generate_fingerprint(audio_data, sample_rate, channels, pipeline_profile, cancel_token)
+            else:
+                result = self.pool.process(audio_data, sample_rate, channels, priority, pipeline_profile, cancel_token)
+                if result['status'] == 'rejected':
+                    raise EngineOverloadedError(
+                        "Audio engine overloaded, retry later",
+                        retry_after_ms=result['retry_after_ms']
+                    )
             
             fingerprint_result = FingerprintResult(
                 hash_values=result['hash_values'],
@@ -108,16 +187,76 @@ class AudioFingerprintEngine:
                 anchor_frequencies=result['anchor_frequencies'],
                 target_frequencies=result['target_frequencies'],
                 time_deltas=result['time_deltas'],
-                count=result['count']
+                peak_strengths=result.get('peak_strengths'),
+                count=result['count'],
+                processing_time_ms=(
+                    int(result['processing_time_ms']) if 'processing_time_ms' in result else None
+                ),
+                processing_mode=result.get('mode'),
+                queue_wait_ms=result.get('queue_wait_ms')
             )
             
             self.logger.info(f"Generated {fingerprint_result.count} fingerprints")
             return fingerprint_result
             
+        except EngineOverloadedError as e:
+            self.logger.warning(f"Fingerprint request rejected: {e} (retry after {e.retry_after_ms} ms)")
+            raise
+        except OperationCancelled as e:
+            self.logger.info(f"Fingerprint request abandoned: {e}")
+            raise
         except Exception as e:
             self.logger.error(f"Fingerprint generation failed: {e}")
             raise RuntimeError(f"Fingerprint generation failed: {e}") from e
     
+    def get_profile(self, name: str):
+        """
+        Get one profile of the engine's profile set.
+        
+        Args:
+            name: 'reference' or 'query'
+            
+        Returns:
+            The FingerprintProfile
+            
+        Raises:
+            ValueError: If the name is not a profile of the set
+        """
+        if name not in FINGERPRINT_PROFILES:
+            raise ValueError(f"Unknown fingerprint profile {name!r}; expected one of {FINGERPRINT_PROFILES}")
+        return getattr(self.profiles, name)
+    
+    def create_tiered_processor(
+        self,
+        index,
+        min_margin: float = 0.5,
+        min_votes: int = 10,
+        max_results: int = 5,
+        min_matches: int = 5
+    ):
+        """
+        Create a two-tier query processor over an index.
+        
+        Queries are matched with a sparse version of the profile set's query
+        profile first; the full query profile runs on the same spectrogram only
+        when the sparse top match is weak or close to the runner-up.
+        
+        Args:
+            index: FingerprintIndex to match against
+            min_margin: Escalate when (top1 - top2) / top1 of the sparse pass is below this
+            min_votes: Escalate when the sparse top match has fewer aligned votes
+            max_results: Maximum matches returned
+            min_matches: Minimum aligned votes for a match
+            
+        Returns:
+            TieredQueryProcessor; its get_stats() reports the escalation rate
+            and the estimated time saved
+        """
+        return afe.TieredQueryProcessor(
+            index, dense=self.profiles.query, min_margin=min_margin, min_votes=min_votes,
+            max_results=max_results, min_matches=min_matches
+        )
+    
     def preprocess_audio(
         self, 
         audio_data: Union[np.ndarray, List[float]], 
@@ -164,7 +303,8 @@ class AudioFingerprintEngine:
     def batch_process_reference_songs(
         self, 
         audio_samples: List[Dict], 
-        song_ids: List[str]
+        song_ids: List[str],
+        cancel_token: Optional[CancellationToken] = None
     ) -> List[BatchProcessingResult]:
         """
         Batch process reference songs for database population.
@@ -173,12 +313,14 @@ class AudioFingerprintEngine:
             audio_samples: List of audio sample dictionaries with keys:
                           'data', 'sample_rate', 'channels'
             song_ids: List of song identifiers
+            cancel_token: Abandons the whole batch once cancelled
             
         Returns:
             List of BatchProcessingResult objects
             
         Raises:
             ValueError: If inputs are invalid
+            OperationCancelled: If cancel_token is cancelled or its deadline passes
             RuntimeError: If batch processing fails
         """
         try:
@@ -200,7 +342,7 @@ class AudioFingerprintEngine:
                 processed_samples.append(sample)
             
             # Process using C++ engine
-            results = afe.batch_process_songs(processed_samples, song_ids)
+            results = afe.batch_process_songs(processed_samples, song_ids, cancel_token)
             
             # Convert to BatchProcessingResult objects
             batch_results = []
@@ -222,10 +364,91 @@ class AudioFingerprintEngine:
             
             return batch_results
             
+        except OperationCancelled:
+            raise
         except Exception as e:
             self.logger.error(f"Batch processing failed: {e}")
             raise RuntimeError(f"Batch processing failed: {e}") from e
     
+    def batch_process_files(
+        self,
+        file_paths: List[str],
+        song_ids: List[str],
+        compute_threads: int = 0,
+        queue_depth: int = 64,
+        io_threads: int = 8,
+        use_io_uring: bool = True,
+        cancel_token: Optional[CancellationToken] = None
+    ) -> Tuple[List[BatchProcessingResult], Dict]:
+        """
+        Read, decode and fingerprint reference audio files from disk.
+        
+        File reads are issued asynchronously (io_uring on Linux when available,
+        a pread thread pool otherwise) and overlap with fingerprinting.
+        Only WAV files are decoded natively; other formats are reported as
+        per-file failures.
+        
+        Args:
+            file_paths: Paths to audio files
+            song_ids: List of song identifiers
+            compute_threads: Fingerprinting threads (0 = one per core)
+            queue_depth: Block reads kept in flight
+            io_threads: Reader threads for the pread fallback
+            use_io_uring: Prefer io_uring when the build supports it
+            cancel_token: Stops reading and fingerprinting further files once cancelled
+            
+        Returns:
+            Tuple of (List of BatchProcessingResult objects, I/O statistics)
+            
+        Raises:
+            ValueError: If inputs are invalid
+            OperationCancelled: If cancel_token is cancelled or its deadline passes
+            RuntimeError: If batch processing fails
+        """
+        try:
+            if len(file_paths) != len(song_ids):
+                raise ValueError("Number of file paths must match number of song IDs")
+            
+            if not file_paths:
+                raise ValueError("No file paths provided")
+            
+            self.logger.info(f"Batch processing {len(file_paths)} reference files")
+            
+            output = afe.batch_process_files(
+                [str(path) for path in file_paths], song_ids,
+                compute_threads, queue_depth, io_threads, use_io_uring,
+                cancel_token=cancel_token
+            )
+            
+            batch_results = []
+            for result in output['results']:
+                batch_results.append(BatchProcessingResult(
+                    song_id=result['song_id'],
+                    success=result['success'],
+                    fingerprint_count=result.get('fingerprint_count', 0),
+                    processing_time_ms=result['processing_time_ms'],
+                    total_duration_ms=result['total_duration_ms'],
+                    error_message=result.get('error_message'),
+                    hash_values=result.get('hash_values'),
+                    time_offsets=result.get('time_offsets')
+                ))
+            
+            io_stats = output['io_stats']
+            successful = sum(1 for r in batch_results if r.success)
+            self.logger.info(
+                f"Batch file processing completed: {successful}/{len(batch_results)} successful "
+                f"({io_stats['backend']}, io wait {io_stats['io_wait_ms']:.1f}ms, "
+                f"compute {io_stats['compute_ms']:.1f}ms)"
+            )
+            
+            return batch_results, io_stats
+            
+        except OperationCancelled:
+            raise
+        except Exception as e:
+            self.logger.error(f"Batch file processing failed: {e}")
+            raise RuntimeError(f"Batch file processing failed: {e}") from e
+    
     def compute_spectrogram(
         self, 
         audio_data: Union[np.ndarray, List[float]], 
@@ -275,6 +498,76 @@ class AudioFingerprintEngine:
             self.logger.error(f"Spectrogram computation failed: {e}")
             raise RuntimeError(f"Spectrogram computation failed: {e}") from e
     
+    def capture_query(
+        self,
+        hash_values: List[int],
+        time_offsets: List[int],
+        matches: List[Dict],
+        stage_ms: Dict[str, float],
+        max_results: int = 5,
+        min_matches: int = 5
+    ) -> bool:
+        """
+        Capture an identification query to the query log if it is sampled.
+        
+        Capture never fails the query: errors are logged and dropped.
+        
+        Args:
+            hash_values: Query fingerprint hash values
+            time_offsets: Query fingerprint time offsets in ms
+            matches: Returned matches as dicts with song_id, match_count,
+                     time_offset_ms and confidence
+            stage_ms: Duration of each query stage, e.g. {'fingerprint': 41.0, 'search': 3.2}
+            max_results: Result limit the query ran with
+            min_matches: Match threshold the query ran with
+            
+        Returns:
+            True if the query was captured
+        """
+        if self.query_log is None:
+            return False
+        
+        try:
+            if not self.query_log.should_capture():
+                return False
+            self.query_log.append(
+                hash_values, time_offsets, matches, stage_ms, max_results, min_matches
+            )
+            return True
+        except Exception as e:
+            self.logger.warning(f"Query capture failed: {e}")
+            return False
+    
+    def get_query_log_statistics(self) -> Optional[Dict]:
+        """
+        Get query capture counters.
+        
+        Returns:
+            Dictionary with offered, captured and bytes, or None if capture is disabled
+        """
+        if self.query_log is None:
+            return None
+        return self.query_log.get_stats()
+    
+    def get_pool_statistics(self) -> Dict:
+        """
+        Get admission control and queue statistics of the worker pool.
+        
+        Returns:
+            Dictionary with per-priority counters and the calibrated cost rate
+        """
+        return self.pool.get_statistics()
+    
+    def get_cancellation_statistics(self) -> Dict:
+        """
+        Get process-wide cancellation counters.
+        
+        Returns:
+            Dictionary with tokens_cancelled, deadlines_expired, operations_cancelled,
+            queued_dropped and the abandoned operations per checkpoint (by_stage)
+        """
+        return afe.cancellation_stats()
+    
     def get_engine_info(self) -> Dict[str, str]:
         """
         Get information about the audio fingerprinting engine.
@@ -286,7 +579,10 @@ class AudioFingerprintEngine:
             'version': afe.__version__,
             'engine': 'C++ with Python bindings',
             'fft_library': 'FFTW3 (if available) or built-in DFT',
-            'supported_formats': 'mono/stereo float32 audio'
+            'supported_formats': 'mono/stereo float32 audio',
+            'profile_set': self.profiles.id(),
+            'hash_signature': self.profiles.reference.hash_signature(),
+            'tuning': afe.EngineTuning.source()
         }
 
 
@@ -298,7 +594,11 @@ def get_engine() -> AudioFingerprintEngine:
     """Get global engine instance (singleton pattern)"""
     global _engine_instance
     if _engine_instance is None:
-        _engine_instance = AudioFingerprintEngine()
+        _engine_instance = AudioFingerprintEngine(
+            profiles_path=os.environ.get("FINGERPRINT_PROFILES"),
+            query_log_path=os.environ.get("FINGERPRINT_QUERY_LOG"),
+            query_log_sample_rate=float(os.environ.get("FINGERPRINT_QUERY_LOG_SAMPLE_RATE", "0.01"))
+        )
     return _engine_instance
 
 
@@ -306,10 +606,13 @@ def get_engine() -> AudioFingerprintEngine:
 def generate_fingerprint(
     audio_data: Union[np.ndarray, List[float]], 
     sample_rate: int, 
-    channels: int = 1
+    channels: int = 1,
+    priority: Optional[str] = None,
+    profile: Optional[str] = None,
+    cancel_token: Optional[CancellationToken] = None
 ) -> FingerprintResult:
     """Generate fingerprint using global engine instance"""
-    return get_engine().generate_fingerprint(audio_data, sample_rate, channels)
+    return get_engine().generate_fingerprint(audio_data, sample_rate, channels, priority, profile, cancel_token)
 
 
 def preprocess_audio(
@@ -326,4 +629,55 @@ def batch_process_reference_songs(
     song_ids: List[str]
 ) -> List[BatchProcessingResult]:
     """Batch process songs using global engine instance"""
-    return get_engine().batch_process_reference_songs(audio_samples, song_ids)
\ No newline at end of file
+    return get_engine().batch_process_reference_songs(audio_samples, song_ids)
+
+
+def batch_process_files(
+    file_paths: List[str],
+    song_ids: List[str]
+) -> Tuple[List[BatchProcessingResult], Dict]:
+    """Batch process audio files using global engine instance"""
+    return get_engine().batch_process_files(file_paths, song_ids)
+
+
+def mp3_stream_info(data: bytes) -> Dict:
+    """
+    Read the layout of an MP3 upload from its frame headers, without decoding.
+    
+    Returns:
+        Dictionary with sample_rate, channels, frames, samples_per_frame and duration_ms
+        
+    Raises:
+        ValueError: If the data holds no MP3 frames
+    """
+    return afe.mp3_stream_info(data)
+
+
+def decode_mp3(
+    data: bytes,
+    start_ms: int = 0,
+    max_duration_ms: int = 0,
+    target_rate: int = 0
+) -> Dict:
+    """
+    Decode part of an MP3 upload to mono float.
+    
+    Only the frames covering [start_ms, start_ms + max_duration_ms) are
+    decoded, plus a few ahead of them for the bit reservoir.
+    
+    Args:
+        data: MP3 file contents
+        start_ms: First millisecond to decode
+        max_duration_ms: Milliseconds to decode (0 = to the end)
+        target_rate: Output sample rate (0 = the stream's rate)
+        
+    Returns:
+        Dictionary with data, sample_rate, channels, duration_ms,
+        frames_decoded and frames_skipped
+        
+    Raises:
+        ValueError: If the data holds no MP3 frames or the range is invalid
+        RuntimeError: If the engine was built without minimp3; check
+            mp3_decoder_available() first (mp3_stream_info works either way)
+    """
+    return afe.decode_mp3(data, start_ms, max_duration_ms, target_rate)
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "audio_types.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace AudioFingerprint {
+
+/**
+ * Decoder for in-memory audio containers
+ */
+class AudioDecoder {
+public:
+    AudioDecoder() = default;
+    ~AudioDecoder() = default;
+
+    /**
+     * Decode a RIFF/WAVE file (8/16/24/32-bit PCM or 32-bit float)
+     * @param data File contents
+     * @param size Size of file contents in bytes
+     * @return Interleaved float samples in [-1.0, 1.0]
+     */
+    AudioSample decode_wav(const uint8_t* data, size_t size) const;
+
+    /**
+     * Decode a file based on its contents (WAV, or MP3 via Mp3Decoder)
+     * @param data File contents
+     * @param size Size of file contents in bytes
+     * @return Interleaved float samples in [-1.0, 1.0] (mono for MP3)
+     */
+    AudioSample decode(const uint8_t* data, size_t size) const;
+
+    /**
+     * Check whether the data starts with a RIFF/WAVE header
+     * @param data File contents
+     * @param size Size of file contents in bytes
+     * @return True if the data looks like a WAV file
+     */
+    static bool is_wav(const uint8_t* data, size_t size);
+
+    /**
+     * Check whether the data starts with an ID3v2 tag or an MP3 frame header
+     * @param data File contents
+     * @param size Size of file contents in bytes
+     * @return True if the data looks like an MP3 file
+     */
+    static bool is_mp3(const uint8_t* data, size_t size);
+
+private:
+    static constexpr uint16_t WAVE_FORMAT_PCM = 0x0001;
+    static constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+    static constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+};
+
+} // namespace AudioFingerprint
@@ -62,6 +62,14 @@ public:
      * @return Preprocessed audio ready for STFT
      */
     AudioSample preprocess_for_fingerprinting(const AudioSample& sample);
+    
+    /**
+     * Preprocess raw audio for native-rate analysis
+     * Converts to mono and normalizes, keeping the input sample rate
+     * @param sample Input audio sample
+     * @return Preprocessed audio for NativeRateAnalyzer
+     */
+    AudioSample preprocess_at_native_rate(const AudioSample& sample);
 
 private:
     // Target sample rate for fingerprinting (11.025 kHz)
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+
+namespace AudioFingerprint {
+
+/**
+ * Thrown at a cancellation checkpoint once the current token is cancelled
+ */
+class OperationCancelled : public std::runtime_error {
+public:
+    /**
+     * Constructor
+     * @param stage Checkpoint that observed the cancellation
+     * @param deadline Whether the token's deadline expired, rather than cancel() being called
+     */
+    OperationCancelled(const std::string& stage, bool deadline);
+
+    const std::string& stage() const { return stage_; }
+    bool deadline_expired() const { return deadline_; }
+
+private:
+    std::string stage_;
+    bool deadline_;
+};
+
+/**
+ * Process-wide cancellation counters
+ */
+struct CancellationStats {
+    uint64_t tokens_cancelled;      // Tokens cancelled by cancel()
+    uint64_t deadlines_expired;     // Tokens cancelled by their deadline
+    uint64_t operations_cancelled;  // Operations abandoned at a checkpoint
+    uint64_t queued_dropped;        // Pool requests dropped before a worker picked them up
+    std::map<std::string, uint64_t> by_stage;  // Abandoned operations per checkpoint
+
+    CancellationStats() : tokens_cancelled(0), deadlines_expired(0), operations_cancelled(0), queued_dropped(0) {}
+};
+
+/**
+ * Handle to a cancellable operation, shared between the thread that may
+ * cancel it (a server noticing a client disconnect or timeout) and the
+ * threads doing the work.
+ *
+ * Copies refer to the same state. Work does not take a token parameter at
+ * every level: the entry point installs it with a CancellationScope, and
+ * long-running stages call CancellationToken::check() at stage and block
+ * boundaries, which throws OperationCancelled once the token is cancelled.
+ * Components that hand work to other threads carry the token with it.
+ * A default-constructed token is never cancelled.
+ */
+class CancellationToken {
+public:
+    // Iterations between checkpoints in per-frame, per-peak and per-hash loops
+    static constexpr int CHECK_INTERVAL = 64;
+
+    /**
+     * Constructor - creates a new, uncancelled token
+     */
+    CancellationToken();
+
+    /**
+     * Cancel the operation; later checkpoints throw
+     */
+    void cancel();
+
+    /**
+     * Cancel the operation once the given time has passed from now
+     * @param timeout_ms Milliseconds until the deadline (negative = none)
+     */
+    void set_deadline(int timeout_ms);
+
+    /**
+     * Check whether the operation was cancelled or its deadline has passed
+     */
+    bool is_cancelled() const;
+
+    /**
+     * Check whether the token was cancelled by its deadline rather than cancel()
+     */
+    bool deadline_expired() const;
+
+    /**
+     * Checkpoint: throw if the token installed on the calling thread is cancelled
+     * @param stage Name of the checkpoint, counted in the statistics
+     * @throws OperationCancelled if cancelled
+     */
+    static void check(const char* stage);
+
+    /**
+     * Get the token installed on the calling thread (an uncancellable one if none)
+     */
+    static CancellationToken current();
+
+    /**
+     * Count a pool request dropped from a queue because it was cancelled
+     */
+    static void count_queued_drop();
+
+    /**
+     * Get the process-wide counters
+     */
+    static CancellationStats stats();
+
+    /**
+     * Reset the process-wide counters
+     */
+    static void reset_stats();
+
+private:
+    friend class CancellationScope;
+
+    struct State {
+        std::atomic<bool> cancelled;
+        std::atomic<bool> deadline_passed;
+        std::atomic<int64_t> deadline_ns;   // steady_clock time; 0 = none
+
+        State() : cancelled(false), deadline_passed(false), deadline_ns(0) {}
+    };
+
+    std::shared_ptr<State> state_;
+
+    explicit CancellationToken(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    /**
+     * Check a token's state, counting a deadline the first time it is seen expired
+     */
+    static bool cancelled(State& state);
+
+    // State of the innermost scope's token on this thread, or null
+    static thread_local const std::shared_ptr<State>* current_;
+
+    static std::mutex stats_mutex_;
+    static CancellationStats stats_;
+};
+
+/**
+ * Installs a token on the calling thread for the lifetime of the scope, so
+ * that checkpoints in the work it runs observe it. Scopes may nest; the
+ * innermost one is checked.
+ */
+class CancellationScope {
+public:
+    explicit CancellationScope(const CancellationToken& token);
+    ~CancellationScope();
+
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+private:
+    std::shared_ptr<CancellationToken::State> state_;
+    const std::shared_ptr<CancellationToken::State>* previous_;
+};
+
+} // namespace AudioFingerprint
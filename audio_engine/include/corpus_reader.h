@@ -0,0 +1,126 @@
+#pragma once
+
+#include "hash_generator.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+namespace AudioFingerprint {
+
+/**
+ * Configuration for bulk corpus reading
+ */
+struct CorpusReaderConfig {
+    int queue_depth;          // Reads kept in flight (io_uring submission depth)
+    size_t block_size;        // Bytes per read request
+    int max_open_files;       // Files being read concurrently
+    int io_threads;           // Reader threads for the pread fallback
+    bool use_io_uring;        // Prefer io_uring when compiled in and supported
+    std::string thread_pool;  // CPU pool of reader and compute threads (empty = none)
+
+    CorpusReaderConfig()
+        : queue_depth(64), block_size(256 * 1024), max_open_files(32),
+          io_threads(8), use_io_uring(true) {}
+};
+
+/**
+ * I/O versus compute accounting for a corpus run
+ */
+struct CorpusReaderStats {
+    std::string backend;       // "io_uring" or "pread"
+    uint64_t files_read;
+    uint64_t files_failed;
+    uint64_t bytes_read;
+    double io_wait_ms;         // Time readers spent blocked on I/O completions
+    double compute_ms;         // Time compute workers spent decoding and fingerprinting
+    double compute_idle_ms;    // Time compute workers spent waiting for file data
+    double wall_time_ms;
+
+    CorpusReaderStats() : files_read(0), files_failed(0), bytes_read(0), io_wait_ms(0.0),
+                          compute_ms(0.0), compute_idle_ms(0.0), wall_time_ms(0.0) {}
+};
+
+/**
+ * Asynchronous whole-file reader for bulk ingest.
+ *
+ * On Linux builds with liburing, reads are issued through io_uring against a set
+ * of registered buffers so many block reads across many files stay in flight at
+ * once. Elsewhere, or when the kernel refuses io_uring, a pool of reader threads
+ * issues pread calls instead. Completed files are handed to a callback in
+ * completion order.
+ */
+class CorpusReader {
+public:
+    /**
+     * Callback invoked once per file
+     * @param index Index of the file in the input list
+     * @param data File contents (empty on error)
+     * @param error Error message, empty on success
+     */
+    using FileCallback = std::function<void(size_t index, std::vector<uint8_t>&& data,
+                                            const std::string& error)>;
+
+    explicit CorpusReader(const CorpusReaderConfig& config = CorpusReaderConfig());
+    ~CorpusReader() = default;
+
+    /**
+     * Read every file and deliver it to the callback. Once the calling
+     * thread's cancellation token is cancelled no further files are started,
+     * and files not started get no callback.
+     * @param paths Files to read
+     * @param on_file Callback for completed files (may be called from reader threads)
+     * @return I/O statistics for the run (compute fields are left zero)
+     */
+    CorpusReaderStats read_all(const std::vector<std::string>& paths, const FileCallback& on_file);
+
+    /**
+     * Check whether this build can use io_uring
+     */
+    static bool io_uring_compiled();
+
+    /**
+     * Get configuration
+     */
+    const CorpusReaderConfig& get_config() const { return config_; }
+
+private:
+    CorpusReaderConfig config_;
+
+#ifdef HAVE_LIBURING
+    /**
+     * io_uring read loop
+     * @return False if io_uring could not be set up (nothing was read)
+     */
+    bool read_all_io_uring(const std::vector<std::string>& paths, const FileCallback& on_file,
+                           CorpusReaderStats& stats);
+#endif
+
+    /**
+     * Thread-pool read loop using pread
+     */
+    void read_all_pread(const std::vector<std::string>& paths, const FileCallback& on_file,
+                        CorpusReaderStats& stats);
+};
+
+/**
+ * Read, decode and fingerprint a list of audio files for the reference database.
+ *
+ * Reading runs on the CorpusReader while a pool of compute threads decodes and
+ * fingerprints completed files, so storage latency overlaps with CPU work.
+ *
+ * @param paths Audio files to ingest
+ * @param song_ids Corresponding song identifiers
+ * @param compute_threads Compute threads (0 = hardware concurrency)
+ * @param config Reader configuration
+ * @param stats Output I/O and compute statistics
+ * @return Per-file processing results in input order
+ */
+std::vector<BatchProcessingResult> batch_process_files(
+    const std::vector<std::string>& paths,
+    const std::vector<std::string>& song_ids,
+    int compute_threads,
+    const CorpusReaderConfig& config,
+    CorpusReaderStats& stats);
+
+} // namespace AudioFingerprint
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+namespace AudioFingerprint {
+
+/**
+ * CPU placement of a named thread pool
+ */
+struct CpuPoolConfig {
+    std::vector<int> cpus;   // CPUs the pool's threads run on (empty = any)
+    int nice;                // Niceness of threads the pool owns (0 = unchanged)
+
+    CpuPoolConfig() : nice(0) {}
+
+    /**
+     * Check the configuration
+     * @throws std::invalid_argument if a CPU number or the niceness is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Utilisation of a named pool since it was defined or its statistics were reset
+ */
+struct CpuPoolStats {
+    std::string name;
+    CpuPoolConfig config;
+    uint64_t threads_entered;     // Threads that ran work in the pool
+    int active_threads;           // Threads in the pool right now
+    uint64_t placement_failures;  // Affinity or priority changes the OS refused
+    double cpu_ms;                // CPU time of threads while in the pool
+    double busy_ms;               // Wall time threads spent in the pool
+    double elapsed_ms;            // Wall time covered by the statistics
+    double utilisation;           // cpu_ms over the pool's CPU capacity for elapsed_ms
+
+    CpuPoolStats() : threads_entered(0), active_threads(0), placement_failures(0), cpu_ms(0.0),
+                     busy_ms(0.0), elapsed_ms(0.0), utilisation(0.0) {}
+};
+
+/**
+ * Process-wide registry of named CPU pools.
+ *
+ * A pool names a CPU set and a thread priority, so that the engine's thread
+ * pools can be partitioned: interactive query work on reserved cores, bulk
+ * ingest and segment compaction on the rest at a lower priority. Components
+ * take a pool name (empty for no placement) and run their threads inside a
+ * CpuPoolScope, which also accounts the CPU time they use to the pool.
+ *
+ * Placement uses sched_setaffinity and per-thread niceness and is only
+ * applied on Linux; elsewhere pools still report utilisation.
+ */
+class CpuPools {
+public:
+    /**
+     * Define a pool, replacing any pool of the same name and its statistics
+     * @param name Pool name
+     * @param config CPU set and niceness
+     * @throws std::invalid_argument if the name is empty or the configuration invalid
+     */
+    static void define(const std::string& name, const CpuPoolConfig& config);
+
+    /**
+     * Check whether a pool is defined
+     */
+    static bool defined(const std::string& name);
+
+    /**
+     * Get the utilisation of every pool, ordered by name
+     */
+    static std::vector<CpuPoolStats> stats();
+
+    /**
+     * Restart the statistics of every pool
+     */
+    static void reset_stats();
+
+    /**
+     * Check whether this platform applies CPU affinity and thread priorities
+     */
+    static bool placement_supported();
+
+private:
+    friend class CpuPoolScope;
+
+    struct Pool {
+        CpuPoolConfig config;
+        std::mutex mutex;    // Guards the fields below
+        CpuPoolStats stats;
+        std::chrono::steady_clock::time_point stats_start;
+    };
+
+    static std::mutex registry_mutex_;
+    static std::map<std::string, std::shared_ptr<Pool>> pools_;
+
+    /**
+     * Look up a pool
+     * @throws std::invalid_argument if it is not defined
+     */
+    static std::shared_ptr<Pool> find(const std::string& name);
+};
+
+/**
+ * Runs the calling thread in a named pool for the lifetime of the scope.
+ *
+ * Owned threads, which were started for the pool's work and end with it, get
+ * the pool's CPU set and niceness. Borrowed threads, such as a caller that
+ * runs part of a parallel query itself, only get the CPU set and have their
+ * previous one restored on exit; niceness is left alone because lowering it
+ * again needs privileges.
+ */
+class CpuPoolScope {
+public:
+    /**
+     * Enter a pool
+     * @param name Pool name (empty = no placement and no accounting)
+     * @param owned_thread Whether the thread was started for the pool's work
+     * @throws std::invalid_argument if the pool is not defined
+     */
+    CpuPoolScope(const std::string& name, bool owned_thread);
+
+    /**
+     * Account the remaining time and leave the pool
+     */
+    ~CpuPoolScope();
+
+    CpuPoolScope(const CpuPoolScope&) = delete;
+    CpuPoolScope& operator=(const CpuPoolScope&) = delete;
+
+    /**
+     * Account the time used so far, for threads that stay in a pool for long
+     */
+    void checkpoint();
+
+private:
+    std::shared_ptr<CpuPools::Pool> pool_;
+    std::vector<int> previous_cpus_;   // Restored on exit; empty if unchanged
+    std::chrono::steady_clock::time_point wall_mark_;
+    double cpu_mark_ms_;
+};
+
+} // namespace AudioFingerprint
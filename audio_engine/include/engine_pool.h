@@ -0,0 +1,314 @@
+#pragma once
+
+#include "audio_types.h"
+#include "hash_generator.h"
+#include "cancellation.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <chrono>
+
+namespace AudioFingerprint {
+
+class TiledPeakPipeline;
+
+/**
+ * Scheduling priority of a pool request. Lower values are served first.
+ */
+enum class RequestPriority {
+    INTERACTIVE = 0,  // User identification queries
+    BATCH = 1         // Reference song ingest
+};
+
+/**
+ * Processing mode selected by admission control
+ */
+enum class ProcessingMode {
+    FULL,     // Full-length, full-density fingerprinting
+    REDUCED   // Truncated window and sparser peaks (hash-compatible)
+};
+
+/**
+ * Outcome of admission control for a request
+ */
+enum class AdmissionStatus {
+    ADMITTED,
+    DOWNGRADED,
+    REJECTED
+};
+
+/**
+ * Cost estimate for a request, computed before it is queued
+ */
+struct CostEstimate {
+    double cost_units;       // Abstract work units (calibrated online)
+    double estimated_ms;     // cost_units converted with the current ms/unit rate
+    float active_fraction;   // Fraction of audio blocks above the energy floor
+    int duration_ms;         // Duration of audio that will be analysed
+
+    CostEstimate() : cost_units(0.0), estimated_ms(0.0), active_fraction(0.0f), duration_ms(0) {}
+};
+
+/**
+ * Admission control configuration
+ */
+struct AdmissionPolicy {
+    int interactive_slo_ms;         // Latency objective for interactive queries
+    int batch_slo_ms;               // Latency objective for batch ingest
+    bool allow_downgrade;           // Allow interactive queries to fall back to REDUCED mode
+    int reduced_max_duration_ms;    // Audio analysed in REDUCED mode
+    float reduced_adaptive_factor;  // Peak threshold factor used in REDUCED mode
+    int max_queue_depth;            // Hard cap on queued requests per priority
+
+    AdmissionPolicy()
+        : interactive_slo_ms(2000), batch_slo_ms(60000), allow_downgrade(true),
+          reduced_max_duration_ms(8000), reduced_adaptive_factor(1.0f),
+          max_queue_depth(256) {}
+};
+
+/**
+ * Result of a request processed by the engine pool
+ */
+struct PoolRequestResult {
+    AdmissionStatus status;
+    ProcessingMode mode;
+    std::vector<Fingerprint> fingerprints;
+    int retry_after_ms;          // Suggested back-off when REJECTED
+    double estimated_ms;         // Admission-time cost estimate
+    double queue_wait_ms;        // Time spent queued before a worker picked it up
+    double processing_time_ms;   // Time spent fingerprinting
+    bool success;
+    std::string cancelled_at;    // Checkpoint that stopped a cancelled request ("queue" if it never ran)
+    std::string error_message;
+
+    PoolRequestResult()
+        : status(AdmissionStatus::REJECTED), mode(ProcessingMode::FULL), retry_after_ms(0),
+          estimated_ms(0.0), queue_wait_ms(0.0), processing_time_ms(0.0), success(false) {}
+};
+
+/**
+ * Aggregate pool statistics
+ */
+struct PoolStatistics {
+    uint64_t admitted[2];
+    uint64_t downgraded[2];
+    uint64_t rejected[2];
+    uint64_t completed[2];
+    uint64_t cancelled[2];      // Dropped from the queue or stopped while running
+    int queue_depth[2];
+    double avg_queue_wait_ms[2];
+    double projected_wait_ms[2];
+    double ms_per_cost_unit;
+    int num_workers;
+
+    PoolStatistics() : admitted{0, 0}, downgraded{0, 0}, rejected{0, 0}, completed{0, 0}, cancelled{0, 0},
+                       queue_depth{0, 0}, avg_queue_wait_ms{0.0, 0.0},
+                       projected_wait_ms{0.0, 0.0}, ms_per_cost_unit(0.0), num_workers(0) {}
+};
+
+/**
+ * Estimates fingerprinting cost from duration, sample rate and a cheap energy pre-pass.
+ *
+ * Preprocessing scales with the raw input sample count, STFT with the analysed
+ * duration, and peak scanning/landmark pairing with the amount of non-silent audio
+ * (pairing grows roughly quadratically with peak density). The unit-to-milliseconds
+ * rate is calibrated from observed processing times.
+ */
+class CostEstimator {
+public:
+    CostEstimator();
+
+    /**
+     * Estimate cost of fingerprinting a sample
+     * @param sample Input audio sample
+     * @param max_duration_ms Analysed duration cap (0 for the full sample)
+     * @return Cost estimate
+     */
+    CostEstimate estimate(const AudioSample& sample, int max_duration_ms = 0) const;
+
+    /**
+     * Feed back an observed processing time to calibrate the ms/unit rate
+     * @param cost_units Estimated units of the completed request
+     * @param actual_ms Measured processing time
+     */
+    void observe(double cost_units, double actual_ms);
+
+    /**
+     * Get current milliseconds per cost unit
+     */
+    double get_ms_per_unit() const;
+
+private:
+    // Block size for the energy pre-pass (samples per channel)
+    static constexpr int ENERGY_BLOCK_SIZE = 2048;
+    // Only every Nth sample in a block is inspected
+    static constexpr int ENERGY_STRIDE = 8;
+    // Smoothing factor for ms/unit calibration
+    static constexpr double CALIBRATION_ALPHA = 0.1;
+
+    std::atomic<double> ms_per_unit_;
+
+    /**
+     * Fraction of blocks whose RMS exceeds a floor relative to the loudest block
+     * @param sample Input audio sample
+     * @param max_frames Number of frames (per channel) to inspect
+     * @return Active fraction in [0, 1]
+     */
+    float compute_active_fraction(const AudioSample& sample, size_t max_frames) const;
+};
+
+/**
+ * Worker pool that runs fingerprinting with cost-based admission control.
+ *
+ * Requests are queued per priority so interactive queries overtake batch ingest.
+ * Before queueing, the projected wait (queued work at the same or higher priority
+ * plus in-flight work, divided across workers) is compared against the SLO; if it
+ * would be exceeded the request is downgraded to REDUCED mode or rejected with a
+ * retry hint.
+ *
+ * A request may carry a cancellation token. Cancelled requests still queued
+ * are dropped, releasing their audio, the next time the queues are touched;
+ * running ones stop at the pipeline's next checkpoint.
+ */
+class EnginePool {
+public:
+    /**
+     * Constructor
+     * @param num_workers Number of worker threads (0 = this host's tuned count, see EngineTuning)
+     * @param policy Admission control configuration
+     * @param thread_pool CPU pool the workers run in (empty = none)
+     */
+    explicit EnginePool(int num_workers = 0, const AdmissionPolicy& policy = AdmissionPolicy(),
+                        const std::string& thread_pool = "");
+
+    /**
+     * Destructor - drains the queues and joins the workers
+     */
+    ~EnginePool();
+
+    EnginePool(const EnginePool&) = delete;
+    EnginePool& operator=(const EnginePool&) = delete;
+
+    /**
+     * Submit a sample for fingerprinting
+     * @param sample Input audio sample
+     * @param priority Scheduling priority
+     * @param profile Fingerprinting profile (REDUCED mode raises its peak threshold)
+     * @param cancel_token Token that abandons the request when cancelled
+     * @return Future resolving to the result (resolved immediately when rejected)
+     */
+    std::future<PoolRequestResult> submit(const AudioSample& sample,
+                                          RequestPriority priority = RequestPriority::INTERACTIVE,
+                                          const FingerprintProfile& profile = FingerprintProfile(),
+                                          const CancellationToken& cancel_token = CancellationToken());
+
+    /**
+     * Submit a sample and wait for its result. If the token is cancelled while
+     * the request is queued, the request is dropped without waiting for a worker.
+     * @param sample Input audio sample
+     * @param priority Scheduling priority
+     * @param profile Fingerprinting profile
+     * @param cancel_token Token that abandons the request when cancelled
+     * @return Request result
+     */
+    PoolRequestResult process(const AudioSample& sample,
+                              RequestPriority priority = RequestPriority::INTERACTIVE,
+                              const FingerprintProfile& profile = FingerprintProfile(),
+                              const CancellationToken& cancel_token = CancellationToken());
+
+    /**
+     * Drop queued requests whose tokens are cancelled, resolving their futures
+     */
+    void drop_cancelled();
+
+    /**
+     * Estimate cost of a sample without submitting it
+     * @param sample Input audio sample
+     * @return Cost estimate
+     */
+    CostEstimate estimate_cost(const AudioSample& sample) const;
+
+    /**
+     * Get aggregate statistics
+     */
+    PoolStatistics get_statistics() const;
+
+    /**
+     * Get admission policy
+     */
+    const AdmissionPolicy& get_policy() const { return policy_; }
+
+    /**
+     * Get the CPU pool of the workers
+     */
+    const std::string& get_thread_pool() const { return thread_pool_; }
+
+private:
+    struct Job {
+        AudioSample sample;
+        FingerprintProfile profile;
+        CancellationToken cancel_token;
+        ProcessingMode mode;
+        CostEstimate estimate;
+        std::chrono::steady_clock::time_point enqueued_at;
+        std::promise<PoolRequestResult> promise;
+    };
+
+    AdmissionPolicy policy_;
+    std::string thread_pool_;
+    CostEstimator estimator_;
+    std::vector<std::thread> workers_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> queues_[2];
+    double queued_ms_[2];       // Sum of estimated_ms of queued jobs per priority
+    double in_flight_ms_;       // Sum of estimated_ms of jobs being processed
+    bool stopping_;
+
+    PoolStatistics stats_;
+    double total_queue_wait_ms_[2];
+
+    /**
+     * Worker thread main loop
+     */
+    void worker_loop();
+
+    /**
+     * Run the fingerprinting pipeline for a job
+     * @param job Job to process
+     * @param pipeline Worker-owned STFT and peak detection pipeline
+     * @return Generated fingerprints
+     */
+    std::vector<Fingerprint> run_pipeline(const Job& job, TiledPeakPipeline& pipeline) const;
+
+    /**
+     * Move cancelled jobs out of the queues (mutex must be held)
+     * @param dropped Receives the jobs, whose promises the caller resolves after unlocking
+     */
+    void take_cancelled(std::vector<Job>& dropped);
+
+    /**
+     * Resolve the promises of dropped jobs as cancelled
+     */
+    static void resolve_cancelled(std::vector<Job>& dropped);
+
+    /**
+     * Projected wait for a new request at given priority (mutex must be held)
+     * @param priority Request priority
+     * @return Projected wait in milliseconds
+     */
+    double projected_wait_ms(RequestPriority priority) const;
+
+    /**
+     * Get SLO for a priority
+     */
+    int slo_for(RequestPriority priority) const;
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace AudioFingerprint {
+
+/**
+ * Kernel and scheduling parameters that depend on the host's caches and
+ * core count. The defaults are the settings the engine used before tuning
+ * existed, and are safe on any machine.
+ */
+struct EngineTuning {
+    int tile_frames;                 // Frames per tile of the fused STFT and peak pipeline
+    int prefetch_distance;           // Posting lists prefetched ahead while voting (0 = none)
+    int parallel_query_min_hashes;   // Query hashes each scoring thread gets at least
+    int query_threads;               // Threads scoring a long query (0 = one per core)
+    int pool_workers;                // Engine pool workers (0 = one per core)
+    int commit_window_us;            // Write-ahead log group commit window
+
+    EngineTuning()
+        : tile_frames(32), prefetch_distance(0), parallel_query_min_hashes(2048), query_threads(0),
+          pool_workers(0), commit_window_us(2000) {}
+
+    /**
+     * Check the settings
+     * @throws std::invalid_argument if a setting is out of range
+     */
+    void validate() const;
+
+    /**
+     * Serialize as a wisdom file for this host
+     */
+    std::string serialize() const;
+
+    /**
+     * Parse a wisdom file
+     * @param text File contents
+     * @return Settings it holds
+     * @throws std::runtime_error if the file is malformed or was tuned on another
+     *         host or for a different number of cores
+     */
+    static EngineTuning parse(const std::string& text);
+
+    /**
+     * Load a wisdom file
+     * @throws std::runtime_error if it cannot be read or parse() rejects it
+     */
+    static EngineTuning load(const std::string& path);
+
+    /**
+     * Write a wisdom file atomically, creating its directory
+     * @throws std::runtime_error if it cannot be written
+     */
+    void save(const std::string& path) const;
+
+    /**
+     * Get the settings in effect for this process. The first call loads the
+     * wisdom file at wisdom_path(); if there is none, or it is unreadable or
+     * was tuned elsewhere, the defaults are used.
+     */
+    static EngineTuning current();
+
+    /**
+     * Replace the settings in effect for this process; components created
+     * afterwards pick them up
+     * @param tuning New settings
+     * @param source Where they came from, reported by source()
+     * @throws std::invalid_argument if the settings are invalid
+     */
+    static void install(const EngineTuning& tuning, const std::string& source);
+
+    /**
+     * Count of settings changes, for components that cache settings on a hot
+     * path and only call current() again when it moves; takes no lock
+     */
+    static uint64_t generation();
+
+    /**
+     * Describe where the settings in effect came from: the wisdom file path,
+     * or "defaults" with the reason no wisdom was used
+     */
+    static std::string source();
+
+    /**
+     * Path of this host's wisdom file: $FINGERPRINT_WISDOM if set, otherwise
+     * wisdom-<host>.conf in the user's cache directory (empty if there is none)
+     */
+    static std::string wisdom_path();
+
+    /**
+     * Name of this host as recorded in wisdom files
+     */
+    static std::string host_name();
+
+private:
+    static std::once_flag load_once_;
+    static std::mutex mutex_;
+    static EngineTuning current_;
+    static std::string source_;
+    static std::atomic<uint64_t> generation_;
+
+    /**
+     * Load this host's wisdom file once, before the first use
+     */
+    static void ensure_loaded();
+};
+
+/**
+ * Autotuning run settings
+ */
+struct AutotuneConfig {
+    std::string work_dir;     // Scratch directory for the index and write-ahead log trials
+    int repetitions;          // Timed runs per candidate; the median counts
+    double tolerance;         // Relative slack within which the default or a cheaper candidate wins
+    bool quick;               // Smaller workloads, for tests and a first estimate
+
+    AutotuneConfig() : repetitions(5), tolerance(0.03), quick(false) {}
+
+    /**
+     * Check the settings
+     * @throws std::invalid_argument if a setting is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Timing of one candidate value
+ */
+struct AutotuneTrial {
+    std::string parameter;
+    int value;
+    double median_ms;         // Median over the repetitions of the parameter's workload
+
+    AutotuneTrial() : value(0), median_ms(0.0) {}
+    AutotuneTrial(const std::string& parameter, int value, double median_ms)
+        : parameter(parameter), value(value), median_ms(median_ms) {}
+};
+
+/**
+ * Outcome of an autotuning run
+ */
+struct AutotuneResult {
+    EngineTuning tuning;                 // Winning settings
+    std::vector<AutotuneTrial> trials;   // Every candidate measured, in order
+    double elapsed_ms;
+
+    AutotuneResult() : elapsed_ms(0.0) {}
+};
+
+/**
+ * One-time benchmark of candidate tuning values on the current machine,
+ * in the spirit of FFTW wisdom.
+ *
+ * Each parameter is timed on its own workload with the others held at the
+ * values chosen so far: the fused pipeline on synthetic audio, index queries
+ * on a synthetic catalog, fingerprinting throughput at each worker count and
+ * durable appends from concurrent writers. Candidates are timed in
+ * interleaved rounds so that drift in machine load affects them alike. The
+ * fastest wins unless the default, or a candidate using fewer threads or a
+ * shorter wait, is within the tolerance of it.
+ *
+ * Trials install candidate settings process-wide, so run the tuner in a
+ * process that is not serving requests.
+ */
+class EngineAutotuner {
+public:
+    /**
+     * Constructor
+     * @param config Run settings
+     * @throws std::invalid_argument if the settings are invalid
+     */
+    explicit EngineAutotuner(const AutotuneConfig& config);
+
+    /**
+     * Run every benchmark; the settings in effect are restored afterwards
+     * @return Winning settings and the trials behind them
+     */
+    AutotuneResult run();
+
+private:
+    AutotuneConfig config_;
+
+    void tune_tile_frames(AutotuneResult& result);
+    void tune_query(AutotuneResult& result);
+    void tune_pool_workers(AutotuneResult& result);
+    void tune_commit_window(AutotuneResult& result);
+
+    /**
+     * Time every candidate in interleaved rounds and pick the winner
+     * @param parameter Name recorded in the trials
+     * @param candidates Values in order of preference when timings tie
+     * @param preferred Value that wins within the tolerance (usually the default)
+     * @param workload Runs the workload for a candidate and returns its time in ms
+     * @return Winning value
+     */
+    template <typename Workload>
+    int pick(AutotuneResult& result, const std::string& parameter, const std::vector<int>& candidates,
+             int preferred, Workload workload) const;
+};
+
+} // namespace AudioFingerprint
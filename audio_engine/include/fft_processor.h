@@ -2,6 +2,7 @@
 
 #include "audio_types.h"
 #include <memory>
+#include <vector>
 
 #ifndef NO_FFTW
 #include <fftw3.h>
@@ -40,6 +41,20 @@ public:
                             int window_size = 2048, 
                             int hop_size = 1024);
     
+    /**
+     * Compute the magnitude spectrum of one Hann-windowed frame without
+     * intermediate allocations
+     * @param frame Pointer to window_size audio samples
+     * @param window_size Number of samples in the frame
+     * @param magnitudes Output buffer of fft_size / 2 + 1 values
+     */
+    void compute_magnitude_frame(const float* frame, int window_size, float* magnitudes);
+    
+    /**
+     * Get FFT size
+     */
+    int get_fft_size() const { return fft_size_; }
+    
     /**
      * Compute single FFT of windowed audio data
      * @param windowed_data Input audio data (should be windowed)
@@ -72,6 +87,7 @@ public:
 
 private:
     int fft_size_;
+    std::vector<float> window_;  // Cached Hann window for the last window size
     
 #ifndef NO_FFTW
     fftwf_plan fft_plan_;
@@ -87,6 +103,11 @@ private:
      * Cleanup FFTW resources
      */
     void cleanup_fftw();
+    
+    /**
+     * Release FFTW resources (planner lock must be held)
+     */
+    void release_fftw();
 #else
     std::vector<float> input_buffer_;
     std::vector<Complex> output_buffer_;
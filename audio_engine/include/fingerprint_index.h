@@ -0,0 +1,379 @@
+#pragma once
+
+#include "index_segment.h"
+#include "ingest_wal.h"
+#include "fingerprint_profile.h"
+#include "song_reorder.h"
+#include "cpu_pool.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <map>
+#include <atomic>
+
+namespace AudioFingerprint {
+
+class ScoringWorkers;
+
+/**
+ * Manifest entry describing one immutable segment file
+ */
+struct SegmentManifestEntry {
+    uint64_t segment_id;
+    std::string file_name;
+    uint64_t size_bytes;
+    uint32_t crc32;
+    uint64_t song_count;
+    uint64_t posting_count;
+
+    SegmentManifestEntry() : segment_id(0), size_bytes(0), crc32(0), song_count(0), posting_count(0) {}
+};
+
+/**
+ * Snapshot of the segments that make up an index.
+ *
+ * Stored as a small text file named MANIFEST in the index directory:
+ *   AFINDEX-MANIFEST 1
+ *   generation <n>
+ *   committed_at_ms <unix ms>
+ *   next_segment_id <n>
+ *   wal_lsn <n>
+ *   profile <profile set id> <hash signature>     (once profiles are bound)
+ *   segment <id> <file> <bytes> <crc32 hex> <songs> <postings>
+ * A new snapshot becomes visible when the file is atomically replaced.
+ */
+struct IndexManifest {
+    uint64_t generation;
+    int64_t committed_at_ms;
+    uint64_t next_segment_id;
+    uint64_t wal_lsn;   // Last write-ahead log record persisted in a segment
+    std::string profile_set;     // Profile set the references were made with (empty if unknown)
+    std::string hash_signature;  // Hash signature of its reference profile
+    std::vector<SegmentManifestEntry> segments;
+
+    IndexManifest() : generation(0), committed_at_ms(0), next_segment_id(1), wal_lsn(0) {}
+
+    /**
+     * Serialize to the MANIFEST text format
+     */
+    std::string serialize() const;
+
+    /**
+     * Parse the MANIFEST text format
+     * @param text Manifest contents
+     * @return Parsed manifest
+     */
+    static IndexManifest parse(const std::string& text);
+
+    /**
+     * Load the manifest of an index directory
+     * @param directory Index directory
+     * @return Parsed manifest, or an empty manifest if none exists yet
+     */
+    static IndexManifest load(const std::string& directory);
+};
+
+/**
+ * Candidate song returned by an index query
+ */
+struct IndexMatch {
+    uint32_t song_id;
+    int match_count;       // Hashes agreeing on the best time offset
+    int time_offset_ms;    // Reference time minus query time at the best offset
+    float confidence;      // match_count relative to the number of query hashes
+    SongMetadata song;     // From the song tables; empty if none has the song
+
+    IndexMatch() : song_id(0), match_count(0), time_offset_ms(0), confidence(0.0f) {}
+};
+
+/**
+ * Size information for an index
+ */
+struct IndexStats {
+    uint64_t generation;
+    size_t segment_count;
+    size_t segment_songs;
+    size_t segment_postings;
+    size_t segment_bytes;
+    size_t mutable_songs;
+    size_t mutable_postings;
+    WalStats wal;            // All zero when durable ingest is off
+    uint64_t wal_bytes;      // Current write-ahead log file size
+
+    IndexStats() : generation(0), segment_count(0), segment_songs(0), segment_postings(0),
+                   segment_bytes(0), mutable_songs(0), mutable_postings(0), wal_bytes(0) {}
+};
+
+/**
+ * Segmented on-disk fingerprint index with offset-histogram matching.
+ *
+ * Songs are added to an in-memory mutable segment that is searchable
+ * immediately. flush() writes it out as an immutable segment file and commits
+ * a new MANIFEST; merge_segments() compacts all segments into one. Segment
+ * files are never modified after they are written, so replicas can copy them
+ * incrementally and switch snapshots by replacing their own MANIFEST.
+ *
+ * Long queries are scored in parallel: query hashes are split across threads,
+ * each building its own offset histograms sharded by song, and thread s then
+ * merges shard s of every thread and scores it. The threads are started by
+ * the first parallel query and kept for the life of the index, so queries pay
+ * neither thread creation nor CPU placement.
+ *
+ * With durable ingest on, add_song() also logs the song to a write-ahead log
+ * and returns once it is synced (group commit batches concurrent callers).
+ * The log is replayed into the mutable segment on open and truncated after
+ * each flush.
+ */
+class FingerprintIndex {
+public:
+    /**
+     * Open or create an index
+     * @param directory Index directory (created if missing)
+     * @param durable_ingest Log added songs to a write-ahead log before acknowledging them
+     * @param commit_window_us Group commit window for the write-ahead log
+     *                         (negative = this host's tuned window, see EngineTuning)
+     */
+    explicit FingerprintIndex(const std::string& directory, bool durable_ingest = false,
+                              int commit_window_us = -1);
+
+    ~FingerprintIndex();
+
+    FingerprintIndex(const FingerprintIndex&) = delete;
+    FingerprintIndex& operator=(const FingerprintIndex&) = delete;
+
+    /**
+     * Add a reference song to the mutable segment
+     * @param song_id Song identifier
+     * @param fingerprints Fingerprints of the song
+     * @param metadata Title, artist, album and duration stored in the song
+     *                 table of the song's segment (optional)
+     *
+     * The song is searchable immediately; with durable ingest on, the call
+     * returns once it is also on stable storage.
+     */
+    void add_song(uint32_t song_id, const std::vector<Fingerprint>& fingerprints,
+                  const SongMetadata& metadata = SongMetadata());
+
+    /**
+     * Write the mutable segment as a new immutable segment and commit the manifest
+     * @return ID of the new segment, or 0 if there was nothing to flush
+     */
+    uint64_t flush();
+
+    /**
+     * Merge all immutable segments into one and delete the inputs
+     * @return ID of the merged segment, or 0 if fewer than two segments exist
+     */
+    uint64_t merge_segments();
+
+    /**
+     * Offline optimisation: merge all immutable segments into one whose songs
+     * are renumbered by recursive graph bisection, and delete the inputs.
+     * Postings of the new segment carry internal song IDs; its ID map turns
+     * them back into the external IDs queries report. Later merges keep the
+     * order and number new songs after it, so run this again once many
+     * songs have been added. The bisection runs without blocking flush()
+     * and ingest; segments flushed meanwhile are merged into the result.
+     * @param config Bisection parameters
+     * @return Posting size and decode speed before and after
+     */
+    SongReorderReport reorder_songs(const SongOrderConfig& config = SongOrderConfig());
+
+    /**
+     * Re-read the manifest and load segments committed by another writer
+     * @return True if the snapshot changed
+     */
+    bool reload();
+
+    /**
+     * Declare the profiles songs are fingerprinted with; recorded in the
+     * manifest at the next commit
+     * @param profiles Reference and query profiles
+     * @throws std::runtime_error if the index holds references with different hashes
+     */
+    void bind_profiles(const ProfileSet& profiles);
+
+    /**
+     * Check that query fingerprints of a profile can be matched against this index
+     * @param profile Query profile
+     * @throws std::invalid_argument if its hashes differ from the references'
+     */
+    void check_query_profile(const FingerprintProfile& profile) const;
+
+    /**
+     * Find reference songs matching a query
+     * @param query Query fingerprints
+     * @param max_results Maximum number of matches to return
+     * @param min_matches Minimum aligned hashes for a match
+     * @return Matches ordered by decreasing match count, with song metadata
+     *         where the song tables have it
+     * @throws OperationCancelled if the calling thread's cancellation token is cancelled
+     */
+    std::vector<IndexMatch> query(const std::vector<Fingerprint>& query,
+                                  int max_results = 5, int min_matches = 5) const;
+
+    /**
+     * Look up a song's metadata in the song tables, newest segment first
+     * @param song_id Song to look up
+     * @param metadata Filled in if found
+     * @return False if no segment has metadata for the song
+     */
+    bool lookup_song(uint32_t song_id, SongMetadata& metadata) const;
+
+    /**
+     * Set how many threads score a long query
+     * @param threads Thread limit (0 = this host's tuned limit, by default one
+     *                per core; 1 = always serial)
+     */
+    void set_query_threads(int threads);
+
+    int get_query_threads() const { return query_threads_.load(); }
+
+    /**
+     * Place the index's work in named CPU pools
+     * @param query_pool Pool of query scoring; its threads are pinned once, when they
+     *                   start, and callers wait while they score
+     * @param maintenance_pool Pool of flush, merge_segments() and reorder_songs()
+     * @throws std::invalid_argument if a non-empty name is not a defined pool
+     */
+    void set_thread_pools(const std::string& query_pool, const std::string& maintenance_pool);
+
+    std::string get_query_pool() const;
+    std::string get_maintenance_pool() const;
+
+    /**
+     * Get the committed manifest
+     */
+    IndexManifest get_manifest() const;
+
+    /**
+     * Get index size information
+     */
+    IndexStats get_stats() const;
+
+    /**
+     * Get index directory
+     */
+    const std::string& get_directory() const { return directory_; }
+
+    /**
+     * Width of the time offset histogram bins in milliseconds
+     */
+    static constexpr int OFFSET_BIN_MS = 100;
+
+private:
+    struct LoadedSegment {
+        SegmentManifestEntry entry;
+        std::shared_ptr<const IndexSegment> segment;
+    };
+
+    // (song_id << 32 | offset bin) -> votes
+    using OffsetHistogram = std::unordered_map<uint64_t, uint32_t>;
+
+    struct MutableSegment {
+        std::unordered_map<uint32_t, std::vector<Posting>> postings;
+        std::map<uint32_t, uint32_t> songs;  // song_id -> fingerprint count
+        std::map<uint32_t, SongMetadata> metadata;
+        size_t posting_count = 0;
+    };
+
+    std::string directory_;
+
+    mutable std::shared_mutex mutex_;            // Guards the fields below
+    IndexManifest manifest_;
+    std::vector<LoadedSegment> segments_;
+    std::shared_ptr<MutableSegment> mutable_;
+    std::shared_ptr<const MutableSegment> flushing_;  // Being written; still searchable
+    std::string profile_set_;      // Bound by bind_profiles()
+    std::string hash_signature_;
+
+    std::mutex write_mutex_;  // Serializes flush, merge and reload
+
+    std::unique_ptr<IngestWal> wal_;  // Null unless durable ingest is on
+
+    std::atomic<int> query_threads_;
+
+    mutable std::mutex pool_mutex_;  // Guards the pool names and the scoring workers
+    std::string query_pool_;
+    std::string maintenance_pool_;
+    mutable std::shared_ptr<ScoringWorkers> scoring_workers_;  // Null until a query needs them
+
+    // Query settings from EngineTuning, re-read only when its generation moves
+    // so that queries do not take its process-wide lock
+    mutable std::atomic<uint64_t> tuning_generation_;
+    mutable std::atomic<int> tuned_query_threads_;
+    mutable std::atomic<int> tuned_parallel_min_hashes_;
+    mutable std::atomic<int> tuned_prefetch_distance_;
+
+    /**
+     * Refresh the cached query settings if EngineTuning changed since they were read
+     */
+    void refresh_query_tuning() const;
+
+    /**
+     * Get workers for the query pool, starting or replacing them if there are
+     * fewer than needed or they were placed in another pool. The caller scores
+     * one part itself unless a query pool is set.
+     * @param parts Parts the query is split into
+     * @param pool Receives the query pool name
+     */
+    std::shared_ptr<ScoringWorkers> scoring_workers(size_t parts, std::string& pool) const;
+
+    /**
+     * Add postings of a song to a mutable segment
+     */
+    static void insert_song(MutableSegment& segment, uint32_t song_id, const std::vector<Fingerprint>& fingerprints,
+                            const SongMetadata& metadata);
+
+    /**
+     * Add the votes of a range of query hashes to histograms sharded by song; requires mutex_
+     * @param prefetch_distance Posting lists prefetched ahead of the one being counted (0 = none)
+     */
+    void vote(const Fingerprint* begin, const Fingerprint* end, std::vector<OffsetHistogram>& shards,
+              int prefetch_distance) const;
+
+    /**
+     * Best match of each song in a histogram shard
+     */
+    static std::vector<IndexMatch> score_shard(const OffsetHistogram& histogram, int min_matches, size_t query_size);
+
+    /**
+     * Look up song metadata, newest segment first; requires mutex_
+     */
+    bool find_metadata(uint32_t song_id, SongMetadata& metadata) const;
+
+    /**
+     * Write a segment file and describe it for the manifest
+     */
+    SegmentManifestEntry write_segment(const IndexSegment& segment, uint64_t segment_id) const;
+
+    /**
+     * Commit a segment that replaces a set of inputs, then delete the inputs
+     * @param inputs Segments the new one replaces
+     * @param manifest Manifest the inputs were read from, profiles stamped
+     * @param segment Replacement segment
+     * @return ID of the new segment
+     */
+    uint64_t replace_segments(const std::vector<LoadedSegment>& inputs, IndexManifest manifest,
+                              const std::shared_ptr<const IndexSegment>& segment);
+
+    /**
+     * Stamp the bound profiles onto a manifest about to be committed; requires mutex_
+     */
+    void stamp_profiles(IndexManifest& manifest) const;
+
+    /**
+     * Durably replace the MANIFEST file
+     */
+    void write_manifest(const IndexManifest& manifest) const;
+
+    /**
+     * Full path of a file inside the index directory
+     */
+    std::string path_for(const std::string& file_name) const;
+};
+
+} // namespace AudioFingerprint
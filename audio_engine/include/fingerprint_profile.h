@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+
+namespace AudioFingerprint {
+
+/**
+ * Settings of one fingerprinting pipeline.
+ *
+ * The analysis fields (sample rate, FFT size, hop) and the hash quantization
+ * decide which hash value a landmark pair gets, so a query can only be matched
+ * against references made with the same values. The density fields (peak
+ * picking and target zone fan-out) only decide how many pairs get hashed and
+ * may differ between the reference and the query pipeline.
+ */
+struct FingerprintProfile {
+    std::string name;
+
+    // Analysis and hashing; must agree between reference and query
+    int fft_size;
+    int hop_size;
+    float freq_quantization;        // Hz per hash frequency bin
+    int time_quantization;          // ms per hash time-delta bin
+    int landmark_size;              // Peaks per hashed landmark: 2 (pairs) or 3 (triplets)
+    bool interpolate_frequency;     // Sub-bin peak frequency (PeakDetector::set_frequency_interpolation)
+    bool interpolate_time;          // Sub-frame peak time (PeakDetector::set_time_interpolation)
+
+    // Density; may differ between reference and query
+    int min_peak_distance;          // Minimum distance between peaks (bins/frames)
+    float adaptive_factor;          // Peak threshold above the local mean
+    float min_magnitude_threshold;  // Absolute peak threshold
+    int max_time_delta_ms;          // Target zone length
+    float max_freq_delta_hz;        // Target zone height
+    int max_pairs_per_anchor;       // Fan-out cap (0 = every peak in the target zone);
+                                    // triplets combine two of the n strongest targets, n > 0
+    int analysis_phases;            // Analyses at evenly spaced sub-hop offsets, merged (1 = one pass)
+    bool native_rate;               // STFT at the input rate instead of resampling (NativeRateAnalyzer)
+
+    /**
+     * Constructor; the defaults are the original symmetric pipeline
+     */
+    FingerprintProfile();
+
+    /**
+     * Sparse profile for catalog songs, keeping the index small (fan-out 5)
+     */
+    static FingerprintProfile reference();
+
+    /**
+     * Reference profile with twice the hop, for an index half the size. Query
+     * with coarse_query(), whose two half-hop phases keep one analysis within
+     * a quarter hop of the reference frame grid.
+     */
+    static FingerprintProfile coarse_reference();
+
+    /**
+     * Query profile matching coarse_reference(): fan-out 20, two analysis phases
+     */
+    static FingerprintProfile coarse_query();
+
+    /**
+     * Denser profile for short queries (fan-out 20). Noise adds peaks to a
+     * query's target zones, pushing the targets a reference kept beyond the
+     * first 5; a wider fan-out still reaches them. Peak picking is unchanged,
+     * since a lower threshold on noisy queries adds more spurious votes than
+     * aligned ones.
+     */
+    static FingerprintProfile query();
+
+    /**
+     * Reference profile with a 1024-point FFT and half the hop, so frames
+     * overlap as in reference() at twice the time resolution. Peak times are
+     * interpolated between frames, which keeps hashes of excerpts that start
+     * off the frame grid closer to the reference's than whole frames do.
+     * Peak frequencies are not: the 10 Hz hash quantum is already about one
+     * bin, and the interpolated values jitter across quantum boundaries.
+     */
+    static FingerprintProfile fine_reference();
+
+    /**
+     * Query profile matching fine_reference(): fan-out 20
+     */
+    static FingerprintProfile fine_query();
+
+    /**
+     * Identify the settings that determine hash values
+     * @return Signature such as "h1-sr11025-fft2048-hop1024-fq10-tq50" ("-lm3" is
+     *         appended for triplet landmarks, "-if" and "-it" for interpolation)
+     */
+    std::string hash_signature() const;
+
+    /**
+     * Check that all settings are usable
+     * @throws std::invalid_argument on an invalid setting
+     */
+    void validate() const;
+
+    /**
+     * Samples (at the analysis rate) skipped before an analysis phase starts
+     * @param phase Phase index in [0, analysis_phases)
+     */
+    int phase_shift(int phase) const { return phase * hop_size / analysis_phases; }
+};
+
+/**
+ * Reference and query profiles that are configured and versioned together.
+ *
+ * Stored as a small text file:
+ *   AFPROFILES 1
+ *   name <name>
+ *   version <n>
+ *   reference.<field> <value>
+ *   query.<field> <value>
+ * Fields not present keep the defaults of FingerprintProfile::reference()
+ * and FingerprintProfile::query().
+ */
+struct ProfileSet {
+    std::string name;
+    int version;
+    FingerprintProfile reference;
+    FingerprintProfile query;
+
+    /**
+     * Constructor; the built-in "default" set
+     */
+    ProfileSet();
+
+    /**
+     * Built-in "triplets" set: three-peak landmarks hashing an anchor with two
+     * of its strongest targets. Posting lists are far shorter than for pairs,
+     * so a query touches fewer candidate songs; fan-outs 4 (reference) and 7
+     * (query) keep index and query sizes close to the default set.
+     */
+    static ProfileSet triplets();
+
+    /**
+     * Built-in "coarse" set: coarse_reference() and coarse_query()
+     */
+    static ProfileSet coarse();
+
+    /**
+     * Built-in "fine" set: fine_reference() and fine_query()
+     */
+    static ProfileSet fine();
+
+    /**
+     * Name and version, e.g. "default/1"
+     */
+    std::string id() const;
+
+    /**
+     * Check both profiles and that queries hash like references
+     * @throws std::invalid_argument if a profile is invalid or the two are incompatible
+     */
+    void validate() const;
+
+    /**
+     * Serialize to the text format
+     */
+    std::string serialize() const;
+
+    /**
+     * Parse and validate the text format
+     * @param text Profile set contents
+     * @return Parsed profile set
+     */
+    static ProfileSet parse(const std::string& text);
+
+    /**
+     * Load and validate a profile set file
+     * @param path File path
+     * @return Parsed profile set
+     */
+    static ProfileSet load(const std::string& path);
+};
+
+/**
+ * Check whether fingerprints of two profiles can be matched against each other
+ * @param reference Profile the catalog was fingerprinted with
+ * @param query Profile the query was fingerprinted with
+ * @param reason Set to an explanation when incompatible (may be null)
+ * @return True if both produce the same hash for the same landmark pair
+ */
+bool profiles_compatible(const FingerprintProfile& reference, const FingerprintProfile& query,
+                         std::string* reason = nullptr);
+
+} // namespace AudioFingerprint
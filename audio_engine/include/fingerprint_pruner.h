@@ -0,0 +1,101 @@
+#pragma once
+
+#include "hash_generator.h"
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Pruning parameters
+ */
+struct PruningConfig {
+    float keep_fraction;        // Fraction of each second's fingerprints to keep
+    int min_per_second;         // Never keep fewer than this per second of audio
+    float rarity_weight;        // Weight of hash rarity (short posting lists)
+    float strength_weight;      // Weight of peak strength
+    float redundancy_weight;    // Weight of the penalty for repeating a nearby hash
+    int redundancy_window_ms;   // Same-hash repeats closer than this are redundant
+
+    PruningConfig() : keep_fraction(0.3f), min_per_second(4), rarity_weight(1.0f),
+                      strength_weight(0.5f), redundancy_weight(1.0f), redundancy_window_ms(1000) {}
+};
+
+/**
+ * Totals over every song pruned so far
+ */
+struct PruningStats {
+    size_t songs;
+    size_t input_fingerprints;
+    size_t kept_fingerprints;
+
+    PruningStats() : songs(0), input_fingerprints(0), kept_fingerprints(0) {}
+
+    /**
+     * Ratio of input to kept fingerprints
+     */
+    double shrink_factor() const {
+        return kept_fingerprints > 0 ? static_cast<double>(input_fingerprints) / kept_fingerprints : 0.0;
+    }
+};
+
+/**
+ * Offline pruning of reference fingerprints that are unlikely to contribute
+ * to a correct match.
+ *
+ * Runs in two passes over a catalog: count_postings() for every song to
+ * learn posting-list lengths, then prune() for every song before it is
+ * indexed. Each fingerprint is scored by
+ *   rarity_weight     * hash rarity (log inverse posting-list length)
+ * + strength_weight   * peak strength rank within the song
+ * - redundancy_weight * repeats of the same hash shortly before it
+ * and only the best keep_fraction of each one-second window is kept.
+ */
+class FingerprintPruner {
+public:
+    /**
+     * Constructor
+     * @param config Pruning parameters
+     */
+    explicit FingerprintPruner(const PruningConfig& config = PruningConfig());
+
+    ~FingerprintPruner() = default;
+
+    /**
+     * First pass: add a song's hashes to the posting-list counts
+     * @param fingerprints Fingerprints of one reference song
+     */
+    void count_postings(const std::vector<Fingerprint>& fingerprints);
+
+    /**
+     * Score each fingerprint of a song; higher is more useful
+     * @param fingerprints Fingerprints of one reference song
+     * @return Score per fingerprint
+     */
+    std::vector<float> score(const std::vector<Fingerprint>& fingerprints) const;
+
+    /**
+     * Second pass: keep the most useful fingerprints of a song
+     * @param fingerprints Fingerprints of one reference song
+     * @return Kept fingerprints in their original order
+     */
+    std::vector<Fingerprint> prune(const std::vector<Fingerprint>& fingerprints);
+
+    /**
+     * Number of postings counted for a hash
+     */
+    uint32_t posting_count(uint32_t hash_value) const;
+
+    const PruningConfig& get_config() const { return config_; }
+    const PruningStats& get_stats() const { return stats_; }
+
+private:
+    PruningConfig config_;
+    std::unordered_map<uint32_t, uint32_t> posting_counts_;
+    size_t total_postings_;
+    PruningStats stats_;
+};
+
+} // namespace AudioFingerprint
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "peak_detector.h"
+#include "fingerprint_profile.h"
 #include <vector>
 #include <cstdint>
 #include <string>
@@ -16,14 +17,16 @@ struct Fingerprint {
     float anchor_freq_hz;       // Anchor peak frequency
     float target_freq_hz;       // Target peak frequency
     int time_delta_ms;          // Time difference between peaks
+    float peak_strength;        // Weaker of the two peak magnitudes (not serialized)
     
     Fingerprint() : hash_value(0), time_offset_ms(0), 
-                        anchor_freq_hz(0.0f), target_freq_hz(0.0f), time_delta_ms(0) {}
+                        anchor_freq_hz(0.0f), target_freq_hz(0.0f), time_delta_ms(0),
+                        peak_strength(0.0f) {}
     
     Fingerprint(uint32_t hash, int offset, float anchor_freq, 
-                    float target_freq, int delta)
+                    float target_freq, int delta, float strength = 0.0f)
         : hash_value(hash), time_offset_ms(offset), anchor_freq_hz(anchor_freq),
-          target_freq_hz(target_freq), time_delta_ms(delta) {}
+          target_freq_hz(target_freq), time_delta_ms(delta), peak_strength(strength) {}
 };
 
 /**
@@ -69,6 +72,36 @@ public:
      */
     uint32_t generate_hash(const LandmarkPair& pair);
     
+    /**
+     * Generate fingerprints from landmark triplets
+     * @param landmark_triplets Input landmark triplets
+     * @return Vector of audio fingerprints (target fields describe the second target)
+     */
+    std::vector<Fingerprint> generate_fingerprints(
+        const std::vector<LandmarkTriplet>& landmark_triplets);
+    
+    /**
+     * Generate hash value from a landmark triplet. The 56-bit key packs the
+     * anchor frequency bin, the log-frequency ratios of both targets to the
+     * anchor, the ratio of the two time deltas and the longer time delta; it
+     * is mixed down to 32 bits to fit the index.
+     * @param triplet Input landmark triplet
+     * @return 32-bit hash value
+     */
+    uint32_t generate_hash(const LandmarkTriplet& triplet);
+    
+    /**
+     * Form pairs or triplets from detected peaks as a profile specifies and hash them
+     * @param peak_detector Detector that found the peaks
+     * @param constellation Detected peaks
+     * @param profile Target zone, fan-out and landmark size (hashed with this
+     *        generator's quantization)
+     * @return Vector of audio fingerprints
+     */
+    std::vector<Fingerprint> hash_constellation(PeakDetector& peak_detector,
+                                                const ConstellationMap& constellation,
+                                                const FingerprintProfile& profile);
+    
     /**
      * Process audio sample and generate complete fingerprint set
      * @param audio_sample Input audio sample
@@ -76,6 +109,16 @@ public:
      */
     std::vector<Fingerprint> process_audio_sample(const AudioSample& audio_sample);
     
+    /**
+     * Process audio sample with the analysis, density and hash settings of a profile
+     * @param audio_sample Input audio sample
+     * @param profile Fingerprinting profile (its quantization overrides this generator's)
+     * @return Vector of audio fingerprints
+     * @throws OperationCancelled if the calling thread's cancellation token is cancelled
+     */
+    std::vector<Fingerprint> process_audio_sample(const AudioSample& audio_sample,
+                                                  const FingerprintProfile& profile);
+    
     /**
      * Batch process multiple audio files for reference database
      * @param audio_samples Vector of audio samples with metadata
@@ -112,6 +155,41 @@ public:
      */
     void set_time_quantization(int quantization);
     
+    /**
+     * Choose between the fused tiled STFT + peak detection pipeline and the
+     * two-pass path that materialises the full spectrogram (results are identical)
+     * @param enabled True to use the fused pipeline
+     */
+    void set_fused_analysis(bool enabled) { fused_analysis_ = enabled; }
+    
+    /**
+     * Fingerprint audio at its own sample rate (NativeRateAnalyzer) instead of
+     * resampling it; the hashes match those of the resampling front end
+     * @param audio_sample Input audio sample, at least 11025 Hz
+     * @param peak_detector Peak detector to use
+     * @param profile Analysis, phases and target zone (hashed with this
+     *        generator's quantization)
+     * @return Vector of audio fingerprints
+     */
+    std::vector<Fingerprint> process_at_native_rate(const AudioSample& audio_sample, PeakDetector& peak_detector,
+                                                    const FingerprintProfile& profile);
+    
+    /**
+     * Append the fingerprints of a phase-shifted analysis, moving them onto the
+     * time base of the unshifted clip
+     * @param merged Fingerprints of the earlier phases
+     * @param phase Fingerprints of an analysis that skipped the first samples
+     * @param shift_samples Samples skipped
+     * @param sample_rate Analysis sample rate
+     */
+    static void append_phase(std::vector<Fingerprint>& merged, const std::vector<Fingerprint>& phase,
+                             int shift_samples, int sample_rate);
+    
+    /**
+     * Profile equivalent to process_audio_sample() without a profile argument
+     */
+    FingerprintProfile get_profile() const;
+    
     /**
      * Get statistics about generated fingerprints
      * @param fingerprints Input fingerprints
@@ -122,6 +200,13 @@ public:
 private:
     float freq_quantization_;
     int time_quantization_;
+    bool fused_analysis_;
+    
+    /**
+     * STFT, peak picking and hashing of preprocessed audio
+     */
+    std::vector<Fingerprint> analyse(const std::vector<float>& audio, PeakDetector& peak_detector,
+                                     const FingerprintProfile& profile);
     
     /**
      * Quantize frequency to discrete bins
@@ -137,6 +222,17 @@ private:
      */
     uint16_t quantize_time(int time_ms);
     
+    /**
+     * Quantize the frequency ratio of a target to its anchor on a log scale
+     * @param target_freq Target frequency in Hz
+     * @param anchor_freq Anchor frequency in Hz
+     * @return Ratio bin, FREQ_RATIO_STEPS_PER_OCTAVE per octave centred on 128
+     */
+    uint8_t quantize_frequency_ratio(float target_freq, float anchor_freq);
+    
+    static constexpr int FREQ_RATIO_STEPS_PER_OCTAVE = 24;  // Quarter tones
+    static constexpr int TIME_RATIO_STEPS = 16;
+    
     /**
      * Combine quantized values into hash
      * @param anchor_freq Quantized anchor frequency
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "hash_generator.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Posting stored for every occurrence of a hash in a reference song
+ */
+struct Posting {
+    uint32_t song_id;
+    int32_t time_offset_ms;
+
+    Posting() : song_id(0), time_offset_ms(0) {}
+    Posting(uint32_t song, int32_t offset) : song_id(song), time_offset_ms(offset) {}
+};
+
+/**
+ * Hash table entry: postings[first, first + count) share the hash
+ */
+struct HashEntry {
+    uint32_t hash_value;
+    uint32_t count;
+    uint64_t first;
+
+    HashEntry() : hash_value(0), count(0), first(0) {}
+};
+
+/**
+ * Per-song summary kept in every segment
+ */
+struct SegmentSong {
+    uint32_t song_id;
+    uint32_t fingerprint_count;
+
+    SegmentSong() : song_id(0), fingerprint_count(0) {}
+    SegmentSong(uint32_t song, uint32_t count) : song_id(song), fingerprint_count(count) {}
+};
+
+/**
+ * Display metadata of a reference song, carried in segments so matches can
+ * be reported without a database lookup
+ */
+struct SongMetadata {
+    std::string title;
+    std::string artist;
+    std::string album;
+    int32_t duration_ms;
+
+    SongMetadata() : duration_ms(0) {}
+    SongMetadata(const std::string& song_title, const std::string& song_artist,
+                 const std::string& song_album, int32_t duration)
+        : title(song_title), artist(song_artist), album(song_album), duration_ms(duration) {}
+
+    bool empty() const { return title.empty() && artist.empty() && album.empty() && duration_ms == 0; }
+};
+
+/**
+ * Song table entry: each string is a (offset, length) range of the string pool
+ */
+struct SongRecord {
+    uint32_t title_offset;
+    uint32_t title_length;
+    uint32_t artist_offset;
+    uint32_t artist_length;
+    uint32_t album_offset;
+    uint32_t album_length;
+    int32_t duration_ms;
+
+    SongRecord() : title_offset(0), title_length(0), artist_offset(0), artist_length(0),
+                   album_offset(0), album_length(0), duration_ms(0) {}
+};
+
+/**
+ * Immutable, sorted index segment.
+ *
+ * On-disk layout (little-endian):
+ *   header    "AFSEG001", uint32 version, uint32 flags,
+ *             uint64 hash count, uint64 posting count, uint64 song count
+ *   hashes    HashEntry[hash count] sorted by hash value
+ *   postings  Posting[posting count] grouped by hash, then song and offset
+ *   songs     SegmentSong[song count] sorted by song ID
+ *   (version 2 with FLAG_SONG_TABLE only)
+ *   pool size uint64 string pool bytes
+ *   records   SongRecord[song count] in the order of songs
+ *   strings   string pool; identical strings are stored once
+ *   (version 2 with FLAG_SONG_ID_MAP only)
+ *   ids       uint32[song count] external song ID of each internal ID
+ *   footer    uint32 CRC-32 of everything before it
+ *
+ * Segments without a song table or ID map are written as version 1, so
+ * older builds can still read them; song_metadata() finds nothing in them.
+ *
+ * Postings normally carry external song IDs. A segment made by reorder()
+ * numbers its songs 0..song count-1 in a chosen order instead, and maps them
+ * back with external_id(); songs, records and metadata lookups stay keyed
+ * by external ID.
+ */
+class IndexSegment {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 2;
+    static constexpr uint32_t FLAG_SONG_TABLE = 1;
+    static constexpr uint32_t FLAG_SONG_ID_MAP = 2;
+
+    IndexSegment() = default;
+
+    /**
+     * Build a segment from unsorted (hash, posting) pairs
+     * @param entries Hash and posting pairs; consumed
+     * @param metadata Metadata by song ID; songs without postings are left out
+     * @return Sorted segment, with a song table if any song has metadata
+     */
+    static IndexSegment build(std::vector<std::pair<uint32_t, Posting>>&& entries,
+                              const std::map<uint32_t, SongMetadata>& metadata = {});
+
+    /**
+     * Merge several segments into one
+     * @param segments Segments to merge
+     * @return Merged segment containing every posting and song table entry
+     *         of the inputs (later segments win for songs in several). If any
+     *         input was renumbered by reorder(), the merged segment keeps that
+     *         song order and numbers songs new to it after the known ones;
+     *         otherwise postings carry external song IDs.
+     */
+    static IndexSegment merge(const std::vector<const IndexSegment*>& segments);
+
+    /**
+     * Renumber the songs of a segment
+     * @param segment Segment to renumber
+     * @param order External IDs of all its songs, in the order to number them
+     * @return Segment whose postings carry internal IDs (the position in
+     *         order), sorted by hash, internal ID and offset
+     * @throws std::invalid_argument if order is not a permutation of the songs
+     */
+    static IndexSegment reorder(const IndexSegment& segment, const std::vector<uint32_t>& order);
+
+    /**
+     * Load and verify a segment file
+     * @param path Segment file path
+     * @return Loaded segment
+     */
+    static IndexSegment load(const std::string& path);
+
+    /**
+     * Parse and verify segment file bytes
+     * @param data Segment file contents
+     * @param source Name used in error messages
+     * @return Parsed segment
+     */
+    static IndexSegment parse(const std::vector<uint8_t>& data, const std::string& source);
+
+    /**
+     * Serialize the segment to its on-disk representation
+     * @return Segment file bytes, including the CRC footer
+     */
+    std::vector<uint8_t> serialize() const;
+
+    /**
+     * Find postings for a hash
+     * @param hash_value Hash to look up
+     * @param count Output number of postings
+     * @return Pointer to the first posting, or nullptr if the hash is absent
+     */
+    const Posting* find(uint32_t hash_value, size_t& count) const;
+
+    /**
+     * Look up a song in the song table
+     * @param song_id Song to look up
+     * @param metadata Filled in if found
+     * @return False if the song is absent or the segment has no song table
+     */
+    bool song_metadata(uint32_t song_id, SongMetadata& metadata) const;
+
+    size_t hash_count() const { return hashes_.size(); }
+    size_t posting_count() const { return postings_.size(); }
+    size_t song_count() const { return songs_.size(); }
+    bool has_song_table() const { return !records_.empty(); }
+    bool has_id_map() const { return !external_ids_.empty(); }
+    size_t string_pool_bytes() const { return strings_.size(); }
+
+    const std::vector<HashEntry>& hashes() const { return hashes_; }
+    const std::vector<Posting>& postings() const { return postings_; }
+    const std::vector<SegmentSong>& songs() const { return songs_; }
+
+    /**
+     * External song ID of a posting's song ID
+     */
+    uint32_t external_id(uint32_t song_id) const {
+        return external_ids_.empty() ? song_id : external_ids_[song_id];
+    }
+
+    /**
+     * Internal to external song ID table, or nullptr if postings carry external IDs
+     */
+    const uint32_t* id_map() const { return external_ids_.empty() ? nullptr : external_ids_.data(); }
+
+private:
+    std::vector<HashEntry> hashes_;
+    std::vector<Posting> postings_;
+    std::vector<SegmentSong> songs_;
+    std::vector<SongRecord> records_;   // Parallel to songs_, or empty
+    std::string strings_;
+    std::vector<uint32_t> external_ids_;  // Indexed by internal ID, or empty
+
+    /**
+     * Metadata of the song at an index of songs_
+     */
+    SongMetadata record_metadata(size_t index) const;
+};
+
+/**
+ * CRC-32 (IEEE 802.3, as used by zlib)
+ * @param data Input bytes
+ * @param size Number of bytes
+ * @param crc Running CRC from a previous call (0 to start)
+ * @return Updated CRC
+ */
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+/**
+ * Read a whole file into memory
+ * @param path File path
+ * @return File contents
+ */
+std::vector<uint8_t> read_binary_file(const std::string& path);
+
+/**
+ * Durably replace a file: write a temporary sibling, flush it to stable
+ * storage and rename it over the destination
+ * @param path Destination path
+ * @param data Contents to write
+ * @param size Number of bytes
+ */
+void write_file_atomically(const std::string& path, const uint8_t* data, size_t size);
+
+} // namespace AudioFingerprint
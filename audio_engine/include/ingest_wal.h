@@ -0,0 +1,145 @@
+#pragma once
+
+#include "hash_generator.h"
+#include "index_segment.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+namespace AudioFingerprint {
+
+/**
+ * Position in the write-ahead log
+ */
+struct WalMark {
+    uint64_t lsn;       // Last sequence number appended
+    uint64_t offset;    // Logical end offset of that record
+
+    WalMark() : lsn(0), offset(0) {}
+};
+
+/**
+ * Write-ahead log activity counters
+ */
+struct WalStats {
+    uint64_t records;        // Records appended since open
+    uint64_t bytes;          // Record bytes appended since open
+    uint64_t syncs;          // fdatasync calls
+    uint64_t replayed;       // Records replayed on open
+    double sync_ms;          // Total time spent in write + fdatasync
+
+    WalStats() : records(0), bytes(0), syncs(0), replayed(0), sync_ms(0.0) {}
+};
+
+/**
+ * Append-only log of songs added to the mutable index segment.
+ *
+ * Appends are made durable by group commit: the first caller waiting for
+ * durability becomes the leader, waits up to the commit window for other
+ * appends to join, then writes the whole batch with a single fdatasync.
+ * Callers that arrived meanwhile are released by the same sync.
+ *
+ * File layout (little-endian): "AFWAL001" magic, then records of
+ *   uint32 payload length, uint32 CRC-32 of the payload,
+ *   payload: uint64 lsn, uint32 song id, uint32 fingerprint count,
+ *            (uint32 hash, int32 time offset ms) per fingerprint,
+ *            then, for songs with metadata, int32 duration ms and
+ *            (uint32 length, bytes) for title, artist and album
+ * A torn or corrupt record at the tail ends replay and is cut off.
+ */
+class IngestWal {
+public:
+    using ReplayCallback = std::function<void(uint64_t lsn, uint32_t song_id,
+                                              const std::vector<Fingerprint>& fingerprints,
+                                              const SongMetadata& metadata)>;
+
+    /**
+     * Open or create a log
+     * @param path Log file path
+     * @param commit_window_us How long a commit leader waits for more appends (0 = no wait)
+     */
+    IngestWal(const std::string& path, int commit_window_us);
+
+    ~IngestWal();
+
+    IngestWal(const IngestWal&) = delete;
+    IngestWal& operator=(const IngestWal&) = delete;
+
+    /**
+     * Replay records written before the last shutdown or crash
+     * @param after_lsn Skip records with sequence numbers up to this one
+     * @param callback Called for each record in log order
+     * @return Number of records replayed
+     */
+    size_t replay(uint64_t after_lsn, const ReplayCallback& callback);
+
+    /**
+     * Buffer a record; it is not durable until wait_durable() returns
+     * @param song_id Song identifier
+     * @param fingerprints Fingerprints of the song
+     * @param metadata Song metadata (not logged if empty)
+     * @return Sequence number of the record
+     */
+    uint64_t append(uint32_t song_id, const std::vector<Fingerprint>& fingerprints,
+                    const SongMetadata& metadata = SongMetadata());
+
+    /**
+     * Block until a record is on stable storage
+     * @param lsn Sequence number returned by append()
+     */
+    void wait_durable(uint64_t lsn);
+
+    /**
+     * Current end of the log, for a later truncate()
+     */
+    WalMark mark() const;
+
+    /**
+     * Drop every record up to a mark once its contents are persisted elsewhere
+     * @param mark Mark taken when the records were handed off
+     */
+    void truncate(const WalMark& mark);
+
+    /**
+     * Get activity counters
+     */
+    WalStats get_stats() const;
+
+    /**
+     * Size of the log file in bytes
+     */
+    uint64_t file_size() const;
+
+    int get_commit_window_us() const { return commit_window_us_; }
+
+private:
+    std::string path_;
+    int commit_window_us_;
+    int fd_;
+
+    std::mutex file_mutex_;    // Held while writing, syncing or rewriting the file
+
+    mutable std::mutex mutex_; // Guards the fields below
+    std::condition_variable durable_cv_;
+    std::vector<uint8_t> pending_;
+    uint64_t appended_lsn_;
+    uint64_t durable_lsn_;
+    uint64_t logical_end_;     // Logical offset after the last appended record
+    uint64_t file_base_;       // Logical offset of the first byte after the file header
+    bool leader_active_;
+    std::string error_;
+    WalStats stats_;
+
+    /**
+     * Write and sync all pending records; requires file_mutex_
+     */
+    void write_pending();
+
+    void open_file();
+    void close_file();
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "fingerprint_index.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Matcher sidecar configuration
+ */
+struct SidecarConfig {
+    int slots;              // Requests in flight at once across all clients
+    int max_query_hashes;   // Largest query a slot holds
+    int max_results;        // Most matches a slot returns
+    int workers;            // Threads serving slots
+    int spin_us;            // Busy-wait before sleeping on a futex, on both sides (none on a single CPU)
+
+    SidecarConfig() : slots(64), max_query_hashes(32768), max_results(32), workers(1), spin_us(50) {}
+
+    /**
+     * Check the configuration
+     * @throws std::invalid_argument if a setting is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Matcher sidecar counters
+ */
+struct SidecarStats {
+    uint64_t requests;
+    uint64_t failed;            // Queries that threw; the client gets the error message
+    uint64_t abandoned;         // Results the client stopped waiting for
+    uint64_t reclaimed_slots;   // Slots freed after their client process died
+    uint64_t sleeps;            // Times a worker found no work and slept on the doorbell
+    double total_service_us;
+    double max_service_us;
+
+    SidecarStats() : requests(0), failed(0), abandoned(0), reclaimed_slots(0), sleeps(0),
+                     total_service_us(0.0), max_service_us(0.0) {}
+};
+
+/**
+ * Serves index queries to other processes through shared memory.
+ *
+ * The sidecar creates a POSIX shared-memory segment holding a ring of
+ * request slots. A client claims a free slot, writes its hashes and offsets
+ * straight into it, marks it submitted and rings a doorbell word; a worker
+ * claims the slot, queries the index and writes the matches back into the
+ * slot. Both sides busy-wait for spin_us and then sleep on the word they are
+ * waiting for with a futex (a short sleep where futexes are unavailable), and
+ * only wake the other side when it is asleep, so a round trip needs no
+ * serialisation and, while both sides are busy, no system call.
+ *
+ * Slots whose client process died are reclaimed while the workers are idle.
+ * Matches carry the song metadata of the index's song tables, with titles,
+ * artists and albums cut to 127 bytes.
+ */
+class MatcherSidecar {
+public:
+    /**
+     * Constructor; creates the shared segment, replacing a stale one of the
+     * same name, and starts the workers
+     * @param name Segment name shared with clients
+     * @param index Index to query; must outlive the sidecar
+     * @param config Slot and worker settings
+     * @throws std::invalid_argument if the name or configuration is invalid
+     * @throws std::runtime_error if the segment cannot be created
+     */
+    MatcherSidecar(const std::string& name, const FingerprintIndex& index,
+                   const SidecarConfig& config = SidecarConfig());
+
+    /**
+     * Destructor - stops the workers and removes the segment
+     */
+    ~MatcherSidecar();
+
+    MatcherSidecar(const MatcherSidecar&) = delete;
+    MatcherSidecar& operator=(const MatcherSidecar&) = delete;
+
+    /**
+     * Stop serving: waiting clients fail and the segment is removed
+     */
+    void stop();
+
+    /**
+     * Get counters
+     */
+    SidecarStats get_stats() const;
+
+    const std::string& get_name() const { return name_; }
+    const SidecarConfig& get_config() const { return config_; }
+
+    /**
+     * Check whether this platform has the shared memory the sidecar needs
+     */
+    static bool supported();
+
+private:
+    std::string name_;
+    const FingerprintIndex& index_;
+    SidecarConfig config_;
+    void* mapping_;
+    size_t mapping_size_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stopping_;
+
+    mutable std::mutex stats_mutex_;
+    SidecarStats stats_;
+
+    /**
+     * Worker thread main loop
+     */
+    void worker_loop(int worker);
+
+    /**
+     * Run the query of a claimed slot and hand the result back
+     */
+    void serve_slot(uint32_t slot);
+
+    /**
+     * Free slots held by client processes that no longer exist
+     */
+    void reclaim_slots();
+};
+
+/**
+ * Client of a matcher sidecar; safe to share between threads
+ */
+class MatcherClient {
+public:
+    /**
+     * Constructor; maps the sidecar's segment
+     * @param name Segment name the sidecar was created with
+     * @param timeout_ms Longest wait for a free slot and the query result
+     * @throws std::runtime_error if no sidecar of that name is running
+     */
+    explicit MatcherClient(const std::string& name, int timeout_ms = 5000);
+
+    /**
+     * Destructor - unmaps the segment
+     */
+    ~MatcherClient();
+
+    MatcherClient(const MatcherClient&) = delete;
+    MatcherClient& operator=(const MatcherClient&) = delete;
+
+    /**
+     * Find reference songs matching a query through the sidecar
+     * @param query Query fingerprints; only hash and time offset are sent
+     * @param max_results Maximum number of matches to return
+     * @param min_matches Minimum aligned hashes for a match
+     * @return Matches ordered by decreasing match count, with song metadata
+     *         cut to 127 bytes per field
+     * @throws std::invalid_argument if the query or max_results exceeds the slot size
+     * @throws std::runtime_error if the sidecar stopped, the query failed or
+     *         no slot or result arrived within the timeout
+     * @throws OperationCancelled if the calling thread's cancellation token is cancelled
+     */
+    std::vector<IndexMatch> query(const std::vector<Fingerprint>& query,
+                                  int max_results = 5, int min_matches = 5) const;
+
+    /**
+     * Check whether the sidecar is still serving this segment
+     */
+    bool connected() const;
+
+    /**
+     * Slot limits of the sidecar
+     */
+    int get_max_query_hashes() const;
+    int get_max_results() const;
+
+private:
+    std::string name_;
+    int timeout_ms_;
+    void* mapping_;
+    size_t mapping_size_;
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "audio_types.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Fields of an MPEG audio Layer III frame header
+ */
+struct Mp3FrameHeader {
+    int version;             // 10 = MPEG-1, 20 = MPEG-2, 25 = MPEG-2.5
+    int bitrate_kbps;
+    int sample_rate;
+    int channels;
+    int frame_bytes;         // Whole frame, header included
+    int samples_per_frame;   // Per channel: 1152 (MPEG-1) or 576
+
+    Mp3FrameHeader()
+        : version(0), bitrate_kbps(0), sample_rate(0), channels(0), frame_bytes(0), samples_per_frame(0) {}
+};
+
+/**
+ * Frame layout of an MP3 stream, found from the frame headers alone
+ */
+struct Mp3StreamInfo {
+    int sample_rate;
+    int channels;
+    int samples_per_frame;
+    std::vector<size_t> frame_offsets;   // Byte offset of each audio frame
+    int64_t total_samples;               // Per channel
+    int duration_ms;
+
+    Mp3StreamInfo() : sample_rate(0), channels(0), samples_per_frame(0), total_samples(0), duration_ms(0) {}
+};
+
+/**
+ * Which part of a stream to decode, and to what rate
+ */
+struct Mp3DecodeOptions {
+    int start_ms;            // First millisecond to return
+    int max_duration_ms;     // Milliseconds to return (0 = to the end)
+    int target_rate;         // Output rate (0 = the stream's rate)
+
+    Mp3DecodeOptions() : start_ms(0), max_duration_ms(0), target_rate(0) {}
+};
+
+/**
+ * Decoded audio and the work it took
+ */
+struct Mp3DecodeResult {
+    AudioSample audio;       // Mono
+    int frames_decoded;      // Warm-up frames included
+    int frames_skipped;      // Frames outside the requested range that were not decoded
+
+    Mp3DecodeResult() : frames_decoded(0), frames_skipped(0) {}
+};
+
+/**
+ * MP3 (MPEG-1/2/2.5 Layer III) decoder for uploaded queries.
+ *
+ * The stream is first indexed from its frame headers, which costs a few
+ * bytes per frame. Only the frames covering the requested range are then
+ * decoded, plus the preceding frames whose bytes the bit reservoir of the
+ * first one may reference and one for the IMDCT overlap; their output is
+ * discarded. The decoded audio is mixed down to mono and resampled to the
+ * target rate.
+ *
+ * Frame decoding uses minimp3 and is compiled in when its header is found
+ * at build time (HAVE_MINIMP3); scan() works either way.
+ */
+class Mp3Decoder {
+public:
+    /**
+     * Parse a frame header
+     * @param data At least 4 bytes
+     * @param header Filled in on success
+     * @return False if the bytes are not a supported Layer III header
+     */
+    static bool parse_frame_header(const uint8_t* data, Mp3FrameHeader& header);
+
+    /**
+     * Index the audio frames of a stream, skipping ID3v2 tags, a leading
+     * Xing/Info frame and trailing non-audio data
+     * @param data Stream bytes
+     * @param size Number of bytes
+     * @return Stream layout
+     * @throws std::invalid_argument if no MP3 frames are found
+     */
+    static Mp3StreamInfo scan(const uint8_t* data, size_t size);
+
+    /**
+     * Decode part of a stream to mono
+     * @param data Stream bytes
+     * @param size Number of bytes
+     * @param options Range and output rate
+     * @return Decoded audio and frame counts
+     * @throws std::invalid_argument if no MP3 frames are found or the range is invalid
+     * @throws std::runtime_error if built without a frame decoder
+     */
+    static Mp3DecodeResult decode(const uint8_t* data, size_t size,
+                                  const Mp3DecodeOptions& options = Mp3DecodeOptions());
+
+    /**
+     * Check whether frame decoding was compiled in
+     */
+    static bool available();
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "audio_types.h"
+#include "fft_processor.h"
+#include <vector>
+
+namespace AudioFingerprint {
+
+/**
+ * STFT front end that analyses audio at its own sample rate, without
+ * resampling to 11.025 kHz first.
+ *
+ * Window and hop are scaled to the same duration as fft_size and hop_size at
+ * 11.025 kHz (8192 / 4096 samples at 44.1 kHz), and each frame's magnitudes
+ * are mapped onto the 11.025 kHz bin grid: bins up to 5.5125 kHz, the same Hz
+ * per bin and the same level. Peak picking and hashing then see the same
+ * spectrogram geometry as with the resampling front end, so the fingerprints
+ * match an index built either way.
+ *
+ * Where the transform's bins coincide with the analysis bins (rates that are
+ * 11.025 kHz times a power of two) they are copied; otherwise the window is
+ * zero-padded to the next power of two and magnitudes are interpolated.
+ */
+class NativeRateAnalyzer {
+public:
+    /**
+     * Constructor
+     * @param sample_rate Input sample rate, at least 11025 Hz
+     * @param fft_size FFT size at the 11.025 kHz analysis rate
+     * @param hop_size Hop at the 11.025 kHz analysis rate
+     */
+    NativeRateAnalyzer(int sample_rate, int fft_size = 2048, int hop_size = 1024);
+
+    NativeRateAnalyzer(const NativeRateAnalyzer&) = delete;
+    NativeRateAnalyzer& operator=(const NativeRateAnalyzer&) = delete;
+
+    /**
+     * Compute the STFT of mono audio at the input rate
+     * @param audio_data Mono samples at the input rate
+     * @return Spectrogram on the 11.025 kHz bin grid (fft_size / 2 + 1 bins)
+     *         with time_resolution in seconds of input audio
+     */
+    Spectrogram compute_stft(const std::vector<float>& audio_data);
+
+    /**
+     * Convert a shift at the analysis rate to input samples
+     */
+    int to_native_samples(int analysis_samples) const;
+
+    int get_sample_rate() const { return sample_rate_; }
+    int get_window_size() const { return window_size_; }
+    int get_hop_size() const { return hop_size_; }
+    int get_transform_size() const { return transform_size_; }
+
+    // Rate the resampling front end analyses at
+    static constexpr int ANALYSIS_RATE = 11025;
+
+private:
+    int sample_rate_;
+    int analysis_bins_;     // fft_size / 2 + 1 at the analysis rate
+    int window_size_;       // Input samples per frame
+    int hop_size_;          // Input samples between frames
+    int transform_size_;    // Power-of-two FFT size >= window_size_
+    float level_;           // Scales magnitudes to the analysis window's gain
+    bool direct_;           // Transform bins coincide with analysis bins
+
+    FFTProcessor fft_processor_;
+    std::vector<float> frame_magnitudes_;
+
+    // Interpolation of analysis bin k from transform bins lower_bin_[k] and lower_bin_[k] + 1
+    std::vector<int> lower_bin_;
+    std::vector<float> fraction_;
+};
+
+} // namespace AudioFingerprint
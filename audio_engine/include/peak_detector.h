@@ -41,6 +41,25 @@ struct LandmarkPair {
     }
 };
 
+/**
+ * Landmark triplet: an anchor and two later peaks from its target zone
+ */
+struct LandmarkTriplet {
+    SpectralPeak anchor;     // Anchor peak (earliest in time)
+    SpectralPeak first;      // Earlier target peak
+    SpectralPeak second;     // Later target peak
+    int first_delta_ms;      // Time from anchor to first target in milliseconds
+    int second_delta_ms;     // Time from anchor to second target in milliseconds
+    
+    LandmarkTriplet() : first_delta_ms(0), second_delta_ms(0) {}
+    
+    LandmarkTriplet(const SpectralPeak& a, const SpectralPeak& f, const SpectralPeak& s)
+        : anchor(a), first(f), second(s) {
+        first_delta_ms = static_cast<int>((first.time_seconds - anchor.time_seconds) * 1000.0f);
+        second_delta_ms = static_cast<int>((second.time_seconds - anchor.time_seconds) * 1000.0f);
+    }
+};
+
 /**
  * Constellation map containing all detected peaks
  */
@@ -86,17 +105,70 @@ public:
      */
     ConstellationMap detect_peaks(const Spectrogram& spectrogram);
     
+    /**
+     * Collect thresholded local maxima from a range of frames.
+     * Frames are addressed through row pointers so callers can scan a sliding
+     * window of frames without materialising the whole spectrogram.
+     * @param rows Row pointers indexed by absolute frame; rows[t] must be valid for
+     *             t in [t_begin - context_frames(), t_end + context_frames())
+     * @param time_frames Total number of frames in the spectrogram
+     * @param frequency_bins Number of bins per frame
+     * @param t_begin First frame to scan
+     * @param t_end One past the last frame to scan
+     * @param time_resolution Seconds per frame
+     * @param freq_resolution Hz per bin
+     * @param candidates Output vector that candidate peaks are appended to
+     */
+    void find_candidate_peaks(const float* const* rows, int time_frames, int frequency_bins,
+                              int t_begin, int t_end,
+                              float time_resolution, float freq_resolution,
+                              std::vector<SpectralPeak>& candidates) const;
+    
+    /**
+     * Filter peaks to remove those too close together
+     * @param peaks Input peaks
+     * @return Filtered peaks
+     */
+    std::vector<SpectralPeak> filter_nearby_peaks(const std::vector<SpectralPeak>& peaks) const;
+    
+    /**
+     * Number of neighbouring frames on each side that candidate detection reads
+     */
+    static int context_frames();
+    
     /**
      * Extract landmark pairs from constellation map
      * @param constellation Input constellation map
      * @param max_time_delta Maximum time difference for pairs (ms)
      * @param max_freq_delta Maximum frequency difference for pairs (Hz)
+     * @param max_pairs_per_anchor Pair each anchor with at most this many of the
+     *        earliest peaks in its target zone (0 = no limit)
      * @return Vector of landmark pairs
      */
     std::vector<LandmarkPair> extract_landmark_pairs(
         const ConstellationMap& constellation,
         int max_time_delta = 2000,
-        float max_freq_delta = 2000.0f);
+        float max_freq_delta = 2000.0f,
+        int max_pairs_per_anchor = 0);
+    
+    /**
+     * Extract landmark triplets from constellation map. Each anchor is combined
+     * with every two of the strongest peaks in its target zone, the later of
+     * which must fall in a later frame than the earlier one. Choosing by
+     * strength rather than time keeps the targets stable when noise adds weak
+     * peaks to the zone.
+     * @param constellation Input constellation map
+     * @param max_time_delta Maximum time difference from the anchor (ms)
+     * @param max_freq_delta Maximum frequency difference from the anchor (Hz)
+     * @param max_targets_per_anchor Targets considered per anchor; an anchor
+     *        yields up to n * (n - 1) / 2 triplets
+     * @return Vector of landmark triplets
+     */
+    std::vector<LandmarkTriplet> extract_landmark_triplets(
+        const ConstellationMap& constellation,
+        int max_time_delta = 2000,
+        float max_freq_delta = 2000.0f,
+        int max_targets_per_anchor = 5);
     
     /**
      * Set adaptive threshold factor
@@ -115,51 +187,91 @@ public:
      * @param threshold Minimum absolute magnitude
      */
     void set_min_magnitude_threshold(float threshold);
+    
+    /**
+     * Enable sub-bin interpolation of peak frequency. Each peak's frequency is
+     * refined by fitting a parabola through the log magnitudes of its bin and
+     * the two neighbouring bins; frequency_bin keeps the grid position.
+     * Off by default, since it changes the hashes.
+     * @param enabled True to interpolate peak frequency
+     */
+    void set_frequency_interpolation(bool enabled);
+    
+    /**
+     * Enable sub-frame interpolation of peak time, fitting the peak's frame and
+     * the two neighbouring frames as for frequency; time_frame keeps the grid
+     * position. Most useful when frames overlap, so that neighbouring frames
+     * see the same onset. Off by default, since it changes the hashes.
+     * @param enabled True to interpolate peak time
+     */
+    void set_time_interpolation(bool enabled);
+    
+    bool frequency_interpolation() const { return frequency_interpolation_; }
+    bool time_interpolation() const { return time_interpolation_; }
 
 private:
     int min_peak_distance_;
     float adaptive_factor_;
     float min_magnitude_threshold_;
+    bool frequency_interpolation_;
+    bool time_interpolation_;
+    
+    static constexpr int LOCAL_MAX_NEIGHBORHOOD = 3;
+    static constexpr int THRESHOLD_REGION = 10;
     
     /**
      * Check if a point is a local maximum in the spectrogram
-     * @param spectrogram Input spectrogram
+     * @param rows Spectrogram rows indexed by time frame
+     * @param time_frames Total number of frames
+     * @param frequency_bins Number of bins per frame
      * @param time_frame Time frame index
      * @param freq_bin Frequency bin index
      * @param neighborhood_size Size of neighborhood to check
      * @return True if point is local maximum
      */
-    bool is_local_maximum(const Spectrogram& spectrogram, 
+    bool is_local_maximum(const float* const* rows, int time_frames, int frequency_bins,
                          int time_frame, int freq_bin, 
-                         int neighborhood_size = 3) const;
+                         int neighborhood_size = LOCAL_MAX_NEIGHBORHOOD) const;
     
     /**
      * Calculate adaptive threshold for a region
-     * @param spectrogram Input spectrogram
+     * @param rows Spectrogram rows indexed by time frame
+     * @param time_frames Total number of frames
+     * @param frequency_bins Number of bins per frame
      * @param time_frame Center time frame
      * @param freq_bin Center frequency bin
      * @param region_size Size of region for threshold calculation
      * @return Adaptive threshold value
      */
-    float calculate_adaptive_threshold(const Spectrogram& spectrogram,
+    float calculate_adaptive_threshold(const float* const* rows, int time_frames, int frequency_bins,
                                      int time_frame, int freq_bin,
-                                     int region_size = 10) const;
-    
-    /**
-     * Filter peaks to remove those too close together
-     * @param peaks Input peaks
-     * @return Filtered peaks
-     */
-    std::vector<SpectralPeak> filter_nearby_peaks(const std::vector<SpectralPeak>& peaks) const;
+                                     int region_size = THRESHOLD_REGION) const;
     
     /**
      * Convert bin indices to actual frequency and time values
      * @param peak Peak with bin indices
-     * @param spectrogram Source spectrogram for resolution info
+     * @param time_resolution Seconds per frame
+     * @param freq_resolution Hz per bin
      * @return Peak with actual frequency and time values
      */
     SpectralPeak convert_to_physical_units(const SpectralPeak& peak, 
-                                          const Spectrogram& spectrogram) const;
+                                          float time_resolution, float freq_resolution) const;
+    
+    /**
+     * Refine a peak's frequency and/or time from its neighbours' magnitudes
+     * @param rows Spectrogram rows indexed by time frame
+     * @param peak Peak at an interior grid point, already in physical units
+     * @param time_resolution Seconds per frame
+     * @param freq_resolution Hz per bin
+     */
+    void interpolate_peak(const float* const* rows, SpectralPeak& peak,
+                          float time_resolution, float freq_resolution) const;
+    
+    /**
+     * Offset of the vertex of the parabola through three equally spaced points
+     * @return Offset from the middle point in [-0.5, 0.5]
+     */
+    static float parabolic_offset(float before, float center, float after);
 };
 
 } // namespace AudioFingerprint
\ No newline at end of file
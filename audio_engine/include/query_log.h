@@ -0,0 +1,131 @@
+#pragma once
+
+#include "hash_generator.h"
+#include "fingerprint_index.h"
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <random>
+
+namespace AudioFingerprint {
+
+/**
+ * One captured query: its fingerprints, what it matched and how long each stage took
+ */
+struct QueryLogRecord {
+    int64_t timestamp_ms;                               // Unix time of capture
+    int max_results;
+    int min_matches;
+    std::vector<Fingerprint> fingerprints;              // Only hash and time offset are kept
+    std::vector<IndexMatch> matches;
+    std::vector<std::pair<std::string, float>> stage_ms; // e.g. ("fingerprint", 41.0), ("search", 3.2)
+
+    QueryLogRecord() : timestamp_ms(0), max_results(5), min_matches(5) {}
+};
+
+/**
+ * Capture counters
+ */
+struct QueryLogStats {
+    uint64_t offered;     // Queries passed to should_capture()
+    uint64_t captured;    // Records appended
+    uint64_t bytes;       // Record bytes appended
+
+    QueryLogStats() : offered(0), captured(0), bytes(0) {}
+};
+
+/**
+ * Sampled binary log of production queries for offline replay.
+ *
+ * Appends are buffered in memory and written once FLUSH_BYTES accumulate, on
+ * flush() or on close; a crash loses at most the buffered tail, which is
+ * acceptable for a sample.
+ *
+ * File layout (little-endian): "AFQLOG01" magic, then records of
+ *   uint32 payload length, uint32 CRC-32 of the payload,
+ *   payload: int64 timestamp ms, int32 max results, int32 min matches,
+ *            uint32 fingerprint count, uint32 match count, uint8 stage count,
+ *            (uint32 hash, int32 time offset ms) per fingerprint,
+ *            (uint32 song id, int32 match count, int32 offset ms, float confidence) per match,
+ *            (uint8 name length, name bytes, float ms) per stage
+ * Several processes may append to one log: each flush is a single append
+ * write of whole records. Reading skips torn or corrupt bytes and resumes at
+ * the next span whose length, CRC and payload check out.
+ */
+class QueryLog {
+public:
+    /**
+     * Open or create a log for appending
+     * @param path Log file path
+     * @param sample_rate Fraction of queries to capture, in [0, 1]
+     * @param seed Seed of the sampling generator (0 = random)
+     */
+    QueryLog(const std::string& path, double sample_rate, uint64_t seed = 0);
+
+    ~QueryLog();
+
+    QueryLog(const QueryLog&) = delete;
+    QueryLog& operator=(const QueryLog&) = delete;
+
+    /**
+     * Decide whether the current query is sampled
+     * @return True if the caller should append() it
+     */
+    bool should_capture();
+
+    /**
+     * Append a record
+     * @param record Captured query
+     */
+    void append(const QueryLogRecord& record);
+
+    /**
+     * Write buffered records to the file
+     */
+    void flush();
+
+    /**
+     * Get capture counters
+     */
+    QueryLogStats get_stats() const;
+
+    const std::string& get_path() const { return path_; }
+    double get_sample_rate() const { return sample_rate_; }
+
+    /**
+     * Read every intact record of a log
+     * @param path Log file path
+     * @return Records in capture order
+     */
+    static std::vector<QueryLogRecord> read(const std::string& path);
+
+    /**
+     * Encode a record as it is stored in the file (header included)
+     */
+    static std::vector<uint8_t> encode(const QueryLogRecord& record);
+
+    /**
+     * Buffered bytes that trigger a write
+     */
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+private:
+    std::string path_;
+    double sample_rate_;
+    std::FILE* file_;
+
+    mutable std::mutex mutex_;  // Guards the fields below
+    std::mt19937_64 rng_;
+    std::vector<uint8_t> buffer_;
+    QueryLogStats stats_;
+
+    /**
+     * Write the buffer; requires mutex_
+     */
+    void write_buffer();
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <mutex>
+#include <cstdint>
+
+namespace AudioFingerprint {
+
+/**
+ * Realtime rule violations counted on an audited thread
+ */
+struct RealtimeAuditCounts {
+    uint64_t allocations;         // Calls of global operator new (audit builds only)
+    uint64_t deallocations;       // Calls of global operator delete (audit builds only)
+    uint64_t lock_acquisitions;   // AuditedMutex locks
+
+    RealtimeAuditCounts() : allocations(0), deallocations(0), lock_acquisitions(0) {}
+};
+
+/**
+ * Counts allocations and lock acquisitions made by the calling thread for
+ * the lifetime of the object, to check that code meant to run in an audio
+ * callback obeys the realtime rules.
+ *
+ * Allocations are only counted in audit builds, which link
+ * src/realtime_audit_hook.cpp (CMake option AUDIO_ENGINE_ALLOCATION_AUDIT,
+ * or FINGERPRINT_ALLOCATION_AUDIT=1 for setup.py). That file replaces the
+ * global operator new and delete, so it is kept out of the shipped library,
+ * where it would tax every allocation of the host and clash with the host's
+ * own allocator. Locks are counted for AuditedMutex, which the engine uses
+ * wherever realtime and non-realtime threads share state. Audits may nest;
+ * the innermost one counts.
+ */
+class RealtimeAudit {
+public:
+    RealtimeAudit();
+    ~RealtimeAudit();
+
+    RealtimeAudit(const RealtimeAudit&) = delete;
+    RealtimeAudit& operator=(const RealtimeAudit&) = delete;
+
+    /**
+     * Get the events counted so far
+     */
+    const RealtimeAuditCounts& counts() const { return counts_; }
+
+    /**
+     * Check that allocations are really being counted in this build, by
+     * auditing one; false unless the allocation hook is linked
+     */
+    static bool allocation_tracking();
+
+    /**
+     * Record an allocation on the calling thread (for the allocation hook)
+     */
+    static void note_allocation();
+
+    /**
+     * Record a deallocation on the calling thread (for the allocation hook)
+     */
+    static void note_deallocation();
+
+    /**
+     * Record a lock acquisition on the calling thread (for AuditedMutex)
+     */
+    static void note_lock();
+
+private:
+    RealtimeAuditCounts counts_;
+    RealtimeAuditCounts* previous_;
+};
+
+/**
+ * std::mutex whose acquisitions are visible to RealtimeAudit
+ */
+class AuditedMutex {
+public:
+    void lock() {
+        RealtimeAudit::note_lock();
+        mutex_.lock();
+    }
+
+    bool try_lock() {
+        RealtimeAudit::note_lock();
+        return mutex_.try_lock();
+    }
+
+    void unlock() { mutex_.unlock(); }
+
+private:
+    std::mutex mutex_;
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "index_segment.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Recursive graph bisection parameters
+ */
+struct SongOrderConfig {
+    int max_iterations;      // Swap rounds per bisection
+    int min_partition;       // Partitions this small are not split further
+    int max_depth;           // Recursion limit
+
+    SongOrderConfig() : max_iterations(20), min_partition(16), max_depth(32) {}
+
+    /**
+     * Check the parameters
+     * @throws std::invalid_argument if any is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Size and decode speed of a segment's postings under delta/varint coding
+ */
+struct PostingCodecStats {
+    size_t postings;
+    size_t id_bytes;         // Bytes of the song ID gaps
+    size_t total_bytes;      // Song ID gaps plus time offsets
+    double decode_ms;        // Best of several full decodes
+
+    PostingCodecStats() : postings(0), id_bytes(0), total_bytes(0), decode_ms(0.0) {}
+
+    double id_bytes_per_posting() const { return postings > 0 ? static_cast<double>(id_bytes) / postings : 0.0; }
+    double bytes_per_posting() const { return postings > 0 ? static_cast<double>(total_bytes) / postings : 0.0; }
+    double decode_mpostings_per_s() const { return decode_ms > 0.0 ? postings / (decode_ms * 1000.0) : 0.0; }
+};
+
+/**
+ * Outcome of reordering an index's songs
+ */
+struct SongReorderReport {
+    uint64_t segment_id;     // Segment written, or 0 if the index had no segments
+    size_t songs;
+    double bisection_ms;
+    PostingCodecStats before;
+    PostingCodecStats after;
+
+    SongReorderReport() : segment_id(0), songs(0), bisection_ms(0.0) {}
+};
+
+/**
+ * Chooses internal song IDs so songs sharing hashes get nearby IDs.
+ *
+ * Songs and hashes form a bipartite graph. The songs are split in half and
+ * songs are swapped between the halves while that lowers the estimated
+ * log-gap cost of the posting lists (Dhulipala et al., "Compressing Graphs
+ * and Indexes with Recursive Graph Bisection"); each half is then split the
+ * same way. Hashes that occur in a single song cannot shrink and are
+ * ignored. The resulting order makes the song ID gaps within posting lists
+ * small, so delta-coded lists compress better, and songs that are voted for
+ * by the same query hashes sit close together.
+ */
+class SongOrderOptimizer {
+public:
+    /**
+     * Constructor
+     * @param config Bisection parameters
+     */
+    explicit SongOrderOptimizer(const SongOrderConfig& config = SongOrderConfig());
+
+    /**
+     * Compute a song order for a segment
+     * @param segment Segment to order
+     * @return External IDs of all its songs in their new order, for IndexSegment::reorder()
+     */
+    std::vector<uint32_t> order(const IndexSegment& segment) const;
+
+    /**
+     * Measure a segment's postings as delta/varint coded lists: song ID gaps
+     * within each hash's list, and time offsets as gaps within a song
+     * @param segment Segment to measure (its posting song IDs are coded as stored)
+     * @return Coded size and decode time
+     */
+    static PostingCodecStats measure(const IndexSegment& segment);
+
+private:
+    SongOrderConfig config_;
+};
+
+} // namespace AudioFingerprint
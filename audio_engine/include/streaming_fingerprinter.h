@@ -0,0 +1,212 @@
+#pragma once
+
+#include "hash_generator.h"
+#include "fingerprint_profile.h"
+#include "realtime_audit.h"
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Single-producer single-consumer ring of samples.
+ *
+ * The buffer is allocated up front and the two indices only grow, so
+ * write() and read() are wait-free: each is a bounded copy plus one acquire
+ * load and one release store.
+ */
+class SpscRing {
+public:
+    /**
+     * Constructor
+     * @param capacity Minimum number of samples held (rounded up to a power of two)
+     */
+    explicit SpscRing(size_t capacity);
+
+    /**
+     * Append samples (producer thread only)
+     * @return Number of samples written; fewer than count when the ring is full
+     */
+    size_t write(const float* samples, size_t count);
+
+    /**
+     * Remove samples (consumer thread only)
+     * @return Number of samples read
+     */
+    size_t read(float* samples, size_t max_count);
+
+    /**
+     * Samples currently held, as seen from the calling side; the other side
+     * may change it at any time
+     */
+    size_t size() const;
+
+    size_t capacity() const { return buffer_.size(); }
+
+private:
+    std::vector<float> buffer_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;   // Samples ever written; producer-owned
+    alignas(64) std::atomic<size_t> tail_;   // Samples ever read; consumer-owned
+};
+
+/**
+ * Streaming front end configuration
+ */
+struct StreamingConfig {
+    int sample_rate;         // Rate of pushed audio
+    int channels;            // Interleaved channels of pushed audio
+    int ring_ms;             // Audio buffered for the worker; pushes beyond it are dropped
+    int hop_ms;              // Audio whose fingerprints each analysis pass emits
+    int context_ms;          // Audio re-analysed on either side of a pass (0 = the profile's target zone)
+    int poll_interval_ms;    // Worker sleep while the ring is empty
+    FingerprintProfile profile;
+
+    StreamingConfig()
+        : sample_rate(44100), channels(2), ring_ms(2000), hop_ms(2000), context_ms(0),
+          poll_interval_ms(5) {}
+
+    /**
+     * Check the configuration
+     * @throws std::invalid_argument if a setting is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Streaming front end counters
+ */
+struct StreamingStats {
+    uint64_t frames_pushed;
+    uint64_t frames_dropped;       // Pushed while the ring was full
+    uint64_t passes;
+    uint64_t failed_passes;
+    uint64_t fingerprints_emitted;
+    size_t ring_capacity_frames;
+    size_t ring_high_water_frames; // Fullest the ring has been after a push
+    double max_pass_ms;
+    std::string last_error;
+
+    StreamingStats() : frames_pushed(0), frames_dropped(0), passes(0), failed_passes(0), fingerprints_emitted(0),
+                       ring_capacity_frames(0), ring_high_water_frames(0), max_pass_ms(0.0) {}
+};
+
+/**
+ * Fingerprints audio pushed from a realtime audio callback.
+ *
+ * push() only copies whole frames into a preallocated SpscRing and updates
+ * a few atomics: it never allocates, locks, waits or makes a system call,
+ * and drops what does not fit instead of blocking. A worker thread polls
+ * the ring, mixes the audio down and fingerprints it in overlapping passes.
+ * Each pass analyses hop_ms of audio plus context_ms on either side, so
+ * landmarks near the hop's edges see the same peaks and targets as in a
+ * whole-file analysis, and emits the fingerprints anchored inside the hop.
+ * Pass boundaries lie on the profile's STFT frame grid. Time offsets count
+ * from the first pushed frame.
+ */
+class StreamingFingerprinter {
+public:
+    /**
+     * Called on the worker thread with the fingerprints of each pass
+     */
+    using EmitCallback = std::function<void(const std::vector<Fingerprint>&)>;
+
+    /**
+     * Constructor; starts the worker
+     * @param config Stream format and analysis settings
+     * @param on_fingerprints Receives emitted fingerprints; if empty they are
+     *                        queued for take_fingerprints()
+     * @throws std::invalid_argument if the configuration is invalid
+     */
+    explicit StreamingFingerprinter(const StreamingConfig& config = StreamingConfig(),
+                                    EmitCallback on_fingerprints = EmitCallback());
+
+    /**
+     * Destructor - finishes the stream
+     */
+    ~StreamingFingerprinter();
+
+    StreamingFingerprinter(const StreamingFingerprinter&) = delete;
+    StreamingFingerprinter& operator=(const StreamingFingerprinter&) = delete;
+
+    /**
+     * Queue audio for fingerprinting; realtime-safe and wait-free. Call from
+     * one thread at a time.
+     * @param samples Interleaved samples
+     * @param frames Number of frames
+     * @return Frames accepted; the rest were dropped because the ring was full
+     *         or the stream is finished
+     */
+    size_t push(const float* samples, size_t frames);
+
+    /**
+     * Fingerprint the remaining audio and stop the worker. Blocks; not realtime-safe.
+     */
+    void finish();
+
+    /**
+     * Remove the fingerprints queued so far (when no callback was given)
+     */
+    std::vector<Fingerprint> take_fingerprints();
+
+    /**
+     * Get counters
+     */
+    StreamingStats get_stats() const;
+
+    const StreamingConfig& get_config() const { return config_; }
+
+private:
+    StreamingConfig config_;
+    EmitCallback on_fingerprints_;
+    SpscRing ring_;
+
+    // Producer-side counters
+    std::atomic<uint64_t> frames_pushed_;
+    std::atomic<uint64_t> frames_dropped_;
+    std::atomic<size_t> ring_high_water_;
+    std::atomic<bool> finishing_;
+
+    // Analysis grid in input frames, and pass geometry in grid steps
+    double step_frames_;
+    double step_ms_;
+    int64_t hop_steps_;
+    int64_t context_steps_;
+
+    // Worker state
+    std::vector<float> mono_;     // Input-rate mono audio from frame mono_start_
+    int64_t mono_start_;
+    int64_t next_step_;           // First grid step whose anchors are not yet emitted
+    std::thread worker_;
+
+    mutable AuditedMutex mutex_;  // Guards the fields below
+    std::vector<Fingerprint> queued_;
+    uint64_t passes_;
+    uint64_t failed_passes_;
+    uint64_t fingerprints_emitted_;
+    double max_pass_ms_;
+    std::string last_error_;
+
+    /**
+     * Worker thread main loop
+     */
+    void worker_loop();
+
+    /**
+     * Input frame at which a grid step starts
+     */
+    int64_t step_frame(int64_t step) const;
+
+    /**
+     * Fingerprint the audio around the next hop (or everything left when final)
+     * and emit the fingerprints anchored in it
+     */
+    void run_pass(HashGenerator& generator, bool final_pass);
+};
+
+} // namespace AudioFingerprint
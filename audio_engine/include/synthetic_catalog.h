@@ -0,0 +1,181 @@
+#pragma once
+
+#include "fingerprint_index.h"
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+
+namespace AudioFingerprint {
+
+/**
+ * Draws ranks 1..n with probability proportional to rank^-exponent, in
+ * constant time per draw (rejection-inversion, Hörmann and Derflinger 1996)
+ */
+class ZipfSampler {
+public:
+    /**
+     * Constructor
+     * @param n Number of ranks
+     * @param exponent Skew; 0 is uniform, around 1 is typical of landmark hashes
+     * @throws std::invalid_argument if n is zero or the exponent is negative
+     */
+    ZipfSampler(uint64_t n, double exponent);
+
+    /**
+     * Draw a rank in [1, n]
+     */
+    uint64_t operator()(std::mt19937_64& rng) const;
+
+private:
+    uint64_t n_;
+    double exponent_;
+    double h_integral_x1_;
+    double h_integral_n_;
+    double s_;
+
+    double h(double x) const;
+    double h_integral(double x) const;
+    double h_integral_inverse(double x) const;
+};
+
+/**
+ * Shape of a synthetic catalog
+ */
+struct SyntheticCatalogConfig {
+    uint32_t songs;
+    int fingerprints_per_song;
+    uint32_t distinct_hashes;     // Hash values in use; ranks map onto them one to one
+    double zipf_exponent;         // Skew of hash frequencies across the catalog
+    int song_duration_ms;
+    uint64_t seed;
+
+    SyntheticCatalogConfig()
+        : songs(10000), fingerprints_per_song(500), distinct_hashes(1u << 24), zipf_exponent(0.8),
+          song_duration_ms(200000), seed(1) {}
+
+    /**
+     * Check the configuration
+     * @throws std::invalid_argument if a setting is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Outcome of building an index from a synthetic catalog
+ */
+struct CatalogBuildStats {
+    uint32_t songs;
+    uint64_t postings;
+    size_t segments_flushed;
+    double add_ms;             // Generating songs and adding them to mutable segments
+    double flush_ms;
+    double merge_ms;           // Compacting the flushed segments into one
+    double top_percent_share;  // Fraction of postings under the most frequent 1% of hashes
+
+    CatalogBuildStats() : songs(0), postings(0), segments_flushed(0), add_ms(0.0), flush_ms(0.0), merge_ms(0.0),
+                          top_percent_share(0.0) {}
+};
+
+/**
+ * Query load for a benchmark run
+ */
+struct QueryBenchmarkConfig {
+    int queries;
+    int concurrency;           // Threads issuing queries at once
+    int query_ms;              // Length of the excerpt each query is cut from
+    double noise_fraction;     // Fraction of query hashes replaced by unrelated ones
+    int max_results;
+    int min_matches;
+    uint64_t seed;
+
+    QueryBenchmarkConfig()
+        : queries(1000), concurrency(1), query_ms(10000), noise_fraction(0.5), max_results(5), min_matches(5),
+          seed(7) {}
+
+    /**
+     * Check the configuration
+     * @throws std::invalid_argument if a setting is out of range
+     */
+    void validate() const;
+};
+
+/**
+ * Latencies and accuracy of a benchmark run
+ */
+struct QueryBenchmarkResult {
+    std::vector<double> latencies_ms;   // Per query, in completion order
+    double wall_ms;
+    double top1_accuracy;               // Fraction whose best match is the excerpted song
+    double avg_query_fingerprints;
+
+    QueryBenchmarkResult() : wall_ms(0.0), top1_accuracy(0.0), avg_query_fingerprints(0.0) {}
+};
+
+/**
+ * Deterministic synthetic catalog for scaling benchmarks.
+ *
+ * A song's fingerprints are generated from the catalog seed and the song ID
+ * alone, so queries can be cut from any song without keeping the catalog in
+ * memory. Hash ranks are Zipf-distributed and mapped to 32-bit hash values
+ * by a bijective mixer, so a few hashes have very long posting lists, as
+ * with real landmarks; time offsets are uniform over the song.
+ */
+class SyntheticCatalog {
+public:
+    /**
+     * Constructor
+     * @param config Catalog shape
+     * @throws std::invalid_argument if the configuration is invalid
+     */
+    explicit SyntheticCatalog(const SyntheticCatalogConfig& config = SyntheticCatalogConfig());
+
+    /**
+     * Generate a song's fingerprints, ordered by time
+     * @param song_id Song in [1, songs]
+     */
+    std::vector<Fingerprint> song_fingerprints(uint32_t song_id) const;
+
+    /**
+     * Add every song to an index, flushing a segment every songs_per_segment
+     * songs and merging the segments at the end
+     * @param index Empty index to fill
+     * @param songs_per_segment Songs per flushed segment
+     * @throws std::invalid_argument if songs_per_segment is not positive
+     */
+    CatalogBuildStats build(FingerprintIndex& index, uint32_t songs_per_segment) const;
+
+    /**
+     * Query an index built from this catalog with excerpts of random songs
+     * @param index Index built by build()
+     * @param config Query load
+     * @throws std::invalid_argument if the configuration is invalid
+     */
+    QueryBenchmarkResult benchmark_queries(const FingerprintIndex& index, const QueryBenchmarkConfig& config) const;
+
+    const SyntheticCatalogConfig& get_config() const { return config_; }
+
+private:
+    SyntheticCatalogConfig config_;
+    ZipfSampler ranks_;
+
+    /**
+     * Hash value of a frequency rank
+     */
+    uint32_t rank_hash(uint64_t rank) const;
+
+    /**
+     * Generate a song's fingerprints
+     * @param top_rank_postings If not null, incremented per fingerprint among the top 1% of ranks
+     */
+    std::vector<Fingerprint> generate_song(uint32_t song_id, uint64_t* top_rank_postings) const;
+
+    /**
+     * Cut a query from a random song, with noise hashes mixed in
+     * @param song_id Set to the excerpted song
+     */
+    std::vector<Fingerprint> make_query(std::mt19937_64& rng, const QueryBenchmarkConfig& config,
+                                        uint32_t& song_id) const;
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "fingerprint_index.h"
+#include "fingerprint_profile.h"
+#include "audio_types.h"
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+namespace AudioFingerprint {
+
+/**
+ * Settings of two-tier query processing
+ */
+struct TieredQueryConfig {
+    FingerprintProfile sparse;   // First pass: few peaks, small fan-out
+    FingerprintProfile dense;    // Escalation pass: the full query profile
+    float min_margin;            // Escalate when (top1 - top2) / top1 of the sparse pass is below this
+    int min_votes;               // Escalate when the sparse top match has fewer aligned votes
+    int max_results;
+    int min_matches;
+
+    /**
+     * Constructor; dense is FingerprintProfile::query() and sparse is
+     * sparse_profile(dense)
+     */
+    TieredQueryConfig();
+
+    /**
+     * Check both profiles and that they hash alike
+     * @throws std::invalid_argument on an invalid setting
+     */
+    void validate() const;
+};
+
+/**
+ * Thinned-out counterpart of a query profile for the first pass: fewer,
+ * stronger peaks and a fan-out of 3, hashing like the original
+ * @param dense Full query profile
+ * @return Sparse profile
+ */
+FingerprintProfile sparse_profile(const FingerprintProfile& dense);
+
+/**
+ * Outcome of one two-tier query
+ */
+struct TieredQueryResult {
+    std::vector<IndexMatch> matches;   // From the dense pass if escalated, else the sparse pass
+    bool escalated;
+    float sparse_margin;               // (top1 - top2) / top1 of the sparse pass, 0 without a match
+    size_t sparse_fingerprints;
+    size_t dense_fingerprints;         // 0 unless escalated
+    double analysis_ms;                // Preprocessing and STFT, shared by both passes
+    double sparse_ms;                  // Sparse peaks, hashing and lookup
+    double dense_ms;                   // Dense peaks, hashing and lookup (0 unless escalated)
+
+    TieredQueryResult()
+        : escalated(false), sparse_margin(0.0f), sparse_fingerprints(0), dense_fingerprints(0),
+          analysis_ms(0.0), sparse_ms(0.0), dense_ms(0.0) {}
+};
+
+/**
+ * Cumulative two-tier counters
+ */
+struct TieredQueryStats {
+    uint64_t queries;
+    uint64_t escalated;
+    double analysis_ms;
+    double sparse_ms;
+    double dense_ms;
+    double escalated_audio_ms;   // Query audio that went through the dense pass
+
+    TieredQueryStats()
+        : queries(0), escalated(0), analysis_ms(0.0), sparse_ms(0.0), dense_ms(0.0),
+          escalated_audio_ms(0.0) {}
+
+    double escalation_rate() const {
+        return queries ? static_cast<double>(escalated) / static_cast<double>(queries) : 0.0;
+    }
+};
+
+/**
+ * Two-tier query processing against a fingerprint index.
+ *
+ * Most queries are identified clearly from a sparse fingerprint set. Each
+ * query is first fingerprinted and matched with the sparse profile; only when
+ * its top match is weak or close to the runner-up are the dense peaks picked
+ * from the same spectrogram and matched again. The STFT, the bulk of the
+ * analysis cost, is computed once for both passes.
+ */
+class TieredQueryProcessor {
+public:
+    /**
+     * Constructor
+     * @param index Index to match against; must outlive the processor
+     * @param config Profiles and escalation thresholds
+     */
+    TieredQueryProcessor(const FingerprintIndex& index, const TieredQueryConfig& config = TieredQueryConfig());
+
+    /**
+     * Identify an audio sample; thread-safe
+     * @param sample Query audio
+     * @return Matches and per-pass timings
+     */
+    TieredQueryResult identify(const AudioSample& sample);
+
+    /**
+     * Get cumulative counters
+     */
+    TieredQueryStats get_stats() const;
+
+    /**
+     * Estimate the time saved against running every query at full density: the
+     * dense passes skipped, priced at the dense-pass cost per second of audio
+     * measured on escalated queries, minus all sparse passes
+     * @return Estimated saving in ms (0 until a query has escalated)
+     */
+    double estimated_saved_ms() const;
+
+    const TieredQueryConfig& get_config() const { return config_; }
+
+private:
+    const FingerprintIndex& index_;
+    TieredQueryConfig config_;
+
+    mutable std::mutex mutex_;   // Guards the fields below
+    TieredQueryStats stats_;
+    double unescalated_audio_ms_;
+
+    /**
+     * Spectrogram of one analysis phase
+     */
+    struct PhaseSpectrogram {
+        int shift;                // Samples skipped at the preprocessed rate
+        Spectrogram spectrogram;
+    };
+
+    /**
+     * Pick peaks, hash and look up one pass over all analysis phases
+     */
+    std::vector<IndexMatch> run_pass(const std::vector<PhaseSpectrogram>& spectrograms, int sample_rate,
+                                     const FingerprintProfile& profile, size_t& fingerprint_count) const;
+
+    /**
+     * Relative lead of the top match over the runner-up
+     */
+    static float margin(const std::vector<IndexMatch>& matches);
+};
+
+} // namespace AudioFingerprint
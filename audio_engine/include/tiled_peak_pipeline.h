@@ -0,0 +1,74 @@
+#pragma once
+
+#include "fft_processor.h"
+#include "peak_detector.h"
+#include <vector>
+
+namespace AudioFingerprint {
+
+/**
+ * Fused STFT and peak detection over tiles of frames.
+ *
+ * Frames are computed a tile at a time into a small ring buffer and scanned for
+ * local maxima while still cache resident. Only the tile plus the context frames
+ * the detector needs on either side are kept, so the full spectrogram is never
+ * materialised. The resulting constellation is identical to running
+ * FFTProcessor::compute_stft followed by PeakDetector::detect_peaks.
+ */
+class TiledPeakPipeline {
+public:
+    /**
+     * Constructor
+     * @param fft_size Size of FFT window (must be power of 2)
+     * @param hop_size Number of samples between frames
+     * @param tile_frames Frames computed per tile (0 = this host's tuned size, see EngineTuning)
+     */
+    TiledPeakPipeline(int fft_size = 2048, int hop_size = 1024, int tile_frames = 0);
+
+    ~TiledPeakPipeline() = default;
+
+    TiledPeakPipeline(const TiledPeakPipeline&) = delete;
+    TiledPeakPipeline& operator=(const TiledPeakPipeline&) = delete;
+
+    /**
+     * Compute the constellation map of an audio signal
+     * @param audio_data Preprocessed mono audio samples
+     * @param peak_detector Detector providing thresholds and suppression
+     * @return Constellation map with detected peaks
+     */
+    ConstellationMap detect_peaks(const std::vector<float>& audio_data, const PeakDetector& peak_detector);
+
+    /**
+     * Get FFT window size
+     */
+    int get_fft_size() const { return fft_processor_.get_fft_size(); }
+
+    /**
+     * Get number of samples between frames
+     */
+    int get_hop_size() const { return hop_size_; }
+
+    /**
+     * Get number of frames per tile
+     */
+    int get_tile_frames() const { return tile_frames_; }
+
+    /**
+     * Get size of the frame ring buffer in bytes
+     */
+    size_t working_set_bytes() const;
+
+private:
+    FFTProcessor fft_processor_;
+    int hop_size_;
+    int tile_frames_;
+    std::vector<float> ring_;           // Resident frames, ring_capacity() rows of bins
+    std::vector<const float*> rows_;    // Absolute frame -> resident row (null once evicted)
+
+    /**
+     * Number of frames held in the ring buffer
+     */
+    int ring_capacity() const;
+};
+
+} // namespace AudioFingerprint
@@ -0,0 +1,786 @@
+#!/usr/bin/env python3
+"""
+Catalog-scale index benchmark on synthetic postings.
+
+Builds a fingerprint index from a synthetic catalog at each of several
+scales (see synthetic_catalog.h) and measures build time, index bytes,
+resident memory and query latency at several concurrency levels. Hash
+frequencies are Zipf-distributed, so a few hashes have very long posting
+lists as with real landmarks, and queries are excerpts of catalog songs
+with noise hashes mixed in. The report fits a power law to every metric
+against catalog size: an exponent near 1 means the metric grows linearly
+with the catalog.
+
+Scales whose index would not fit the byte budget or the free disk space are
+skipped and their metrics extrapolated from the fit over the measured ones.
+
+The threads command measures one catalog instead, with long queries scored
+by an increasing number of threads, to show how parallel scoring scales on
+this host's cores.
+
+The reorder command builds a catalog whose songs share hashes within
+groups, as covers and releases of one recording do, and measures what
+reorder_songs() (see song_reorder.h) saves in song ID bytes per posting and
+how fast the postings decode before and after.
+
+The ingest command measures durable ingest (see ingest_wal.h) instead:
+songs per second from concurrent writers at several group-commit windows,
+and how many log syncs they shared.
+
+The pools command measures query latency alone, next to bulk ingest of audio
+files, and with the two split across CPU pools (see cpu_pool.h), to show how
+well a query pool shields interactive queries from ingest.
+
+The sidecar command measures the round trip through the matcher sidecar
+(see matcher_sidecar.h), for empty queries and for catalog excerpts,
+against querying the index directly.
+
+Usage:
+    python index_benchmark.py run WORK_DIR [--scales 10000,100000,1000000,10000000]
+                              [--concurrency 1,4,16] [--max-index-bytes BYTES] [--output REPORT]
+    python index_benchmark.py report REPORT
+    python index_benchmark.py threads WORK_DIR [--songs 5000] [--threads 1,2,4,8]
+    python index_benchmark.py reorder WORK_DIR [--songs 20000] [--groups 200]
+    python index_benchmark.py ingest WORK_DIR [--windows 0,500,2000,5000] [--threads 8]
+    python index_benchmark.py pools WORK_DIR [--songs 3000] [--ingest-files 8] [--query-cpus N]
+    python index_benchmark.py sidecar WORK_DIR [--songs 2000] [--round-trips 2000] [--workers 1]
+"""
+
+import argparse
+import json
+import logging
+import math
+import os
+import shutil
+import sys
+import threading
+import time
+import wave
+from dataclasses import dataclass, field, asdict
+from typing import Dict, List, Optional, Sequence
+
+import numpy as np
+
+try:
+    from . import audio_fingerprint_engine as afe
+except ImportError:
+    import audio_fingerprint_engine as afe
+
+DEFAULT_SCALES = (10_000, 100_000, 1_000_000, 10_000_000)
+DEFAULT_CONCURRENCY = (1, 4, 16)
+DEFAULT_MAX_INDEX_BYTES = 16 << 30
+PERCENTILES = (50, 99)
+# Segment bytes per posting assumed before the first scale is measured
+INITIAL_BYTES_PER_POSTING = 16.0
+# Merging holds the inputs and the merged segment on disk at once
+MERGE_DISK_FACTOR = 2.0
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass
+class ConcurrencyResult:
+    """Query latency at one concurrency level"""
+    concurrency: int
+    queries: int
+    qps: float
+    latency_ms: Dict[str, float]
+    top1_accuracy: float
+
+
+@dataclass
+class ScaleResult:
+    """Measurements of the index built at one catalog size"""
+    songs: int
+    postings: int
+    measured: bool                  # False: skipped, metrics extrapolated
+    skip_reason: str = ""
+    build_ms: float = 0.0
+    add_ms: float = 0.0
+    flush_ms: float = 0.0
+    merge_ms: float = 0.0
+    index_bytes: int = 0
+    bytes_per_posting: float = 0.0
+    open_ms: float = 0.0
+    rss_open_mb: float = 0.0        # Resident growth from opening the index
+    rss_query_mb: float = 0.0       # Resident growth once queries have touched it
+    top_percent_share: float = 0.0
+    queries: List[ConcurrencyResult] = field(default_factory=list)
+
+
+@dataclass
+class ScalingReport:
+    """Benchmark results across catalog sizes"""
+    catalog: Dict
+    query_load: Dict
+    max_index_bytes: int
+    scales: List[ScaleResult] = field(default_factory=list)
+    exponents: Dict[str, float] = field(default_factory=dict)   # Fitted d log(metric) / d log(songs)
+
+
+def latency_summary(values: List[float]) -> Dict[str, float]:
+    """Nearest-rank percentiles and mean of a latency sample"""
+    if not values:
+        return {}
+
+    ordered = sorted(values)
+    summary = {}
+    for p in PERCENTILES:
+        rank = max(1, -(-p * len(ordered) // 100))
+        summary[f"p{p}"] = ordered[rank - 1]
+    summary["mean"] = sum(ordered) / len(ordered)
+    return summary
+
+
+def _resident_mb() -> float:
+    """Resident set size of this process, or 0 where /proc is unavailable"""
+    try:
+        with open("/proc/self/statm") as f:
+            return int(f.read().split()[1]) * os.sysconf("SC_PAGE_SIZE") / (1 << 20)
+    except (OSError, ValueError, IndexError):
+        return 0.0
+
+
+def _metrics(result: ScaleResult) -> Dict[str, float]:
+    """Scalar metrics of a scale, keyed as in ScalingReport.exponents"""
+    metrics = {
+        "build_ms": result.build_ms,
+        "index_bytes": float(result.index_bytes),
+        "rss_query_mb": result.rss_query_mb,
+    }
+    for run in result.queries:
+        for key, value in run.latency_ms.items():
+            metrics[f"c{run.concurrency}_{key}_ms"] = value
+        metrics[f"c{run.concurrency}_qps"] = run.qps
+    return metrics
+
+
+def fit_power_law(points: Sequence[tuple]) -> Optional[tuple]:
+    """
+    Least-squares fit of y = a * x^b in log-log space.
+
+    Returns:
+        (a, b), or None with fewer than two usable points
+    """
+    usable = [(math.log(x), math.log(y)) for x, y in points if x > 0 and y > 0]
+    if len(usable) < 2:
+        return None
+
+    mean_x = sum(x for x, _ in usable) / len(usable)
+    mean_y = sum(y for _, y in usable) / len(usable)
+    var_x = sum((x - mean_x) ** 2 for x, _ in usable)
+    if var_x == 0:
+        return None
+
+    b = sum((x - mean_x) * (y - mean_y) for x, y in usable) / var_x
+    return math.exp(mean_y - b * mean_x), b
+
+
+def measure_scale(work_dir: str, songs: int, catalog_args: Dict, query_args: Dict,
+                  concurrency: Sequence[int], songs_per_segment: int, keep: bool) -> ScaleResult:
+    """Build the index of one catalog size and benchmark queries against it"""
+    index_dir = os.path.join(work_dir, f"songs-{songs}")
+    shutil.rmtree(index_dir, ignore_errors=True)
+
+    catalog = afe.SyntheticCatalog(songs=songs, **catalog_args)
+    try:
+        index = afe.FingerprintIndex(index_dir)
+        start = time.perf_counter()
+        build = catalog.build(index, songs_per_segment)
+        build_ms = (time.perf_counter() - start) * 1000.0
+        index_bytes = index.get_stats()["segment_bytes"]
+        del index
+
+        # Reopen so the resident numbers cover the built index alone
+        rss_before = _resident_mb()
+        start = time.perf_counter()
+        index = afe.FingerprintIndex(index_dir)
+        open_ms = (time.perf_counter() - start) * 1000.0
+        rss_open = _resident_mb() - rss_before
+
+        runs = []
+        for level in concurrency:
+            bench = catalog.benchmark_queries(index, concurrency=level, **query_args)
+            wall_s = bench["wall_ms"] / 1000.0
+            runs.append(ConcurrencyResult(
+                concurrency=level,
+                queries=len(bench["latencies_ms"]),
+                qps=len(bench["latencies_ms"]) / wall_s if wall_s > 0 else 0.0,
+                latency_ms=latency_summary(bench["latencies_ms"]),
+                top1_accuracy=bench["top1_accuracy"],
+            ))
+            logger.info(f"{songs} songs, concurrency {level}: p50 {runs[-1].latency_ms['p50']:.2f} ms, "
+                        f"p99 {runs[-1].latency_ms['p99']:.2f} ms, {runs[-1].qps:.0f} qps")
+        rss_query = _resident_mb() - rss_before
+        del index
+    finally:
+        if not keep:
+            shutil.rmtree(index_dir, ignore_errors=True)
+
+    return ScaleResult(
+        songs=songs,
+        postings=build["postings"],
+        measured=True,
+        build_ms=build_ms,
+        add_ms=build["add_ms"],
+        flush_ms=build["flush_ms"],
+        merge_ms=build["merge_ms"],
+        index_bytes=index_bytes,
+        bytes_per_posting=index_bytes / build["postings"] if build["postings"] else 0.0,
+        open_ms=open_ms,
+        rss_open_mb=rss_open,
+        rss_query_mb=rss_query,
+        top_percent_share=build["top_percent_share"],
+        queries=runs,
+    )
+
+
+def _extrapolate(result: ScaleResult, measured: List[ScaleResult], concurrency: Sequence[int]) -> None:
+    """Fill a skipped scale's metrics from power laws fitted to the measured scales"""
+    def predict(metric: str) -> float:
+        fit = fit_power_law([(m.songs, _metrics(m).get(metric, 0.0)) for m in measured])
+        return fit[0] * result.songs ** fit[1] if fit else 0.0
+
+    result.build_ms = predict("build_ms")
+    result.index_bytes = int(predict("index_bytes"))
+    result.bytes_per_posting = result.index_bytes / result.postings if result.postings else 0.0
+    result.rss_query_mb = predict("rss_query_mb")
+    for level in concurrency:
+        latency = {f"p{p}": predict(f"c{level}_p{p}_ms") for p in PERCENTILES}
+        result.queries.append(ConcurrencyResult(concurrency=level, queries=0, qps=predict(f"c{level}_qps"),
+                                                latency_ms=latency, top1_accuracy=0.0))
+
+
+def run_benchmark(work_dir: str, scales: Sequence[int] = DEFAULT_SCALES,
+                  concurrency: Sequence[int] = DEFAULT_CONCURRENCY,
+                  max_index_bytes: int = DEFAULT_MAX_INDEX_BYTES, fingerprints_per_song: int = 500,
+                  distinct_hashes: int = 1 << 24, zipf_exponent: float = 0.8, queries: int = 1000,
+                  query_ms: int = 10000, noise_fraction: float = 0.5, songs_per_segment: int = 10000,
+                  seed: int = 1, keep: bool = False) -> ScalingReport:
+    """
+    Benchmark index builds and queries across catalog sizes.
+
+    Args:
+        work_dir: Directory for the index builds
+        scales: Catalog sizes in songs, measured smallest first
+        concurrency: Query concurrency levels measured at every scale
+        max_index_bytes: Skip scales whose index is expected to exceed this
+        fingerprints_per_song: Postings each song adds
+        distinct_hashes: Hash values in use across the catalog
+        zipf_exponent: Skew of hash frequencies
+        queries: Queries per concurrency level
+        query_ms: Length of the excerpt each query is cut from
+        noise_fraction: Fraction of query hashes replaced by unrelated ones
+        songs_per_segment: Songs per flushed segment, which bounds build memory
+        seed: Catalog seed
+        keep: Keep the index builds instead of deleting each after measuring it
+    """
+    if not scales or any(songs <= 0 for songs in scales):
+        raise ValueError("Scales must be positive song counts")
+    if not concurrency or any(level <= 0 for level in concurrency):
+        raise ValueError("Concurrency levels must be positive")
+
+    os.makedirs(work_dir, exist_ok=True)
+    catalog_args = {"fingerprints_per_song": fingerprints_per_song, "distinct_hashes": distinct_hashes,
+                    "zipf_exponent": zipf_exponent, "seed": seed}
+    query_args = {"queries": queries, "query_ms": query_ms, "noise_fraction": noise_fraction}
+    report = ScalingReport(catalog=catalog_args, query_load=query_args, max_index_bytes=max_index_bytes)
+
+    measured: List[ScaleResult] = []
+    for songs in sorted(scales):
+        postings = songs * fingerprints_per_song
+        bytes_per_posting = measured[-1].bytes_per_posting if measured else INITIAL_BYTES_PER_POSTING
+        expected_bytes = postings * bytes_per_posting
+        free_bytes = shutil.disk_usage(work_dir).free
+
+        skip_reason = ""
+        if expected_bytes > max_index_bytes:
+            skip_reason = f"expected {expected_bytes / (1 << 30):.1f} GiB index exceeds the byte budget"
+        elif expected_bytes * MERGE_DISK_FACTOR > free_bytes:
+            skip_reason = f"expected {expected_bytes / (1 << 30):.1f} GiB index does not fit the free disk space"
+
+        if skip_reason:
+            logger.info(f"Skipping {songs} songs: {skip_reason}")
+            report.scales.append(ScaleResult(songs=songs, postings=postings, measured=False,
+                                             skip_reason=skip_reason))
+            continue
+
+        logger.info(f"Building {songs} songs ({postings} postings)")
+        result = measure_scale(work_dir, songs, catalog_args, query_args, concurrency, songs_per_segment, keep)
+        measured.append(result)
+        report.scales.append(result)
+
+    for result in report.scales:
+        if not result.measured:
+            _extrapolate(result, measured, concurrency)
+
+    if measured:
+        for metric in _metrics(measured[0]):
+            fit = fit_power_law([(m.songs, _metrics(m).get(metric, 0.0)) for m in measured])
+            if fit:
+                report.exponents[metric] = fit[1]
+
+    return report
+
+
+def run_thread_scaling(work_dir: str, songs: int = 5_000, threads: Sequence[int] = (1, 2, 4, 8),
+                       fingerprints_per_song: int = 20_000, queries: int = 200, query_ms: int = 200_000,
+                       concurrency: int = 1, seed: int = 1) -> Dict:
+    """
+    Measure long-query latency as the number of scoring threads grows.
+
+    Args:
+        work_dir: Directory for the index build, removed afterwards
+        songs: Catalog size in songs
+        threads: Scoring thread counts to measure
+        fingerprints_per_song: Postings each song adds; a query is split into
+                               at most one part per parallel_query_min_hashes
+                               of its hashes, so it must be dense enough
+        queries: Queries per thread count
+        query_ms: Length of each query excerpt; long enough to be split
+        concurrency: Queries in flight at once
+        seed: Catalog seed
+    """
+    if not threads or any(count <= 0 for count in threads):
+        raise ValueError("Thread counts must be positive")
+
+    index_dir = os.path.join(work_dir, f"threads-{songs}")
+    shutil.rmtree(index_dir, ignore_errors=True)
+    catalog = afe.SyntheticCatalog(songs=songs, fingerprints_per_song=fingerprints_per_song, seed=seed)
+    report = {"cpus": os.cpu_count(), "songs": songs, "fingerprints_per_song": fingerprints_per_song,
+              "query_ms": query_ms, "concurrency": concurrency, "runs": []}
+    try:
+        index = afe.FingerprintIndex(index_dir)
+        catalog.build(index)
+        for count in threads:
+            index.set_query_threads(count)
+            catalog.benchmark_queries(index, queries=max(1, queries // 10), concurrency=concurrency,
+                                      query_ms=query_ms)   # Warm-up
+            bench = catalog.benchmark_queries(index, queries=queries, concurrency=concurrency, query_ms=query_ms)
+            latency = latency_summary(bench["latencies_ms"])
+            report["runs"].append({"threads": count, "latency_ms": latency,
+                                   "top1_accuracy": bench["top1_accuracy"]})
+            logger.info(f"{count} scoring threads: p50 {latency['p50']:.2f} ms, p99 {latency['p99']:.2f} ms")
+        del index
+    finally:
+        shutil.rmtree(index_dir, ignore_errors=True)
+
+    serial = report["runs"][0]["latency_ms"]["p50"]
+    for run in report["runs"]:
+        run["speedup_p50"] = serial / run["latency_ms"]["p50"] if run["latency_ms"]["p50"] > 0 else 0.0
+    return report
+
+
+def run_reorder(work_dir: str, songs: int = 20_000, groups: int = 200, fingerprints_per_song: int = 300,
+                shared_fraction: float = 0.6, songs_per_segment: int = 5_000, probes: int = 200,
+                seed: int = 0) -> Dict:
+    """
+    Measure song ID coding and posting decode speed before and after
+    reordering songs by hash co-occurrence.
+
+    Args:
+        work_dir: Directory for the index build, removed afterwards
+        songs: Catalog size in songs
+        groups: Groups of songs drawing their shared hashes from one vocabulary
+        fingerprints_per_song: Postings each song adds
+        shared_fraction: Share of a song's hashes drawn from its group's vocabulary
+        songs_per_segment: Songs per flushed segment before reordering
+        probes: Songs queried before and after to check the results agree
+        seed: Catalog seed
+    """
+    if groups <= 0 or not 0.0 <= shared_fraction <= 1.0:
+        raise ValueError("Groups must be positive and the shared fraction in [0, 1]")
+
+    rng = np.random.default_rng(seed)
+    song_ids = rng.permutation(songs) + 1   # Song IDs in no particular order
+    shared = int(fingerprints_per_song * shared_fraction)
+    offsets = list(range(0, fingerprints_per_song * 40, 40))
+    catalog = {}
+    for i, song_id in enumerate(song_ids):
+        vocabulary = (i % groups) * 100_000
+        hashes = np.concatenate([vocabulary + rng.integers(0, 2_000, size=shared),
+                                 rng.integers(2**31, 2**32, size=fingerprints_per_song - shared)])
+        catalog[int(song_id)] = [int(h) for h in hashes]
+
+    index_dir = os.path.join(work_dir, f"reorder-{songs}")
+    shutil.rmtree(index_dir, ignore_errors=True)
+    try:
+        index = afe.FingerprintIndex(index_dir)
+        for n, (song_id, hashes) in enumerate(catalog.items()):
+            index.add_song(song_id, hashes, offsets)
+            if n % songs_per_segment == songs_per_segment - 1:
+                index.flush()
+        index.flush()
+
+        probe_ids = list(catalog)[::max(1, songs // probes)]
+        half = fingerprints_per_song // 2
+        expected = [index.query(catalog[song_id][:half], offsets[:half]) for song_id in probe_ids]
+        report = index.reorder_songs()
+        agreed = sum(index.query(catalog[song_id][:half], offsets[:half]) == matches
+                     for song_id, matches in zip(probe_ids, expected))
+        del index
+    finally:
+        shutil.rmtree(index_dir, ignore_errors=True)
+
+    report.update({"groups": groups, "shared_fraction": shared_fraction,
+                   "probe_agreement": agreed / len(probe_ids)})
+    for stage in ("before", "after"):
+        codec = report[stage]
+        logger.info(f"{stage}: {codec['id_bytes_per_posting']:.3f} song ID bytes/posting, "
+                    f"{codec['decode_mpostings_per_s']:.0f} M postings/s decoded")
+    return report
+
+
+def run_ingest_throughput(work_dir: str, windows: Sequence[int] = (0, 500, 2000, 5000), threads: int = 8,
+                          songs_per_thread: int = 25, fingerprints_per_song: int = 200, seed: int = 1) -> Dict:
+    """
+    Measure durable ingest throughput at several group-commit windows.
+
+    Args:
+        work_dir: Directory for the index builds, removed afterwards
+        windows: Commit windows in microseconds (0 = sync every song)
+        threads: Concurrent writers
+        songs_per_thread: Songs each writer adds
+        fingerprints_per_song: Postings each song adds
+        seed: Catalog seed
+    """
+    if threads <= 0 or songs_per_thread <= 0:
+        raise ValueError("Writers and songs per writer must be positive")
+
+    total = threads * songs_per_thread
+    catalog = afe.SyntheticCatalog(songs=total, fingerprints_per_song=fingerprints_per_song, seed=seed)
+    songs = {song_id: catalog.song_fingerprints(song_id) for song_id in range(1, total + 1)}
+    report = {"threads": threads, "songs": total, "fingerprints_per_song": fingerprints_per_song, "runs": []}
+
+    for window_us in windows:
+        index_dir = os.path.join(work_dir, f"ingest-{window_us}")
+        shutil.rmtree(index_dir, ignore_errors=True)
+        try:
+            index = afe.FingerprintIndex(index_dir, durable_ingest=True, commit_window_us=window_us)
+
+            def ingest(worker: int) -> None:
+                for song_id in range(worker * songs_per_thread + 1, (worker + 1) * songs_per_thread + 1):
+                    index.add_song(song_id, songs[song_id]["hash_values"], songs[song_id]["time_offsets"])
+
+            start = time.perf_counter()
+            writers = [threading.Thread(target=ingest, args=(worker,)) for worker in range(threads)]
+            for writer in writers:
+                writer.start()
+            for writer in writers:
+                writer.join()
+            elapsed = time.perf_counter() - start
+
+            stats = index.get_stats()
+            run = {"commit_window_us": window_us, "songs_per_s": total / elapsed if elapsed > 0 else 0.0,
+                   "wal_syncs": stats["wal_syncs"], "wal_records": stats["wal_records"]}
+            report["runs"].append(run)
+            logger.info(f"window {window_us} us: {run['songs_per_s']:.0f} songs/s, "
+                        f"{run['wal_syncs']} syncs for {run['wal_records']} songs")
+            del index
+        finally:
+            shutil.rmtree(index_dir, ignore_errors=True)
+
+    return report
+
+
+def _write_ingest_files(directory: str, count: int, seconds: float, sample_rate: int = 22050) -> List[str]:
+    """Write tone mixtures for the ingest load as 16-bit mono WAV files"""
+    paths = []
+    t = np.arange(int(sample_rate * seconds)) / sample_rate
+    for i in range(count):
+        rng = np.random.default_rng(i)
+        signal = sum(0.3 * np.sin(2 * np.pi * freq * t) for freq in rng.uniform(200, 3000, size=3))
+        path = os.path.join(directory, f"ingest_{i}.wav")
+        with wave.open(path, "wb") as wav_file:
+            wav_file.setnchannels(1)
+            wav_file.setsampwidth(2)
+            wav_file.setframerate(sample_rate)
+            wav_file.writeframes((signal / 1.5 * 32767).astype(np.int16).tobytes())
+        paths.append(path)
+    return paths
+
+
+def run_pool_isolation(work_dir: str, songs: int = 3_000, ingest_files: int = 8, ingest_seconds: float = 20.0,
+                       queries: int = 200, query_cpus: int = 0, seed: int = 3) -> Dict:
+    """
+    Measure query latency alone, next to concurrent bulk ingest, and with
+    queries and ingest in separate CPU pools.
+
+    Args:
+        work_dir: Directory for the index and ingest files, removed afterwards
+        songs: Catalog size in songs
+        ingest_files: Audio files the ingest load fingerprints in a loop
+        ingest_seconds: Length of each ingest file
+        queries: Queries per stage
+        query_cpus: CPUs reserved for the query pool (0 = a quarter of them);
+                    with a single CPU only the ingest pool's niceness separates them
+        seed: Catalog seed
+    """
+    cpus = sorted(os.sched_getaffinity(0)) if hasattr(os, "sched_getaffinity") else []
+    reserved = query_cpus or max(1, len(cpus) // 4)
+    query_pool_cpus = cpus[:reserved]
+    ingest_pool_cpus = cpus[reserved:] or cpus
+    afe.define_cpu_pool("bench_query", cpus=query_pool_cpus)
+    afe.define_cpu_pool("bench_ingest", cpus=ingest_pool_cpus, nice=10)
+
+    bench_dir = os.path.join(work_dir, f"pools-{songs}")
+    shutil.rmtree(bench_dir, ignore_errors=True)
+    os.makedirs(bench_dir)
+    report = {"cpus": len(cpus), "query_cpus": query_pool_cpus, "ingest_cpus": ingest_pool_cpus, "stages": []}
+    try:
+        paths = _write_ingest_files(bench_dir, ingest_files, ingest_seconds)
+        catalog = afe.SyntheticCatalog(songs=songs, seed=seed)
+        index = afe.FingerprintIndex(os.path.join(bench_dir, "index"))
+        catalog.build(index)
+
+        def measure(label: str, ingest_pool: Optional[str]) -> None:
+            stop = threading.Event()
+
+            def ingest():
+                while not stop.is_set():
+                    afe.batch_process_files(paths, [str(i) for i in range(len(paths))],
+                                            compute_threads=max(1, len(cpus)), thread_pool=ingest_pool)
+
+            worker = threading.Thread(target=ingest) if ingest_pool is not None else None
+            if worker:
+                worker.start()
+                time.sleep(0.2)
+            try:
+                bench = catalog.benchmark_queries(index, queries=queries)
+            finally:
+                stop.set()
+                if worker:
+                    worker.join()
+
+            latency = latency_summary(bench["latencies_ms"])
+            report["stages"].append({"stage": label, "latency_ms": latency,
+                                     "top1_accuracy": bench["top1_accuracy"]})
+            logger.info(f"{label}: p50 {latency['p50']:.3f} ms, p99 {latency['p99']:.3f} ms")
+
+        measure("alone", None)
+        measure("with ingest, shared", "")
+        index.set_thread_pools(query_pool="bench_query")
+        afe.reset_cpu_pool_stats()
+        measure("with ingest, partitioned", "bench_ingest")
+        report["pool_stats"] = afe.cpu_pool_stats()
+        del index
+    finally:
+        shutil.rmtree(bench_dir, ignore_errors=True)
+
+    return report
+
+
+def run_sidecar_latency(work_dir: str, songs: int = 2_000, round_trips: int = 2_000, query_hashes: int = 500,
+                        workers: int = 1, seed: int = 1) -> Dict:
+    """
+    Measure query round trips through the matcher sidecar against direct queries.
+
+    Args:
+        work_dir: Directory for the index build, removed afterwards
+        songs: Catalog size in songs
+        round_trips: Queries timed per stage
+        query_hashes: Hashes per query, taken from the start of catalog songs
+        workers: Sidecar threads serving queries
+        seed: Catalog seed
+    """
+    index_dir = os.path.join(work_dir, f"sidecar-{songs}")
+    shutil.rmtree(index_dir, ignore_errors=True)
+    catalog = afe.SyntheticCatalog(songs=songs, seed=seed)
+    report = {"cpus": os.cpu_count(), "songs": songs, "query_hashes": query_hashes, "workers": workers,
+              "stages": []}
+    try:
+        index = afe.FingerprintIndex(index_dir)
+        catalog.build(index)
+        rng = np.random.default_rng(seed)
+        queries = []
+        for song_id in rng.integers(1, songs + 1, 64):
+            song = catalog.song_fingerprints(int(song_id))
+            queries.append((song["hash_values"][:query_hashes], song["time_offsets"][:query_hashes]))
+
+        name = f"bench-{os.getpid()}"
+        sidecar = afe.MatcherSidecar(name, index, workers=workers)
+        try:
+            client = afe.MatcherClient(name)
+
+            def measure(label: str, run) -> None:
+                for i in range(min(100, round_trips)):   # Warm-up
+                    run(i)
+                latencies = []
+                for i in range(round_trips):
+                    start = time.perf_counter()
+                    run(i)
+                    latencies.append((time.perf_counter() - start) * 1e6)
+
+                latency = latency_summary(latencies)
+                report["stages"].append({"stage": label, "latency_us": latency})
+                logger.info(f"{label}: p50 {latency['p50']:.1f} us, p99 {latency['p99']:.1f} us")
+
+            measure("sidecar, empty query", lambda i: client.query([], [], 1, 1))
+            measure("direct", lambda i: index.query(*queries[i % len(queries)], 5, 5))
+            measure("sidecar", lambda i: client.query(*queries[i % len(queries)], 5, 5))
+            report["sidecar_stats"] = sidecar.get_stats()
+        finally:
+            sidecar.stop()
+        del index
+    finally:
+        shutil.rmtree(index_dir, ignore_errors=True)
+
+    return report
+
+
+def format_report(report: Dict) -> str:
+    """Render a scaling report as a text table"""
+    levels = [run["concurrency"] for run in report["scales"][0]["queries"]] if report["scales"] else []
+    header = f"{'songs':>10} {'build s':>9} {'index MB':>10} {'B/post':>7} {'rss MB':>8}"
+    for level in levels:
+        header += f" {f'c{level} p50':>9} {f'c{level} p99':>9}"
+    lines = [header]
+
+    for scale in report["scales"]:
+        line = (f"{scale['songs']:>10} {scale['build_ms'] / 1000.0:>9.1f} {scale['index_bytes'] / (1 << 20):>10.1f} "
+                f"{scale['bytes_per_posting']:>7.2f} {scale['rss_query_mb']:>8.1f}")
+        for run in scale["queries"]:
+            line += f" {run['latency_ms'].get('p50', 0.0):>9.2f} {run['latency_ms'].get('p99', 0.0):>9.2f}"
+        if not scale["measured"]:
+            line += "  (extrapolated)"
+        lines.append(line)
+
+    if report["exponents"]:
+        lines.append("")
+        lines.append("Growth exponents (1.0 = linear in catalog size):")
+        for metric, exponent in sorted(report["exponents"].items()):
+            lines.append(f"  {metric:<16} {exponent:.2f}")
+    return "\n".join(lines)
+
+
+def _int_list(value: str) -> List[int]:
+    return [int(item) for item in value.split(",") if item]
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Measure how index build, memory and latency scale with catalog size")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    run_parser = subparsers.add_parser("run", help="Build and benchmark synthetic catalogs")
+    run_parser.add_argument("work_dir")
+    run_parser.add_argument("--scales", type=_int_list, default=list(DEFAULT_SCALES),
+                            help="Comma-separated catalog sizes in songs")
+    run_parser.add_argument("--concurrency", type=_int_list, default=list(DEFAULT_CONCURRENCY),
+                            help="Comma-separated query concurrency levels")
+    run_parser.add_argument("--max-index-bytes", type=int, default=DEFAULT_MAX_INDEX_BYTES,
+                            help="Skip and extrapolate scales whose index would be larger")
+    run_parser.add_argument("--fingerprints-per-song", type=int, default=500)
+    run_parser.add_argument("--distinct-hashes", type=int, default=1 << 24)
+    run_parser.add_argument("--zipf-exponent", type=float, default=0.8, help="Skew of hash frequencies")
+    run_parser.add_argument("--queries", type=int, default=1000, help="Queries per concurrency level")
+    run_parser.add_argument("--query-ms", type=int, default=10000, help="Length of each query excerpt")
+    run_parser.add_argument("--noise-fraction", type=float, default=0.5,
+                            help="Fraction of query hashes replaced by unrelated ones")
+    run_parser.add_argument("--songs-per-segment", type=int, default=10000,
+                            help="Songs per flushed segment while building")
+    run_parser.add_argument("--seed", type=int, default=1)
+    run_parser.add_argument("--keep", action="store_true", help="Keep the index builds")
+    run_parser.add_argument("--output", help="Also write the report to this file")
+
+    report_parser = subparsers.add_parser("report", help="Print a saved report as a table")
+    report_parser.add_argument("report")
+
+    threads_parser = subparsers.add_parser("threads", help="Measure long-query latency per scoring thread count")
+    threads_parser.add_argument("work_dir")
+    threads_parser.add_argument("--songs", type=int, default=5_000)
+    threads_parser.add_argument("--threads", type=_int_list, default=[1, 2, 4, 8],
+                                help="Comma-separated scoring thread counts")
+    threads_parser.add_argument("--fingerprints-per-song", type=int, default=20_000)
+    threads_parser.add_argument("--queries", type=int, default=200, help="Queries per thread count")
+    threads_parser.add_argument("--query-ms", type=int, default=200_000, help="Length of each query excerpt")
+    threads_parser.add_argument("--concurrency", type=int, default=1, help="Queries in flight at once")
+    threads_parser.add_argument("--seed", type=int, default=1)
+
+    reorder_parser = subparsers.add_parser("reorder", help="Measure song ID coding before and after reordering")
+    reorder_parser.add_argument("work_dir")
+    reorder_parser.add_argument("--songs", type=int, default=20_000)
+    reorder_parser.add_argument("--groups", type=int, default=200, help="Groups of songs sharing hashes")
+    reorder_parser.add_argument("--fingerprints-per-song", type=int, default=300)
+    reorder_parser.add_argument("--shared-fraction", type=float, default=0.6,
+                                help="Share of a song's hashes drawn from its group")
+    reorder_parser.add_argument("--songs-per-segment", type=int, default=5_000)
+    reorder_parser.add_argument("--seed", type=int, default=0)
+
+    ingest_parser = subparsers.add_parser("ingest", help="Measure durable ingest throughput per commit window")
+    ingest_parser.add_argument("work_dir")
+    ingest_parser.add_argument("--windows", type=_int_list, default=[0, 500, 2000, 5000],
+                               help="Comma-separated commit windows in microseconds")
+    ingest_parser.add_argument("--threads", type=int, default=8, help="Concurrent writers")
+    ingest_parser.add_argument("--songs-per-thread", type=int, default=25)
+    ingest_parser.add_argument("--fingerprints-per-song", type=int, default=200)
+    ingest_parser.add_argument("--seed", type=int, default=1)
+
+    pools_parser = subparsers.add_parser("pools", help="Measure query latency next to ingest, with and without CPU pools")
+    pools_parser.add_argument("work_dir")
+    pools_parser.add_argument("--songs", type=int, default=3_000)
+    pools_parser.add_argument("--ingest-files", type=int, default=8, help="Audio files the ingest load fingerprints")
+    pools_parser.add_argument("--ingest-seconds", type=float, default=20.0, help="Length of each ingest file")
+    pools_parser.add_argument("--queries", type=int, default=200, help="Queries per stage")
+    pools_parser.add_argument("--query-cpus", type=int, default=0,
+                              help="CPUs reserved for queries (0 = a quarter of them)")
+    pools_parser.add_argument("--seed", type=int, default=3)
+
+    sidecar_parser = subparsers.add_parser("sidecar", help="Measure the matcher sidecar round trip against direct queries")
+    sidecar_parser.add_argument("work_dir")
+    sidecar_parser.add_argument("--songs", type=int, default=2_000)
+    sidecar_parser.add_argument("--round-trips", type=int, default=2_000, help="Queries timed per stage")
+    sidecar_parser.add_argument("--query-hashes", type=int, default=500, help="Hashes per query")
+    sidecar_parser.add_argument("--workers", type=int, default=1, help="Sidecar threads serving queries")
+    sidecar_parser.add_argument("--seed", type=int, default=1)
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "run":
+        report = asdict(run_benchmark(
+            args.work_dir, args.scales, args.concurrency, args.max_index_bytes, args.fingerprints_per_song,
+            args.distinct_hashes, args.zipf_exponent, args.queries, args.query_ms, args.noise_fraction,
+            args.songs_per_segment, args.seed, args.keep))
+        if args.output:
+            with open(args.output, "w") as f:
+                json.dump(report, f)
+        print(json.dumps(report))
+        return 0
+
+    if args.command == "threads":
+        os.makedirs(args.work_dir, exist_ok=True)
+        print(json.dumps(run_thread_scaling(args.work_dir, args.songs, args.threads, args.fingerprints_per_song,
+                                            args.queries, args.query_ms, args.concurrency, args.seed)))
+        return 0
+
+    if args.command == "reorder":
+        os.makedirs(args.work_dir, exist_ok=True)
+        print(json.dumps(run_reorder(args.work_dir, args.songs, args.groups, args.fingerprints_per_song,
+                                     args.shared_fraction, args.songs_per_segment, seed=args.seed)))
+        return 0
+
+    if args.command == "ingest":
+        os.makedirs(args.work_dir, exist_ok=True)
+        print(json.dumps(run_ingest_throughput(args.work_dir, args.windows, args.threads, args.songs_per_thread,
+                                               args.fingerprints_per_song, args.seed)))
+        return 0
+
+    if args.command == "pools":
+        os.makedirs(args.work_dir, exist_ok=True)
+        print(json.dumps(run_pool_isolation(args.work_dir, args.songs, args.ingest_files, args.ingest_seconds,
+                                            args.queries, args.query_cpus, args.seed)))
+        return 0
+
+    if args.command == "sidecar":
+        os.makedirs(args.work_dir, exist_ok=True)
+        print(json.dumps(run_sidecar_latency(args.work_dir, args.songs, args.round_trips, args.query_hashes,
+                                             args.workers, args.seed)))
+        return 0
+
+    with open(args.report) as f:
+        print(format_report(json.load(f)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+"""
+Read-replica shipping for the segmented fingerprint index.
+
+A primary index directory contains immutable segment files and a MANIFEST
+naming the segments of the current snapshot (see fingerprint_index.h).
+Replication copies only the segments the replica does not have yet, verifies
+their size and CRC-32, and then switches the replica to the new snapshot by
+atomically replacing its MANIFEST. Segments no longer referenced are deleted
+afterwards, so a replica process reading the old snapshot never sees a
+missing file before it reloads.
+
+Usage:
+    python index_replication.py replicate PRIMARY_DIR REPLICA_DIR [--watch SECONDS]
+    python index_replication.py status PRIMARY_DIR REPLICA_DIR
+"""
+
+import argparse
+import json
+import logging
+import os
+import sys
+import time
+import zlib
+from dataclasses import dataclass, field, asdict
+from typing import List, Optional
+
+MANIFEST_NAME = "MANIFEST"
+MANIFEST_HEADER = "AFINDEX-MANIFEST 1"
+COPY_CHUNK_BYTES = 1 << 20
+MAX_SNAPSHOT_RETRIES = 3
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass
+class SegmentInfo:
+    """One segment line of a MANIFEST"""
+    segment_id: int
+    file_name: str
+    size_bytes: int
+    crc32: int
+    song_count: int
+    posting_count: int
+
+
+@dataclass
+class Manifest:
+    """Parsed MANIFEST of an index directory"""
+    generation: int = 0
+    committed_at_ms: int = 0
+    next_segment_id: int = 1
+    wal_lsn: int = 0
+    profile_set: str = ""
+    hash_signature: str = ""
+    segments: List[SegmentInfo] = field(default_factory=list)
+
+    def serialize(self) -> str:
+        lines = [
+            MANIFEST_HEADER,
+            f"generation {self.generation}",
+            f"committed_at_ms {self.committed_at_ms}",
+            f"next_segment_id {self.next_segment_id}",
+            f"wal_lsn {self.wal_lsn}",
+        ]
+        if self.hash_signature:
+            lines.append(f"profile {self.profile_set} {self.hash_signature}")
+        for s in self.segments:
+            lines.append(f"segment {s.segment_id} {s.file_name} {s.size_bytes} "
+                         f"{s.crc32:08x} {s.song_count} {s.posting_count}")
+        return "\n".join(lines) + "\n"
+
+    @classmethod
+    def parse(cls, text: str) -> "Manifest":
+        lines = text.splitlines()
+        if not lines or lines[0].strip() != MANIFEST_HEADER:
+            raise ValueError("Not an index manifest")
+
+        manifest = cls()
+        for line in lines[1:]:
+            parts = line.split()
+            if not parts:
+                continue
+            key = parts[0]
+            if key == "generation":
+                manifest.generation = int(parts[1])
+            elif key == "committed_at_ms":
+                manifest.committed_at_ms = int(parts[1])
+            elif key == "next_segment_id":
+                manifest.next_segment_id = int(parts[1])
+            elif key == "wal_lsn":
+                manifest.wal_lsn = int(parts[1])
+            elif key == "profile":
+                manifest.profile_set = parts[1]
+                manifest.hash_signature = parts[2]
+            elif key == "segment":
+                if len(parts) < 7:
+                    raise ValueError(f"Malformed segment line: {line}")
+                manifest.segments.append(SegmentInfo(
+                    segment_id=int(parts[1]),
+                    file_name=parts[2],
+                    size_bytes=int(parts[3]),
+                    crc32=int(parts[4], 16),
+                    song_count=int(parts[5]),
+                    posting_count=int(parts[6]),
+                ))
+            # Unknown keys are skipped so newer primaries stay readable
+        return manifest
+
+
+@dataclass
+class ReplicationReport:
+    """Result of one replication pass"""
+    primary_generation: int = 0
+    replica_generation_before: int = 0
+    replica_generation_after: int = 0
+    segments_copied: int = 0
+    bytes_copied: int = 0
+    segments_removed: int = 0
+    duration_ms: float = 0.0
+
+
+@dataclass
+class ReplicationStatus:
+    """How far a replica trails its primary"""
+    primary_generation: int
+    replica_generation: int
+    generations_behind: int
+    lag_ms: int
+    missing_segments: int
+
+
+def read_manifest(directory: str) -> Manifest:
+    """Read the MANIFEST of an index directory; an absent file is an empty index"""
+    path = os.path.join(directory, MANIFEST_NAME)
+    try:
+        with open(path, "r", encoding="ascii") as f:
+            return Manifest.parse(f.read())
+    except FileNotFoundError:
+        return Manifest()
+
+
+def _fsync_directory(directory: str) -> None:
+    if os.name == "nt":
+        return
+    fd = os.open(directory, os.O_RDONLY)
+    try:
+        os.fsync(fd)
+    finally:
+        os.close(fd)
+
+
+def write_manifest(directory: str, manifest: Manifest) -> None:
+    """Durably and atomically replace the MANIFEST of an index directory"""
+    path = os.path.join(directory, MANIFEST_NAME)
+    tmp_path = path + ".tmp"
+    with open(tmp_path, "w", encoding="ascii") as f:
+        f.write(manifest.serialize())
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(tmp_path, path)
+    _fsync_directory(directory)
+
+
+def _file_crc32(path: str) -> int:
+    crc = 0
+    with open(path, "rb") as f:
+        while True:
+            chunk = f.read(COPY_CHUNK_BYTES)
+            if not chunk:
+                break
+            crc = zlib.crc32(chunk, crc)
+    return crc & 0xFFFFFFFF
+
+
+def _segment_is_current(path: str, segment: SegmentInfo) -> bool:
+    return (os.path.exists(path) and os.path.getsize(path) == segment.size_bytes
+            and _file_crc32(path) == segment.crc32)
+
+
+def _copy_segment(primary_dir: str, replica_dir: str, segment: SegmentInfo) -> int:
+    """Copy and verify one segment; returns bytes copied"""
+    source = os.path.join(primary_dir, segment.file_name)
+    target = os.path.join(replica_dir, segment.file_name)
+    tmp_path = target + ".tmp"
+
+    crc = 0
+    size = 0
+    try:
+        with open(source, "rb") as src, open(tmp_path, "wb") as dst:
+            while True:
+                chunk = src.read(COPY_CHUNK_BYTES)
+                if not chunk:
+                    break
+                crc = zlib.crc32(chunk, crc)
+                size += len(chunk)
+                dst.write(chunk)
+            dst.flush()
+            os.fsync(dst.fileno())
+
+        if size != segment.size_bytes or (crc & 0xFFFFFFFF) != segment.crc32:
+            raise IOError(f"Segment {segment.file_name} failed verification "
+                          f"({size} bytes, crc {crc & 0xFFFFFFFF:08x})")
+
+        os.replace(tmp_path, target)
+    except BaseException:
+        if os.path.exists(tmp_path):
+            os.remove(tmp_path)
+        raise
+
+    return size
+
+
+def _remove_unreferenced(replica_dir: str, manifest: Manifest) -> int:
+    referenced = {s.file_name for s in manifest.segments}
+    removed = 0
+    for name in os.listdir(replica_dir):
+        if name.endswith(".afs") and name not in referenced:
+            os.remove(os.path.join(replica_dir, name))
+            removed += 1
+    return removed
+
+
+def replicate(primary_dir: str, replica_dir: str) -> ReplicationReport:
+    """
+    Bring a replica directory up to the primary's committed snapshot.
+
+    Only segments that are missing or differ on the replica are copied. If the
+    primary compacts a segment away while it is being copied, the primary
+    manifest is re-read and the pass retried.
+    """
+    start = time.perf_counter()
+    os.makedirs(replica_dir, exist_ok=True)
+
+    report = ReplicationReport()
+    replica = read_manifest(replica_dir)
+    report.replica_generation_before = replica.generation
+
+    for attempt in range(MAX_SNAPSHOT_RETRIES):
+        primary = read_manifest(primary_dir)
+        report.primary_generation = primary.generation
+
+        if primary.generation == replica.generation:
+            break
+
+        try:
+            for segment in primary.segments:
+                target = os.path.join(replica_dir, segment.file_name)
+                if _segment_is_current(target, segment):
+                    continue
+                report.bytes_copied += _copy_segment(primary_dir, replica_dir, segment)
+                report.segments_copied += 1
+        except (FileNotFoundError, IOError) as e:
+            if attempt + 1 == MAX_SNAPSHOT_RETRIES:
+                raise RuntimeError(f"Replication failed: {e}")
+            logger.warning(f"Primary snapshot changed during copy, retrying: {e}")
+            continue
+
+        write_manifest(replica_dir, primary)
+        replica = primary
+        break
+
+    report.replica_generation_after = replica.generation
+    report.segments_removed = _remove_unreferenced(replica_dir, replica)
+    report.duration_ms = (time.perf_counter() - start) * 1000.0
+    return report
+
+
+def replication_status(primary_dir: str, replica_dir: str) -> ReplicationStatus:
+    """Report how far a replica trails its primary"""
+    primary = read_manifest(primary_dir)
+    replica = read_manifest(replica_dir)
+
+    replica_files = {s.file_name for s in replica.segments}
+    missing = sum(1 for s in primary.segments if s.file_name not in replica_files)
+
+    lag_ms = 0
+    if primary.generation != replica.generation:
+        lag_ms = max(0, primary.committed_at_ms - replica.committed_at_ms)
+
+    return ReplicationStatus(
+        primary_generation=primary.generation,
+        replica_generation=replica.generation,
+        generations_behind=max(0, primary.generation - replica.generation),
+        lag_ms=lag_ms,
+        missing_segments=missing,
+    )
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Ship fingerprint index segments to a read replica")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    replicate_parser = subparsers.add_parser("replicate", help="Copy new segments and switch the replica snapshot")
+    replicate_parser.add_argument("primary_dir")
+    replicate_parser.add_argument("replica_dir")
+    replicate_parser.add_argument("--watch", type=float, default=0.0,
+                                  help="Repeat every N seconds instead of running once")
+
+    status_parser = subparsers.add_parser("status", help="Report replication lag")
+    status_parser.add_argument("primary_dir")
+    status_parser.add_argument("replica_dir")
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "status":
+        print(json.dumps(asdict(replication_status(args.primary_dir, args.replica_dir))))
+        return 0
+
+    while True:
+        report = replicate(args.primary_dir, args.replica_dir)
+        print(json.dumps(asdict(report)), flush=True)
+        if args.watch <= 0:
+            return 0
+        time.sleep(args.watch)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""
+Shared-memory matcher sidecar for API worker processes.
+
+One sidecar process opens the fingerprint index and serves index queries to
+every API worker on the host through a shared-memory segment (see
+matcher_sidecar.h). Workers need no index copy of their own, and a query
+costs neither a socket round trip nor serialisation: hashes and matches are
+copied straight into and out of the segment. The sidecar reloads the index
+periodically to pick up segments committed by the ingest side.
+
+Usage:
+    python matcher_sidecar.py serve INDEX_DIR [--name NAME] [--workers N] [--reload-interval SECONDS]
+    python matcher_sidecar.py ping [--name NAME] [--count N]
+"""
+
+import argparse
+import json
+import logging
+import os
+import signal
+import sys
+import threading
+import time
+from typing import Dict, List, Optional, Sequence
+
+try:
+    from . import audio_fingerprint_engine as afe
+except ImportError:
+    import audio_fingerprint_engine as afe
+
+DEFAULT_NAME = os.environ.get("FINGERPRINT_SIDECAR", "afe")
+PERCENTILES = (50, 90, 99)
+
+logger = logging.getLogger(__name__)
+
+
+def serve(index_dir: str, name: str = DEFAULT_NAME, workers: int = 1, slots: int = 64,
+          reload_interval: float = 5.0, stop_event: Optional[threading.Event] = None) -> Dict:
+    """
+    Serve an index to other processes until stop_event is set.
+
+    Args:
+        index_dir: Index directory to open
+        name: Shared segment name the clients connect to
+        workers: Threads serving queries
+        slots: Queries in flight at once across all clients
+        reload_interval: Seconds between index reloads (0 = never reload)
+        stop_event: Stops serving when set; None serves forever
+
+    Returns:
+        Sidecar counters at shutdown
+    """
+    stop_event = stop_event or threading.Event()
+    index = afe.FingerprintIndex(index_dir)
+    sidecar = afe.MatcherSidecar(name, index, slots=slots, workers=workers)
+    logger.info(f"Matcher sidecar {name} serving {index_dir} "
+                f"(generation {index.get_manifest()['generation']}, {workers} worker(s))")
+
+    try:
+        while not stop_event.wait(reload_interval if reload_interval > 0 else 1.0):
+            if reload_interval > 0 and index.reload():
+                logger.info(f"Reloaded {index_dir} at generation {index.get_manifest()['generation']}")
+    finally:
+        sidecar.stop()
+
+    stats = sidecar.get_stats()
+    logger.info(f"Matcher sidecar {name} stopped after {stats['requests']} requests")
+    return stats
+
+
+class SidecarMatcher:
+    """
+    Client side of the matcher sidecar, for API workers.
+
+    Connects on first use and reconnects once when the sidecar was restarted.
+    Safe to share between threads.
+    """
+
+    def __init__(self, name: str = DEFAULT_NAME, timeout_ms: int = 5000):
+        self.name = name
+        self.timeout_ms = timeout_ms
+        self._client = None
+        self._lock = threading.Lock()
+
+    def _connect(self, stale=None):
+        with self._lock:
+            if self._client is None or self._client is stale:
+                self._client = afe.MatcherClient(self.name, self.timeout_ms)
+            return self._client
+
+    def query(self, hash_values: Sequence[int], time_offsets: Sequence[int], max_results: int = 5,
+              min_matches: int = 5, cancel_token: Optional[afe.CancellationToken] = None) -> List[Dict]:
+        """
+        Find reference songs matching a query through the sidecar.
+
+        Returns:
+            Matches with song_id, match_count, time_offset_ms and confidence,
+            plus title, artist, album and duration_ms for songs with metadata,
+            ordered by decreasing match count
+
+        Raises:
+            ValueError: If the query exceeds the sidecar's slot size
+            OperationCancelled: If cancel_token is cancelled
+            RuntimeError: If no sidecar is running or the query fails
+        """
+        client = self._connect()
+        try:
+            return client.query(hash_values, time_offsets, max_results, min_matches, cancel_token)
+        except afe.OperationCancelled:
+            raise
+        except RuntimeError:
+            if client.connected():
+                raise
+            logger.info(f"Matcher sidecar {self.name} restarted, reconnecting")
+
+        return self._connect(stale=client).query(hash_values, time_offsets, max_results, min_matches,
+                                                 cancel_token)
+
+    def ping(self) -> float:
+        """
+        Time an empty query, which measures the shared-memory round trip alone.
+
+        Returns:
+            Round trip in microseconds
+        """
+        start = time.perf_counter()
+        self.query([], [], max_results=1, min_matches=1)
+        return (time.perf_counter() - start) * 1e6
+
+
+def wait_for_sidecar(name: str = DEFAULT_NAME, timeout: float = 10.0) -> SidecarMatcher:
+    """
+    Connect to a sidecar that may still be starting.
+
+    Raises:
+        RuntimeError: If it does not come up within the timeout
+    """
+    deadline = time.monotonic() + timeout
+    while True:
+        matcher = SidecarMatcher(name)
+        try:
+            matcher.ping()
+            return matcher
+        except RuntimeError:
+            if time.monotonic() >= deadline:
+                raise
+            time.sleep(0.05)
+
+
+def latency_summary(values: List[float]) -> Dict[str, float]:
+    ordered = sorted(values)
+    if not ordered:
+        return {f"p{p}": 0.0 for p in PERCENTILES}
+    return {f"p{p}": ordered[min(len(ordered) - 1, len(ordered) * p // 100)] for p in PERCENTILES}
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Serve index queries to API workers through shared memory")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    serve_parser = subparsers.add_parser("serve", help="Run the sidecar for an index directory")
+    serve_parser.add_argument("index_dir")
+    serve_parser.add_argument("--name", default=DEFAULT_NAME, help="Shared segment name")
+    serve_parser.add_argument("--workers", type=int, default=1, help="Threads serving queries")
+    serve_parser.add_argument("--slots", type=int, default=64, help="Queries in flight at once")
+    serve_parser.add_argument("--reload-interval", type=float, default=5.0,
+                              help="Seconds between index reloads (0 = never)")
+
+    ping_parser = subparsers.add_parser("ping", help="Measure the round trip to a running sidecar")
+    ping_parser.add_argument("--name", default=DEFAULT_NAME, help="Shared segment name")
+    ping_parser.add_argument("--count", type=int, default=1000, help="Round trips to time")
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "serve":
+        stop_event = threading.Event()
+        for signum in (signal.SIGINT, signal.SIGTERM):
+            signal.signal(signum, lambda *_: stop_event.set())
+        stats = serve(args.index_dir, args.name, args.workers, args.slots, args.reload_interval, stop_event)
+        print(json.dumps(stats))
+        return 0
+
+    matcher = SidecarMatcher(args.name)
+    round_trips = [matcher.ping() for _ in range(args.count)]
+    print(json.dumps({"name": args.name, "count": args.count, "round_trip_us": latency_summary(round_trips)}))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,424 @@
+#!/usr/bin/env python3
+"""
+Recall and cost of fingerprint profiles on synthetic audio.
+
+Each command fingerprints a catalog of synthetic songs (sequences of decaying
+chords with random pitches and lengths) into an index, queries it with noisy
+excerpts and compares a profile or query strategy against the default one.
+Noise is white and set relative to each excerpt's power, so an SNR of 0 dB
+adds noise as loud as the music.
+
+Usage:
+    python profile_benchmark.py profiles [--songs 8] [--snr-db -6]
+    python profile_benchmark.py triplets [--songs 20] [--snr-db 0]
+    python profile_benchmark.py tiered [--songs 20] [--snr-db 10,-6,-12,-16]
+    python profile_benchmark.py phases [--songs 15] [--snr-db 0]
+    python profile_benchmark.py native [--songs 8] [--sample-rates 44100,48000] [--snr-db 6]
+    python profile_benchmark.py fine [--songs 15] [--snr-db -10]
+"""
+
+import argparse
+import json
+import logging
+import os
+import sys
+import tempfile
+import time
+from typing import Dict, List, Optional, Sequence
+
+import numpy as np
+
+try:
+    from . import audio_fingerprint_engine as afe
+except ImportError:
+    import audio_fingerprint_engine as afe
+
+SAMPLE_RATE = 22050
+
+logger = logging.getLogger(__name__)
+
+
+def synthetic_song(seed: int, duration: float = 30.0, sample_rate: int = SAMPLE_RATE) -> np.ndarray:
+    """Sequence of decaying chords with random pitches and lengths"""
+    rng = np.random.default_rng(seed)
+    audio = np.zeros(int(duration * sample_rate), dtype=np.float32)
+    start = 0.0
+    while start < duration:
+        note_length = 0.15 + 0.3 * rng.random()
+        begin = int(start * sample_rate)
+        end = min(len(audio), int((start + note_length) * sample_rate))
+        t = np.arange(end - begin) / sample_rate
+        for _ in range(rng.integers(2, 5)):
+            freq = 120.0 * 2 ** (5 * rng.random())
+            audio[begin:end] += (0.2 + 0.3 * rng.random()) * np.exp(-3 * t) * np.sin(2 * np.pi * freq * t)
+        start += note_length
+    return audio
+
+
+def add_noise(excerpt: np.ndarray, snr_db: float, rng: np.random.Generator) -> np.ndarray:
+    """White noise at snr_db below the excerpt's power"""
+    scale = np.sqrt(np.mean(excerpt ** 2) / 10 ** (snr_db / 10))
+    return (excerpt + rng.normal(0, scale, len(excerpt))).astype(np.float32)
+
+
+def _top1(matches: List[Dict], song_id: int) -> bool:
+    return bool(matches) and matches[0]['song_id'] == song_id
+
+
+def run_profiles(songs: int = 8, snr_db: float = -6.0, seed: int = 7) -> Dict:
+    """
+    Compare sparse reference-profile queries with dense query-profile
+    queries against an index of the reference profile.
+
+    Args:
+        songs: Catalog size in songs
+        snr_db: Noise level of the queries
+        seed: Noise seed
+    """
+    profiles = afe.ProfileSet()
+    catalog = [synthetic_song(song_id, duration=15.0) for song_id in range(1, songs + 1)]
+    report = {"songs": songs, "snr_db": snr_db}
+
+    with tempfile.TemporaryDirectory() as temp_dir:
+        index = afe.FingerprintIndex(temp_dir)
+        index.bind_profiles(profiles)
+        symmetric_postings = 0
+        for song_id, song in enumerate(catalog, 1):
+            fp = afe.generate_fingerprint(song, SAMPLE_RATE, 1, profiles.reference)
+            index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+            symmetric_postings += afe.generate_fingerprint(song, SAMPLE_RATE, 1)['count']
+        report["index_shrink"] = symmetric_postings / index.get_stats()['mutable_postings']
+
+        rng = np.random.default_rng(seed)
+        votes = {'reference': 0, 'query': 0}
+        hits = {'reference': 0, 'query': 0}
+        queries = 0
+        for song_id, song in enumerate(catalog, 1):
+            for start_s in (2.0, 8.5):
+                excerpt = song[int(start_s * SAMPLE_RATE):int((start_s + 5.0) * SAMPLE_RATE)]
+                noisy = add_noise(excerpt, snr_db, rng)
+                queries += 1
+                for name in votes:
+                    query = afe.generate_fingerprint(noisy, SAMPLE_RATE, 1, getattr(profiles, name))
+                    matches = index.query(query['hash_values'], query['time_offsets'], songs, 1)
+                    hits[name] += _top1(matches, song_id)
+                    votes[name] += next((m['match_count'] for m in matches if m['song_id'] == song_id), 0)
+
+    for name in votes:
+        report[f"{name}_profile"] = {"aligned_votes": votes[name] / queries, "recall_at_1": hits[name] / queries}
+    logger.info(f"index {report['index_shrink']:.2f}x smaller, aligned votes per query "
+                f"{votes['reference'] / queries:.1f} (reference profile) -> {votes['query'] / queries:.1f} (query profile)")
+    return report
+
+
+def run_triplets(songs: int = 20, snr_db: float = 0.0, seed: int = 3) -> Dict:
+    """
+    Compare pair hashes with landmark triplet hashes: posting list lengths,
+    postings and candidate songs a query touches, and recall@1.
+
+    Args:
+        songs: Catalog size in songs
+        snr_db: Noise level of the queries
+        seed: Noise seed
+    """
+    catalog = [synthetic_song(song_id) for song_id in range(1, songs + 1)]
+    profile_sets = {'pairs': afe.ProfileSet(), 'triplets': afe.ProfileSet.triplets()}
+    report = {"songs": songs, "snr_db": snr_db}
+
+    with tempfile.TemporaryDirectory() as temp_dir:
+        for name, profiles in profile_sets.items():
+            index = afe.FingerprintIndex(os.path.join(temp_dir, name))
+            postings = {}
+            for song_id, song in enumerate(catalog, 1):
+                fp = afe.generate_fingerprint(song, SAMPLE_RATE, 1, profiles.reference)
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                for h in fp['hash_values']:
+                    postings.setdefault(h, set()).add(song_id)
+
+            rng = np.random.default_rng(seed)
+            hits, scanned, candidates, queries = 0, 0, 0, 0
+            for song_id, song in enumerate(catalog, 1):
+                for start_s in (2.0, 14.0):
+                    excerpt = song[int(start_s * SAMPLE_RATE):int((start_s + 5.0) * SAMPLE_RATE)]
+                    query = afe.generate_fingerprint(add_noise(excerpt, snr_db, rng), SAMPLE_RATE, 1, profiles.query)
+                    touched = set()
+                    for h in query['hash_values']:
+                        songs_with_hash = postings.get(h, ())
+                        scanned += len(songs_with_hash)
+                        touched.update(songs_with_hash)
+                    candidates += len(touched)
+                    queries += 1
+
+                    matches = index.query(query['hash_values'], query['time_offsets'], 1, 1)
+                    hits += _top1(matches, song_id)
+
+            lengths = sorted(len(songs_with_hash) for songs_with_hash in postings.values())
+            report[name] = {
+                "postings": index.get_stats()['mutable_postings'],
+                "posting_length": {"p50": lengths[len(lengths) // 2], "p99": lengths[len(lengths) * 99 // 100],
+                                   "max": lengths[-1]},
+                "postings_per_query": scanned / queries,
+                "candidates_per_query": candidates / queries,
+                "recall_at_1": hits / queries,
+            }
+            logger.info(f"{name}: {scanned / queries:.0f} postings and {candidates / queries:.1f} candidate songs "
+                        f"per query, recall@1 {hits / queries:.3f}")
+    return report
+
+
+def run_tiered(songs: int = 20, snr_db: Sequence[float] = (10.0, -6.0, -12.0, -16.0), seed: int = 9) -> Dict:
+    """
+    Compare two-tier queries (sparse pass first, dense pass when ambiguous)
+    with always running the dense pass: escalation rate per noise level,
+    recall@1 and time per query.
+
+    Args:
+        songs: Catalog size in songs
+        snr_db: Noise levels; each song is queried once per level
+        seed: Noise seed
+    """
+    catalog = [synthetic_song(song_id) for song_id in range(1, songs + 1)]
+    report = {"songs": songs}
+
+    with tempfile.TemporaryDirectory() as temp_dir:
+        index = afe.FingerprintIndex(temp_dir)
+        for song_id, song in enumerate(catalog, 1):
+            fp = afe.generate_fingerprint(song, SAMPLE_RATE, 1, afe.FingerprintProfile.reference())
+            index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+
+        tiered = afe.TieredQueryProcessor(index)
+        always_dense = afe.TieredQueryProcessor(index, min_votes=2**31 - 1)
+        rng = np.random.default_rng(seed)
+        hits = {'tiered': 0, 'dense': 0}
+        escalated = {level: 0 for level in snr_db}
+        queries = 0
+        for song_id, song in enumerate(catalog, 1):
+            for k, level in enumerate(snr_db):
+                start = int((2.0 + 6.0 * (k % 4)) * SAMPLE_RATE)
+                noisy = add_noise(song[start:start + 5 * SAMPLE_RATE], level, rng)
+                queries += 1
+
+                result = tiered.identify(noisy, SAMPLE_RATE)
+                hits['tiered'] += _top1(result['matches'], song_id)
+                hits['dense'] += _top1(always_dense.identify(noisy, SAMPLE_RATE)['matches'], song_id)
+                escalated[level] += result['escalated']
+
+        stats = tiered.get_stats()
+        dense_stats = always_dense.get_stats()
+
+    report.update({
+        "escalation_rate": stats['escalation_rate'],
+        "escalation_by_snr_db": {str(level): count / songs for level, count in escalated.items()},
+        "tiered_ms_per_query": (stats['analysis_ms'] + stats['sparse_ms'] + stats['dense_ms']) / queries,
+        "dense_ms_per_query": (dense_stats['analysis_ms'] + dense_stats['dense_ms']) / queries,
+        "estimated_saved_ms_per_query": stats['estimated_saved_ms'] / queries,
+        "recall_at_1": {name: count / queries for name, count in hits.items()},
+    })
+    logger.info(f"{stats['escalation_rate']:.0%} escalated, {report['tiered_ms_per_query']:.1f} ms vs "
+                f"{report['dense_ms_per_query']:.1f} ms per query always dense")
+    return report
+
+
+def _random_clips(catalog: List[np.ndarray], clips_per_song: int, clip_s: float, snr_db: float,
+                  rng: np.random.Generator, sample_rate: int = SAMPLE_RATE) -> List[tuple]:
+    """(song ID, clean excerpt, noisy excerpt) at random starts, mostly off any frame grid"""
+    clips = []
+    for song_id, song in enumerate(catalog, 1):
+        for _ in range(clips_per_song):
+            start = int(rng.integers(2 * sample_rate, len(song) - int((clip_s + 2) * sample_rate)))
+            excerpt = song[start:start + int(clip_s * sample_rate)]
+            clips.append((song_id, excerpt, add_noise(excerpt, snr_db, rng)))
+    return clips
+
+
+def run_phases(songs: int = 15, snr_db: float = 0.0, phases: Sequence[int] = (1, 2), seed: int = 13) -> Dict:
+    """
+    Compare a coarse reference hop, queried with one or more analysis
+    phases, with the default hop: index postings and recall@1.
+
+    Args:
+        songs: Catalog size in songs
+        snr_db: Noise level of the queries
+        phases: Query analysis phases to measure against the coarse reference
+        seed: Clip and noise seed
+    """
+    catalog = [synthetic_song(song_id) for song_id in range(1, songs + 1)]
+    clips = _random_clips(catalog, 4, 5.0, snr_db, np.random.default_rng(seed))
+
+    def measure(reference, query):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            postings = 0
+            for song_id, song in enumerate(catalog, 1):
+                fp = afe.generate_fingerprint(song, SAMPLE_RATE, 1, reference)
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                postings += len(fp['hash_values'])
+            hits = 0
+            for song_id, _, noisy in clips:
+                fp = afe.generate_fingerprint(noisy, SAMPLE_RATE, 1, query)
+                hits += _top1(index.query(fp['hash_values'], fp['time_offsets'], 5, 5), song_id)
+            return {"postings": postings, "recall_at_1": hits / len(clips)}
+
+    report = {"songs": songs, "snr_db": snr_db,
+              "default_hop": measure(afe.FingerprintProfile.reference(), afe.FingerprintProfile.query()),
+              "coarse_hop": {}}
+    for count in phases:
+        query = afe.FingerprintProfile.coarse_query()
+        query.analysis_phases = count
+        report["coarse_hop"][str(count)] = measure(afe.FingerprintProfile.coarse_reference(), query)
+        logger.info(f"coarse hop, {count} query phases: recall@1 {report['coarse_hop'][str(count)]['recall_at_1']:.3f}")
+    return report
+
+
+def run_native(songs: int = 8, sample_rates: Sequence[int] = (44100, 48000), snr_db: float = 6.0,
+               seed: int = 17) -> Dict:
+    """
+    Compare native-rate query analysis with resampling to 11.025 kHz:
+    recall@1 against an index built from resampled audio, and front-end
+    time per 5 s query.
+
+    Args:
+        songs: Catalog size in songs
+        sample_rates: Input sample rates to measure
+        snr_db: Noise level of the queries
+        seed: Clip and noise seed
+    """
+    native_profile = afe.FingerprintProfile.query()
+    native_profile.native_rate = True
+    profiles = {'resampled': afe.FingerprintProfile.query(), 'native': native_profile}
+    report = {"songs": songs, "snr_db": snr_db, "rates": []}
+
+    for sample_rate in sample_rates:
+        catalog = [synthetic_song(song_id, duration=20.0, sample_rate=sample_rate) for song_id in range(1, songs + 1)]
+        clips = _random_clips(catalog, 3, 5.0, snr_db, np.random.default_rng(seed), sample_rate)
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            for song_id, song in enumerate(catalog, 1):
+                fp = afe.generate_fingerprint(song, sample_rate, 1, afe.FingerprintProfile.reference())
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+
+            hits = {name: 0 for name in profiles}
+            elapsed = {name: 0.0 for name in profiles}
+            for song_id, _, noisy in clips:
+                for name, profile in profiles.items():
+                    begin = time.perf_counter()
+                    fp = afe.generate_fingerprint(noisy, sample_rate, 1, profile)
+                    elapsed[name] += time.perf_counter() - begin
+                    hits[name] += _top1(index.query(fp['hash_values'], fp['time_offsets'], 5, 5), song_id)
+
+        run = {"sample_rate": sample_rate}
+        for name in profiles:
+            run[name] = {"recall_at_1": hits[name] / len(clips), "ms_per_query": 1000 * elapsed[name] / len(clips)}
+        report["rates"].append(run)
+        logger.info(f"{sample_rate} Hz: recall@1 {run['native']['recall_at_1']:.3f} native vs "
+                    f"{run['resampled']['recall_at_1']:.3f} resampled, {run['native']['ms_per_query']:.1f} ms vs "
+                    f"{run['resampled']['ms_per_query']:.1f} ms per query")
+    return report
+
+
+def run_fine(songs: int = 15, snr_db: float = -10.0, clip_s: float = 2.0, seed: int = 17) -> Dict:
+    """
+    Compare the fine profile set (1024-point analysis, interpolated peak
+    times) with the default 2048-point one: hash stability of clean
+    off-grid excerpts and recall@1 of short noisy ones.
+
+    Args:
+        songs: Catalog size in songs
+        snr_db: Noise level of the queries
+        clip_s: Length of each excerpt
+        seed: Clip and noise seed
+    """
+    catalog = [synthetic_song(song_id) for song_id in range(1, songs + 1)]
+    clips = _random_clips(catalog, 4, clip_s, snr_db, np.random.default_rng(seed))
+    report = {"songs": songs, "snr_db": snr_db, "clip_s": clip_s}
+
+    for name, profiles in (("baseline", afe.ProfileSet()), ("fine", afe.ProfileSet.fine())):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            song_hashes = {}
+            for song_id, song in enumerate(catalog, 1):
+                fp = afe.generate_fingerprint(song, SAMPLE_RATE, 1, profiles.reference)
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                song_hashes[song_id] = set(fp['hash_values'])
+
+            stable, hits = [], 0
+            for song_id, excerpt, noisy in clips:
+                # Share of a clean excerpt's hashes that the song has
+                hashes = afe.generate_fingerprint(excerpt, SAMPLE_RATE, 1, profiles.reference)['hash_values']
+                stable.append(np.mean([h in song_hashes[song_id] for h in hashes]))
+                fp = afe.generate_fingerprint(noisy, SAMPLE_RATE, 1, profiles.query)
+                hits += _top1(index.query(fp['hash_values'], fp['time_offsets'], 5, 5), song_id)
+
+        report[name] = {"stability": float(np.mean(stable)), "recall_at_1": hits / len(clips)}
+        logger.info(f"{name}: stability {report[name]['stability']:.3f}, "
+                    f"recall@1 at {snr_db:g} dB {report[name]['recall_at_1']:.3f}")
+    return report
+
+
+def _int_list(value: str) -> List[int]:
+    return [int(item) for item in value.split(",") if item]
+
+
+def _float_list(value: str) -> List[float]:
+    return [float(item) for item in value.split(",") if item]
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Compare fingerprint profiles on synthetic audio")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    profiles_parser = subparsers.add_parser("profiles", help="Aligned votes of sparse vs dense queries on a sparse index")
+    profiles_parser.add_argument("--songs", type=int, default=8)
+    profiles_parser.add_argument("--snr-db", type=float, default=-6.0)
+    profiles_parser.add_argument("--seed", type=int, default=7)
+
+    triplets_parser = subparsers.add_parser("triplets", help="Posting lengths and recall of pair vs triplet hashes")
+    triplets_parser.add_argument("--songs", type=int, default=20)
+    triplets_parser.add_argument("--snr-db", type=float, default=0.0)
+    triplets_parser.add_argument("--seed", type=int, default=3)
+
+    tiered_parser = subparsers.add_parser("tiered", help="Escalation rate, recall and latency of two-tier queries")
+    tiered_parser.add_argument("--songs", type=int, default=20)
+    tiered_parser.add_argument("--snr-db", type=_float_list, default=[10.0, -6.0, -12.0, -16.0],
+                               help="Comma-separated noise levels")
+    tiered_parser.add_argument("--seed", type=int, default=9)
+
+    phases_parser = subparsers.add_parser("phases", help="Recall of a coarse reference hop by query analysis phases")
+    phases_parser.add_argument("--songs", type=int, default=15)
+    phases_parser.add_argument("--snr-db", type=float, default=0.0)
+    phases_parser.add_argument("--phases", type=_int_list, default=[1, 2], help="Comma-separated phase counts")
+    phases_parser.add_argument("--seed", type=int, default=13)
+
+    native_parser = subparsers.add_parser("native", help="Recall and front-end cost of native-rate query analysis")
+    native_parser.add_argument("--songs", type=int, default=8)
+    native_parser.add_argument("--sample-rates", type=_int_list, default=[44100, 48000],
+                               help="Comma-separated input sample rates")
+    native_parser.add_argument("--snr-db", type=float, default=6.0)
+    native_parser.add_argument("--seed", type=int, default=17)
+
+    fine_parser = subparsers.add_parser("fine", help="Hash stability and recall of the fine profile set")
+    fine_parser.add_argument("--songs", type=int, default=15)
+    fine_parser.add_argument("--snr-db", type=float, default=-10.0)
+    fine_parser.add_argument("--clip-s", type=float, default=2.0, help="Length of each excerpt")
+    fine_parser.add_argument("--seed", type=int, default=17)
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "profiles":
+        print(json.dumps(run_profiles(args.songs, args.snr_db, args.seed)))
+    elif args.command == "triplets":
+        print(json.dumps(run_triplets(args.songs, args.snr_db, args.seed)))
+    elif args.command == "tiered":
+        print(json.dumps(run_tiered(args.songs, args.snr_db, args.seed)))
+    elif args.command == "phases":
+        print(json.dumps(run_phases(args.songs, args.snr_db, args.phases, args.seed)))
+    elif args.command == "native":
+        print(json.dumps(run_native(args.songs, args.sample_rates, args.snr_db, args.seed)))
+    elif args.command == "fine":
+        print(json.dumps(run_fine(args.songs, args.snr_db, args.clip_s, args.seed)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""
+Offline replay of captured production queries against an index build.
+
+The identification service samples queries into a binary query log (see
+query_log.h): each record holds the query's fingerprints, the matches it
+returned and how long each stage took. Replaying the log against an index
+directory at a fixed concurrency measures that build on the real query mix;
+comparing two replay reports shows which queries changed their top result
+and how the latency distribution moved.
+
+Usage:
+    python query_replay.py run LOG INDEX_DIR [--concurrency N] [--output REPORT]
+    python query_replay.py compare BASELINE_REPORT CANDIDATE_REPORT [--max-p99-regression FRACTION]
+"""
+
+import argparse
+import json
+import logging
+import sys
+import time
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass, field, asdict
+from typing import Dict, List, Optional
+
+try:
+    from . import audio_fingerprint_engine as afe
+except ImportError:
+    import audio_fingerprint_engine as afe
+
+PERCENTILES = (50, 90, 99)
+MAX_LISTED_CHANGES = 20
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass
+class ReplayReport:
+    """Outcome of replaying a query log against one index build"""
+    log_path: str
+    log_digest: int                 # CRC-32 of the replayed fingerprints, identifies the query set
+    index_dir: str
+    index_generation: int
+    hash_signature: str
+    concurrency: int
+    query_threads: int
+    queries: int
+    wall_ms: float
+    qps: float
+    latency_ms: Dict[str, float]
+    logged_search_ms: Dict[str, float]
+    agreement_with_log: float       # Fraction of queries whose top song equals the captured one
+    top_songs: List[Optional[int]] = field(default_factory=list)
+
+
+@dataclass
+class ReplayComparison:
+    """Differences between a baseline and a candidate replay of the same log"""
+    queries: int
+    top1_agreement: float
+    changed_queries: int
+    changed: List[Dict] = field(default_factory=list)
+    baseline_latency_ms: Dict[str, float] = field(default_factory=dict)
+    candidate_latency_ms: Dict[str, float] = field(default_factory=dict)
+    latency_change: Dict[str, float] = field(default_factory=dict)   # Relative, 0.1 = 10% slower
+    regression: bool = False
+
+
+def latency_summary(values: List[float]) -> Dict[str, float]:
+    """Nearest-rank percentiles, maximum and mean of a latency sample"""
+    if not values:
+        return {}
+
+    ordered = sorted(values)
+    summary = {}
+    for p in PERCENTILES:
+        rank = max(1, -(-p * len(ordered) // 100))
+        summary[f"p{p}"] = ordered[rank - 1]
+    summary["max"] = ordered[-1]
+    summary["mean"] = sum(ordered) / len(ordered)
+    return summary
+
+
+def _top_song(matches: List[Dict]) -> Optional[int]:
+    return matches[0]["song_id"] if matches else None
+
+
+def _log_digest(records: List[Dict]) -> int:
+    crc = 0
+    for record in records:
+        crc = zlib.crc32(json.dumps([record["hash_values"], record["time_offsets"]]).encode(), crc)
+    return crc
+
+
+def replay(log_path: str, index_dir: str, concurrency: int = 4, query_threads: int = 1,
+           limit: int = 0) -> ReplayReport:
+    """
+    Run every query of a log against an index directory.
+
+    Args:
+        log_path: Query log written by the service
+        index_dir: Index build to measure
+        concurrency: Queries in flight at once
+        query_threads: Threads scoring each query (see FingerprintIndex.set_query_threads)
+        limit: Replay only the first N queries (0 = all)
+    """
+    if concurrency <= 0:
+        raise ValueError("Concurrency must be positive")
+
+    records = afe.read_query_log(log_path)
+    if limit > 0:
+        records = records[:limit]
+
+    index = afe.FingerprintIndex(index_dir)
+    index.set_query_threads(query_threads)
+    manifest = index.get_manifest()
+
+    def run_query(record):
+        start = time.perf_counter()
+        matches = index.query(record["hash_values"], record["time_offsets"],
+                              record["max_results"], record["min_matches"])
+        return matches, (time.perf_counter() - start) * 1000.0
+
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=concurrency) as executor:
+        outcomes = list(executor.map(run_query, records))
+    wall_ms = (time.perf_counter() - start) * 1000.0
+
+    top_songs = [_top_song(matches) for matches, _ in outcomes]
+    agreeing = sum(1 for record, top in zip(records, top_songs) if _top_song(record["matches"]) == top)
+    logged_search = [record["stage_ms"]["search"] for record in records if "search" in record["stage_ms"]]
+
+    logger.info(f"Replayed {len(records)} queries against {index_dir} in {wall_ms:.0f} ms")
+
+    return ReplayReport(
+        log_path=log_path,
+        log_digest=_log_digest(records),
+        index_dir=index_dir,
+        index_generation=manifest["generation"],
+        hash_signature=manifest["hash_signature"],
+        concurrency=concurrency,
+        query_threads=query_threads,
+        queries=len(records),
+        wall_ms=wall_ms,
+        qps=len(records) / (wall_ms / 1000.0) if wall_ms > 0 else 0.0,
+        latency_ms=latency_summary([latency for _, latency in outcomes]),
+        logged_search_ms=latency_summary(logged_search),
+        agreement_with_log=agreeing / len(records) if records else 1.0,
+        top_songs=top_songs,
+    )
+
+
+def compare(baseline: Dict, candidate: Dict, max_p99_regression: float = 0.1,
+            min_agreement: float = 1.0) -> ReplayComparison:
+    """
+    Compare two replay reports of the same query log.
+
+    A candidate regresses if fewer than min_agreement of the queries keep
+    their top song or its p99 latency grows by more than max_p99_regression.
+    """
+    if baseline["log_digest"] != candidate["log_digest"]:
+        raise ValueError("Reports were produced from different query sets")
+
+    baseline_top = baseline["top_songs"]
+    candidate_top = candidate["top_songs"]
+    changed = [
+        {"query": i, "baseline": before, "candidate": after}
+        for i, (before, after) in enumerate(zip(baseline_top, candidate_top))
+        if before != after
+    ]
+    queries = len(baseline_top)
+    agreement = 1.0 - len(changed) / queries if queries else 1.0
+
+    latency_change = {}
+    for key, before in baseline["latency_ms"].items():
+        after = candidate["latency_ms"].get(key)
+        if after is not None and before > 0:
+            latency_change[key] = (after - before) / before
+
+    return ReplayComparison(
+        queries=queries,
+        top1_agreement=agreement,
+        changed_queries=len(changed),
+        changed=changed[:MAX_LISTED_CHANGES],
+        baseline_latency_ms=baseline["latency_ms"],
+        candidate_latency_ms=candidate["latency_ms"],
+        latency_change=latency_change,
+        regression=(agreement < min_agreement or
+                    latency_change.get("p99", 0.0) > max_p99_regression),
+    )
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Replay captured queries against fingerprint index builds")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    run_parser = subparsers.add_parser("run", help="Replay a query log against an index directory")
+    run_parser.add_argument("log")
+    run_parser.add_argument("index_dir")
+    run_parser.add_argument("--concurrency", type=int, default=4, help="Queries in flight at once")
+    run_parser.add_argument("--query-threads", type=int, default=1, help="Threads scoring each query")
+    run_parser.add_argument("--limit", type=int, default=0, help="Replay only the first N queries")
+    run_parser.add_argument("--output", help="Also write the report to this file")
+
+    compare_parser = subparsers.add_parser("compare", help="Compare a candidate replay report to a baseline")
+    compare_parser.add_argument("baseline")
+    compare_parser.add_argument("candidate")
+    compare_parser.add_argument("--max-p99-regression", type=float, default=0.1,
+                                help="Largest acceptable relative p99 increase")
+    compare_parser.add_argument("--min-agreement", type=float, default=1.0,
+                                help="Smallest acceptable fraction of unchanged top results")
+
+    args = parser.parse_args(argv)
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(levelname)s %(message)s")
+
+    if args.command == "run":
+        report = asdict(replay(args.log, args.index_dir, args.concurrency, args.query_threads, args.limit))
+        if args.output:
+            with open(args.output, "w") as f:
+                json.dump(report, f)
+        print(json.dumps(report))
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    with open(args.candidate) as f:
+        candidate = json.load(f)
+
+    comparison = compare(baseline, candidate, args.max_p99_regression, args.min_agreement)
+    print(json.dumps(asdict(comparison)))
+    return 1 if comparison.regression else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
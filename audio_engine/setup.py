@@ -17,7 +17,28 @@ ext_modules = [
             "src/audio_preprocessor.cpp",
             "src/fft_processor.cpp", 
             "src/peak_detector.cpp",
+            "src/tiled_peak_pipeline.cpp",
             "src/hash_generator.cpp",
+            "src/engine_pool.cpp",
+            "src/audio_decoder.cpp",
+            "src/corpus_reader.cpp",
+            "src/index_segment.cpp",
+            "src/fingerprint_index.cpp",
+            "src/ingest_wal.cpp",
+            "src/fingerprint_pruner.cpp",
+            "src/fingerprint_profile.cpp",
+            "src/query_log.cpp",
+            "src/tiered_query.cpp",
+            "src/native_rate_analyzer.cpp",
+            "src/mp3_decoder.cpp",
+            "src/song_reorder.cpp",
+            "src/cpu_pool.cpp",
+            "src/cancellation.cpp",
+            "src/realtime_audit.cpp",
+            "src/streaming_fingerprinter.cpp",
+            "src/matcher_sidecar.cpp",
+            "src/synthetic_catalog.cpp",
+            "src/engine_tuning.cpp",
             "src/python_bindings.cpp",
         ],
         include_dirs=[
@@ -61,6 +82,29 @@ else:
             "/usr/include",
             "/usr/local/include",
         ])
+        # shm_open for the matcher sidecar (part of libc from glibc 2.34)
+        ext.libraries.append("rt")
+        # io_uring corpus reader when liburing is installed
+        if any(os.path.exists(os.path.join(d, "liburing.h"))
+               for d in ("/usr/include", "/usr/local/include")):
+            ext.libraries.append("uring")
+            ext.define_macros.append(("HAVE_LIBURING", "1"))
+
+# MP3 decoding when the minimp3 header is installed (or MINIMP3_INCLUDE_DIR points at it)
+for ext in ext_modules:
+    minimp3_dirs = [os.environ.get("MINIMP3_INCLUDE_DIR", "")] + [
+        os.path.join(d, sub) for d in ext.include_dirs for sub in ("", "minimp3")
+    ]
+    minimp3_dir = next((d for d in minimp3_dirs if d and os.path.exists(os.path.join(d, "minimp3.h"))), None)
+    if minimp3_dir:
+        ext.include_dirs.append(minimp3_dir)
+        ext.define_macros.append(("HAVE_MINIMP3", "1"))
+
+# Allocation counting for realtime audits replaces the global operator new and
+# delete for the whole host process, so it is only linked into test builds
+if os.environ.get("FINGERPRINT_ALLOCATION_AUDIT") == "1":
+    for ext in ext_modules:
+        ext.sources.append("src/realtime_audit_hook.cpp")
 
 setup(
     name="audio_fingerprint_engine",
@@ -0,0 +1,143 @@
+#include "audio_decoder.h"
+#include "mp3_decoder.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+namespace AudioFingerprint {
+
+namespace {
+
+uint16_t read_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+bool AudioDecoder::is_wav(const uint8_t* data, size_t size) {
+    return size >= 12 && std::memcmp(data, "RIFF", 4) == 0 && std::memcmp(data + 8, "WAVE", 4) == 0;
+}
+
+bool AudioDecoder::is_mp3(const uint8_t* data, size_t size) {
+    Mp3FrameHeader header;
+    return (size >= 3 && std::memcmp(data, "ID3", 3) == 0) ||
+           (size >= 4 && Mp3Decoder::parse_frame_header(data, header));
+}
+
+AudioSample AudioDecoder::decode(const uint8_t* data, size_t size) const {
+    if (is_wav(data, size)) {
+        return decode_wav(data, size);
+    }
+
+    if (is_mp3(data, size)) {
+        return Mp3Decoder::decode(data, size).audio;
+    }
+
+    throw std::invalid_argument("Unsupported audio container");
+}
+
+AudioSample AudioDecoder::decode_wav(const uint8_t* data, size_t size) const {
+    if (!is_wav(data, size)) {
+        throw std::invalid_argument("Not a RIFF/WAVE file");
+    }
+
+    uint16_t format = 0;
+    uint16_t channels = 0;
+    uint32_t sample_rate = 0;
+    uint16_t bits_per_sample = 0;
+    const uint8_t* pcm = nullptr;
+    size_t pcm_size = 0;
+
+    // Walk the chunk list; chunks are word-aligned
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const uint8_t* chunk = data + offset;
+        uint32_t chunk_size = read_u32(chunk + 4);
+        size_t body = offset + 8;
+        size_t available = size - body;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_size < 16 || available < 16) {
+                throw std::invalid_argument("WAV fmt chunk too small");
+            }
+
+            format = read_u16(data + body);
+            channels = read_u16(data + body + 2);
+            sample_rate = read_u32(data + body + 4);
+            bits_per_sample = read_u16(data + body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE stores the real format tag in the sub-format GUID
+            if (format == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 && available >= 40) {
+                format = read_u16(data + body + 24);
+            }
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            pcm = data + body;
+            // Streamed WAVs may carry a placeholder size; clamp to what we have
+            pcm_size = std::min<size_t>(chunk_size, available);
+            break;
+        }
+
+        offset = body + chunk_size + (chunk_size & 1);
+    }
+
+    if (channels == 0 || sample_rate == 0 || bits_per_sample == 0) {
+        throw std::invalid_argument("WAV file has no valid fmt chunk");
+    }
+
+    if (pcm == nullptr) {
+        throw std::invalid_argument("WAV file has no data chunk");
+    }
+
+    const size_t bytes_per_sample = bits_per_sample / 8;
+    const size_t sample_count = bytes_per_sample > 0 ? pcm_size / bytes_per_sample : 0;
+    std::vector<float> samples(sample_count);
+
+    if (format == WAVE_FORMAT_PCM) {
+        switch (bits_per_sample) {
+            case 8:
+                for (size_t i = 0; i < sample_count; ++i) {
+                    samples[i] = (static_cast<float>(pcm[i]) - 128.0f) / 128.0f;
+                }
+                break;
+            case 16:
+                for (size_t i = 0; i < sample_count; ++i) {
+                    int16_t value = static_cast<int16_t>(read_u16(pcm + i * 2));
+                    samples[i] = static_cast<float>(value) / 32768.0f;
+                }
+                break;
+            case 24:
+                for (size_t i = 0; i < sample_count; ++i) {
+                    const uint8_t* p = pcm + i * 3;
+                    int32_t value = static_cast<int32_t>(
+                        (static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) |
+                        (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+                    samples[i] = static_cast<float>(value) / 8388608.0f;
+                }
+                break;
+            case 32:
+                for (size_t i = 0; i < sample_count; ++i) {
+                    int32_t value = static_cast<int32_t>(read_u32(pcm + i * 4));
+                    samples[i] = static_cast<float>(value / 2147483648.0);
+                }
+                break;
+            default:
+                throw std::invalid_argument("Unsupported PCM bit depth");
+        }
+    } else if (format == WAVE_FORMAT_IEEE_FLOAT && bits_per_sample == 32) {
+        std::memcpy(samples.data(), pcm, sample_count * sizeof(float));
+    } else {
+        throw std::invalid_argument("Unsupported WAV sample format");
+    }
+
+    // Drop a trailing partial frame
+    samples.resize(samples.size() - samples.size() % channels);
+
+    return AudioSample(samples, static_cast<int>(sample_rate), static_cast<int>(channels));
+}
+
+} // namespace AudioFingerprint
@@ -187,4 +187,18 @@ AudioSample AudioPreprocessor::preprocess_for_fingerprinting(const AudioSample&
     return AudioSample(processed_data, current_sample_rate, 1);
 }
 
+AudioSample AudioPreprocessor::preprocess_at_native_rate(const AudioSample& sample) {
+    if (sample.empty()) {
+        throw std::invalid_argument("Input audio sample is empty");
+    }
+    
+    if (sample.channels > 2) {
+        throw std::invalid_argument("Only mono and stereo audio are supported");
+    }
+    
+    // Convert stereo to mono if necessary, then normalize
+    std::vector<float> processed_data = sample.channels == 2 ? stereo_to_mono(sample.data) : sample.data;
+    return AudioSample(normalize_audio(processed_data), sample.sample_rate, 1);
+}
+
 } // namespace AudioFingerprint
\ No newline at end of file
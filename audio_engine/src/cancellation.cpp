@@ -0,0 +1,105 @@
+#include "cancellation.h"
+
+namespace AudioFingerprint {
+
+namespace {
+
+int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+thread_local const std::shared_ptr<CancellationToken::State>* CancellationToken::current_ = nullptr;
+std::mutex CancellationToken::stats_mutex_;
+CancellationStats CancellationToken::stats_;
+
+OperationCancelled::OperationCancelled(const std::string& stage, bool deadline)
+    : std::runtime_error(std::string(deadline ? "Deadline expired" : "Operation cancelled") + " at " + stage),
+      stage_(stage), deadline_(deadline) {
+}
+
+CancellationToken::CancellationToken() : state_(std::make_shared<State>()) {
+}
+
+void CancellationToken::cancel() {
+    if (!state_->cancelled.exchange(true)) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.tokens_cancelled++;
+    }
+}
+
+void CancellationToken::set_deadline(int timeout_ms) {
+    state_->deadline_ns.store(timeout_ms < 0 ? 0 : steady_now_ns() + static_cast<int64_t>(timeout_ms) * 1000000);
+}
+
+bool CancellationToken::is_cancelled() const {
+    return cancelled(*state_);
+}
+
+bool CancellationToken::deadline_expired() const {
+    return !state_->cancelled.load(std::memory_order_relaxed) && cancelled(*state_);
+}
+
+bool CancellationToken::cancelled(State& state) {
+    if (state.cancelled.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    const int64_t deadline = state.deadline_ns.load(std::memory_order_relaxed);
+    if (deadline == 0 || steady_now_ns() < deadline) {
+        return false;
+    }
+
+    // The first observer of an expired deadline counts it
+    if (!state.deadline_passed.exchange(true)) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.deadlines_expired++;
+    }
+    return true;
+}
+
+void CancellationToken::check(const char* stage) {
+    if (current_ == nullptr || !cancelled(**current_)) {
+        return;
+    }
+
+    const bool deadline = CancellationToken(*current_).deadline_expired();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.operations_cancelled++;
+        stats_.by_stage[stage]++;
+    }
+    throw OperationCancelled(stage, deadline);
+}
+
+CancellationToken CancellationToken::current() {
+    return current_ ? CancellationToken(*current_) : CancellationToken();
+}
+
+void CancellationToken::count_queued_drop() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.queued_dropped++;
+}
+
+CancellationStats CancellationToken::stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void CancellationToken::reset_stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = CancellationStats();
+}
+
+CancellationScope::CancellationScope(const CancellationToken& token)
+    : state_(token.state_), previous_(CancellationToken::current_) {
+    CancellationToken::current_ = &state_;
+}
+
+CancellationScope::~CancellationScope() {
+    CancellationToken::current_ = previous_;
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,619 @@
+#include "corpus_reader.h"
+#include "audio_decoder.h"
+#include "cpu_pool.h"
+#include "cancellation.h"
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <sys/uio.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+#ifndef _WIN32
+/**
+ * Owns a file descriptor and closes it on every exit path
+ */
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd = -1) : fd_(fd) {}
+    ~FileDescriptor() { reset(); }
+
+    FileDescriptor(FileDescriptor&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept {
+        if (this != &other) {
+            reset(other.fd_);
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd_; }
+    bool valid() const { return fd_ >= 0; }
+
+    void reset(int fd = -1) {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        fd_ = fd;
+    }
+
+private:
+    int fd_;
+};
+#endif
+
+#ifdef HAVE_LIBURING
+/**
+ * Owns an io_uring instance and its registered buffers, releasing both on every exit path
+ */
+class Ring {
+public:
+    Ring() = default;
+    ~Ring() {
+        if (buffers_registered_) {
+            io_uring_unregister_buffers(&ring_);
+        }
+        if (initialized_) {
+            io_uring_queue_exit(&ring_);
+        }
+    }
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    /**
+     * @return false if the kernel has no io_uring or it is blocked by seccomp
+     */
+    bool init(unsigned entries) {
+        initialized_ = io_uring_queue_init(entries, &ring_, 0) == 0;
+        return initialized_;
+    }
+
+    /**
+     * @return false if the memlock limit does not allow registration
+     */
+    bool register_buffers(const iovec* iovecs, unsigned count) {
+        buffers_registered_ = io_uring_register_buffers(&ring_, iovecs, count) == 0;
+        return buffers_registered_;
+    }
+
+    io_uring* get() { return &ring_; }
+
+private:
+    io_uring ring_;
+    bool initialized_ = false;
+    bool buffers_registered_ = false;
+};
+#endif
+
+/**
+ * Read a whole file with blocking reads, accumulating time spent in the kernel
+ */
+std::vector<uint8_t> read_file_blocking(const std::string& path, size_t block_size, double& io_wait_ms) {
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t length = std::min(block_size, data.size() - offset);
+        auto start = Clock::now();
+        file.read(reinterpret_cast<char*>(data.data() + offset), static_cast<std::streamsize>(length));
+        io_wait_ms += elapsed_ms(start, Clock::now());
+        if (!file) {
+            throw std::runtime_error("Read failed for " + path);
+        }
+        offset += length;
+    }
+
+    return data;
+#else
+    FileDescriptor fd(::open(path.c_str(), O_RDONLY));
+    if (!fd.valid()) {
+        throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0) {
+        throw std::runtime_error("Cannot stat " + path + ": " + std::strerror(errno));
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(st.st_size));
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t length = std::min(block_size, data.size() - offset);
+        auto start = Clock::now();
+        ssize_t n = ::pread(fd.get(), data.data() + offset, length, static_cast<off_t>(offset));
+        io_wait_ms += elapsed_ms(start, Clock::now());
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("Read failed for " + path);
+        }
+        offset += static_cast<size_t>(n);
+    }
+
+    return data;
+#endif
+}
+
+} // namespace
+
+CorpusReader::CorpusReader(const CorpusReaderConfig& config) : config_(config) {
+    if (config.queue_depth <= 0 || config.max_open_files <= 0 || config.io_threads <= 0) {
+        throw std::invalid_argument("Queue depth, open file limit and I/O threads must be positive");
+    }
+
+    if (config.block_size == 0) {
+        throw std::invalid_argument("Block size must be positive");
+    }
+
+    if (!config.thread_pool.empty() && !CpuPools::defined(config.thread_pool)) {
+        throw std::invalid_argument("Unknown CPU pool: " + config.thread_pool);
+    }
+}
+
+bool CorpusReader::io_uring_compiled() {
+#ifdef HAVE_LIBURING
+    return true;
+#else
+    return false;
+#endif
+}
+
+CorpusReaderStats CorpusReader::read_all(const std::vector<std::string>& paths, const FileCallback& on_file) {
+    CorpusReaderStats stats;
+    auto start = Clock::now();
+
+#ifdef HAVE_LIBURING
+    if (config_.use_io_uring) {
+        // The ring is driven by the calling thread
+        CpuPoolScope placement(config_.thread_pool, false);
+        if (read_all_io_uring(paths, on_file, stats)) {
+            stats.backend = "io_uring";
+            stats.wall_time_ms = elapsed_ms(start, Clock::now());
+            return stats;
+        }
+    }
+#endif
+
+    stats.backend = "pread";
+    read_all_pread(paths, on_file, stats);
+    stats.wall_time_ms = elapsed_ms(start, Clock::now());
+    return stats;
+}
+
+void CorpusReader::read_all_pread(const std::vector<std::string>& paths, const FileCallback& on_file,
+                                  CorpusReaderStats& stats) {
+    std::atomic<size_t> next_index(0);
+    std::mutex stats_mutex;
+    const CancellationToken token = CancellationToken::current();
+
+    auto reader = [&]() {
+        CpuPoolScope placement(config_.thread_pool, true);
+        double io_wait_ms = 0.0;
+        uint64_t files_read = 0;
+        uint64_t files_failed = 0;
+        uint64_t bytes_read = 0;
+
+        for (size_t i = next_index++; i < paths.size() && !token.is_cancelled(); i = next_index++) {
+            std::vector<uint8_t> data;
+            std::string error;
+
+            try {
+                data = read_file_blocking(paths[i], config_.block_size, io_wait_ms);
+                files_read++;
+                bytes_read += data.size();
+            } catch (const std::exception& e) {
+                error = e.what();
+                files_failed++;
+            }
+
+            on_file(i, std::move(data), error);
+        }
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.io_wait_ms += io_wait_ms;
+        stats.files_read += files_read;
+        stats.files_failed += files_failed;
+        stats.bytes_read += bytes_read;
+    };
+
+    size_t thread_count = std::min(static_cast<size_t>(config_.io_threads), paths.size());
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back(reader);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+#ifdef HAVE_LIBURING
+bool CorpusReader::read_all_io_uring(const std::vector<std::string>& paths, const FileCallback& on_file,
+                                     CorpusReaderStats& stats) {
+    struct OpenFile {
+        size_t index;
+        FileDescriptor fd;
+        uint64_t size;
+        uint64_t next_offset;   // Next byte not yet requested
+        uint64_t completed;     // Bytes copied into data
+        int in_flight;
+        bool failed;
+        std::string error;
+        std::vector<uint8_t> data;
+    };
+
+    struct ReadRequest {
+        int slot;
+        uint64_t offset;
+        unsigned length;
+    };
+
+    const int depth = config_.queue_depth;
+    const size_t block_size = config_.block_size;
+
+    // The buffers and requests are declared before the ring so that reads still
+    // in flight when an exception unwinds are torn down before their targets
+    std::vector<std::vector<uint8_t>> buffers(depth, std::vector<uint8_t>(block_size));
+    std::vector<ReadRequest> requests(depth);
+    std::vector<OpenFile> slots(config_.max_open_files);
+
+    Ring ring;
+    if (!ring.init(static_cast<unsigned>(depth))) {
+        return false;  // Kernel without io_uring or blocked by seccomp
+    }
+
+    // One registered buffer per in-flight read; fall back to plain reads if the
+    // memlock limit does not allow registration
+    std::vector<iovec> iovecs(depth);
+    for (int b = 0; b < depth; ++b) {
+        iovecs[b].iov_base = buffers[b].data();
+        iovecs[b].iov_len = block_size;
+    }
+    bool fixed_buffers = ring.register_buffers(iovecs.data(), static_cast<unsigned>(depth));
+
+    std::vector<int> free_buffers;
+    for (int b = depth - 1; b >= 0; --b) {
+        free_buffers.push_back(b);
+    }
+
+    std::vector<int> free_slots;
+    for (int s = config_.max_open_files - 1; s >= 0; --s) {
+        free_slots.push_back(s);
+    }
+
+    size_t next_path = 0;
+    int total_in_flight = 0;
+    int round_robin = 0;
+    const CancellationToken token = CancellationToken::current();
+
+    auto finish_file = [&](int slot) {
+        OpenFile& file = slots[slot];
+        file.fd.reset();
+
+        if (file.failed) {
+            stats.files_failed++;
+            on_file(file.index, std::vector<uint8_t>(), file.error);
+        } else {
+            stats.files_read++;
+            stats.bytes_read += file.size;
+            on_file(file.index, std::move(file.data), std::string());
+        }
+
+        file.data = std::vector<uint8_t>();
+        free_slots.push_back(slot);
+    };
+
+    auto submit_read = [&](int slot, int buffer, uint64_t offset, unsigned length) {
+        io_uring_sqe* sqe = io_uring_get_sqe(ring.get());
+        if (fixed_buffers) {
+            io_uring_prep_read_fixed(sqe, slots[slot].fd.get(), buffers[buffer].data(), length, offset, buffer);
+        } else {
+            io_uring_prep_read(sqe, slots[slot].fd.get(), buffers[buffer].data(), length, offset);
+        }
+        io_uring_sqe_set_data(sqe, &requests[buffer]);
+        requests[buffer] = ReadRequest{slot, offset, length};
+        slots[slot].in_flight++;
+        total_in_flight++;
+    };
+
+    while (next_path < paths.size() || total_in_flight > 0 ||
+           static_cast<int>(free_slots.size()) < config_.max_open_files) {
+        if (token.is_cancelled()) {
+            next_path = paths.size();  // Let the files in flight complete, start no more
+        }
+
+        // Open files up to the concurrency limit
+        while (!free_slots.empty() && next_path < paths.size()) {
+            size_t index = next_path++;
+            FileDescriptor fd(::open(paths[index].c_str(), O_RDONLY));
+            struct stat st;
+
+            if (!fd.valid() || ::fstat(fd.get(), &st) != 0) {
+                std::string error = "Cannot open " + paths[index] + ": " + std::strerror(errno);
+                fd.reset();
+                stats.files_failed++;
+                on_file(index, std::vector<uint8_t>(), error);
+                continue;
+            }
+
+            int slot = free_slots.back();
+            free_slots.pop_back();
+
+            OpenFile& file = slots[slot];
+            file.index = index;
+            file.fd = std::move(fd);
+            file.size = static_cast<uint64_t>(st.st_size);
+            file.next_offset = 0;
+            file.completed = 0;
+            file.in_flight = 0;
+            file.failed = false;
+            file.error.clear();
+            file.data.assign(static_cast<size_t>(file.size), 0);
+
+            if (file.size == 0) {
+                finish_file(slot);
+            }
+        }
+
+        // Fill free buffers with block reads spread across the open files
+        int stalled = 0;
+        while (!free_buffers.empty() && stalled < config_.max_open_files) {
+            int slot = round_robin;
+            round_robin = (round_robin + 1) % config_.max_open_files;
+
+            OpenFile& file = slots[slot];
+            if (!file.fd.valid() || file.failed || file.next_offset >= file.size) {
+                stalled++;
+                continue;
+            }
+            stalled = 0;
+
+            int buffer = free_buffers.back();
+            free_buffers.pop_back();
+
+            unsigned length = static_cast<unsigned>(std::min<uint64_t>(block_size, file.size - file.next_offset));
+            submit_read(slot, buffer, file.next_offset, length);
+            file.next_offset += length;
+        }
+
+        if (total_in_flight == 0) {
+            if (next_path >= paths.size()) {
+                break;
+            }
+            continue;
+        }
+
+        io_uring_submit(ring.get());
+
+        // Block for one completion, then drain whatever else is ready
+        io_uring_cqe* cqe = nullptr;
+        auto wait_start = Clock::now();
+        int ret = io_uring_wait_cqe(ring.get(), &cqe);
+        stats.io_wait_ms += elapsed_ms(wait_start, Clock::now());
+
+        if (ret < 0) {
+            if (ret == -EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("io_uring_wait_cqe failed: ") + std::strerror(-ret));
+        }
+
+        while (cqe != nullptr) {
+            ReadRequest* request = static_cast<ReadRequest*>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(ring.get(), cqe);
+
+            int buffer = static_cast<int>(request - requests.data());
+            OpenFile& file = slots[request->slot];
+            file.in_flight--;
+            total_in_flight--;
+
+            if (result < 0 || (result == 0 && request->length > 0)) {
+                file.failed = true;
+                file.error = "Read failed for " + paths[file.index] + ": " +
+                             (result < 0 ? std::strerror(-result) : "unexpected end of file");
+                free_buffers.push_back(buffer);
+            } else {
+                std::memcpy(file.data.data() + request->offset, buffers[buffer].data(),
+                            static_cast<size_t>(result));
+                file.completed += static_cast<uint64_t>(result);
+
+                if (static_cast<unsigned>(result) < request->length) {
+                    // Short read: request the remainder into the same buffer
+                    submit_read(request->slot, buffer, request->offset + result,
+                                request->length - static_cast<unsigned>(result));
+                } else {
+                    free_buffers.push_back(buffer);
+                }
+            }
+
+            if (file.in_flight == 0 && (file.failed || file.completed == file.size)) {
+                finish_file(request->slot);
+            }
+
+            cqe = nullptr;
+            if (io_uring_peek_cqe(ring.get(), &cqe) != 0) {
+                cqe = nullptr;
+            }
+        }
+    }
+
+    return true;
+}
+#endif
+
+std::vector<BatchProcessingResult> batch_process_files(
+    const std::vector<std::string>& paths,
+    const std::vector<std::string>& song_ids,
+    int compute_threads,
+    const CorpusReaderConfig& config,
+    CorpusReaderStats& stats) {
+
+    if (paths.size() != song_ids.size()) {
+        throw std::invalid_argument("File paths and song IDs must have same size");
+    }
+
+    if (compute_threads <= 0) {
+        compute_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    std::vector<BatchProcessingResult> results(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        results[i].song_id = song_ids[i];
+    }
+
+    // Compute threads run under the caller's token; once it is cancelled they
+    // discard queued files and the whole batch throws after they have stopped
+    const CancellationToken token = CancellationToken::current();
+
+    // Bounded hand-off between the reader and the compute threads; a full queue
+    // stalls the reader so memory stays proportional to the number of workers
+    const size_t max_pending = static_cast<size_t>(compute_threads) * 2;
+    std::deque<std::pair<size_t, std::vector<uint8_t>>> pending;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool reading_done = false;
+    double compute_ms = 0.0;
+    double compute_idle_ms = 0.0;
+
+    auto compute_worker = [&]() {
+        CpuPoolScope placement(config.thread_pool, true);
+        CancellationScope cancellation(token);
+        AudioDecoder decoder;
+        HashGenerator generator;
+        double busy_ms = 0.0;
+        double idle_ms = 0.0;
+
+        while (true) {
+            std::pair<size_t, std::vector<uint8_t>> item;
+            {
+                auto wait_start = Clock::now();
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [&] { return reading_done || !pending.empty(); });
+                idle_ms += elapsed_ms(wait_start, Clock::now());
+
+                if (pending.empty()) {
+                    break;
+                }
+                item = std::move(pending.front());
+                pending.pop_front();
+            }
+            not_full.notify_one();
+
+            BatchProcessingResult& result = results[item.first];
+            if (token.is_cancelled()) {
+                continue;
+            }
+            auto start = Clock::now();
+
+            try {
+                AudioSample sample = decoder.decode(item.second.data(), item.second.size());
+                item.second = std::vector<uint8_t>();  // Release the encoded bytes early
+                result.fingerprints = generator.process_audio_sample(sample);
+                result.total_duration_ms = sample.duration_ms;
+                result.success = true;
+            } catch (const std::exception& e) {
+                result.success = false;
+                result.error_message = e.what();
+            }
+
+            double file_ms = elapsed_ms(start, Clock::now());
+            result.processing_time_ms = static_cast<int>(file_ms);
+            busy_ms += file_ms;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        compute_ms += busy_ms;
+        compute_idle_ms += idle_ms;
+    };
+
+    // Constructed first so an invalid configuration throws before any thread starts
+    CorpusReader reader(config);
+
+    std::vector<std::thread> workers;
+    workers.reserve(compute_threads);
+    for (int t = 0; t < compute_threads; ++t) {
+        workers.emplace_back(compute_worker);
+    }
+
+    try {
+        stats = reader.read_all(paths, [&](size_t index, std::vector<uint8_t>&& data, const std::string& error) {
+            if (!error.empty()) {
+                results[index].success = false;
+                results[index].error_message = error;
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&] { return pending.size() < max_pending; });
+            pending.emplace_back(index, std::move(data));
+            lock.unlock();
+            not_empty.notify_one();
+        });
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reading_done = true;
+        }
+        not_empty.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reading_done = true;
+    }
+    not_empty.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    CancellationToken::check("corpus");
+
+    stats.compute_ms = compute_ms;
+    stats.compute_idle_ms = compute_idle_ms;
+    return results;
+}
+
+} // namespace AudioFingerprint
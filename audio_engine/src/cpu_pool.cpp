@@ -0,0 +1,238 @@
+#include "cpu_pool.h"
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <ctime>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Highest CPU number a pool may name (size of cpu_set_t)
+const int MAX_CPUS = 1024;
+
+double elapsed_ms(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * CPU time of the calling thread; wall time where no per-thread clock exists
+ */
+double thread_cpu_ms() {
+#ifndef _WIN32
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+    }
+#endif
+    return std::chrono::duration<double, std::milli>(Clock::now().time_since_epoch()).count();
+}
+
+#ifdef __linux__
+bool get_thread_cpus(std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return false;
+    }
+    cpus.clear();
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return true;
+}
+
+bool set_thread_cpus(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+bool set_thread_nice(int nice) {
+    // Linux applies PRIO_PROCESS to the single thread a TID names
+    return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) == 0;
+}
+#endif
+
+} // namespace
+
+std::mutex CpuPools::registry_mutex_;
+std::map<std::string, std::shared_ptr<CpuPools::Pool>> CpuPools::pools_;
+
+void CpuPoolConfig::validate() const {
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= MAX_CPUS) {
+            throw std::invalid_argument("CPU numbers must be in [0, " + std::to_string(MAX_CPUS) + ")");
+        }
+    }
+
+    if (nice < -20 || nice > 19) {
+        throw std::invalid_argument("Niceness must be in [-20, 19]");
+    }
+}
+
+void CpuPools::define(const std::string& name, const CpuPoolConfig& config) {
+    if (name.empty()) {
+        throw std::invalid_argument("CPU pool name must not be empty");
+    }
+    config.validate();
+
+    auto pool = std::make_shared<Pool>();
+    pool->config = config;
+    std::sort(pool->config.cpus.begin(), pool->config.cpus.end());
+    pool->config.cpus.erase(std::unique(pool->config.cpus.begin(), pool->config.cpus.end()),
+                            pool->config.cpus.end());
+    pool->stats.name = name;
+    pool->stats.config = pool->config;
+    pool->stats_start = Clock::now();
+
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    pools_[name] = pool;
+}
+
+bool CpuPools::defined(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    return pools_.count(name) > 0;
+}
+
+std::vector<CpuPoolStats> CpuPools::stats() {
+    std::vector<std::shared_ptr<Pool>> pools;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        for (const auto& entry : pools_) {
+            pools.push_back(entry.second);
+        }
+    }
+
+    const double hardware_cpus = static_cast<double>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<CpuPoolStats> result;
+    for (const auto& pool : pools) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        CpuPoolStats stats = pool->stats;
+        stats.elapsed_ms = elapsed_ms(pool->stats_start, Clock::now());
+
+        double cpus = pool->config.cpus.empty() ? hardware_cpus : static_cast<double>(pool->config.cpus.size());
+        stats.utilisation = stats.elapsed_ms > 0.0 ? stats.cpu_ms / (stats.elapsed_ms * cpus) : 0.0;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+void CpuPools::reset_stats() {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+    for (auto& entry : pools_) {
+        Pool& pool = *entry.second;
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        // Threads still inside keep counting from now on
+        CpuPoolStats fresh;
+        fresh.name = pool.stats.name;
+        fresh.config = pool.stats.config;
+        fresh.active_threads = pool.stats.active_threads;
+        pool.stats = fresh;
+        pool.stats_start = Clock::now();
+    }
+}
+
+bool CpuPools::placement_supported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::shared_ptr<CpuPools::Pool> CpuPools::find(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    auto it = pools_.find(name);
+    if (it == pools_.end()) {
+        throw std::invalid_argument("Unknown CPU pool: " + name);
+    }
+    return it->second;
+}
+
+CpuPoolScope::CpuPoolScope(const std::string& name, bool owned_thread) : cpu_mark_ms_(0.0) {
+    if (name.empty()) {
+        return;
+    }
+
+    pool_ = CpuPools::find(name);
+    const CpuPoolConfig& config = pool_->config;
+    uint64_t failures = 0;
+
+#ifdef __linux__
+    if (!config.cpus.empty()) {
+        std::vector<int> previous;
+        bool saved = owned_thread || get_thread_cpus(previous);
+        if (saved && set_thread_cpus(config.cpus)) {
+            previous_cpus_ = std::move(previous);
+        } else {
+            failures++;
+        }
+    }
+
+    if (owned_thread && config.nice != 0 && !set_thread_nice(config.nice)) {
+        failures++;
+    }
+#else
+    (void)owned_thread;
+#endif
+
+    wall_mark_ = std::chrono::steady_clock::now();
+    cpu_mark_ms_ = thread_cpu_ms();
+
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    pool_->stats.threads_entered++;
+    pool_->stats.active_threads++;
+    pool_->stats.placement_failures += failures;
+}
+
+CpuPoolScope::~CpuPoolScope() {
+    if (!pool_) {
+        return;
+    }
+
+    checkpoint();
+
+#ifdef __linux__
+    if (!previous_cpus_.empty()) {
+        set_thread_cpus(previous_cpus_);
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    pool_->stats.active_threads--;
+}
+
+void CpuPoolScope::checkpoint() {
+    if (!pool_) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double cpu_now = thread_cpu_ms();
+    double busy = elapsed_ms(wall_mark_, now);
+    double cpu = cpu_now - cpu_mark_ms_;
+    wall_mark_ = now;
+    cpu_mark_ms_ = cpu_now;
+
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    pool_->stats.busy_ms += busy;
+    pool_->stats.cpu_ms += cpu;
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,483 @@
+#include "engine_pool.h"
+#include "audio_preprocessor.h"
+#include "tiled_peak_pipeline.h"
+#include "peak_detector.h"
+#include "native_rate_analyzer.h"
+#include "cpu_pool.h"
+#include "engine_tuning.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace AudioFingerprint {
+
+namespace {
+
+// Relative weights of the pipeline stages in cost units
+constexpr double WEIGHT_INPUT_PER_MSAMPLE = 1.0;   // Mono mixdown, resampling, normalization
+constexpr double WEIGHT_PER_SECOND = 1.0;          // STFT frames
+constexpr double WEIGHT_ACTIVE_PER_SECOND = 2.0;   // Local-max scan and adaptive threshold
+constexpr double WEIGHT_PAIRING_PER_SECOND = 4.0;  // Landmark pairing (quadratic in density)
+
+// Initial calibration before any request has completed
+constexpr double DEFAULT_MS_PER_UNIT = 5.0;
+
+// Blocks quieter than this (relative mean square) count as silence
+constexpr double ACTIVE_ENERGY_FLOOR = 0.01;
+
+// Minimum retry hint returned with a rejection
+constexpr int MIN_RETRY_AFTER_MS = 100;
+
+// How often a waiting caller checks its cancellation token
+constexpr std::chrono::milliseconds CANCEL_POLL_INTERVAL(5);
+
+int priority_index(RequestPriority priority) {
+    return static_cast<int>(priority);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start,
+                  std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+CostEstimator::CostEstimator() : ms_per_unit_(DEFAULT_MS_PER_UNIT) {
+}
+
+CostEstimate CostEstimator::estimate(const AudioSample& sample, int max_duration_ms) const {
+    CostEstimate estimate;
+
+    if (sample.empty() || sample.sample_rate <= 0 || sample.channels <= 0) {
+        return estimate;
+    }
+
+    size_t total_frames = sample.data.size() / static_cast<size_t>(sample.channels);
+    size_t frames = total_frames;
+    if (max_duration_ms > 0) {
+        size_t max_frames = static_cast<size_t>(
+            static_cast<int64_t>(max_duration_ms) * sample.sample_rate / 1000);
+        frames = std::min(frames, max_frames);
+    }
+
+    double seconds = static_cast<double>(frames) / static_cast<double>(sample.sample_rate);
+    double input_msamples = static_cast<double>(frames * sample.channels) / 1e6;
+    float active = compute_active_fraction(sample, frames);
+
+    estimate.duration_ms = static_cast<int>(seconds * 1000.0);
+    estimate.active_fraction = active;
+    estimate.cost_units = WEIGHT_INPUT_PER_MSAMPLE * input_msamples +
+                          WEIGHT_PER_SECOND * seconds +
+                          WEIGHT_ACTIVE_PER_SECOND * seconds * active +
+                          WEIGHT_PAIRING_PER_SECOND * seconds * active * active;
+    estimate.estimated_ms = estimate.cost_units * ms_per_unit_.load();
+
+    return estimate;
+}
+
+void CostEstimator::observe(double cost_units, double actual_ms) {
+    if (cost_units <= 0.0 || actual_ms < 0.0) {
+        return;
+    }
+
+    double observed = actual_ms / cost_units;
+    double current = ms_per_unit_.load();
+    ms_per_unit_.store(current + CALIBRATION_ALPHA * (observed - current));
+}
+
+double CostEstimator::get_ms_per_unit() const {
+    return ms_per_unit_.load();
+}
+
+float CostEstimator::compute_active_fraction(const AudioSample& sample, size_t max_frames) const {
+    const size_t channels = static_cast<size_t>(sample.channels);
+    const size_t block = static_cast<size_t>(ENERGY_BLOCK_SIZE);
+
+    std::vector<double> block_energy;
+    block_energy.reserve(max_frames / block + 1);
+
+    // Strided mean square of the first channel per block
+    for (size_t start = 0; start < max_frames; start += block) {
+        size_t end = std::min(start + block, max_frames);
+        double sum = 0.0;
+        size_t count = 0;
+
+        for (size_t i = start; i < end; i += ENERGY_STRIDE) {
+            float value = sample.data[i * channels];
+            sum += static_cast<double>(value) * value;
+            count++;
+        }
+
+        block_energy.push_back(count > 0 ? sum / static_cast<double>(count) : 0.0);
+    }
+
+    if (block_energy.empty()) {
+        return 0.0f;
+    }
+
+    double max_energy = *std::max_element(block_energy.begin(), block_energy.end());
+    if (max_energy < 1e-12) {
+        return 0.0f;
+    }
+
+    double floor = max_energy * ACTIVE_ENERGY_FLOOR;
+    size_t active = std::count_if(block_energy.begin(), block_energy.end(),
+                                  [floor](double e) { return e >= floor; });
+
+    return static_cast<float>(active) / static_cast<float>(block_energy.size());
+}
+
+EnginePool::EnginePool(int num_workers, const AdmissionPolicy& policy, const std::string& thread_pool)
+    : policy_(policy), thread_pool_(thread_pool), queued_ms_{0.0, 0.0}, in_flight_ms_(0.0), stopping_(false),
+      total_queue_wait_ms_{0.0, 0.0} {
+
+    if (num_workers < 0) {
+        throw std::invalid_argument("Number of workers must be non-negative");
+    }
+
+    if (policy.interactive_slo_ms <= 0 || policy.batch_slo_ms <= 0) {
+        throw std::invalid_argument("SLO must be positive");
+    }
+
+    if (policy.max_queue_depth <= 0) {
+        throw std::invalid_argument("Maximum queue depth must be positive");
+    }
+
+    if (!thread_pool.empty() && !CpuPools::defined(thread_pool)) {
+        throw std::invalid_argument("Unknown CPU pool: " + thread_pool);
+    }
+
+    if (num_workers == 0) {
+        num_workers = EngineTuning::current().pool_workers;
+    }
+    if (num_workers == 0) {
+        num_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    stats_.num_workers = num_workers;
+    workers_.reserve(num_workers);
+    for (int i = 0; i < num_workers; ++i) {
+        workers_.emplace_back(&EnginePool::worker_loop, this);
+    }
+}
+
+EnginePool::~EnginePool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+std::future<PoolRequestResult> EnginePool::submit(const AudioSample& sample, RequestPriority priority,
+                                                  const FingerprintProfile& profile,
+                                                  const CancellationToken& cancel_token) {
+    if (sample.empty()) {
+        throw std::invalid_argument("Audio sample is empty");
+    }
+
+    profile.validate();
+
+    if (sample.sample_rate <= 0 || sample.channels <= 0) {
+        throw std::invalid_argument("Sample rate and channel count must be positive");
+    }
+
+    const int p = priority_index(priority);
+    const double slo = static_cast<double>(slo_for(priority));
+
+    // Cost estimates do not depend on pool state, compute them outside the lock
+    CostEstimate full = estimator_.estimate(sample);
+    CostEstimate reduced;
+    bool can_downgrade = priority == RequestPriority::INTERACTIVE && policy_.allow_downgrade &&
+                         full.duration_ms > policy_.reduced_max_duration_ms;
+    if (can_downgrade) {
+        reduced = estimator_.estimate(sample, policy_.reduced_max_duration_ms);
+    }
+
+    // Copy the sample before taking the lock; a downgrade only truncates it
+    Job job;
+    job.sample = sample;
+    job.profile = profile;
+    job.cancel_token = cancel_token;
+
+    std::vector<Job> dropped;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Cancelled requests no longer count towards the projected wait
+    take_cancelled(dropped);
+    double wait = projected_wait_ms(priority);
+    bool queue_full = static_cast<int>(queues_[p].size()) >= policy_.max_queue_depth;
+    job.enqueued_at = std::chrono::steady_clock::now();
+
+    if (!queue_full && wait + full.estimated_ms <= slo) {
+        job.mode = ProcessingMode::FULL;
+        job.estimate = full;
+    } else if (!queue_full && can_downgrade && wait + reduced.estimated_ms <= slo) {
+        job.mode = ProcessingMode::REDUCED;
+        job.estimate = reduced;
+
+        // Only the analysed prefix is handed to the worker
+        size_t frames = static_cast<size_t>(
+            static_cast<int64_t>(policy_.reduced_max_duration_ms) * sample.sample_rate / 1000);
+        job.sample.data.resize(std::min(sample.data.size(), frames * sample.channels));
+        job.sample.duration_ms = reduced.duration_ms;
+    } else {
+        stats_.rejected[p]++;
+        lock.unlock();
+        resolve_cancelled(dropped);
+
+        PoolRequestResult result;
+        result.status = AdmissionStatus::REJECTED;
+        result.estimated_ms = full.estimated_ms;
+        result.retry_after_ms = std::max(MIN_RETRY_AFTER_MS,
+                                         static_cast<int>(std::ceil(wait + full.estimated_ms - slo)));
+        result.error_message = "Engine overloaded: projected latency exceeds SLO";
+
+        std::promise<PoolRequestResult> promise;
+        promise.set_value(std::move(result));
+        return promise.get_future();
+    }
+
+    if (job.mode == ProcessingMode::REDUCED) {
+        stats_.downgraded[p]++;
+    } else {
+        stats_.admitted[p]++;
+    }
+
+    std::future<PoolRequestResult> future = job.promise.get_future();
+    queued_ms_[p] += job.estimate.estimated_ms;
+    queues_[p].push_back(std::move(job));
+    lock.unlock();
+    resolve_cancelled(dropped);
+
+    cv_.notify_one();
+    return future;
+}
+
+PoolRequestResult EnginePool::process(const AudioSample& sample, RequestPriority priority,
+                                      const FingerprintProfile& profile, const CancellationToken& cancel_token) {
+    std::future<PoolRequestResult> future = submit(sample, priority, profile, cancel_token);
+
+    // A cancelled request still queued is removed by its caller, not left until a worker frees up
+    while (future.wait_for(CANCEL_POLL_INTERVAL) != std::future_status::ready) {
+        if (cancel_token.is_cancelled()) {
+            drop_cancelled();
+        }
+    }
+    return future.get();
+}
+
+void EnginePool::drop_cancelled() {
+    std::vector<Job> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        take_cancelled(dropped);
+    }
+    resolve_cancelled(dropped);
+}
+
+CostEstimate EnginePool::estimate_cost(const AudioSample& sample) const {
+    return estimator_.estimate(sample);
+}
+
+PoolStatistics EnginePool::get_statistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    PoolStatistics stats = stats_;
+    for (int p = 0; p < 2; ++p) {
+        stats.queue_depth[p] = static_cast<int>(queues_[p].size());
+        stats.avg_queue_wait_ms[p] = stats_.completed[p] > 0
+            ? total_queue_wait_ms_[p] / static_cast<double>(stats_.completed[p])
+            : 0.0;
+        stats.projected_wait_ms[p] = projected_wait_ms(static_cast<RequestPriority>(p));
+    }
+    stats.ms_per_cost_unit = estimator_.get_ms_per_unit();
+
+    return stats;
+}
+
+void EnginePool::worker_loop() {
+    CpuPoolScope placement(thread_pool_, true);
+
+    // FFTW plans are expensive to create, so each worker keeps its own pipeline
+    TiledPeakPipeline pipeline(2048, 1024);
+
+    while (true) {
+        Job job;
+        int p = 0;
+        std::vector<Job> dropped;
+        bool have_job = false;
+        bool stop = false;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] {
+                return stopping_ || !queues_[0].empty() || !queues_[1].empty();
+            });
+            take_cancelled(dropped);
+
+            if (queues_[0].empty() && queues_[1].empty()) {
+                stop = stopping_;  // Stopping and fully drained, or everything queued was cancelled
+            } else {
+                // Strict priority: interactive work always overtakes batch work
+                p = queues_[0].empty() ? 1 : 0;
+                job = std::move(queues_[p].front());
+                queues_[p].pop_front();
+                queued_ms_[p] = std::max(0.0, queued_ms_[p] - job.estimate.estimated_ms);
+                in_flight_ms_ += job.estimate.estimated_ms;
+                have_job = true;
+            }
+        }
+
+        resolve_cancelled(dropped);
+        if (stop) {
+            return;
+        }
+        if (!have_job) {
+            continue;
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+
+        PoolRequestResult result;
+        result.status = job.mode == ProcessingMode::REDUCED ? AdmissionStatus::DOWNGRADED
+                                                            : AdmissionStatus::ADMITTED;
+        result.mode = job.mode;
+        result.estimated_ms = job.estimate.estimated_ms;
+        result.queue_wait_ms = elapsed_ms(job.enqueued_at, start_time);
+
+        try {
+            CancellationScope cancellation(job.cancel_token);
+            result.fingerprints = run_pipeline(job, pipeline);
+            result.success = true;
+        } catch (const OperationCancelled& e) {
+            result.cancelled_at = e.stage();
+            result.error_message = e.what();
+        } catch (const std::exception& e) {
+            result.success = false;
+            result.error_message = e.what();
+        }
+
+        result.processing_time_ms = elapsed_ms(start_time, std::chrono::steady_clock::now());
+        placement.checkpoint();
+
+        if (result.success) {
+            estimator_.observe(job.estimate.cost_units, result.processing_time_ms);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_ms_ = std::max(0.0, in_flight_ms_ - job.estimate.estimated_ms);
+            stats_.completed[p]++;
+            if (!result.cancelled_at.empty()) {
+                stats_.cancelled[p]++;
+            }
+            total_queue_wait_ms_[p] += result.queue_wait_ms;
+        }
+
+        job.promise.set_value(std::move(result));
+    }
+}
+
+std::vector<Fingerprint> EnginePool::run_pipeline(const Job& job, TiledPeakPipeline& pipeline) const {
+    const FingerprintProfile& profile = job.profile;
+
+    AudioPreprocessor preprocessor;
+    PeakDetector peak_detector(profile.min_peak_distance,
+                               job.mode == ProcessingMode::REDUCED
+                                   ? std::max(profile.adaptive_factor, policy_.reduced_adaptive_factor)
+                                   : profile.adaptive_factor,
+                               profile.min_magnitude_threshold);
+    peak_detector.set_frequency_interpolation(profile.interpolate_frequency);
+    peak_detector.set_time_interpolation(profile.interpolate_time);
+    HashGenerator generator(profile.freq_quantization, profile.time_quantization);
+
+    if (profile.native_rate && job.sample.sample_rate > NativeRateAnalyzer::ANALYSIS_RATE) {
+        return generator.process_at_native_rate(job.sample, peak_detector, profile);
+    }
+
+    auto preprocessed = preprocessor.preprocess_for_fingerprinting(job.sample);
+    CancellationToken::check("preprocess");
+
+    std::unique_ptr<TiledPeakPipeline> profile_pipeline;
+    if (profile.fft_size != pipeline.get_fft_size() || profile.hop_size != pipeline.get_hop_size()) {
+        profile_pipeline.reset(new TiledPeakPipeline(profile.fft_size, profile.hop_size));
+    }
+    TiledPeakPipeline& analysis = profile_pipeline ? *profile_pipeline : pipeline;
+
+    ConstellationMap constellation = analysis.detect_peaks(preprocessed.data, peak_detector);
+    std::vector<Fingerprint> fingerprints = generator.hash_constellation(peak_detector, constellation, profile);
+
+    // Sub-hop phases, as in HashGenerator::process_audio_sample()
+    for (int phase = 1; phase < profile.analysis_phases; ++phase) {
+        const int shift = profile.phase_shift(phase);
+        if (static_cast<size_t>(shift) >= preprocessed.data.size()) {
+            break;
+        }
+        std::vector<float> shifted(preprocessed.data.begin() + shift, preprocessed.data.end());
+        constellation = analysis.detect_peaks(shifted, peak_detector);
+        HashGenerator::append_phase(fingerprints, generator.hash_constellation(peak_detector, constellation, profile),
+                                    shift, preprocessed.sample_rate);
+    }
+
+    return fingerprints;
+}
+
+void EnginePool::take_cancelled(std::vector<Job>& dropped) {
+    for (int p = 0; p < 2; ++p) {
+        std::deque<Job>& queue = queues_[p];
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (!it->cancel_token.is_cancelled()) {
+                ++it;
+                continue;
+            }
+            queued_ms_[p] = std::max(0.0, queued_ms_[p] - it->estimate.estimated_ms);
+            stats_.cancelled[p]++;
+            dropped.push_back(std::move(*it));
+            it = queue.erase(it);
+        }
+    }
+}
+
+void EnginePool::resolve_cancelled(std::vector<Job>& dropped) {
+    auto now = std::chrono::steady_clock::now();
+    for (Job& job : dropped) {
+        CancellationToken::count_queued_drop();
+
+        PoolRequestResult result;
+        result.status = job.mode == ProcessingMode::REDUCED ? AdmissionStatus::DOWNGRADED
+                                                            : AdmissionStatus::ADMITTED;
+        result.mode = job.mode;
+        result.estimated_ms = job.estimate.estimated_ms;
+        result.queue_wait_ms = elapsed_ms(job.enqueued_at, now);
+        result.cancelled_at = "queue";
+        result.error_message = "Cancelled while queued";
+        job.promise.set_value(std::move(result));
+    }
+    dropped.clear();
+}
+
+double EnginePool::projected_wait_ms(RequestPriority priority) const {
+    // Work this request cannot overtake: everything queued at the same or higher
+    // priority plus everything already running, shared across the workers
+    double backlog = in_flight_ms_;
+    for (int p = 0; p <= priority_index(priority); ++p) {
+        backlog += queued_ms_[p];
+    }
+
+    return backlog / static_cast<double>(std::max(1, stats_.num_workers));
+}
+
+int EnginePool::slo_for(RequestPriority priority) const {
+    return priority == RequestPriority::INTERACTIVE ? policy_.interactive_slo_ms
+                                                    : policy_.batch_slo_ms;
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,577 @@
+#include "engine_tuning.h"
+#include "tiled_peak_pipeline.h"
+#include "hash_generator.h"
+#include "fingerprint_index.h"
+#include "ingest_wal.h"
+#include "synthetic_catalog.h"
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* const WISDOM_HEADER = "AFWISDOM 1";
+const int ANALYSIS_RATE = 11025;
+const int WAL_WRITERS = 8;
+const int WAL_FINGERPRINTS = 64;
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int host_cpus() {
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+/**
+ * 1, 2, 4, ... up to the core count, and the core count itself
+ */
+std::vector<int> thread_candidates() {
+    std::vector<int> candidates;
+    for (int threads = 1; threads < host_cpus(); threads *= 2) {
+        candidates.push_back(threads);
+    }
+    candidates.push_back(host_cpus());
+    return candidates;
+}
+
+/**
+ * Tones that hop between frequencies over noise, so the peak detector finds
+ * a realistic number of peaks
+ */
+std::vector<float> synthetic_audio(int seconds, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<float> frequency(200.0f, 4000.0f);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+
+    std::vector<float> audio(static_cast<size_t>(seconds) * ANALYSIS_RATE);
+    float tones[3] = {frequency(rng), frequency(rng), frequency(rng)};
+    for (size_t i = 0; i < audio.size(); ++i) {
+        if (i % (ANALYSIS_RATE / 4) == 0) {
+            tones[rng() % 3] = frequency(rng);
+        }
+        float t = static_cast<float>(i) / ANALYSIS_RATE;
+        float sample = noise(rng);
+        for (float tone : tones) {
+            sample += 0.2f * std::sin(6.2831853f * tone * t);
+        }
+        audio[i] = sample;
+    }
+    return audio;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+}
+
+/**
+ * Restores the settings in effect when a tuning run started
+ */
+class TuningRestore {
+public:
+    TuningRestore() : tuning_(EngineTuning::current()), source_(EngineTuning::source()) {}
+    ~TuningRestore() { EngineTuning::install(tuning_, source_); }
+
+private:
+    EngineTuning tuning_;
+    std::string source_;
+};
+
+} // namespace
+
+std::once_flag EngineTuning::load_once_;
+std::mutex EngineTuning::mutex_;
+EngineTuning EngineTuning::current_;
+std::atomic<uint64_t> EngineTuning::generation_(0);
+std::string EngineTuning::source_ = "defaults";
+
+void EngineTuning::validate() const {
+    if (tile_frames <= 0 || tile_frames > 4096) {
+        throw std::invalid_argument("tile_frames must be in [1, 4096]");
+    }
+    if (prefetch_distance < 0 || prefetch_distance > 64) {
+        throw std::invalid_argument("prefetch_distance must be in [0, 64]");
+    }
+    if (parallel_query_min_hashes <= 0 || parallel_query_min_hashes > (1 << 20)) {
+        throw std::invalid_argument("parallel_query_min_hashes must be in [1, 1048576]");
+    }
+    if (query_threads < 0 || query_threads > 1024) {
+        throw std::invalid_argument("query_threads must be in [0, 1024]");
+    }
+    if (pool_workers < 0 || pool_workers > 1024) {
+        throw std::invalid_argument("pool_workers must be in [0, 1024]");
+    }
+    if (commit_window_us < 0 || commit_window_us > 1000000) {
+        throw std::invalid_argument("commit_window_us must be in [0, 1000000]");
+    }
+}
+
+std::string EngineTuning::serialize() const {
+    std::ostringstream out;
+    out << WISDOM_HEADER << "\n";
+    out << "host " << host_name() << "\n";
+    out << "cpus " << host_cpus() << "\n";
+    out << "tile_frames " << tile_frames << "\n";
+    out << "prefetch_distance " << prefetch_distance << "\n";
+    out << "parallel_query_min_hashes " << parallel_query_min_hashes << "\n";
+    out << "query_threads " << query_threads << "\n";
+    out << "pool_workers " << pool_workers << "\n";
+    out << "commit_window_us " << commit_window_us << "\n";
+    return out.str();
+}
+
+EngineTuning EngineTuning::parse(const std::string& text) {
+    std::istringstream in(text);
+    std::string line;
+
+    if (!std::getline(in, line) || line != WISDOM_HEADER) {
+        throw std::runtime_error("Unsupported wisdom format");
+    }
+
+    EngineTuning tuning;
+    std::string host;
+    int cpus = 0;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if (key == "host") {
+            fields >> host;
+        } else if (key == "cpus") {
+            fields >> cpus;
+        } else if (key == "tile_frames") {
+            fields >> tuning.tile_frames;
+        } else if (key == "prefetch_distance") {
+            fields >> tuning.prefetch_distance;
+        } else if (key == "parallel_query_min_hashes") {
+            fields >> tuning.parallel_query_min_hashes;
+        } else if (key == "query_threads") {
+            fields >> tuning.query_threads;
+        } else if (key == "pool_workers") {
+            fields >> tuning.pool_workers;
+        } else if (key == "commit_window_us") {
+            fields >> tuning.commit_window_us;
+        } else {
+            throw std::runtime_error("Unknown wisdom key: " + key);
+        }
+
+        if (fields.fail()) {
+            throw std::runtime_error("Malformed wisdom line: " + line);
+        }
+    }
+
+    // Settings tuned for other caches or another core count can be slower
+    // than the defaults, so they are not carried over
+    if (host != host_name()) {
+        throw std::runtime_error("Wisdom was tuned on host " + (host.empty() ? std::string("(none)") : host));
+    }
+    if (cpus != host_cpus()) {
+        throw std::runtime_error("Wisdom was tuned for " + std::to_string(cpus) + " CPUs, this host has " +
+                                 std::to_string(host_cpus()));
+    }
+
+    tuning.validate();
+    return tuning;
+}
+
+EngineTuning EngineTuning::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open wisdom: " + path);
+    }
+
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+}
+
+void EngineTuning::save(const std::string& path) const {
+    validate();
+
+    std::filesystem::path target(path);
+    if (target.has_parent_path()) {
+        std::filesystem::create_directories(target.parent_path());
+    }
+
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        file << serialize();
+        if (!file) {
+            throw std::runtime_error("Cannot write wisdom: " + temp);
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp, target, error);
+    if (error) {
+        std::filesystem::remove(temp);
+        throw std::runtime_error("Cannot replace wisdom " + path + ": " + error.message());
+    }
+}
+
+void EngineTuning::ensure_loaded() {
+    std::call_once(load_once_, [] {
+        std::string path = wisdom_path();
+        EngineTuning tuning;
+        std::string source;
+
+        if (path.empty()) {
+            source = "defaults (no wisdom path)";
+        } else if (!std::filesystem::exists(path)) {
+            source = "defaults (no wisdom at " + path + ")";
+        } else {
+            try {
+                tuning = load(path);
+                source = path;
+            } catch (const std::exception& e) {
+                tuning = EngineTuning();
+                source = std::string("defaults (") + e.what() + ")";
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_ = tuning;
+        source_ = source;
+        generation_.fetch_add(1, std::memory_order_release);
+    });
+}
+
+EngineTuning EngineTuning::current() {
+    ensure_loaded();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+}
+
+void EngineTuning::install(const EngineTuning& tuning, const std::string& source) {
+    tuning.validate();
+    ensure_loaded();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_ = tuning;
+    source_ = source;
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t EngineTuning::generation() {
+    ensure_loaded();
+    return generation_.load(std::memory_order_acquire);
+}
+
+std::string EngineTuning::source() {
+    ensure_loaded();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return source_;
+}
+
+std::string EngineTuning::wisdom_path() {
+    if (const char* path = std::getenv("FINGERPRINT_WISDOM")) {
+        // Set but empty turns wisdom off
+        return path;
+    }
+
+    std::string cache;
+#ifdef _WIN32
+    if (const char* local = std::getenv("LOCALAPPDATA")) {
+        cache = local;
+    }
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        cache = xdg;
+    } else if (const char* home = std::getenv("HOME")) {
+        cache = std::string(home) + "/.cache";
+    }
+#endif
+    if (cache.empty()) {
+        return "";
+    }
+
+    return (std::filesystem::path(cache) / "audio_fingerprint" / ("wisdom-" + host_name() + ".conf")).string();
+}
+
+std::string EngineTuning::host_name() {
+    std::string name;
+#ifdef _WIN32
+    if (const char* computer = std::getenv("COMPUTERNAME")) {
+        name = computer;
+    }
+#else
+    char buffer[256] = {0};
+    if (gethostname(buffer, sizeof(buffer) - 1) == 0) {
+        name = buffer;
+    }
+#endif
+    if (name.empty()) {
+        return "localhost";
+    }
+
+    // The name goes into a file name and a whitespace-separated field
+    for (char& c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '_') {
+            c = '_';
+        }
+    }
+    return name;
+}
+
+void AutotuneConfig::validate() const {
+    if (work_dir.empty()) {
+        throw std::invalid_argument("Autotune work directory must not be empty");
+    }
+    if (repetitions <= 0) {
+        throw std::invalid_argument("repetitions must be positive");
+    }
+    if (!(tolerance >= 0.0) || tolerance > 1.0) {
+        throw std::invalid_argument("tolerance must be in [0, 1]");
+    }
+}
+
+EngineAutotuner::EngineAutotuner(const AutotuneConfig& config) : config_(config) {
+    config_.validate();
+}
+
+template <typename Workload>
+int EngineAutotuner::pick(AutotuneResult& result, const std::string& parameter, const std::vector<int>& candidates,
+                          int preferred, Workload workload) const {
+    std::vector<std::vector<double>> times(candidates.size());
+    for (int round = 0; round < config_.repetitions; ++round) {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            times[i].push_back(workload(candidates[i]));
+        }
+    }
+
+    std::vector<double> medians;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        medians.push_back(median(times[i]));
+        result.trials.emplace_back(parameter, candidates[i], medians.back());
+    }
+
+    const double limit = *std::min_element(medians.begin(), medians.end()) * (1.0 + config_.tolerance);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (candidates[i] == preferred && medians[i] <= limit) {
+            return preferred;
+        }
+    }
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (medians[i] <= limit) {
+            return candidates[i];
+        }
+    }
+    return candidates.front();
+}
+
+AutotuneResult EngineAutotuner::run() {
+    TuningRestore restore;
+    std::filesystem::create_directories(config_.work_dir);
+
+    auto start = Clock::now();
+    AutotuneResult result;
+
+    // Fingerprinting throughput depends on the tile size, so that goes first
+    tune_tile_frames(result);
+    tune_pool_workers(result);
+    tune_query(result);
+    tune_commit_window(result);
+
+    result.tuning.validate();
+    result.elapsed_ms = elapsed_ms(start);
+    return result;
+}
+
+void EngineAutotuner::tune_tile_frames(AutotuneResult& result) {
+    const std::vector<float> audio = synthetic_audio(config_.quick ? 10 : 60, 1);
+    const EngineTuning defaults;
+    PeakDetector peak_detector;
+
+    result.tuning.tile_frames = pick(result, "tile_frames", {8, 16, 32, 64, 128}, defaults.tile_frames,
+                                     [&](int tile_frames) {
+        TiledPeakPipeline pipeline(2048, 1024, tile_frames);
+        auto start = Clock::now();
+        pipeline.detect_peaks(audio, peak_detector);
+        return elapsed_ms(start);
+    });
+    EngineTuning::install(result.tuning, "autotune");
+}
+
+void EngineAutotuner::tune_pool_workers(AutotuneResult& result) {
+    std::vector<int> candidates = thread_candidates();
+    if (candidates.size() == 1) {
+        result.tuning.pool_workers = candidates.front();
+        return;
+    }
+
+    // Enough clips to keep the largest candidate busy for a few rounds
+    const int clips = 2 * candidates.back();
+    const AudioSample clip(synthetic_audio(config_.quick ? 3 : 10, 2), ANALYSIS_RATE, 1);
+
+    result.tuning.pool_workers = pick(result, "pool_workers", candidates, host_cpus(), [&](int workers) {
+        std::atomic<int> next(0);
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (int w = 0; w < workers; ++w) {
+            threads.emplace_back([&] {
+                HashGenerator generator;
+                while (next.fetch_add(1) < clips) {
+                    generator.process_audio_sample(clip);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return elapsed_ms(start);
+    });
+    EngineTuning::install(result.tuning, "autotune");
+}
+
+void EngineAutotuner::tune_query(AutotuneResult& result) {
+    const std::string index_dir = (std::filesystem::path(config_.work_dir) / "autotune-index").string();
+    std::filesystem::remove_all(index_dir);
+
+    SyntheticCatalogConfig catalog_config;
+    catalog_config.songs = config_.quick ? 1000 : 20000;
+    SyntheticCatalog catalog(catalog_config);
+
+    // Queries of whole songs, which reach every posting list size the catalog has
+    auto make_queries = [&](int count, int songs_per_query, uint64_t seed) {
+        std::mt19937_64 rng(seed);
+        std::uniform_int_distribution<uint32_t> song(1, catalog_config.songs);
+        std::vector<std::vector<Fingerprint>> queries(count);
+        for (auto& query : queries) {
+            for (int s = 0; s < songs_per_query; ++s) {
+                std::vector<Fingerprint> fingerprints = catalog.song_fingerprints(song(rng));
+                query.insert(query.end(), fingerprints.begin(), fingerprints.end());
+            }
+        }
+        return queries;
+    };
+    auto run_queries = [](const FingerprintIndex& index, const std::vector<std::vector<Fingerprint>>& queries) {
+        auto start = Clock::now();
+        for (const auto& query : queries) {
+            index.query(query);
+        }
+        return elapsed_ms(start);
+    };
+    auto install_with = [&](int EngineTuning::*field, int value) {
+        EngineTuning trial = result.tuning;
+        trial.*field = value;
+        EngineTuning::install(trial, "autotune");
+    };
+
+    try {
+        FingerprintIndex index(index_dir);
+        catalog.build(index, 10000);
+        index.set_query_threads(0);
+        const EngineTuning defaults;
+
+        // Serial scoring, where the prefetch distance matters most
+        result.tuning.query_threads = 1;
+        const auto serial_queries = make_queries(config_.quick ? 10 : 40, 4, 3);
+        result.tuning.prefetch_distance = pick(result, "prefetch_distance", {0, 2, 4, 8, 16},
+                                               defaults.prefetch_distance, [&](int distance) {
+            install_with(&EngineTuning::prefetch_distance, distance);
+            return run_queries(index, serial_queries);
+        });
+
+        std::vector<int> candidates = thread_candidates();
+        if (candidates.size() == 1) {
+            result.tuning.query_threads = 1;
+        } else {
+            // Long queries with every candidate thread count in use
+            const auto long_queries = make_queries(config_.quick ? 4 : 10, 32, 4);
+            result.tuning.parallel_query_min_hashes = 1;
+            result.tuning.query_threads = pick(result, "query_threads", candidates, host_cpus(), [&](int threads) {
+                install_with(&EngineTuning::query_threads, threads);
+                return run_queries(index, long_queries);
+            });
+
+            // The query length from which splitting pays off
+            std::vector<std::vector<Fingerprint>> mixed;
+            for (int songs : {2, 4, 8, 16}) {
+                auto sized = make_queries(config_.quick ? 2 : 8, songs, 5 + songs);
+                mixed.insert(mixed.end(), sized.begin(), sized.end());
+            }
+            result.tuning.parallel_query_min_hashes = pick(result, "parallel_query_min_hashes",
+                                                           {512, 1024, 2048, 4096, 8192},
+                                                           defaults.parallel_query_min_hashes, [&](int min_hashes) {
+                install_with(&EngineTuning::parallel_query_min_hashes, min_hashes);
+                return run_queries(index, mixed);
+            });
+        }
+    } catch (...) {
+        std::filesystem::remove_all(index_dir);
+        throw;
+    }
+
+    std::filesystem::remove_all(index_dir);
+    EngineTuning::install(result.tuning, "autotune");
+}
+
+void EngineAutotuner::tune_commit_window(AutotuneResult& result) {
+    const std::string wal_path = (std::filesystem::path(config_.work_dir) / "autotune.wal").string();
+    const int appends = config_.quick ? 8 : 64;
+    const std::vector<Fingerprint> fingerprints(WAL_FINGERPRINTS, Fingerprint(0x12345678u, 1000, 0.0f, 0.0f, 0));
+    const EngineTuning defaults;
+
+    // Concurrent writers waiting for durability, as during bulk ingest; the
+    // window trades each append's latency for fewer syncs
+    result.tuning.commit_window_us = pick(result, "commit_window_us", {0, 250, 500, 1000, 2000, 4000},
+                                          defaults.commit_window_us, [&](int window_us) {
+        std::filesystem::remove(wal_path);
+        double ms = 0.0;
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        {
+            IngestWal wal(wal_path, window_us);
+            auto start = Clock::now();
+            std::vector<std::thread> writers;
+            for (int w = 0; w < WAL_WRITERS; ++w) {
+                writers.emplace_back([&, w] {
+                    try {
+                        for (int i = 0; i < appends; ++i) {
+                            wal.wait_durable(wal.append(static_cast<uint32_t>(w * appends + i + 1), fingerprints));
+                        }
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        error = std::current_exception();
+                    }
+                });
+            }
+            for (auto& writer : writers) {
+                writer.join();
+            }
+            ms = elapsed_ms(start);
+        }
+        std::filesystem::remove(wal_path);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return ms;
+    });
+}
+
+} // namespace AudioFingerprint
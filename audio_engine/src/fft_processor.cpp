@@ -1,8 +1,10 @@
 #include "fft_processor.h"
 #include "audio_preprocessor.h"
+#include "cancellation.h"
 #include <stdexcept>
 #include <cmath>
 #include <algorithm>
+#include <mutex>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -10,6 +12,13 @@
 
 namespace AudioFingerprint {
 
+#ifndef NO_FFTW
+namespace {
+// The FFTW planner is not thread-safe; only fftwf_execute may run concurrently
+std::mutex fftw_planner_mutex;
+}
+#endif
+
 FFTProcessor::FFTProcessor(int fft_size) 
     : fft_size_(fft_size) {
     
@@ -37,12 +46,14 @@ FFTProcessor::~FFTProcessor() {
 
 #ifndef NO_FFTW
 void FFTProcessor::initialize_fftw() {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+    
     // Allocate aligned memory for FFTW
     input_buffer_ = fftwf_alloc_real(fft_size_);
     output_buffer_ = fftwf_alloc_complex(fft_size_ / 2 + 1);
     
     if (!input_buffer_ || !output_buffer_) {
-        cleanup_fftw();
+        release_fftw();
         throw std::runtime_error("Failed to allocate FFTW buffers");
     }
     
@@ -50,12 +61,17 @@ void FFTProcessor::initialize_fftw() {
     fft_plan_ = fftwf_plan_dft_r2c_1d(fft_size_, input_buffer_, output_buffer_, FFTW_MEASURE);
     
     if (!fft_plan_) {
-        cleanup_fftw();
+        release_fftw();
         throw std::runtime_error("Failed to create FFTW plan");
     }
 }
 
 void FFTProcessor::cleanup_fftw() {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+    release_fftw();
+}
+
+void FFTProcessor::release_fftw() {
     if (fft_plan_) {
         fftwf_destroy_plan(fft_plan_);
         fft_plan_ = nullptr;
@@ -87,7 +103,9 @@ Spectrogram FFTProcessor::compute_stft(const std::vector<float>& audio_data,
         throw std::invalid_argument("Invalid hop size");
     }
     
-    AudioPreprocessor preprocessor;
+    if (audio_data.size() < static_cast<size_t>(window_size)) {
+        throw std::invalid_argument("Audio data is shorter than one analysis window");
+    }
     
     // Calculate number of frames
     int num_frames = static_cast<int>((audio_data.size() - window_size) / hop_size) + 1;
@@ -107,36 +125,54 @@ Spectrogram FFTProcessor::compute_stft(const std::vector<float>& audio_data,
     
     // Process each frame
     for (int frame = 0; frame < num_frames; ++frame) {
-        int start_idx = frame * hop_size;
-        
-        // Extract window of audio data
-        std::vector<float> window_data(window_size);
-        for (int i = 0; i < window_size; ++i) {
-            if (start_idx + i < static_cast<int>(audio_data.size())) {
-                window_data[i] = audio_data[start_idx + i];
-            } else {
-                window_data[i] = 0.0f;  // Zero padding
-            }
-        }
-        
-        // Apply Hann window
-        auto windowed_data = preprocessor.apply_hann_window(window_data, window_size);
-        
-        // Compute FFT
-        auto fft_result = compute_fft(windowed_data);
-        
-        // Convert to magnitude spectrum
-        auto magnitude_spectrum = compute_magnitude_spectrum(fft_result);
-        
-        // Store in spectrogram
-        for (int bin = 0; bin < freq_bins && bin < static_cast<int>(magnitude_spectrum.size()); ++bin) {
-            spectrogram.data[frame][bin] = magnitude_spectrum[bin];
+        if (frame % CancellationToken::CHECK_INTERVAL == 0) {
+            CancellationToken::check("stft");
         }
+        compute_magnitude_frame(audio_data.data() + static_cast<size_t>(frame) * hop_size,
+                                window_size, spectrogram.data[frame].data());
     }
     
     return spectrogram;
 }
 
+void FFTProcessor::compute_magnitude_frame(const float* frame, int window_size, float* magnitudes) {
+    if (window_size <= 0 || window_size > fft_size_) {
+        throw std::invalid_argument("Window size cannot exceed FFT size");
+    }
+    
+    if (static_cast<int>(window_.size()) != window_size) {
+        // Windowing a unit signal yields the coefficients themselves
+        AudioPreprocessor preprocessor;
+        window_ = preprocessor.apply_hann_window(std::vector<float>(window_size, 1.0f), window_size);
+    }
+    
+    int output_size = fft_size_ / 2 + 1;
+    
+#ifndef NO_FFTW
+    // Window straight into the FFTW input buffer, zero padding the tail
+    for (int i = 0; i < window_size; ++i) {
+        input_buffer_[i] = frame[i] * window_[i];
+    }
+    std::fill(input_buffer_ + window_size, input_buffer_ + fft_size_, 0.0f);
+    
+    fftwf_execute(fft_plan_);
+    
+    for (int i = 0; i < output_size; ++i) {
+        magnitudes[i] = Complex(output_buffer_[i][0], output_buffer_[i][1]).magnitude();
+    }
+#else
+    input_buffer_.assign(window_size, 0.0f);
+    for (int i = 0; i < window_size; ++i) {
+        input_buffer_[i] = frame[i] * window_[i];
+    }
+    
+    auto spectrum = compute_dft(input_buffer_);
+    for (int i = 0; i < output_size; ++i) {
+        magnitudes[i] = spectrum[i].magnitude();
+    }
+#endif
+}
+
 std::vector<Complex> FFTProcessor::compute_fft(const std::vector<float>& windowed_data) {
     if (windowed_data.empty()) {
         throw std::invalid_argument("Windowed data is empty");
@@ -0,0 +1,969 @@
+#include "fingerprint_index.h"
+#include "cancellation.h"
+#include "engine_tuning.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+
+namespace AudioFingerprint {
+
+namespace {
+
+const char* MANIFEST_FILE = "MANIFEST";
+const char* MANIFEST_HEADER = "AFINDEX-MANIFEST 1";
+const char* WAL_FILE = "wal.log";
+
+int64_t unix_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int floor_div(int value, int divisor) {
+    int quotient = value / divisor;
+    return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+}
+
+uint64_t histogram_key(uint32_t song_id, int bin) {
+    return (static_cast<uint64_t>(song_id) << 32) | static_cast<uint32_t>(bin);
+}
+
+/**
+ * Postings of one query hash in one immutable segment
+ */
+struct PostingRange {
+    const Posting* postings;
+    size_t count;
+    int query_offset_ms;
+    const uint32_t* id_map;
+};
+
+inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+} // namespace
+
+std::string IndexManifest::serialize() const {
+    std::ostringstream out;
+    out << MANIFEST_HEADER << "\n";
+    out << "generation " << generation << "\n";
+    out << "committed_at_ms " << committed_at_ms << "\n";
+    out << "next_segment_id " << next_segment_id << "\n";
+    out << "wal_lsn " << wal_lsn << "\n";
+    if (!hash_signature.empty()) {
+        out << "profile " << profile_set << " " << hash_signature << "\n";
+    }
+
+    for (const auto& segment : segments) {
+        char crc_hex[9];
+        std::snprintf(crc_hex, sizeof(crc_hex), "%08x", segment.crc32);
+        out << "segment " << segment.segment_id << " " << segment.file_name << " "
+            << segment.size_bytes << " " << crc_hex << " "
+            << segment.song_count << " " << segment.posting_count << "\n";
+    }
+
+    return out.str();
+}
+
+IndexManifest IndexManifest::parse(const std::string& text) {
+    std::istringstream in(text);
+    std::string line;
+
+    if (!std::getline(in, line) || line != MANIFEST_HEADER) {
+        throw std::runtime_error("Unsupported index manifest format");
+    }
+
+    IndexManifest manifest;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if (key == "generation") {
+            fields >> manifest.generation;
+        } else if (key == "committed_at_ms") {
+            fields >> manifest.committed_at_ms;
+        } else if (key == "next_segment_id") {
+            fields >> manifest.next_segment_id;
+        } else if (key == "wal_lsn") {
+            fields >> manifest.wal_lsn;
+        } else if (key == "profile") {
+            fields >> manifest.profile_set >> manifest.hash_signature;
+        } else if (key == "segment") {
+            SegmentManifestEntry entry;
+            std::string crc_hex;
+            fields >> entry.segment_id >> entry.file_name >> entry.size_bytes >> crc_hex
+                   >> entry.song_count >> entry.posting_count;
+            entry.crc32 = static_cast<uint32_t>(std::stoul(crc_hex, nullptr, 16));
+            manifest.segments.push_back(entry);
+        } else {
+            // Unknown keys are skipped so newer writers stay readable
+            continue;
+        }
+
+        if (fields.fail()) {
+            throw std::runtime_error("Malformed index manifest line: " + line);
+        }
+    }
+
+    return manifest;
+}
+
+IndexManifest IndexManifest::load(const std::string& directory) {
+    std::string path = (std::filesystem::path(directory) / MANIFEST_FILE).string();
+    if (!std::filesystem::exists(path)) {
+        return IndexManifest();
+    }
+
+    std::vector<uint8_t> data = read_binary_file(path);
+    return parse(std::string(data.begin(), data.end()));
+}
+
+/**
+ * Persistent threads that run the parts of parallel queries.
+ *
+ * Each thread enters the index's query CPU pool once, when it starts, and
+ * then takes parts of whichever queries are running. Without a pool, callers
+ * take parts of their own query too, so a query finishes even while every
+ * worker is busy with others; with one, callers only wait, so scoring never
+ * leaves the pool and no thread is pinned per query.
+ */
+class ScoringWorkers {
+public:
+    ScoringWorkers(const std::string& pool, size_t threads) : pool_(pool), stopping_(false) {
+        threads_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back(&ScoringWorkers::worker_loop, this);
+        }
+    }
+
+    ~ScoringWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    ScoringWorkers(const ScoringWorkers&) = delete;
+    ScoringWorkers& operator=(const ScoringWorkers&) = delete;
+
+    const std::string& pool() const { return pool_; }
+    size_t size() const { return threads_.size(); }
+
+    /**
+     * Run task(0) .. task(count - 1) under the caller's cancellation token;
+     * rethrows the first exception once all have finished
+     * @param caller_helps Whether the caller runs task(0) and claims parts
+     *                     too, or leaves every part to the workers
+     */
+    void run(size_t count, const std::function<void(size_t)>& task, bool caller_helps) {
+        Batch batch(task, CancellationToken::current(), count, caller_helps ? 1 : 0);
+        if (batch.next < count) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                batches_.push_back(&batch);
+            }
+            work_cv_.notify_all();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (caller_helps) {
+            lock.unlock();
+            std::exception_ptr error = run_part(batch, 0);
+            lock.lock();
+            finish_part(batch, error);
+            size_t index = 0;
+            while (claim(batch, index)) {
+                lock.unlock();
+                error = run_part(batch, index);
+                lock.lock();
+                finish_part(batch, error);
+            }
+        }
+        batch_done_.wait(lock, [&] { return batch.finished == batch.count; });
+        lock.unlock();
+
+        if (batch.error) {
+            std::rethrow_exception(batch.error);
+        }
+    }
+
+private:
+    struct Batch {
+        const std::function<void(size_t)>& task;
+        CancellationToken token;
+        size_t count;
+        size_t next;        // First unclaimed part
+        size_t finished;
+        std::exception_ptr error;
+
+        Batch(const std::function<void(size_t)>& batch_task, const CancellationToken& batch_token, size_t parts,
+              size_t first_unclaimed)
+            : task(batch_task), token(batch_token), count(parts), next(first_unclaimed), finished(0) {}
+    };
+
+    std::string pool_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;                  // Guards the fields below and every queued batch
+    std::condition_variable work_cv_;
+    std::condition_variable batch_done_;
+    std::deque<Batch*> batches_;        // Batches with unclaimed parts
+    bool stopping_;
+
+    /**
+     * Claim the next part of a batch, dequeuing it once all are claimed; requires mutex_
+     */
+    bool claim(Batch& batch, size_t& index) {
+        if (batch.next >= batch.count) {
+            return false;
+        }
+        index = batch.next++;
+        if (batch.next == batch.count) {
+            batches_.erase(std::find(batches_.begin(), batches_.end(), &batch));
+        }
+        return true;
+    }
+
+    static std::exception_ptr run_part(Batch& batch, size_t index) {
+        try {
+            batch.task(index);
+        } catch (...) {
+            return std::current_exception();
+        }
+        return nullptr;
+    }
+
+    /**
+     * Record a finished part; requires mutex_
+     */
+    void finish_part(Batch& batch, const std::exception_ptr& error) {
+        if (error && !batch.error) {
+            batch.error = error;
+        }
+        if (++batch.finished == batch.count) {
+            batch_done_.notify_all();
+        }
+    }
+
+    void worker_loop() {
+        CpuPoolScope placement(pool_, true);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            work_cv_.wait(lock, [this] { return stopping_ || !batches_.empty(); });
+            if (batches_.empty()) {
+                return;
+            }
+
+            Batch& batch = *batches_.front();
+            size_t index = 0;
+            claim(batch, index);
+            lock.unlock();
+
+            std::exception_ptr error;
+            {
+                CancellationScope cancellation(batch.token);
+                error = run_part(batch, index);
+            }
+            placement.checkpoint();
+
+            lock.lock();
+            finish_part(batch, error);
+        }
+    }
+};
+
+FingerprintIndex::FingerprintIndex(const std::string& directory, bool durable_ingest, int commit_window_us)
+    : directory_(directory), mutable_(std::make_shared<MutableSegment>()), query_threads_(0),
+      tuning_generation_(0), tuned_query_threads_(0), tuned_parallel_min_hashes_(1), tuned_prefetch_distance_(0) {
+
+    if (directory.empty()) {
+        throw std::invalid_argument("Index directory must not be empty");
+    }
+
+    std::filesystem::create_directories(directory_);
+    reload();
+
+    if (durable_ingest) {
+        // Rebuild the mutable segment from songs logged after the last flush
+        if (commit_window_us < 0) {
+            commit_window_us = EngineTuning::current().commit_window_us;
+        }
+        wal_ = std::make_unique<IngestWal>(path_for(WAL_FILE), commit_window_us);
+        wal_->replay(manifest_.wal_lsn, [this](uint64_t, uint32_t song_id, const std::vector<Fingerprint>& fingerprints,
+                                               const SongMetadata& metadata) {
+            insert_song(*mutable_, song_id, fingerprints, metadata);
+        });
+    }
+}
+
+FingerprintIndex::~FingerprintIndex() = default;
+
+std::string FingerprintIndex::path_for(const std::string& file_name) const {
+    return (std::filesystem::path(directory_) / file_name).string();
+}
+
+void FingerprintIndex::insert_song(MutableSegment& segment, uint32_t song_id,
+                                   const std::vector<Fingerprint>& fingerprints, const SongMetadata& metadata) {
+    for (const auto& fp : fingerprints) {
+        segment.postings[fp.hash_value].emplace_back(song_id, fp.time_offset_ms);
+    }
+    segment.songs[song_id] += static_cast<uint32_t>(fingerprints.size());
+    segment.posting_count += fingerprints.size();
+    if (!metadata.empty()) {
+        segment.metadata[song_id] = metadata;
+    }
+}
+
+void FingerprintIndex::add_song(uint32_t song_id, const std::vector<Fingerprint>& fingerprints,
+                                const SongMetadata& metadata) {
+    uint64_t lsn = 0;
+    {
+        // Logging and inserting under one lock keeps log order consistent with
+        // the mutable segment that flush() swaps out
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (wal_) {
+            lsn = wal_->append(song_id, fingerprints, metadata);
+        }
+        insert_song(*mutable_, song_id, fingerprints, metadata);
+    }
+
+    if (wal_) {
+        wal_->wait_durable(lsn);
+    }
+}
+
+SegmentManifestEntry FingerprintIndex::write_segment(const IndexSegment& segment, uint64_t segment_id) const {
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "seg_%016llx.afs", static_cast<unsigned long long>(segment_id));
+
+    std::vector<uint8_t> bytes = segment.serialize();
+    write_file_atomically(path_for(file_name), bytes.data(), bytes.size());
+
+    SegmentManifestEntry entry;
+    entry.segment_id = segment_id;
+    entry.file_name = file_name;
+    entry.size_bytes = bytes.size();
+    entry.crc32 = crc32(bytes.data(), bytes.size());
+    entry.song_count = segment.song_count();
+    entry.posting_count = segment.posting_count();
+    return entry;
+}
+
+void FingerprintIndex::bind_profiles(const ProfileSet& profiles) {
+    profiles.validate();
+    std::string signature = profiles.reference.hash_signature();
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!manifest_.hash_signature.empty() && manifest_.hash_signature != signature) {
+        throw std::runtime_error("Index " + directory_ + " holds references hashed as " +
+                                 manifest_.hash_signature + " (profile set " + manifest_.profile_set +
+                                 "); profile set " + profiles.id() + " hashes as " + signature);
+    }
+    profile_set_ = profiles.id();
+    hash_signature_ = signature;
+}
+
+void FingerprintIndex::check_query_profile(const FingerprintProfile& profile) const {
+    std::string signature = profile.hash_signature();
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const std::string& expected = !hash_signature_.empty() ? hash_signature_ : manifest_.hash_signature;
+    if (!expected.empty() && expected != signature) {
+        throw std::invalid_argument("Query profile " + profile.name + " hashes as " + signature +
+                                    " but index " + directory_ + " holds references hashed as " + expected);
+    }
+}
+
+void FingerprintIndex::stamp_profiles(IndexManifest& manifest) const {
+    if (!hash_signature_.empty()) {
+        manifest.profile_set = profile_set_;
+        manifest.hash_signature = hash_signature_;
+    }
+}
+
+void FingerprintIndex::write_manifest(const IndexManifest& manifest) const {
+    std::string text = manifest.serialize();
+    write_file_atomically(path_for(MANIFEST_FILE), reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+uint64_t FingerprintIndex::flush() {
+    CpuPoolScope placement(get_maintenance_pool(), false);
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+
+    std::shared_ptr<const MutableSegment> flushing;
+    uint64_t segment_id;
+    WalMark wal_mark;
+    {
+        // Swap in an empty mutable segment; the old one stays searchable until committed
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (mutable_->posting_count == 0) {
+            return 0;
+        }
+        flushing_ = mutable_;
+        flushing = flushing_;
+        mutable_ = std::make_shared<MutableSegment>();
+        segment_id = manifest_.next_segment_id;
+        if (wal_) {
+            wal_mark = wal_->mark();
+        }
+    }
+
+    std::vector<std::pair<uint32_t, Posting>> entries;
+    entries.reserve(flushing->posting_count);
+    for (const auto& bucket : flushing->postings) {
+        for (const auto& posting : bucket.second) {
+            entries.emplace_back(bucket.first, posting);
+        }
+    }
+
+    auto segment = std::make_shared<const IndexSegment>(IndexSegment::build(std::move(entries), flushing->metadata));
+
+    try {
+        SegmentManifestEntry entry = write_segment(*segment, segment_id);
+
+        IndexManifest manifest;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            manifest = manifest_;
+            stamp_profiles(manifest);
+        }
+        manifest.generation++;
+        manifest.committed_at_ms = unix_time_ms();
+        manifest.next_segment_id = segment_id + 1;
+        manifest.wal_lsn = std::max(manifest.wal_lsn, wal_mark.lsn);
+        manifest.segments.push_back(entry);
+        write_manifest(manifest);
+
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        manifest_ = manifest;
+        segments_.push_back(LoadedSegment{entry, segment});
+        flushing_.reset();
+    } catch (...) {
+        // Put the songs back so a later flush can retry
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& bucket : flushing->postings) {
+            auto& target = mutable_->postings[bucket.first];
+            target.insert(target.end(), bucket.second.begin(), bucket.second.end());
+        }
+        for (const auto& song : flushing->songs) {
+            mutable_->songs[song.first] += song.second;
+        }
+        for (const auto& song : flushing->metadata) {
+            mutable_->metadata.insert(song);  // Metadata added since the swap is newer
+        }
+        mutable_->posting_count += flushing->posting_count;
+        flushing_.reset();
+        throw;
+    }
+
+    if (wal_) {
+        try {
+            wal_->truncate(wal_mark);
+        } catch (const std::exception&) {
+            // The manifest's wal_lsn already skips these records on replay;
+            // the next flush truncates again
+        }
+    }
+
+    return segment_id;
+}
+
+uint64_t FingerprintIndex::merge_segments() {
+    CpuPoolScope placement(get_maintenance_pool(), false);
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+
+    std::vector<LoadedSegment> inputs;
+    IndexManifest manifest;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        inputs = segments_;
+        manifest = manifest_;
+        stamp_profiles(manifest);
+    }
+
+    if (inputs.size() < 2) {
+        return 0;
+    }
+
+    std::vector<const IndexSegment*> sources;
+    for (const auto& input : inputs) {
+        sources.push_back(input.segment.get());
+    }
+
+    return replace_segments(inputs, manifest,
+                            std::make_shared<const IndexSegment>(IndexSegment::merge(sources)));
+}
+
+SongReorderReport FingerprintIndex::reorder_songs(const SongOrderConfig& config) {
+    SongOrderOptimizer optimizer(config);
+    CpuPoolScope placement(get_maintenance_pool(), false);
+
+    // The bisection runs without the write lock so flushes and ingest carry
+    // on; segments flushed meanwhile are merged in when the result is swapped
+    for (int attempt = 1;; ++attempt) {
+        std::vector<LoadedSegment> inputs;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            inputs = segments_;
+        }
+
+        SongReorderReport report;
+        if (inputs.empty()) {
+            return report;
+        }
+
+        std::vector<const IndexSegment*> sources;
+        for (const auto& input : inputs) {
+            sources.push_back(input.segment.get());
+        }
+
+        IndexSegment merged = IndexSegment::merge(sources);
+        report.songs = merged.song_count();
+        report.before = SongOrderOptimizer::measure(merged);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint32_t> order = optimizer.order(merged);
+        report.bisection_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        auto reordered = std::make_shared<const IndexSegment>(IndexSegment::reorder(merged, order));
+        report.after = SongOrderOptimizer::measure(*reordered);
+
+        std::lock_guard<std::mutex> write_lock(write_mutex_);
+        std::vector<LoadedSegment> current;
+        IndexManifest manifest;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            current = segments_;
+            manifest = manifest_;
+            stamp_profiles(manifest);
+        }
+
+        // Only flushes may have happened if the inputs are still the oldest segments
+        bool unchanged = current.size() >= inputs.size() &&
+                         std::equal(inputs.begin(), inputs.end(), current.begin(),
+                                    [](const LoadedSegment& a, const LoadedSegment& b) {
+                                        return a.entry.segment_id == b.entry.segment_id;
+                                    });
+        if (!unchanged) {
+            if (attempt >= 3) {
+                throw std::runtime_error("Index " + directory_ + " kept changing while songs were reordered");
+            }
+            continue;
+        }
+
+        std::shared_ptr<const IndexSegment> segment = reordered;
+        if (current.size() > inputs.size()) {
+            std::vector<const IndexSegment*> parts{reordered.get()};
+            for (size_t i = inputs.size(); i < current.size(); ++i) {
+                parts.push_back(current[i].segment.get());
+            }
+            segment = std::make_shared<const IndexSegment>(IndexSegment::merge(parts));
+        }
+        report.segment_id = replace_segments(current, manifest, segment);
+        return report;
+    }
+}
+
+uint64_t FingerprintIndex::replace_segments(const std::vector<LoadedSegment>& inputs, IndexManifest manifest,
+                                            const std::shared_ptr<const IndexSegment>& segment) {
+    uint64_t segment_id = manifest.next_segment_id;
+    SegmentManifestEntry entry = write_segment(*segment, segment_id);
+
+    manifest.generation++;
+    manifest.committed_at_ms = unix_time_ms();
+    manifest.next_segment_id = segment_id + 1;
+    manifest.segments.clear();
+    manifest.segments.push_back(entry);
+    write_manifest(manifest);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        manifest_ = manifest;
+        segments_.clear();
+        segments_.push_back(LoadedSegment{entry, segment});
+    }
+
+    // Inputs are unreachable from the new manifest; readers hold them in memory
+    for (const auto& input : inputs) {
+        std::error_code ignored;
+        std::filesystem::remove(path_for(input.entry.file_name), ignored);
+    }
+
+    return segment_id;
+}
+
+bool FingerprintIndex::reload() {
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+
+    // A concurrent writer may retire segments between reading the manifest and
+    // opening them; re-read the manifest and try again in that case
+    for (int attempt = 1;; ++attempt) {
+        IndexManifest manifest = IndexManifest::load(directory_);
+
+        std::vector<LoadedSegment> current;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            if (!hash_signature_.empty() && !manifest.hash_signature.empty() &&
+                manifest.hash_signature != hash_signature_) {
+                throw std::logic_error("Index " + directory_ + " was rebuilt with hashes " +
+                                       manifest.hash_signature + " (profile set " + manifest.profile_set +
+                                       "); this reader is bound to " + hash_signature_);
+            }
+            if (manifest.generation == manifest_.generation && manifest.segments.size() == segments_.size()) {
+                return false;
+            }
+            current = segments_;
+        }
+
+        try {
+            // Reuse segments that are already loaded, load the rest
+            std::vector<LoadedSegment> segments;
+            for (const auto& entry : manifest.segments) {
+                auto it = std::find_if(current.begin(), current.end(), [&](const LoadedSegment& loaded) {
+                    return loaded.entry.segment_id == entry.segment_id;
+                });
+
+                if (it != current.end()) {
+                    segments.push_back(*it);
+                    continue;
+                }
+
+                std::vector<uint8_t> bytes = read_binary_file(path_for(entry.file_name));
+                if (bytes.size() != entry.size_bytes || crc32(bytes.data(), bytes.size()) != entry.crc32) {
+                    throw std::runtime_error("Segment " + entry.file_name + " does not match the manifest");
+                }
+                segments.push_back(LoadedSegment{
+                    entry, std::make_shared<const IndexSegment>(IndexSegment::parse(bytes, entry.file_name))});
+            }
+
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            manifest_ = manifest;
+            segments_ = std::move(segments);
+            return true;
+        } catch (const std::runtime_error&) {
+            if (attempt >= 3) {
+                throw;
+            }
+        }
+    }
+}
+
+void FingerprintIndex::set_query_threads(int threads) {
+    if (threads < 0) {
+        throw std::invalid_argument("Query thread count must not be negative");
+    }
+    query_threads_.store(threads);
+}
+
+void FingerprintIndex::set_thread_pools(const std::string& query_pool, const std::string& maintenance_pool) {
+    for (const std::string* pool : {&query_pool, &maintenance_pool}) {
+        if (!pool->empty() && !CpuPools::defined(*pool)) {
+            throw std::invalid_argument("Unknown CPU pool: " + *pool);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    query_pool_ = query_pool;
+    maintenance_pool_ = maintenance_pool;
+}
+
+std::shared_ptr<ScoringWorkers> FingerprintIndex::scoring_workers(size_t parts, std::string& pool) const {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    pool = query_pool_;
+    const size_t needed = query_pool_.empty() ? parts - 1 : parts;
+    if (needed > 0 && (!scoring_workers_ || scoring_workers_->pool() != query_pool_ ||
+                       scoring_workers_->size() < needed)) {
+        // Queries still running on the old workers keep them until they finish
+        scoring_workers_ = std::make_shared<ScoringWorkers>(query_pool_, needed);
+    }
+    return scoring_workers_;
+}
+
+void FingerprintIndex::refresh_query_tuning() const {
+    const uint64_t generation = EngineTuning::generation();
+    if (tuning_generation_.load(std::memory_order_acquire) == generation) {
+        return;
+    }
+
+    const EngineTuning tuning = EngineTuning::current();
+    tuned_query_threads_.store(tuning.query_threads, std::memory_order_relaxed);
+    tuned_parallel_min_hashes_.store(tuning.parallel_query_min_hashes, std::memory_order_relaxed);
+    tuned_prefetch_distance_.store(tuning.prefetch_distance, std::memory_order_relaxed);
+    tuning_generation_.store(generation, std::memory_order_release);
+}
+
+std::string FingerprintIndex::get_query_pool() const {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    return query_pool_;
+}
+
+std::string FingerprintIndex::get_maintenance_pool() const {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    return maintenance_pool_;
+}
+
+void FingerprintIndex::vote(const Fingerprint* begin, const Fingerprint* end,
+                            std::vector<OffsetHistogram>& shards, int prefetch_distance) const {
+    auto add = [&](const Posting* postings, size_t count, int query_offset_ms, const uint32_t* id_map) {
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t song_id = id_map ? id_map[postings[i].song_id] : postings[i].song_id;
+            int bin = floor_div(postings[i].time_offset_ms - query_offset_ms, OFFSET_BIN_MS);
+            shards[song_id % shards.size()][histogram_key(song_id, bin)]++;
+        }
+    };
+
+    const MutableSegment* live_segments[] = {mutable_.get(), flushing_.get()};
+    std::vector<PostingRange> ranges;
+
+    for (const Fingerprint* block = begin; block != end;) {
+        CancellationToken::check("index_vote");
+        const Fingerprint* block_end = block + std::min<ptrdiff_t>(end - block, CancellationToken::CHECK_INTERVAL);
+
+        // Resolve the block's posting lists first, so the start of each list
+        // can be prefetched a few lists ahead of the one being counted
+        ranges.clear();
+        for (const Fingerprint* fp = block; fp != block_end; ++fp) {
+            for (const auto& loaded : segments_) {
+                PostingRange range{nullptr, 0, fp->time_offset_ms, loaded.segment->id_map()};
+                range.postings = loaded.segment->find(fp->hash_value, range.count);
+                if (range.count > 0) {
+                    ranges.push_back(range);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            if (prefetch_distance > 0 && i + prefetch_distance < ranges.size()) {
+                prefetch(ranges[i + prefetch_distance].postings);
+            }
+            add(ranges[i].postings, ranges[i].count, ranges[i].query_offset_ms, ranges[i].id_map);
+        }
+
+        for (const Fingerprint* fp = block; fp != block_end; ++fp) {
+            for (const MutableSegment* live : live_segments) {
+                if (live == nullptr) {
+                    continue;
+                }
+                auto it = live->postings.find(fp->hash_value);
+                if (it != live->postings.end()) {
+                    add(it->second.data(), it->second.size(), fp->time_offset_ms, nullptr);
+                }
+            }
+        }
+
+        block = block_end;
+    }
+}
+
+std::vector<IndexMatch> FingerprintIndex::score_shard(const OffsetHistogram& histogram, int min_matches,
+                                                      size_t query_size) {
+    // Score each song by its best pair of adjacent bins, which absorbs offsets
+    // that straddle a bin boundary
+    std::unordered_map<uint32_t, IndexMatch> best;
+    for (const auto& cell : histogram) {
+        uint32_t song_id = static_cast<uint32_t>(cell.first >> 32);
+        int bin = static_cast<int>(static_cast<uint32_t>(cell.first));
+
+        auto next = histogram.find(histogram_key(song_id, bin + 1));
+        int votes = static_cast<int>(cell.second) + (next != histogram.end() ? static_cast<int>(next->second) : 0);
+
+        IndexMatch& match = best[song_id];
+        if (votes > match.match_count || (votes == match.match_count && bin * OFFSET_BIN_MS < match.time_offset_ms)) {
+            match.song_id = song_id;
+            match.match_count = votes;
+            match.time_offset_ms = bin * OFFSET_BIN_MS;
+        }
+    }
+
+    std::vector<IndexMatch> matches;
+    for (auto& entry : best) {
+        if (entry.second.match_count >= min_matches) {
+            entry.second.confidence = std::min(1.0f, static_cast<float>(entry.second.match_count) /
+                                                         static_cast<float>(query_size));
+            matches.push_back(entry.second);
+        }
+    }
+
+    return matches;
+}
+
+std::vector<IndexMatch> FingerprintIndex::query(const std::vector<Fingerprint>& query,
+                                                int max_results, int min_matches) const {
+    if (query.empty() || max_results <= 0) {
+        return std::vector<IndexMatch>();
+    }
+
+    refresh_query_tuning();
+    const int prefetch_distance = tuned_prefetch_distance_.load(std::memory_order_relaxed);
+    size_t threads = static_cast<size_t>(query_threads_.load());
+    if (threads == 0) {
+        threads = static_cast<size_t>(tuned_query_threads_.load(std::memory_order_relaxed));
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t min_hashes = static_cast<size_t>(tuned_parallel_min_hashes_.load(std::memory_order_relaxed));
+    threads = std::max<size_t>(1, std::min(threads, query.size() / std::max<size_t>(1, min_hashes)));
+
+    // In a query pool every part runs on the workers, which were pinned when
+    // they started; otherwise the caller scores a part itself
+    std::string pool;
+    const std::shared_ptr<ScoringWorkers> workers = scoring_workers(threads, pool);
+    const bool in_pool = !pool.empty();
+    auto run_parallel = [&](const std::function<void(size_t)>& task) {
+        if (threads == 1 && !in_pool) {
+            task(0);
+        } else {
+            workers->run(threads, task, !in_pool);
+        }
+    };
+
+    // Each thread counts (song, offset bin) votes for its share of the query
+    // hashes. Histograms are sharded by song so a song's bins, including the
+    // adjacent bin used for scoring, always end up in the same shard.
+    std::vector<std::vector<OffsetHistogram>> local(threads, std::vector<OffsetHistogram>(threads));
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const size_t chunk = (query.size() + threads - 1) / threads;
+        run_parallel([&](size_t t) {
+            size_t begin = std::min(query.size(), t * chunk);
+            size_t end = std::min(query.size(), begin + chunk);
+            vote(query.data() + begin, query.data() + end, local[t], prefetch_distance);
+        });
+    }
+
+    // Parallel reduction: thread s merges shard s of every thread into the
+    // largest of them and scores it
+    std::vector<std::vector<IndexMatch>> shard_matches(threads);
+    run_parallel([&](size_t s) {
+        size_t largest = 0;
+        for (size_t t = 1; t < threads; ++t) {
+            if (local[t][s].size() > local[largest][s].size()) {
+                largest = t;
+            }
+        }
+
+        OffsetHistogram& merged = local[largest][s];
+        for (size_t t = 0; t < threads; ++t) {
+            if (t == largest) {
+                continue;
+            }
+            for (const auto& cell : local[t][s]) {
+                merged[cell.first] += cell.second;
+            }
+            OffsetHistogram().swap(local[t][s]);
+        }
+
+        CancellationToken::check("index_score");
+        shard_matches[s] = score_shard(merged, min_matches, query.size());
+    });
+
+    std::vector<IndexMatch> matches;
+    for (auto& shard : shard_matches) {
+        matches.insert(matches.end(), shard.begin(), shard.end());
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const IndexMatch& a, const IndexMatch& b) {
+        if (a.match_count != b.match_count) return a.match_count > b.match_count;
+        return a.song_id < b.song_id;
+    });
+
+    if (matches.size() > static_cast<size_t>(max_results)) {
+        matches.resize(max_results);
+    }
+
+    // Complete the few returned matches from the song tables
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (auto& match : matches) {
+            find_metadata(match.song_id, match.song);
+        }
+    }
+
+    return matches;
+}
+
+bool FingerprintIndex::lookup_song(uint32_t song_id, SongMetadata& metadata) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return find_metadata(song_id, metadata);
+}
+
+bool FingerprintIndex::find_metadata(uint32_t song_id, SongMetadata& metadata) const {
+    const MutableSegment* live_segments[] = {mutable_.get(), flushing_.get()};
+    for (const MutableSegment* live : live_segments) {
+        if (live == nullptr) {
+            continue;
+        }
+        auto it = live->metadata.find(song_id);
+        if (it != live->metadata.end()) {
+            metadata = it->second;
+            return true;
+        }
+    }
+
+    for (auto it = segments_.rbegin(); it != segments_.rend(); ++it) {
+        if (it->segment->song_metadata(song_id, metadata)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+IndexManifest FingerprintIndex::get_manifest() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return manifest_;
+}
+
+IndexStats FingerprintIndex::get_stats() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    IndexStats stats;
+    stats.generation = manifest_.generation;
+    stats.segment_count = segments_.size();
+    for (const auto& loaded : segments_) {
+        stats.segment_songs += loaded.entry.song_count;
+        stats.segment_postings += loaded.entry.posting_count;
+        stats.segment_bytes += loaded.entry.size_bytes;
+    }
+
+    const MutableSegment* live_segments[] = {mutable_.get(), flushing_.get()};
+    for (const MutableSegment* live : live_segments) {
+        if (live != nullptr) {
+            stats.mutable_songs += live->songs.size();
+            stats.mutable_postings += live->posting_count;
+        }
+    }
+
+    if (wal_) {
+        stats.wal = wal_->get_stats();
+        stats.wal_bytes = wal_->file_size();
+    }
+
+    return stats;
+}
+
+} // namespace AudioFingerprint
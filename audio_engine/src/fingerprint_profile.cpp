@@ -0,0 +1,334 @@
+#include "fingerprint_profile.h"
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+
+namespace AudioFingerprint {
+
+namespace {
+
+const char* const PROFILES_HEADER = "AFPROFILES 1";
+
+// Bumped whenever the hash function itself changes
+const int HASH_SCHEME_VERSION = 1;
+
+// Rate the preprocessor resamples to before analysis
+const int ANALYSIS_SAMPLE_RATE = 11025;
+
+void write_profile(std::ostream& out, const std::string& prefix, const FingerprintProfile& profile) {
+    out << prefix << "name " << profile.name << "\n";
+    out << prefix << "fft_size " << profile.fft_size << "\n";
+    out << prefix << "hop_size " << profile.hop_size << "\n";
+    out << prefix << "freq_quantization " << profile.freq_quantization << "\n";
+    out << prefix << "time_quantization " << profile.time_quantization << "\n";
+    out << prefix << "landmark_size " << profile.landmark_size << "\n";
+    out << prefix << "interpolate_frequency " << profile.interpolate_frequency << "\n";
+    out << prefix << "interpolate_time " << profile.interpolate_time << "\n";
+    out << prefix << "min_peak_distance " << profile.min_peak_distance << "\n";
+    out << prefix << "adaptive_factor " << profile.adaptive_factor << "\n";
+    out << prefix << "min_magnitude_threshold " << profile.min_magnitude_threshold << "\n";
+    out << prefix << "max_time_delta_ms " << profile.max_time_delta_ms << "\n";
+    out << prefix << "max_freq_delta_hz " << profile.max_freq_delta_hz << "\n";
+    out << prefix << "max_pairs_per_anchor " << profile.max_pairs_per_anchor << "\n";
+    out << prefix << "analysis_phases " << profile.analysis_phases << "\n";
+    out << prefix << "native_rate " << profile.native_rate << "\n";
+}
+
+/**
+ * Read one field into a profile; returns false for an unknown field
+ */
+bool read_field(std::istream& fields, const std::string& field, FingerprintProfile& profile) {
+    if (field == "name") {
+        fields >> profile.name;
+    } else if (field == "fft_size") {
+        fields >> profile.fft_size;
+    } else if (field == "hop_size") {
+        fields >> profile.hop_size;
+    } else if (field == "freq_quantization") {
+        fields >> profile.freq_quantization;
+    } else if (field == "time_quantization") {
+        fields >> profile.time_quantization;
+    } else if (field == "landmark_size") {
+        fields >> profile.landmark_size;
+    } else if (field == "interpolate_frequency") {
+        fields >> profile.interpolate_frequency;
+    } else if (field == "interpolate_time") {
+        fields >> profile.interpolate_time;
+    } else if (field == "min_peak_distance") {
+        fields >> profile.min_peak_distance;
+    } else if (field == "adaptive_factor") {
+        fields >> profile.adaptive_factor;
+    } else if (field == "min_magnitude_threshold") {
+        fields >> profile.min_magnitude_threshold;
+    } else if (field == "max_time_delta_ms") {
+        fields >> profile.max_time_delta_ms;
+    } else if (field == "max_freq_delta_hz") {
+        fields >> profile.max_freq_delta_hz;
+    } else if (field == "max_pairs_per_anchor") {
+        fields >> profile.max_pairs_per_anchor;
+    } else if (field == "analysis_phases") {
+        fields >> profile.analysis_phases;
+    } else if (field == "native_rate") {
+        fields >> profile.native_rate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+FingerprintProfile::FingerprintProfile()
+    : name("symmetric"), fft_size(2048), hop_size(1024), freq_quantization(10.0f), time_quantization(50),
+      landmark_size(2), interpolate_frequency(false), interpolate_time(false),
+      min_peak_distance(3), adaptive_factor(0.7f), min_magnitude_threshold(0.01f),
+      max_time_delta_ms(2000), max_freq_delta_hz(2000.0f), max_pairs_per_anchor(0),
+      analysis_phases(1), native_rate(false) {}
+
+FingerprintProfile FingerprintProfile::reference() {
+    FingerprintProfile profile;
+    profile.name = "reference";
+    profile.max_pairs_per_anchor = 5;
+    return profile;
+}
+
+FingerprintProfile FingerprintProfile::coarse_reference() {
+    FingerprintProfile profile = reference();
+    profile.name = "coarse-reference";
+    profile.hop_size = 2048;
+    return profile;
+}
+
+FingerprintProfile FingerprintProfile::coarse_query() {
+    FingerprintProfile profile = query();
+    profile.name = "coarse-query";
+    profile.hop_size = 2048;
+    profile.analysis_phases = 2;
+    return profile;
+}
+
+FingerprintProfile FingerprintProfile::query() {
+    FingerprintProfile profile;
+    profile.name = "query";
+    profile.max_pairs_per_anchor = 20;
+    return profile;
+}
+
+FingerprintProfile FingerprintProfile::fine_reference() {
+    FingerprintProfile profile = reference();
+    profile.name = "fine-reference";
+    profile.fft_size = 1024;
+    profile.hop_size = 512;
+    profile.interpolate_time = true;
+    return profile;
+}
+
+FingerprintProfile FingerprintProfile::fine_query() {
+    FingerprintProfile profile = query();
+    profile.name = "fine-query";
+    profile.fft_size = 1024;
+    profile.hop_size = 512;
+    profile.interpolate_time = true;
+    return profile;
+}
+
+std::string FingerprintProfile::hash_signature() const {
+    std::ostringstream out;
+    out << "h" << HASH_SCHEME_VERSION << "-sr" << ANALYSIS_SAMPLE_RATE
+        << "-fft" << fft_size << "-hop" << hop_size
+        << "-fq" << freq_quantization << "-tq" << time_quantization;
+    if (landmark_size != 2) {
+        out << "-lm" << landmark_size;
+    }
+    if (interpolate_frequency) {
+        out << "-if";
+    }
+    if (interpolate_time) {
+        out << "-it";
+    }
+    return out.str();
+}
+
+void FingerprintProfile::validate() const {
+    if (name.empty() || name.find_first_of(" \t\r\n") != std::string::npos) {
+        throw std::invalid_argument("Profile name must be a single non-empty word");
+    }
+
+    if (fft_size <= 0 || (fft_size & (fft_size - 1)) != 0) {
+        throw std::invalid_argument("Profile " + name + ": FFT size must be a power of 2");
+    }
+
+    if (hop_size <= 0 || hop_size > fft_size) {
+        throw std::invalid_argument("Profile " + name + ": hop size must be in (0, fft_size]");
+    }
+
+    if (freq_quantization <= 0.0f || time_quantization <= 0) {
+        throw std::invalid_argument("Profile " + name + ": hash quantization must be positive");
+    }
+
+    if (landmark_size != 2 && landmark_size != 3) {
+        throw std::invalid_argument("Profile " + name + ": landmark size must be 2 or 3");
+    }
+
+    if (min_peak_distance <= 0) {
+        throw std::invalid_argument("Profile " + name + ": minimum peak distance must be positive");
+    }
+
+    if (adaptive_factor < 0.0f || adaptive_factor > 1.0f) {
+        throw std::invalid_argument("Profile " + name + ": adaptive factor must be between 0.0 and 1.0");
+    }
+
+    if (min_magnitude_threshold < 0.0f) {
+        throw std::invalid_argument("Profile " + name + ": minimum magnitude threshold must be non-negative");
+    }
+
+    if (max_time_delta_ms <= 0 || max_freq_delta_hz <= 0.0f) {
+        throw std::invalid_argument("Profile " + name + ": target zone must not be empty");
+    }
+
+    if (max_pairs_per_anchor < 0) {
+        throw std::invalid_argument("Profile " + name + ": maximum pairs per anchor must not be negative");
+    }
+
+    if (landmark_size == 3 && max_pairs_per_anchor == 0) {
+        throw std::invalid_argument("Profile " + name + ": triplet landmarks need a limited fan-out");
+    }
+
+    if (analysis_phases <= 0 || analysis_phases > hop_size) {
+        throw std::invalid_argument("Profile " + name + ": analysis phases must be in [1, hop_size]");
+    }
+}
+
+bool profiles_compatible(const FingerprintProfile& reference, const FingerprintProfile& query,
+                         std::string* reason) {
+    std::string ref_signature = reference.hash_signature();
+    std::string query_signature = query.hash_signature();
+    if (ref_signature == query_signature) {
+        return true;
+    }
+
+    if (reason) {
+        *reason = "profile " + query.name + " hashes as " + query_signature +
+                  " but profile " + reference.name + " hashes as " + ref_signature;
+    }
+    return false;
+}
+
+ProfileSet::ProfileSet()
+    : name("default"), version(1),
+      reference(FingerprintProfile::reference()), query(FingerprintProfile::query()) {}
+
+ProfileSet ProfileSet::triplets() {
+    ProfileSet profiles;
+    profiles.name = "triplets";
+    profiles.reference.landmark_size = 3;
+    profiles.reference.max_pairs_per_anchor = 4;
+    profiles.query.landmark_size = 3;
+    profiles.query.max_pairs_per_anchor = 7;
+    return profiles;
+}
+
+ProfileSet ProfileSet::coarse() {
+    ProfileSet profiles;
+    profiles.name = "coarse";
+    profiles.reference = FingerprintProfile::coarse_reference();
+    profiles.query = FingerprintProfile::coarse_query();
+    return profiles;
+}
+
+ProfileSet ProfileSet::fine() {
+    ProfileSet profiles;
+    profiles.name = "fine";
+    profiles.reference = FingerprintProfile::fine_reference();
+    profiles.query = FingerprintProfile::fine_query();
+    return profiles;
+}
+
+std::string ProfileSet::id() const {
+    return name + "/" + std::to_string(version);
+}
+
+void ProfileSet::validate() const {
+    if (name.empty() || name.find_first_of(" \t\r\n/") != std::string::npos) {
+        throw std::invalid_argument("Profile set name must be a single non-empty word");
+    }
+
+    if (version <= 0) {
+        throw std::invalid_argument("Profile set version must be positive");
+    }
+
+    reference.validate();
+    query.validate();
+
+    std::string reason;
+    if (!profiles_compatible(reference, query, &reason)) {
+        throw std::invalid_argument("Profile set " + id() + " is inconsistent: " + reason);
+    }
+}
+
+std::string ProfileSet::serialize() const {
+    std::ostringstream out;
+    out << PROFILES_HEADER << "\n";
+    out << "name " << name << "\n";
+    out << "version " << version << "\n";
+    write_profile(out, "reference.", reference);
+    write_profile(out, "query.", query);
+    return out.str();
+}
+
+ProfileSet ProfileSet::parse(const std::string& text) {
+    std::istringstream in(text);
+    std::string line;
+
+    if (!std::getline(in, line) || line != PROFILES_HEADER) {
+        throw std::runtime_error("Unsupported profile set format");
+    }
+
+    ProfileSet profiles;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        bool known = true;
+        if (key == "name") {
+            fields >> profiles.name;
+        } else if (key == "version") {
+            fields >> profiles.version;
+        } else if (key.compare(0, 10, "reference.") == 0) {
+            known = read_field(fields, key.substr(10), profiles.reference);
+        } else if (key.compare(0, 6, "query.") == 0) {
+            known = read_field(fields, key.substr(6), profiles.query);
+        } else {
+            known = false;
+        }
+
+        if (!known) {
+            throw std::runtime_error("Unknown profile set key: " + key);
+        }
+
+        if (fields.fail()) {
+            throw std::runtime_error("Malformed profile set line: " + line);
+        }
+    }
+
+    profiles.validate();
+    return profiles;
+}
+
+ProfileSet ProfileSet::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open profile set: " + path);
+    }
+
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+}
+
+} // namespace AudioFingerprint
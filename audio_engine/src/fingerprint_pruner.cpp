@@ -0,0 +1,141 @@
+#include "fingerprint_pruner.h"
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace AudioFingerprint {
+
+FingerprintPruner::FingerprintPruner(const PruningConfig& config)
+    : config_(config), total_postings_(0) {
+
+    if (config.keep_fraction <= 0.0f || config.keep_fraction > 1.0f) {
+        throw std::invalid_argument("Keep fraction must be in (0, 1]");
+    }
+
+    if (config.min_per_second < 0 || config.redundancy_window_ms < 0) {
+        throw std::invalid_argument("Pruning limits must not be negative");
+    }
+}
+
+void FingerprintPruner::count_postings(const std::vector<Fingerprint>& fingerprints) {
+    for (const auto& fp : fingerprints) {
+        posting_counts_[fp.hash_value]++;
+    }
+    total_postings_ += fingerprints.size();
+}
+
+uint32_t FingerprintPruner::posting_count(uint32_t hash_value) const {
+    auto it = posting_counts_.find(hash_value);
+    return it != posting_counts_.end() ? it->second : 0;
+}
+
+std::vector<float> FingerprintPruner::score(const std::vector<Fingerprint>& fingerprints) const {
+    const size_t n = fingerprints.size();
+    std::vector<float> scores(n, 0.0f);
+    if (n == 0) {
+        return scores;
+    }
+
+    // Rarity: log inverse posting-list length, scaled to [0, 1] over the catalog
+    const double max_rarity = std::log1p(static_cast<double>(std::max<size_t>(total_postings_, 1)));
+
+    // Strength: rank within the song, so loud and quiet recordings score alike
+    std::vector<size_t> by_strength(n);
+    std::iota(by_strength.begin(), by_strength.end(), 0);
+    std::stable_sort(by_strength.begin(), by_strength.end(), [&](size_t a, size_t b) {
+        return fingerprints[a].peak_strength < fingerprints[b].peak_strength;
+    });
+    std::vector<float> strength_rank(n, 0.0f);
+    for (size_t rank = 0; rank < n; ++rank) {
+        strength_rank[by_strength[rank]] = n > 1 ? static_cast<float>(rank) / static_cast<float>(n - 1) : 1.0f;
+    }
+
+    // Redundancy: earlier occurrences of the same hash within the window vote
+    // for the same offset, so later ones add little
+    std::vector<size_t> by_hash(n);
+    std::iota(by_hash.begin(), by_hash.end(), 0);
+    std::sort(by_hash.begin(), by_hash.end(), [&](size_t a, size_t b) {
+        if (fingerprints[a].hash_value != fingerprints[b].hash_value) {
+            return fingerprints[a].hash_value < fingerprints[b].hash_value;
+        }
+        if (fingerprints[a].time_offset_ms != fingerprints[b].time_offset_ms) {
+            return fingerprints[a].time_offset_ms < fingerprints[b].time_offset_ms;
+        }
+        return a < b;
+    });
+    std::vector<float> redundancy(n, 0.0f);
+    size_t window_start = 0;
+    for (size_t k = 0; k < n; ++k) {
+        const Fingerprint& fp = fingerprints[by_hash[k]];
+        if (k > 0 && fingerprints[by_hash[k - 1]].hash_value != fp.hash_value) {
+            window_start = k;
+        }
+        while (fingerprints[by_hash[window_start]].time_offset_ms < fp.time_offset_ms - config_.redundancy_window_ms) {
+            window_start++;
+        }
+        float repeats = static_cast<float>(k - window_start);
+        redundancy[by_hash[k]] = repeats / (1.0f + repeats);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t postings = std::max<uint32_t>(posting_count(fingerprints[i].hash_value), 1);
+        float rarity = static_cast<float>(
+            std::log1p(static_cast<double>(std::max<size_t>(total_postings_, 1)) / postings) / max_rarity);
+
+        scores[i] = config_.rarity_weight * rarity +
+                    config_.strength_weight * strength_rank[i] -
+                    config_.redundancy_weight * redundancy[i];
+    }
+
+    return scores;
+}
+
+std::vector<Fingerprint> FingerprintPruner::prune(const std::vector<Fingerprint>& fingerprints) {
+    std::vector<float> scores = score(fingerprints);
+
+    // Group by one-second window of the reference song
+    std::vector<size_t> order(fingerprints.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return fingerprints[a].time_offset_ms / 1000 < fingerprints[b].time_offset_ms / 1000;
+    });
+
+    std::vector<char> keep(fingerprints.size(), 0);
+    for (size_t begin = 0; begin < order.size();) {
+        int second = fingerprints[order[begin]].time_offset_ms / 1000;
+        size_t end = begin;
+        while (end < order.size() && fingerprints[order[end]].time_offset_ms / 1000 == second) {
+            end++;
+        }
+
+        size_t count = end - begin;
+        size_t budget = static_cast<size_t>(std::ceil(config_.keep_fraction * static_cast<float>(count)));
+        budget = std::min(count, std::max(budget, static_cast<size_t>(config_.min_per_second)));
+
+        // Best scores first; ties keep the earlier fingerprint
+        std::stable_sort(order.begin() + begin, order.begin() + end,
+                         [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+        for (size_t k = begin; k < begin + budget; ++k) {
+            keep[order[k]] = 1;
+        }
+
+        begin = end;
+    }
+
+    std::vector<Fingerprint> kept;
+    kept.reserve(fingerprints.size());
+    for (size_t i = 0; i < fingerprints.size(); ++i) {
+        if (keep[i]) {
+            kept.push_back(fingerprints[i]);
+        }
+    }
+
+    stats_.songs++;
+    stats_.input_fingerprints += fingerprints.size();
+    stats_.kept_fingerprints += kept.size();
+
+    return kept;
+}
+
+} // namespace AudioFingerprint
@@ -2,16 +2,21 @@
 #include "audio_preprocessor.h"
 #include "fft_processor.h"
 #include "peak_detector.h"
+#include "tiled_peak_pipeline.h"
+#include "native_rate_analyzer.h"
+#include "cancellation.h"
 #include <stdexcept>
 #include <algorithm>
 #include <chrono>
 #include <sstream>
 #include <cstring>
+#include <cmath>
 
 namespace AudioFingerprint {
 
 HashGenerator::HashGenerator(float freq_quantization, int time_quantization)
-    : freq_quantization_(freq_quantization), time_quantization_(time_quantization) {
+    : freq_quantization_(freq_quantization), time_quantization_(time_quantization),
+      fused_analysis_(true) {
     
     if (freq_quantization <= 0.0f) {
         throw std::invalid_argument("Frequency quantization must be positive");
@@ -37,7 +42,8 @@ std::vector<Fingerprint> HashGenerator::generate_fingerprints(
             time_offset_ms,
             pair.anchor.frequency_hz,
             pair.target.frequency_hz,
-            pair.time_delta_ms
+            pair.time_delta_ms,
+            std::min(pair.anchor.magnitude, pair.target.magnitude)
         );
         
         fingerprints.push_back(fingerprint);
@@ -56,30 +62,175 @@ uint32_t HashGenerator::generate_hash(const LandmarkPair& pair) {
     return combine_to_hash(anchor_freq_bin, target_freq_bin, time_delta_bin);
 }
 
+std::vector<Fingerprint> HashGenerator::generate_fingerprints(
+    const std::vector<LandmarkTriplet>& landmark_triplets) {
+    
+    std::vector<Fingerprint> fingerprints;
+    fingerprints.reserve(landmark_triplets.size());
+    
+    for (const auto& triplet : landmark_triplets) {
+        fingerprints.emplace_back(
+            generate_hash(triplet),
+            static_cast<int>(triplet.anchor.time_seconds * 1000.0f),
+            triplet.anchor.frequency_hz,
+            triplet.second.frequency_hz,
+            triplet.second_delta_ms,
+            std::min({triplet.anchor.magnitude, triplet.first.magnitude, triplet.second.magnitude})
+        );
+    }
+    
+    return fingerprints;
+}
+
+uint32_t HashGenerator::generate_hash(const LandmarkTriplet& triplet) {
+    uint64_t anchor_freq_bin = quantize_frequency(triplet.anchor.frequency_hz);
+    uint64_t first_ratio = quantize_frequency_ratio(triplet.first.frequency_hz, triplet.anchor.frequency_hz);
+    uint64_t second_ratio = quantize_frequency_ratio(triplet.second.frequency_hz, triplet.anchor.frequency_hz);
+    uint64_t time_delta_bin = quantize_time(triplet.second_delta_ms);
+    
+    // Position of the first target between anchor and second target; tempo invariant
+    uint64_t time_ratio = 0;
+    if (triplet.second_delta_ms > 0) {
+        time_ratio = static_cast<uint64_t>(
+            std::max(0, triplet.first_delta_ms) * TIME_RATIO_STEPS / triplet.second_delta_ms);
+    }
+    
+    uint64_t key = (anchor_freq_bin << 40) | (first_ratio << 32) | (second_ratio << 24) |
+                   (time_ratio << 16) | time_delta_bin;
+    
+    // 64-bit finalizer (MurmurHash3 fmix64); the high half is the hash
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<uint32_t>(key >> 32);
+}
+
+std::vector<Fingerprint> HashGenerator::hash_constellation(PeakDetector& peak_detector,
+                                                           const ConstellationMap& constellation,
+                                                           const FingerprintProfile& profile) {
+    if (profile.landmark_size == 3) {
+        auto landmark_triplets = peak_detector.extract_landmark_triplets(
+            constellation, profile.max_time_delta_ms, profile.max_freq_delta_hz, profile.max_pairs_per_anchor);
+        return generate_fingerprints(landmark_triplets);
+    }
+    
+    auto landmark_pairs = peak_detector.extract_landmark_pairs(
+        constellation, profile.max_time_delta_ms, profile.max_freq_delta_hz, profile.max_pairs_per_anchor);
+    return generate_fingerprints(landmark_pairs);
+}
+
 std::vector<Fingerprint> HashGenerator::process_audio_sample(const AudioSample& audio_sample) {
+    return process_audio_sample(audio_sample, get_profile());
+}
+
+std::vector<Fingerprint> HashGenerator::process_audio_sample(const AudioSample& audio_sample,
+                                                             const FingerprintProfile& profile) {
     if (audio_sample.empty()) {
         throw std::invalid_argument("Audio sample is empty");
     }
     
+    profile.validate();
+    
     // Create processing components
     AudioPreprocessor preprocessor;
-    FFTProcessor fft_processor(2048);
-    PeakDetector peak_detector;
+    PeakDetector peak_detector(profile.min_peak_distance, profile.adaptive_factor,
+                               profile.min_magnitude_threshold);
+    peak_detector.set_frequency_interpolation(profile.interpolate_frequency);
+    peak_detector.set_time_interpolation(profile.interpolate_time);
+    
+    // Hash with the profile's quantization
+    HashGenerator profile_hasher(profile.freq_quantization, profile.time_quantization);
+    profile_hasher.set_fused_analysis(fused_analysis_);
+    HashGenerator& hasher =
+        profile.freq_quantization == freq_quantization_ && profile.time_quantization == time_quantization_
+            ? *this : profile_hasher;
+    
+    if (profile.native_rate && audio_sample.sample_rate > NativeRateAnalyzer::ANALYSIS_RATE) {
+        return hasher.process_at_native_rate(audio_sample, peak_detector, profile);
+    }
     
     // Preprocess audio
     auto preprocessed = preprocessor.preprocess_for_fingerprinting(audio_sample);
+    CancellationToken::check("preprocess");
     
-    // Compute spectrogram
-    auto spectrogram = fft_processor.compute_stft(preprocessed.data, 2048, 1024);
+    std::vector<Fingerprint> fingerprints = hasher.analyse(preprocessed.data, peak_detector, profile);
     
-    // Detect peaks
-    auto constellation = peak_detector.detect_peaks(spectrogram);
+    // Further phases analyse the clip from sub-hop offsets, so that one of
+    // them lines up closely with the frame grid of a coarse-hop reference
+    for (int phase = 1; phase < profile.analysis_phases; ++phase) {
+        const int shift = profile.phase_shift(phase);
+        if (static_cast<size_t>(shift) >= preprocessed.data.size()) {
+            break;
+        }
+        std::vector<float> shifted(preprocessed.data.begin() + shift, preprocessed.data.end());
+        append_phase(fingerprints, hasher.analyse(shifted, peak_detector, profile), shift,
+                     preprocessed.sample_rate);
+    }
     
-    // Extract landmark pairs
-    auto landmark_pairs = peak_detector.extract_landmark_pairs(constellation, 2000, 2000.0f);
+    return fingerprints;
+}
+
+std::vector<Fingerprint> HashGenerator::analyse(const std::vector<float>& audio, PeakDetector& peak_detector,
+                                                const FingerprintProfile& profile) {
+    // Compute spectrogram and detect peaks
+    ConstellationMap constellation;
+    if (fused_analysis_) {
+        TiledPeakPipeline pipeline(profile.fft_size, profile.hop_size);
+        constellation = pipeline.detect_peaks(audio, peak_detector);
+    } else {
+        FFTProcessor fft_processor(profile.fft_size);
+        auto spectrogram = fft_processor.compute_stft(audio, profile.fft_size, profile.hop_size);
+        constellation = peak_detector.detect_peaks(spectrogram);
+    }
     
-    // Generate fingerprints
-    return generate_fingerprints(landmark_pairs);
+    // Form landmarks and hash them
+    return hash_constellation(peak_detector, constellation, profile);
+}
+
+std::vector<Fingerprint> HashGenerator::process_at_native_rate(const AudioSample& audio_sample,
+                                                               PeakDetector& peak_detector,
+                                                               const FingerprintProfile& profile) {
+    AudioPreprocessor preprocessor;
+    auto preprocessed = preprocessor.preprocess_at_native_rate(audio_sample);
+    CancellationToken::check("preprocess");
+    NativeRateAnalyzer analyzer(preprocessed.sample_rate, profile.fft_size, profile.hop_size);
+    
+    std::vector<Fingerprint> fingerprints;
+    for (int phase = 0; phase < profile.analysis_phases; ++phase) {
+        const int shift = analyzer.to_native_samples(profile.phase_shift(phase));
+        ConstellationMap constellation;
+        if (shift == 0) {
+            constellation = peak_detector.detect_peaks(analyzer.compute_stft(preprocessed.data));
+        } else if (static_cast<size_t>(shift) < preprocessed.data.size()) {
+            std::vector<float> shifted(preprocessed.data.begin() + shift, preprocessed.data.end());
+            constellation = peak_detector.detect_peaks(analyzer.compute_stft(shifted));
+        } else {
+            break;
+        }
+        append_phase(fingerprints, hash_constellation(peak_detector, constellation, profile), shift,
+                     preprocessed.sample_rate);
+    }
+    
+    return fingerprints;
+}
+
+void HashGenerator::append_phase(std::vector<Fingerprint>& merged, const std::vector<Fingerprint>& phase,
+                                 int shift_samples, int sample_rate) {
+    const int shift_ms = static_cast<int>(std::lround(shift_samples * 1000.0 / sample_rate));
+    merged.reserve(merged.size() + phase.size());
+    for (const auto& fp : phase) {
+        merged.push_back(fp);
+        merged.back().time_offset_ms += shift_ms;
+    }
+}
+
+FingerprintProfile HashGenerator::get_profile() const {
+    FingerprintProfile profile;
+    profile.freq_quantization = freq_quantization_;
+    profile.time_quantization = time_quantization_;
+    return profile;
 }
 
 std::vector<BatchProcessingResult> HashGenerator::batch_process_reference_songs(
@@ -94,6 +245,7 @@ std::vector<BatchProcessingResult> HashGenerator::batch_process_reference_songs(
     results.reserve(audio_samples.size());
     
     for (size_t i = 0; i < audio_samples.size(); ++i) {
+        CancellationToken::check("batch");
         BatchProcessingResult result;
         result.song_id = song_ids[i];
         
@@ -105,6 +257,8 @@ std::vector<BatchProcessingResult> HashGenerator::batch_process_reference_songs(
             result.total_duration_ms = audio_samples[i].duration_ms;
             result.success = true;
             
+        } catch (const OperationCancelled&) {
+            throw;  // Cancels the whole batch, not one song
         } catch (const std::exception& e) {
             result.success = false;
             result.error_message = e.what();
@@ -228,6 +382,14 @@ uint16_t HashGenerator::quantize_time(int time_ms) {
     return std::min(bin, static_cast<uint16_t>(65535));  // Clamp to 16-bit range
 }
 
+uint8_t HashGenerator::quantize_frequency_ratio(float target_freq, float anchor_freq) {
+    // Bin 0 (DC) peaks would give an unbounded ratio
+    const float floor_hz = freq_quantization_;
+    float octaves = std::log2(std::max(target_freq, floor_hz) / std::max(anchor_freq, floor_hz));
+    int bin = 128 + static_cast<int>(std::floor(octaves * FREQ_RATIO_STEPS_PER_OCTAVE));
+    return static_cast<uint8_t>(std::min(255, std::max(0, bin)));
+}
+
 uint32_t HashGenerator::combine_to_hash(uint16_t anchor_freq, uint16_t target_freq, uint16_t time_delta) {
     // Use a simple but effective hash combination
     return hash_function(
@@ -0,0 +1,537 @@
+#include "index_segment.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+const char SEGMENT_MAGIC[8] = {'A', 'F', 'S', 'E', 'G', '0', '0', '1'};
+const size_t HEADER_SIZE = 8 + 4 + 4 + 8 + 8 + 8;
+const size_t HASH_ENTRY_SIZE = 16;
+const size_t POSTING_SIZE = 8;
+const size_t SONG_ENTRY_SIZE = 8;
+const size_t SONG_RECORD_SIZE = 28;
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t get_u64(const uint8_t* p) {
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+bool posting_less(const std::pair<uint32_t, Posting>& a, const std::pair<uint32_t, Posting>& b) {
+    if (a.first != b.first) return a.first < b.first;
+    if (a.second.song_id != b.second.song_id) return a.second.song_id < b.second.song_id;
+    return a.second.time_offset_ms < b.second.time_offset_ms;
+}
+
+/**
+ * Append a string to a pool unless it is already there
+ */
+void intern(std::string& pool, std::unordered_map<std::string, uint32_t>& offsets, const std::string& value,
+            uint32_t& offset, uint32_t& length) {
+    length = static_cast<uint32_t>(value.size());
+    if (value.empty()) {
+        offset = 0;
+        return;
+    }
+
+    auto it = offsets.find(value);
+    if (it == offsets.end()) {
+        it = offsets.emplace(value, static_cast<uint32_t>(pool.size())).first;
+        pool += value;
+    }
+    offset = it->second;
+}
+
+} // namespace
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    static uint32_t table[256];
+    static bool table_ready = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)table_ready;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::vector<uint8_t> read_binary_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!data.empty() && !file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error("Read failed for " + path);
+    }
+
+    return data;
+}
+
+void write_file_atomically(const std::string& path, const uint8_t* data, size_t size) {
+    const std::string tmp_path = path + ".tmp";
+
+#ifdef _WIN32
+    FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Cannot create " + tmp_path);
+    }
+    bool ok = std::fwrite(data, 1, size, file) == size && std::fflush(file) == 0 &&
+              _commit(_fileno(file)) == 0;
+    std::fclose(file);
+    if (!ok) {
+        throw std::runtime_error("Write failed for " + tmp_path);
+    }
+
+    if (!MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        throw std::runtime_error("Cannot replace " + path);
+    }
+#else
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create " + tmp_path + ": " + std::strerror(errno));
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::write(fd, data + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ::close(fd);
+            throw std::runtime_error("Write failed for " + tmp_path + ": " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    if (::fsync(fd) != 0) {
+        ::close(fd);
+        throw std::runtime_error("fsync failed for " + tmp_path + ": " + std::strerror(errno));
+    }
+    ::close(fd);
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace " + path + ": " + std::strerror(errno));
+    }
+
+    // Persist the directory entry so the rename survives a crash
+    std::string directory = ".";
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos) {
+        directory = slash == 0 ? "/" : path.substr(0, slash);
+    }
+    int dir_fd = ::open(directory.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+#endif
+}
+
+IndexSegment IndexSegment::build(std::vector<std::pair<uint32_t, Posting>>&& entries,
+                                 const std::map<uint32_t, SongMetadata>& metadata) {
+    std::sort(entries.begin(), entries.end(), posting_less);
+
+    IndexSegment segment;
+    segment.postings_.reserve(entries.size());
+
+    std::vector<SegmentSong> song_counts;
+    for (const auto& entry : entries) {
+        if (segment.hashes_.empty() || segment.hashes_.back().hash_value != entry.first) {
+            HashEntry hash_entry;
+            hash_entry.hash_value = entry.first;
+            hash_entry.first = segment.postings_.size();
+            segment.hashes_.push_back(hash_entry);
+        }
+        segment.hashes_.back().count++;
+        segment.postings_.push_back(entry.second);
+        song_counts.emplace_back(entry.second.song_id, 1);
+    }
+    entries.clear();
+    entries.shrink_to_fit();
+
+    // Collapse per-posting counts into one entry per song
+    std::sort(song_counts.begin(), song_counts.end(),
+              [](const SegmentSong& a, const SegmentSong& b) { return a.song_id < b.song_id; });
+    for (const auto& song : song_counts) {
+        if (segment.songs_.empty() || segment.songs_.back().song_id != song.song_id) {
+            segment.songs_.emplace_back(song.song_id, 0);
+        }
+        segment.songs_.back().fingerprint_count++;
+    }
+
+    bool any_metadata = false;
+    for (const auto& song : segment.songs_) {
+        auto it = metadata.find(song.song_id);
+        if (it != metadata.end() && !it->second.empty()) {
+            any_metadata = true;
+            break;
+        }
+    }
+
+    if (any_metadata) {
+        std::unordered_map<std::string, uint32_t> offsets;
+        segment.records_.resize(segment.songs_.size());
+        for (size_t i = 0; i < segment.songs_.size(); ++i) {
+            auto it = metadata.find(segment.songs_[i].song_id);
+            if (it == metadata.end()) {
+                continue;
+            }
+            SongRecord& record = segment.records_[i];
+            intern(segment.strings_, offsets, it->second.title, record.title_offset, record.title_length);
+            intern(segment.strings_, offsets, it->second.artist, record.artist_offset, record.artist_length);
+            intern(segment.strings_, offsets, it->second.album, record.album_offset, record.album_length);
+            record.duration_ms = it->second.duration_ms;
+        }
+    }
+
+    return segment;
+}
+
+IndexSegment IndexSegment::merge(const std::vector<const IndexSegment*>& segments) {
+    size_t total = 0;
+    for (const auto* segment : segments) {
+        total += segment->posting_count();
+    }
+
+    std::vector<std::pair<uint32_t, Posting>> entries;
+    entries.reserve(total);
+    std::map<uint32_t, SongMetadata> metadata;
+    for (const auto* segment : segments) {
+        for (const auto& hash_entry : segment->hashes_) {
+            for (uint64_t i = 0; i < hash_entry.count; ++i) {
+                Posting posting = segment->postings_[hash_entry.first + i];
+                posting.song_id = segment->external_id(posting.song_id);
+                entries.emplace_back(hash_entry.hash_value, posting);
+            }
+        }
+        for (size_t i = 0; i < segment->records_.size(); ++i) {
+            SongMetadata song = segment->record_metadata(i);
+            if (!song.empty()) {
+                metadata[segment->songs_[i].song_id] = std::move(song);
+            }
+        }
+    }
+
+    IndexSegment merged = build(std::move(entries), metadata);
+
+    // Keep the song order of renumbered inputs, so compaction does not undo
+    // reorder(); songs they do not know are numbered after them
+    std::vector<uint32_t> order;
+    std::unordered_set<uint32_t> ordered;
+    for (const auto* segment : segments) {
+        for (uint32_t external : segment->external_ids_) {
+            if (ordered.insert(external).second) {
+                order.push_back(external);
+            }
+        }
+    }
+    if (order.empty()) {
+        return merged;
+    }
+    for (const auto& song : merged.songs_) {
+        if (!ordered.count(song.song_id)) {
+            order.push_back(song.song_id);
+        }
+    }
+    return reorder(merged, order);
+}
+
+IndexSegment IndexSegment::reorder(const IndexSegment& segment, const std::vector<uint32_t>& order) {
+    if (order.size() != segment.songs_.size()) {
+        throw std::invalid_argument("Song order must list every song of the segment once");
+    }
+
+    // External ID -> new internal ID, via the position in songs_
+    std::vector<uint32_t> internal(segment.songs_.size(), UINT32_MAX);
+    for (size_t position = 0; position < order.size(); ++position) {
+        auto it = std::lower_bound(segment.songs_.begin(), segment.songs_.end(), order[position],
+                                   [](const SegmentSong& song, uint32_t value) { return song.song_id < value; });
+        if (it == segment.songs_.end() || it->song_id != order[position] ||
+            internal[it - segment.songs_.begin()] != UINT32_MAX) {
+            throw std::invalid_argument("Song order must list every song of the segment once");
+        }
+        internal[it - segment.songs_.begin()] = static_cast<uint32_t>(position);
+    }
+
+    auto song_index = [&](uint32_t external) {
+        return static_cast<size_t>(std::lower_bound(segment.songs_.begin(), segment.songs_.end(), external,
+                                                    [](const SegmentSong& song, uint32_t value) {
+                                                        return song.song_id < value;
+                                                    }) - segment.songs_.begin());
+    };
+
+    IndexSegment reordered;
+    reordered.hashes_ = segment.hashes_;
+    reordered.postings_.resize(segment.postings_.size());
+    reordered.songs_ = segment.songs_;
+    reordered.records_ = segment.records_;
+    reordered.strings_ = segment.strings_;
+    reordered.external_ids_ = order;
+
+    // Hash lists keep their place and length; only their order changes
+    for (const auto& hash_entry : segment.hashes_) {
+        Posting* list = reordered.postings_.data() + hash_entry.first;
+        for (uint64_t i = 0; i < hash_entry.count; ++i) {
+            list[i] = segment.postings_[hash_entry.first + i];
+            list[i].song_id = internal[song_index(segment.external_id(list[i].song_id))];
+        }
+        std::sort(list, list + hash_entry.count, [](const Posting& a, const Posting& b) {
+            if (a.song_id != b.song_id) return a.song_id < b.song_id;
+            return a.time_offset_ms < b.time_offset_ms;
+        });
+    }
+
+    return reordered;
+}
+
+std::vector<uint8_t> IndexSegment::serialize() const {
+    std::vector<uint8_t> out;
+    out.reserve(HEADER_SIZE + hashes_.size() * HASH_ENTRY_SIZE + postings_.size() * POSTING_SIZE +
+                songs_.size() * SONG_ENTRY_SIZE + (has_song_table() ? 8 + records_.size() * SONG_RECORD_SIZE : 0) +
+                strings_.size() + external_ids_.size() * 4 + 4);
+
+    for (char c : SEGMENT_MAGIC) {
+        out.push_back(static_cast<uint8_t>(c));
+    }
+    // Segments without a song table or ID map stay readable by version 1 builds
+    const uint32_t flags = (has_song_table() ? FLAG_SONG_TABLE : 0) | (has_id_map() ? FLAG_SONG_ID_MAP : 0);
+    put_u32(out, flags != 0 ? FORMAT_VERSION : 1);
+    put_u32(out, flags);
+    put_u64(out, hashes_.size());
+    put_u64(out, postings_.size());
+    put_u64(out, songs_.size());
+
+    for (const auto& entry : hashes_) {
+        put_u32(out, entry.hash_value);
+        put_u32(out, entry.count);
+        put_u64(out, entry.first);
+    }
+
+    for (const auto& posting : postings_) {
+        put_u32(out, posting.song_id);
+        put_u32(out, static_cast<uint32_t>(posting.time_offset_ms));
+    }
+
+    for (const auto& song : songs_) {
+        put_u32(out, song.song_id);
+        put_u32(out, song.fingerprint_count);
+    }
+
+    if (has_song_table()) {
+        put_u64(out, strings_.size());
+        for (const auto& record : records_) {
+            put_u32(out, record.title_offset);
+            put_u32(out, record.title_length);
+            put_u32(out, record.artist_offset);
+            put_u32(out, record.artist_length);
+            put_u32(out, record.album_offset);
+            put_u32(out, record.album_length);
+            put_u32(out, static_cast<uint32_t>(record.duration_ms));
+        }
+        out.insert(out.end(), strings_.begin(), strings_.end());
+    }
+
+    for (uint32_t external : external_ids_) {
+        put_u32(out, external);
+    }
+
+    put_u32(out, crc32(out.data(), out.size()));
+    return out;
+}
+
+IndexSegment IndexSegment::load(const std::string& path) {
+    return parse(read_binary_file(path), path);
+}
+
+IndexSegment IndexSegment::parse(const std::vector<uint8_t>& data, const std::string& path) {
+    if (data.size() < HEADER_SIZE + 4 || std::memcmp(data.data(), SEGMENT_MAGIC, 8) != 0) {
+        throw std::runtime_error("Not an index segment: " + path);
+    }
+
+    uint32_t stored_crc = get_u32(data.data() + data.size() - 4);
+    if (crc32(data.data(), data.size() - 4) != stored_crc) {
+        throw std::runtime_error("Checksum mismatch in index segment: " + path);
+    }
+
+    const uint8_t* p = data.data() + 8;
+    uint32_t version = get_u32(p);
+    uint32_t flags = get_u32(p + 4);
+    if (version != 1 && version != FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported index segment version in " + path);
+    }
+    if ((version == 1 && flags != 0) || (flags & ~(FLAG_SONG_TABLE | FLAG_SONG_ID_MAP)) != 0) {
+        throw std::runtime_error("Unsupported index segment flags in " + path);
+    }
+
+    uint64_t hash_count = get_u64(p + 8);
+    uint64_t posting_count = get_u64(p + 16);
+    uint64_t song_count = get_u64(p + 24);
+
+    uint64_t expected = HEADER_SIZE + hash_count * HASH_ENTRY_SIZE + posting_count * POSTING_SIZE +
+                        song_count * SONG_ENTRY_SIZE + 4;
+    uint64_t pool_size = 0;
+    if (flags & FLAG_SONG_TABLE) {
+        if (expected + 8 > data.size()) {
+            throw std::runtime_error("Truncated index segment: " + path);
+        }
+        pool_size = get_u64(data.data() + expected - 4);
+        expected += 8 + song_count * SONG_RECORD_SIZE + pool_size;
+    }
+    if (flags & FLAG_SONG_ID_MAP) {
+        expected += song_count * 4;
+    }
+    if (expected != data.size()) {
+        throw std::runtime_error("Truncated index segment: " + path);
+    }
+
+    IndexSegment segment;
+    p = data.data() + HEADER_SIZE;
+
+    segment.hashes_.resize(hash_count);
+    for (auto& entry : segment.hashes_) {
+        entry.hash_value = get_u32(p);
+        entry.count = get_u32(p + 4);
+        entry.first = get_u64(p + 8);
+        if (entry.first + entry.count > posting_count) {
+            throw std::runtime_error("Corrupt hash table in index segment: " + path);
+        }
+        p += HASH_ENTRY_SIZE;
+    }
+
+    segment.postings_.resize(posting_count);
+    for (auto& posting : segment.postings_) {
+        posting.song_id = get_u32(p);
+        posting.time_offset_ms = static_cast<int32_t>(get_u32(p + 4));
+        p += POSTING_SIZE;
+    }
+
+    segment.songs_.resize(song_count);
+    for (auto& song : segment.songs_) {
+        song.song_id = get_u32(p);
+        song.fingerprint_count = get_u32(p + 4);
+        p += SONG_ENTRY_SIZE;
+    }
+
+    if (flags & FLAG_SONG_TABLE) {
+        p += 8;  // Pool size, read above
+        segment.records_.resize(song_count);
+        for (auto& record : segment.records_) {
+            record.title_offset = get_u32(p);
+            record.title_length = get_u32(p + 4);
+            record.artist_offset = get_u32(p + 8);
+            record.artist_length = get_u32(p + 12);
+            record.album_offset = get_u32(p + 16);
+            record.album_length = get_u32(p + 20);
+            record.duration_ms = static_cast<int32_t>(get_u32(p + 24));
+            if (static_cast<uint64_t>(record.title_offset) + record.title_length > pool_size ||
+                static_cast<uint64_t>(record.artist_offset) + record.artist_length > pool_size ||
+                static_cast<uint64_t>(record.album_offset) + record.album_length > pool_size) {
+                throw std::runtime_error("Corrupt song table in index segment: " + path);
+            }
+            p += SONG_RECORD_SIZE;
+        }
+        segment.strings_.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(pool_size));
+        p += pool_size;
+    }
+
+    if (flags & FLAG_SONG_ID_MAP) {
+        segment.external_ids_.resize(song_count);
+        for (auto& external : segment.external_ids_) {
+            external = get_u32(p);
+            p += 4;
+        }
+        for (const auto& posting : segment.postings_) {
+            if (posting.song_id >= song_count) {
+                throw std::runtime_error("Corrupt song ID map in index segment: " + path);
+            }
+        }
+    }
+
+    return segment;
+}
+
+const Posting* IndexSegment::find(uint32_t hash_value, size_t& count) const {
+    auto it = std::lower_bound(hashes_.begin(), hashes_.end(), hash_value,
+                               [](const HashEntry& entry, uint32_t value) { return entry.hash_value < value; });
+
+    if (it == hashes_.end() || it->hash_value != hash_value) {
+        count = 0;
+        return nullptr;
+    }
+
+    count = it->count;
+    return postings_.data() + it->first;
+}
+
+bool IndexSegment::song_metadata(uint32_t song_id, SongMetadata& metadata) const {
+    if (records_.empty()) {
+        return false;
+    }
+
+    auto it = std::lower_bound(songs_.begin(), songs_.end(), song_id,
+                               [](const SegmentSong& song, uint32_t value) { return song.song_id < value; });
+    if (it == songs_.end() || it->song_id != song_id) {
+        return false;
+    }
+
+    SongMetadata found = record_metadata(static_cast<size_t>(it - songs_.begin()));
+    if (found.empty()) {
+        return false;
+    }
+    metadata = std::move(found);
+    return true;
+}
+
+SongMetadata IndexSegment::record_metadata(size_t index) const {
+    const SongRecord& record = records_[index];
+    return SongMetadata(strings_.substr(record.title_offset, record.title_length),
+                        strings_.substr(record.artist_offset, record.artist_length),
+                        strings_.substr(record.album_offset, record.album_length),
+                        record.duration_ms);
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,430 @@
+#include "ingest_wal.h"
+#include "index_segment.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+const char WAL_MAGIC[8] = {'A', 'F', 'W', 'A', 'L', '0', '0', '1'};
+const size_t WAL_HEADER_SIZE = 8;
+const size_t RECORD_HEADER_SIZE = 8;       // Payload length + CRC
+const size_t RECORD_FIXED_PAYLOAD = 16;    // LSN + song ID + fingerprint count
+const size_t FINGERPRINT_SIZE = 8;
+
+void put_u32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void put_u64(uint8_t* p, uint64_t value) {
+    put_u32(p, static_cast<uint32_t>(value));
+    put_u32(p + 4, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t get_u64(const uint8_t* p) {
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+size_t metadata_size(const SongMetadata& metadata) {
+    if (metadata.empty()) {
+        return 0;
+    }
+    return 4 + 12 + metadata.title.size() + metadata.artist.size() + metadata.album.size();
+}
+
+uint8_t* put_string(uint8_t* p, const std::string& value) {
+    put_u32(p, static_cast<uint32_t>(value.size()));
+    std::memcpy(p + 4, value.data(), value.size());
+    return p + 4 + value.size();
+}
+
+/**
+ * Read one length-prefixed string of a metadata block
+ * @return False if it runs past the end
+ */
+bool get_string(const uint8_t*& p, const uint8_t* end, std::string& value) {
+    if (end - p < 4 || static_cast<uint64_t>(end - p - 4) < get_u32(p)) {
+        return false;
+    }
+    uint32_t length = get_u32(p);
+    value.assign(reinterpret_cast<const char*>(p + 4), length);
+    p += 4 + length;
+    return true;
+}
+
+/**
+ * Parse the metadata block of a record
+ * @return False if it is malformed
+ */
+bool parse_metadata(const uint8_t* p, const uint8_t* end, SongMetadata& metadata) {
+    metadata = SongMetadata();
+    if (p == end) {
+        return true;
+    }
+    if (end - p < 4) {
+        return false;
+    }
+    metadata.duration_ms = static_cast<int32_t>(get_u32(p));
+    p += 4;
+    return get_string(p, end, metadata.title) && get_string(p, end, metadata.artist) &&
+           get_string(p, end, metadata.album) && p == end;
+}
+
+void write_all(int fd, const uint8_t* data, size_t size, const std::string& path) {
+    size_t written = 0;
+    while (written < size) {
+#ifdef _WIN32
+        int n = _write(fd, data + written, static_cast<unsigned int>(std::min<size_t>(size - written, 1u << 30)));
+#else
+        ssize_t n = ::write(fd, data + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n <= 0) {
+            throw std::runtime_error("Write failed for " + path + ": " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+void sync_data(int fd, const std::string& path) {
+#ifdef _WIN32
+    int result = _commit(fd);
+#elif defined(__APPLE__)
+    int result = ::fsync(fd);
+#else
+    int result = ::fdatasync(fd);
+#endif
+    if (result != 0) {
+        throw std::runtime_error("Sync failed for " + path + ": " + std::strerror(errno));
+    }
+}
+
+} // namespace
+
+IngestWal::IngestWal(const std::string& path, int commit_window_us)
+    : path_(path), commit_window_us_(commit_window_us), fd_(-1),
+      appended_lsn_(0), durable_lsn_(0), logical_end_(0), file_base_(0), leader_active_(false) {
+
+    if (commit_window_us < 0) {
+        throw std::invalid_argument("Commit window must not be negative");
+    }
+
+    open_file();
+}
+
+IngestWal::~IngestWal() {
+    // Records nobody waited for were never acknowledged, but write them anyway
+    try {
+        std::lock_guard<std::mutex> file_lock(file_mutex_);
+        write_pending();
+    } catch (const std::exception&) {
+    }
+    close_file();
+}
+
+void IngestWal::open_file() {
+#ifdef _WIN32
+    fd_ = _open(path_.c_str(), _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+#endif
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open write-ahead log " + path_ + ": " + std::strerror(errno));
+    }
+
+    if (file_size() == 0) {
+        write_all(fd_, reinterpret_cast<const uint8_t*>(WAL_MAGIC), WAL_HEADER_SIZE, path_);
+        sync_data(fd_, path_);
+    }
+}
+
+void IngestWal::close_file() {
+    if (fd_ >= 0) {
+#ifdef _WIN32
+        _close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
+    }
+}
+
+uint64_t IngestWal::file_size() const {
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path_.c_str(), &info) != 0) {
+        return 0;
+    }
+#else
+    struct stat info;
+    if (::stat(path_.c_str(), &info) != 0) {
+        return 0;
+    }
+#endif
+    return static_cast<uint64_t>(info.st_size);
+}
+
+size_t IngestWal::replay(uint64_t after_lsn, const ReplayCallback& callback) {
+    std::lock_guard<std::mutex> file_lock(file_mutex_);
+
+    std::vector<uint8_t> data = read_binary_file(path_);
+    if (data.size() < WAL_HEADER_SIZE || std::memcmp(data.data(), WAL_MAGIC, WAL_HEADER_SIZE) != 0) {
+        throw std::runtime_error("Not a write-ahead log: " + path_);
+    }
+
+    size_t replayed = 0;
+    uint64_t last_lsn = after_lsn;
+    size_t pos = WAL_HEADER_SIZE;
+    std::vector<Fingerprint> fingerprints;
+    SongMetadata metadata;
+
+    while (pos + RECORD_HEADER_SIZE <= data.size()) {
+        uint32_t length = get_u32(data.data() + pos);
+        uint32_t stored_crc = get_u32(data.data() + pos + 4);
+        const uint8_t* payload = data.data() + pos + RECORD_HEADER_SIZE;
+
+        if (length < RECORD_FIXED_PAYLOAD || length > data.size() - pos - RECORD_HEADER_SIZE ||
+            crc32(payload, length) != stored_crc) {
+            break;
+        }
+
+        uint64_t lsn = get_u64(payload);
+        uint32_t song_id = get_u32(payload + 8);
+        uint32_t count = get_u32(payload + 12);
+        const uint64_t fingerprint_end = RECORD_FIXED_PAYLOAD + static_cast<uint64_t>(count) * FINGERPRINT_SIZE;
+        if (fingerprint_end > length || !parse_metadata(payload + fingerprint_end, payload + length, metadata)) {
+            break;
+        }
+
+        if (lsn > after_lsn) {
+            fingerprints.clear();
+            fingerprints.reserve(count);
+            const uint8_t* p = payload + RECORD_FIXED_PAYLOAD;
+            for (uint32_t i = 0; i < count; ++i, p += FINGERPRINT_SIZE) {
+                fingerprints.emplace_back(get_u32(p), static_cast<int32_t>(get_u32(p + 4)), 0.0f, 0.0f, 0);
+            }
+            callback(lsn, song_id, fingerprints, metadata);
+            replayed++;
+        }
+
+        last_lsn = std::max(last_lsn, lsn);
+        pos += RECORD_HEADER_SIZE + length;
+    }
+
+    // Cut off a record torn by a crash so new appends follow the last good one
+    if (pos < data.size()) {
+#ifdef _WIN32
+        int result = _chsize_s(fd_, static_cast<__int64>(pos));
+#else
+        int result = ::ftruncate(fd_, static_cast<off_t>(pos));
+#endif
+        if (result != 0) {
+            throw std::runtime_error("Cannot truncate write-ahead log " + path_);
+        }
+        sync_data(fd_, path_);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    appended_lsn_ = last_lsn;
+    durable_lsn_ = last_lsn;
+    logical_end_ = file_base_ + (pos - WAL_HEADER_SIZE);
+    stats_.replayed += replayed;
+
+    return replayed;
+}
+
+uint64_t IngestWal::append(uint32_t song_id, const std::vector<Fingerprint>& fingerprints,
+                          const SongMetadata& metadata) {
+    const size_t payload_size = RECORD_FIXED_PAYLOAD + fingerprints.size() * FINGERPRINT_SIZE +
+                                metadata_size(metadata);
+    const size_t record_size = RECORD_HEADER_SIZE + payload_size;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+
+    uint64_t lsn = ++appended_lsn_;
+
+    size_t start = pending_.size();
+    pending_.resize(start + record_size);
+    uint8_t* record = pending_.data() + start;
+    uint8_t* payload = record + RECORD_HEADER_SIZE;
+
+    put_u64(payload, lsn);
+    put_u32(payload + 8, song_id);
+    put_u32(payload + 12, static_cast<uint32_t>(fingerprints.size()));
+    uint8_t* p = payload + RECORD_FIXED_PAYLOAD;
+    for (const auto& fp : fingerprints) {
+        put_u32(p, fp.hash_value);
+        put_u32(p + 4, static_cast<uint32_t>(fp.time_offset_ms));
+        p += FINGERPRINT_SIZE;
+    }
+    if (!metadata.empty()) {
+        put_u32(p, static_cast<uint32_t>(metadata.duration_ms));
+        p = put_string(p + 4, metadata.title);
+        p = put_string(p, metadata.artist);
+        put_string(p, metadata.album);
+    }
+
+    put_u32(record, static_cast<uint32_t>(payload_size));
+    put_u32(record + 4, crc32(payload, payload_size));
+
+    logical_end_ += record_size;
+    stats_.records++;
+    stats_.bytes += record_size;
+
+    return lsn;
+}
+
+void IngestWal::write_pending() {
+    std::vector<uint8_t> batch;
+    uint64_t target;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch.swap(pending_);
+        target = appended_lsn_;
+    }
+
+    if (batch.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        if (fd_ < 0) {
+            throw std::runtime_error("Write-ahead log " + path_ + " is not open");
+        }
+        write_all(fd_, batch.data(), batch.size(), path_);
+        sync_data(fd_, path_);
+    } catch (const std::exception& e) {
+        // The file state is unknown after a failed write; refuse further appends
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = std::string("Write-ahead log failed: ") + e.what();
+        }
+        durable_cv_.notify_all();
+        throw;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        durable_lsn_ = std::max(durable_lsn_, target);
+        stats_.syncs++;
+        stats_.sync_ms += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    durable_cv_.notify_all();
+}
+
+void IngestWal::wait_durable(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (durable_lsn_ < lsn) {
+        if (!error_.empty()) {
+            throw std::runtime_error(error_);
+        }
+
+        if (leader_active_) {
+            durable_cv_.wait(lock);
+            continue;
+        }
+
+        // Lead the next group commit: give other appenders the window to join
+        leader_active_ = true;
+        lock.unlock();
+
+        if (commit_window_us_ > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(commit_window_us_));
+        }
+
+        try {
+            std::lock_guard<std::mutex> file_lock(file_mutex_);
+            write_pending();
+        } catch (const std::exception&) {
+            // Recorded in error_ and reported below
+        }
+
+        lock.lock();
+        leader_active_ = false;
+        durable_cv_.notify_all();
+    }
+}
+
+WalMark IngestWal::mark() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    WalMark mark;
+    mark.lsn = appended_lsn_;
+    mark.offset = logical_end_;
+    return mark;
+}
+
+void IngestWal::truncate(const WalMark& mark) {
+    std::lock_guard<std::mutex> file_lock(file_mutex_);
+
+    // Everything appended so far is written first, so the file holds the whole log
+    write_pending();
+
+    uint64_t base;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        base = file_base_;
+    }
+    if (mark.offset <= base) {
+        return;
+    }
+
+    // Keep only the records appended after the mark
+    std::vector<uint8_t> rewritten(WAL_MAGIC, WAL_MAGIC + WAL_HEADER_SIZE);
+    {
+        std::ifstream file(path_, std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(WAL_HEADER_SIZE + (mark.offset - base)));
+        rewritten.insert(rewritten.end(), std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    close_file();
+    try {
+        write_file_atomically(path_, rewritten.data(), rewritten.size());
+    } catch (...) {
+        open_file();
+        throw;
+    }
+    open_file();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_base_ = mark.offset;
+}
+
+WalStats IngestWal::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,722 @@
+#include "matcher_sidecar.h"
+#include "cancellation.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free &&
+              sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "Shared-memory words must be lock-free and address-free");
+
+const char SIDECAR_MAGIC[8] = {'A', 'F', 'S', 'I', 'D', 'E', '0', '2'};
+const size_t CACHE_LINE = 64;
+const size_t MAX_NAME_LENGTH = 200;
+const size_t ERROR_LENGTH = 160;
+
+// Song titles, artists and albums longer than this, terminator included, are cut
+const size_t METADATA_TEXT_LENGTH = 128;
+
+// Longest a sleeping side waits before rechecking stop, timeout and cancellation
+const int WORKER_IDLE_WAIT_US = 100000;
+const int CLIENT_WAIT_SLICE_US = 10000;
+
+// Client back-off while every slot is taken
+const int SLOT_RETRY_US = 50;
+
+// Interval between scans for slots of dead clients
+const auto RECLAIM_INTERVAL = std::chrono::seconds(1);
+
+enum SlotState : uint32_t {
+    SLOT_FREE = 0,
+    SLOT_CLAIMED,      // A client is writing its query
+    SLOT_SUBMITTED,    // Waiting for a worker
+    SLOT_RUNNING,      // A worker is querying
+    SLOT_DONE,         // Result written; the client frees the slot after reading it
+    SLOT_ABANDONED     // The client gave up while it ran; the worker frees it
+};
+
+/**
+ * Segment header; written by the sidecar before it sets ready
+ */
+struct SharedHeader {
+    char magic[8];
+    uint32_t slot_count;
+    uint32_t max_query_hashes;
+    uint32_t max_results;
+    uint32_t spin_us;
+    uint64_t slot_bytes;
+    int64_t server_pid;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> running;     // Cleared when the sidecar stops
+    alignas(CACHE_LINE) std::atomic<uint32_t> doorbell;          // Bumped on every submission
+    std::atomic<uint32_t> sleeping_workers;
+    alignas(CACHE_LINE) std::atomic<uint32_t> next_slot;         // Where clients start looking for a free slot
+};
+
+struct SharedMatch {
+    uint32_t song_id;
+    int32_t match_count;
+    int32_t time_offset_ms;
+    float confidence;
+    int32_t duration_ms;
+    char title[METADATA_TEXT_LENGTH];
+    char artist[METADATA_TEXT_LENGTH];
+    char album[METADATA_TEXT_LENGTH];
+};
+
+/**
+ * Slot header, followed by the query hashes, query offsets and matches
+ */
+struct SlotHeader {
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> client_waiting;   // The client sleeps on state
+    std::atomic<int64_t> owner_pid;         // Client holding the slot; 0 while free or being claimed
+    uint32_t hash_count;
+    int32_t max_results;
+    int32_t min_matches;
+    int32_t deadline_ms;                    // Worker gives up after this long (0 = never)
+    uint32_t result_count;
+    uint32_t failed;
+    char error[ERROR_LENGTH];
+};
+
+constexpr size_t align_up(size_t size) {
+    return (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+const size_t HEADER_BYTES = align_up(sizeof(SharedHeader));
+const size_t SLOT_HEADER_BYTES = align_up(sizeof(SlotHeader));
+
+size_t slot_bytes(uint32_t max_query_hashes, uint32_t max_results) {
+    return align_up(SLOT_HEADER_BYTES + max_query_hashes * (sizeof(uint32_t) + sizeof(int32_t)) +
+                    max_results * sizeof(SharedMatch));
+}
+
+SharedHeader* header_of(void* mapping) {
+    return static_cast<SharedHeader*>(mapping);
+}
+
+/**
+ * Slot of a mapping; the sidecar passes its own slot size rather than trusting
+ * the header, which clients can write to
+ */
+SlotHeader* slot_at(void* mapping, uint32_t slot, uint64_t bytes_per_slot) {
+    return reinterpret_cast<SlotHeader*>(static_cast<char*>(mapping) + HEADER_BYTES + slot * bytes_per_slot);
+}
+
+uint32_t* slot_hashes(SlotHeader* slot) {
+    return reinterpret_cast<uint32_t*>(reinterpret_cast<char*>(slot) + SLOT_HEADER_BYTES);
+}
+
+int32_t* slot_offsets(SlotHeader* slot, uint32_t max_query_hashes) {
+    return reinterpret_cast<int32_t*>(slot_hashes(slot) + max_query_hashes);
+}
+
+SharedMatch* slot_results(SlotHeader* slot, uint32_t max_query_hashes) {
+    return reinterpret_cast<SharedMatch*>(slot_offsets(slot, max_query_hashes) + max_query_hashes);
+}
+
+std::string segment_path(const std::string& name) {
+    if (name.empty() || name.size() > MAX_NAME_LENGTH || name.find('/') != std::string::npos) {
+        throw std::invalid_argument("Sidecar name must be 1-200 characters without '/'");
+    }
+    return "/afe-sidecar-" + name;
+}
+
+void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/**
+ * Busy-wait budget; on a single CPU spinning only delays the other side
+ */
+std::chrono::microseconds spin_budget(uint32_t spin_us) {
+    static const bool single_cpu = std::thread::hardware_concurrency() <= 1;
+    return std::chrono::microseconds(single_cpu ? 0 : spin_us);
+}
+
+/**
+ * Sleep while a shared word holds the expected value, at most timeout_us
+ */
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_us) {
+#ifdef __linux__
+    timespec timeout;
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_nsec = (timeout_us % 1000000) * 1000L;
+    // Not FUTEX_PRIVATE: the word is shared with other processes
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#else
+    if (word.load() == expected) {
+        std::this_thread::sleep_for(std::chrono::microseconds(std::min(timeout_us, 100)));
+    }
+#endif
+}
+
+/**
+ * Wake sleepers on a shared word
+ */
+void futex_wake(std::atomic<uint32_t>& word, int count) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+#else
+    (void)word;
+    (void)count;
+#endif
+}
+
+#ifndef _WIN32
+bool process_alive(int64_t pid) {
+    return pid > 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM);
+}
+
+/**
+ * Map an existing segment
+ * @return Mapping, or null if there is no segment of that name
+ */
+void* map_segment(const std::string& path, size_t& size) {
+    int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= HEADER_BYTES) {
+        size = static_cast<size_t>(info.st_size);
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    return mapping == MAP_FAILED ? nullptr : mapping;
+}
+#endif
+
+/**
+ * Copy text into a shared field, cut at a UTF-8 character boundary if too long
+ */
+void write_text(char (&field)[METADATA_TEXT_LENGTH], const std::string& text) {
+    size_t length = std::min(text.size(), METADATA_TEXT_LENGTH - 1);
+    if (length < text.size()) {
+        while (length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+    std::memcpy(field, text.data(), length);
+    field[length] = '\0';
+}
+
+/**
+ * Read a shared text field without trusting its terminator
+ */
+std::string read_text(const char (&field)[METADATA_TEXT_LENGTH]) {
+    const void* end = std::memchr(field, '\0', METADATA_TEXT_LENGTH);
+    return std::string(field, end ? static_cast<const char*>(end) - field : METADATA_TEXT_LENGTH);
+}
+
+/**
+ * Hand a slot back; the owner is cleared first so that a slot in SLOT_CLAIMED
+ * always names its current client or none yet
+ */
+void release_slot(SlotHeader* slot) {
+    slot->owner_pid.store(0);
+    slot->state.store(SLOT_FREE);
+}
+
+/**
+ * Give up on a slot whose result the client no longer waits for
+ */
+void abandon_slot(SlotHeader* slot) {
+    slot->owner_pid.store(0);
+    uint32_t expected = SLOT_SUBMITTED;
+    if (slot->state.compare_exchange_strong(expected, SLOT_FREE)) {
+        return;
+    }
+    expected = SLOT_RUNNING;
+    if (slot->state.compare_exchange_strong(expected, SLOT_ABANDONED)) {
+        return;
+    }
+    // Finished in the meantime
+    slot->state.store(SLOT_FREE);
+}
+
+} // namespace
+
+void SidecarConfig::validate() const {
+    if (slots <= 0 || max_query_hashes <= 0 || max_results <= 0 || workers <= 0) {
+        throw std::invalid_argument("Sidecar slots, limits and workers must be positive");
+    }
+
+    if (spin_us < 0) {
+        throw std::invalid_argument("Sidecar spin time must not be negative");
+    }
+}
+
+bool MatcherSidecar::supported() {
+#ifdef _WIN32
+    return false;
+#else
+    return true;
+#endif
+}
+
+MatcherSidecar::MatcherSidecar(const std::string& name, const FingerprintIndex& index, const SidecarConfig& config)
+    : name_(name), index_(index), config_(config), mapping_(nullptr), mapping_size_(0), stopping_(false) {
+    config_.validate();
+    const std::string path = segment_path(name_);
+
+#ifdef _WIN32
+    throw std::runtime_error("The matcher sidecar requires POSIX shared memory");
+#else
+    // Replace a segment left behind by a sidecar that died, but not a live one
+    size_t existing_size = 0;
+    if (void* existing = map_segment(path, existing_size)) {
+        SharedHeader* existing_header = header_of(existing);
+        const bool live = existing_header->ready.load() && existing_header->running.load() &&
+                          process_alive(existing_header->server_pid);
+        munmap(existing, existing_size);
+        if (live) {
+            throw std::runtime_error("A matcher sidecar named " + name_ + " is already running");
+        }
+    }
+    shm_unlink(path.c_str());
+
+    const uint64_t bytes_per_slot = slot_bytes(config_.max_query_hashes, config_.max_results);
+    mapping_size_ = HEADER_BYTES + static_cast<size_t>(config_.slots) * bytes_per_slot;
+
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create shared memory " + path + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd, static_cast<off_t>(mapping_size_)) != 0) {
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Cannot size shared memory " + path + ": " + error);
+    }
+    void* mapping = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Cannot map shared memory " + path + ": " + std::strerror(errno));
+    }
+    mapping_ = mapping;
+
+    // The segment starts zeroed: every slot is free
+    SharedHeader* header = header_of(mapping_);
+    std::memcpy(header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    header->slot_count = static_cast<uint32_t>(config_.slots);
+    header->max_query_hashes = static_cast<uint32_t>(config_.max_query_hashes);
+    header->max_results = static_cast<uint32_t>(config_.max_results);
+    header->spin_us = static_cast<uint32_t>(config_.spin_us);
+    header->slot_bytes = bytes_per_slot;
+    header->server_pid = static_cast<int64_t>(getpid());
+    header->running.store(1);
+    header->ready.store(1);
+
+    for (int worker = 0; worker < config_.workers; ++worker) {
+        workers_.emplace_back(&MatcherSidecar::worker_loop, this, worker);
+    }
+#endif
+}
+
+MatcherSidecar::~MatcherSidecar() {
+    stop();
+#ifndef _WIN32
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+    }
+#endif
+}
+
+void MatcherSidecar::stop() {
+    if (stopping_.exchange(true) || !mapping_) {
+        return;
+    }
+
+    SharedHeader* header = header_of(mapping_);
+    header->running.store(0);
+    futex_wake(header->doorbell, INT_MAX);
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+
+    // Waiting clients notice that the sidecar stopped
+    const uint64_t bytes_per_slot = slot_bytes(config_.max_query_hashes, config_.max_results);
+    for (int slot = 0; slot < config_.slots; ++slot) {
+        futex_wake(slot_at(mapping_, static_cast<uint32_t>(slot), bytes_per_slot)->state, INT_MAX);
+    }
+
+#ifndef _WIN32
+    shm_unlink(segment_path(name_).c_str());
+#endif
+}
+
+SidecarStats MatcherSidecar::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void MatcherSidecar::worker_loop(int worker) {
+    SharedHeader* header = header_of(mapping_);
+    const uint32_t slots = static_cast<uint32_t>(config_.slots);
+    const uint64_t bytes_per_slot = slot_bytes(config_.max_query_hashes, config_.max_results);
+    uint32_t cursor = static_cast<uint32_t>(worker) * slots / static_cast<uint32_t>(config_.workers);
+    auto next_reclaim = Clock::now() + RECLAIM_INTERVAL;
+
+    while (!stopping_.load()) {
+        // Read before scanning: a submission after the scan changes it
+        const uint32_t bell = header->doorbell.load();
+
+        bool served = false;
+        for (uint32_t i = 0; i < slots; ++i) {
+            const uint32_t slot = (cursor + i) % slots;
+            uint32_t expected = SLOT_SUBMITTED;
+            if (slot_at(mapping_, slot, bytes_per_slot)->state.compare_exchange_strong(expected, SLOT_RUNNING)) {
+                serve_slot(slot);
+                cursor = slot + 1;
+                served = true;
+            }
+        }
+        if (served) {
+            continue;
+        }
+
+        const auto spin_until = Clock::now() + spin_budget(static_cast<uint32_t>(config_.spin_us));
+        while (header->doorbell.load(std::memory_order_relaxed) == bell && Clock::now() < spin_until) {
+            cpu_relax();
+        }
+
+        // Clients only wake the doorbell when a worker has announced it sleeps
+        header->sleeping_workers.fetch_add(1);
+        const bool idle = header->doorbell.load() == bell && !stopping_.load();
+        if (idle) {
+            futex_wait(header->doorbell, bell, WORKER_IDLE_WAIT_US);
+        }
+        header->sleeping_workers.fetch_sub(1);
+
+        if (idle) {
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.sleeps++;
+            }
+            if (worker == 0 && Clock::now() >= next_reclaim) {
+                reclaim_slots();
+                next_reclaim = Clock::now() + RECLAIM_INTERVAL;
+            }
+        }
+    }
+}
+
+void MatcherSidecar::serve_slot(uint32_t slot) {
+    // Layout comes from the sidecar's own configuration, and request fields are
+    // read once: a client can change shared memory at any time
+    const uint32_t max_query_hashes = static_cast<uint32_t>(config_.max_query_hashes);
+    SlotHeader* request = slot_at(mapping_, slot, slot_bytes(config_.max_query_hashes, config_.max_results));
+    const auto start = Clock::now();
+
+    const uint32_t hash_count = request->hash_count;
+    const int32_t max_results = request->max_results;
+    const int32_t min_matches = request->min_matches;
+    const int32_t deadline_ms = request->deadline_ms;
+    const bool valid = hash_count <= max_query_hashes && max_results > 0 && max_results <= config_.max_results;
+
+    std::vector<Fingerprint> query(valid ? hash_count : 0);
+    const uint32_t* hashes = slot_hashes(request);
+    const int32_t* offsets = slot_offsets(request, max_query_hashes);
+    for (uint32_t i = 0; i < query.size(); ++i) {
+        query[i].hash_value = hashes[i];
+        query[i].time_offset_ms = offsets[i];
+    }
+
+    // Stop scoring a query its client has timed out on
+    CancellationToken token;
+    if (deadline_ms > 0) {
+        token.set_deadline(deadline_ms);
+    }
+
+    bool failed = false;
+    try {
+        if (!valid) {
+            throw std::invalid_argument("Request exceeds the sidecar's slot limits");
+        }
+
+        CancellationScope cancellation(token);
+        std::vector<IndexMatch> matches = index_.query(query, max_results, min_matches);
+
+        SharedMatch* results = slot_results(request, max_query_hashes);
+        const uint32_t result_count =
+            static_cast<uint32_t>(std::min(matches.size(), static_cast<size_t>(max_results)));
+        for (uint32_t i = 0; i < result_count; ++i) {
+            results[i].song_id = matches[i].song_id;
+            results[i].match_count = matches[i].match_count;
+            results[i].time_offset_ms = matches[i].time_offset_ms;
+            results[i].confidence = matches[i].confidence;
+            results[i].duration_ms = matches[i].song.duration_ms;
+            write_text(results[i].title, matches[i].song.title);
+            write_text(results[i].artist, matches[i].song.artist);
+            write_text(results[i].album, matches[i].song.album);
+        }
+        request->result_count = result_count;
+        request->failed = 0;
+    } catch (const std::exception& e) {
+        failed = true;
+        request->result_count = 0;
+        request->failed = 1;
+        std::strncpy(request->error, e.what(), ERROR_LENGTH - 1);
+        request->error[ERROR_LENGTH - 1] = '\0';
+    }
+
+    const double service_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    uint32_t expected = SLOT_RUNNING;
+    const bool delivered = request->state.compare_exchange_strong(expected, SLOT_DONE);
+    if (!delivered) {
+        request->state.store(SLOT_FREE);
+    } else if (request->client_waiting.load()) {
+        futex_wake(request->state, INT_MAX);
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.requests++;
+    stats_.total_service_us += service_us;
+    stats_.max_service_us = std::max(stats_.max_service_us, service_us);
+    if (failed) {
+        stats_.failed++;
+    }
+    if (!delivered) {
+        stats_.abandoned++;
+    }
+}
+
+void MatcherSidecar::reclaim_slots() {
+#ifndef _WIN32
+    const uint64_t bytes_per_slot = slot_bytes(config_.max_query_hashes, config_.max_results);
+    uint64_t reclaimed = 0;
+
+    for (int slot = 0; slot < config_.slots; ++slot) {
+        SlotHeader* request = slot_at(mapping_, static_cast<uint32_t>(slot), bytes_per_slot);
+        uint32_t state = request->state.load();
+        if (state != SLOT_CLAIMED && state != SLOT_DONE) {
+            continue;
+        }
+
+        // Released slots have no owner, so a claimed slot without one is still
+        // being claimed; an owner, once stored, is the slot's current client
+        int64_t owner = request->owner_pid.load();
+        if (owner == 0 || process_alive(owner)) {
+            continue;
+        }
+
+        // Only the dead client moves the slot on from here
+        if (request->owner_pid.compare_exchange_strong(owner, 0) &&
+            request->state.compare_exchange_strong(state, SLOT_FREE)) {
+            reclaimed++;
+        }
+    }
+
+    if (reclaimed > 0) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.reclaimed_slots += reclaimed;
+    }
+#endif
+}
+
+MatcherClient::MatcherClient(const std::string& name, int timeout_ms)
+    : name_(name), timeout_ms_(timeout_ms), mapping_(nullptr), mapping_size_(0) {
+    if (timeout_ms_ <= 0) {
+        throw std::invalid_argument("Sidecar timeout must be positive");
+    }
+    const std::string path = segment_path(name_);
+
+#ifdef _WIN32
+    throw std::runtime_error("The matcher sidecar requires POSIX shared memory");
+#else
+    mapping_ = map_segment(path, mapping_size_);
+    if (!mapping_) {
+        throw std::runtime_error("No matcher sidecar named " + name_);
+    }
+
+    SharedHeader* header = header_of(mapping_);
+    const bool valid = std::memcmp(header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) == 0 &&
+                       header->ready.load() &&
+                       mapping_size_ >= HEADER_BYTES + header->slot_count * header->slot_bytes;
+    if (!valid) {
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        throw std::runtime_error("Matcher sidecar " + name_ + " is not ready");
+    }
+#endif
+}
+
+MatcherClient::~MatcherClient() {
+#ifndef _WIN32
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+    }
+#endif
+}
+
+bool MatcherClient::connected() const {
+#ifdef _WIN32
+    return false;
+#else
+    SharedHeader* header = header_of(mapping_);
+    return header->running.load() && process_alive(header->server_pid);
+#endif
+}
+
+int MatcherClient::get_max_query_hashes() const {
+    return static_cast<int>(header_of(mapping_)->max_query_hashes);
+}
+
+int MatcherClient::get_max_results() const {
+    return static_cast<int>(header_of(mapping_)->max_results);
+}
+
+std::vector<IndexMatch> MatcherClient::query(const std::vector<Fingerprint>& query,
+                                             int max_results, int min_matches) const {
+    SharedHeader* header = header_of(mapping_);
+    if (query.size() > header->max_query_hashes) {
+        throw std::invalid_argument("Query has more hashes than a sidecar slot holds");
+    }
+    if (max_results <= 0 || static_cast<uint32_t>(max_results) > header->max_results) {
+        throw std::invalid_argument("max_results must be between 1 and the sidecar's limit");
+    }
+    if (!header->running.load()) {
+        throw std::runtime_error("Matcher sidecar " + name_ + " stopped");
+    }
+
+    // Claim a free slot, starting where the last client left off
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::milliseconds(timeout_ms_);
+    const uint32_t slots = header->slot_count;
+    SlotHeader* request = nullptr;
+    while (!request) {
+        const uint32_t start_slot = header->next_slot.fetch_add(1, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < slots && !request; ++i) {
+            SlotHeader* candidate = slot_at(mapping_, (start_slot + i) % slots, header->slot_bytes);
+            uint32_t expected = SLOT_FREE;
+            if (candidate->state.compare_exchange_strong(expected, SLOT_CLAIMED)) {
+                request = candidate;
+            }
+        }
+        if (request) {
+            break;
+        }
+
+        CancellationToken::check("sidecar");
+        if (!connected()) {
+            throw std::runtime_error("Matcher sidecar " + name_ + " stopped");
+        }
+        if (Clock::now() >= deadline) {
+            throw std::runtime_error("All matcher sidecar slots stayed busy");
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(SLOT_RETRY_US));
+    }
+
+#ifndef _WIN32
+    request->owner_pid.store(static_cast<int64_t>(getpid()));
+#endif
+    uint32_t* hashes = slot_hashes(request);
+    int32_t* offsets = slot_offsets(request, header->max_query_hashes);
+    for (size_t i = 0; i < query.size(); ++i) {
+        hashes[i] = query[i].hash_value;
+        offsets[i] = query[i].time_offset_ms;
+    }
+    request->hash_count = static_cast<uint32_t>(query.size());
+    request->max_results = max_results;
+    request->min_matches = min_matches;
+    request->deadline_ms = std::max(1, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - Clock::now()).count()));
+    request->client_waiting.store(0);
+
+    request->state.store(SLOT_SUBMITTED);
+    header->doorbell.fetch_add(1);
+    if (header->sleeping_workers.load() > 0) {
+        futex_wake(header->doorbell, 1);
+    }
+
+    const auto spin_until = Clock::now() + spin_budget(header->spin_us);
+    uint32_t state = request->state.load();
+    while (state != SLOT_DONE && Clock::now() < spin_until) {
+        cpu_relax();
+        state = request->state.load();
+    }
+
+    while (state != SLOT_DONE) {
+        if (CancellationToken::current().is_cancelled()) {
+            abandon_slot(request);
+            CancellationToken::check("sidecar");
+        }
+        if (!connected()) {
+            abandon_slot(request);
+            throw std::runtime_error("Matcher sidecar " + name_ + " stopped");
+        }
+        if (Clock::now() >= deadline) {
+            abandon_slot(request);
+            throw std::runtime_error("Matcher sidecar query timed out");
+        }
+
+        // The worker only wakes the slot when the client announced it sleeps
+        request->client_waiting.store(1);
+        if (request->state.load() == state) {
+            futex_wait(request->state, state, CLIENT_WAIT_SLICE_US);
+        }
+        request->client_waiting.store(0);
+        state = request->state.load();
+    }
+
+    std::vector<IndexMatch> matches;
+    const bool failed = request->failed != 0;
+    const std::string error = failed ? std::string(request->error) : std::string();
+    if (!failed) {
+        const SharedMatch* results = slot_results(request, header->max_query_hashes);
+        matches.resize(request->result_count);
+        for (uint32_t i = 0; i < request->result_count; ++i) {
+            matches[i].song_id = results[i].song_id;
+            matches[i].match_count = results[i].match_count;
+            matches[i].time_offset_ms = results[i].time_offset_ms;
+            matches[i].confidence = results[i].confidence;
+            matches[i].song.duration_ms = results[i].duration_ms;
+            matches[i].song.title = read_text(results[i].title);
+            matches[i].song.artist = read_text(results[i].artist);
+            matches[i].song.album = read_text(results[i].album);
+        }
+    }
+    release_slot(request);
+
+    if (failed) {
+        throw std::runtime_error("Matcher sidecar query failed: " + error);
+    }
+    return matches;
+}
+
+} // namespace AudioFingerprint
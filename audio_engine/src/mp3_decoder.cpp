@@ -0,0 +1,274 @@
+#include "mp3_decoder.h"
+#include "audio_preprocessor.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#ifdef HAVE_MINIMP3
+#define MINIMP3_IMPLEMENTATION
+#define MINIMP3_FLOAT_OUTPUT
+#include <minimp3.h>
+#endif
+
+namespace AudioFingerprint {
+
+namespace {
+
+// Layer III bitrates (kbps) by bitrate index; index 0 (free format) is unsupported
+const int MPEG1_BITRATES[16] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0};
+const int MPEG2_BITRATES[16] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0};
+const int MPEG1_SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+// Largest main_data_begin back-reference into earlier frames
+const int MPEG1_RESERVOIR_BYTES = 511;
+const int MPEG2_RESERVOIR_BYTES = 255;
+
+int side_info_bytes(const Mp3FrameHeader& header) {
+    if (header.version == 10) {
+        return header.channels == 1 ? 17 : 32;
+    }
+    return header.channels == 1 ? 9 : 17;
+}
+
+bool same_stream(const Mp3FrameHeader& a, const Mp3FrameHeader& b) {
+    return a.version == b.version && a.sample_rate == b.sample_rate;
+}
+
+/**
+ * Bytes taken by ID3v2 tags at the start of the data
+ */
+size_t skip_id3v2(const uint8_t* data, size_t size) {
+    size_t pos = 0;
+    while (pos + 10 <= size && std::memcmp(data + pos, "ID3", 3) == 0) {
+        size_t tag_size = (static_cast<size_t>(data[pos + 6] & 0x7f) << 21) |
+                          (static_cast<size_t>(data[pos + 7] & 0x7f) << 14) |
+                          (static_cast<size_t>(data[pos + 8] & 0x7f) << 7) |
+                          static_cast<size_t>(data[pos + 9] & 0x7f);
+        size_t footer = (data[pos + 5] & 0x10) ? 10 : 0;
+        pos += 10 + tag_size + footer;
+    }
+    return std::min(pos, size);
+}
+
+/**
+ * Whether a frame header at pos is followed by a matching one (or the end)
+ */
+bool confirmed_frame(const uint8_t* data, size_t size, size_t pos, Mp3FrameHeader& header) {
+    if (pos + 4 > size || !Mp3Decoder::parse_frame_header(data + pos, header) ||
+        pos + header.frame_bytes > size) {
+        return false;
+    }
+
+    size_t next = pos + header.frame_bytes;
+    Mp3FrameHeader next_header;
+    return next + 4 > size || (Mp3Decoder::parse_frame_header(data + next, next_header) &&
+                               same_stream(header, next_header));
+}
+
+/**
+ * Whether a frame carries a Xing, Info or VBRI tag instead of audio
+ */
+bool is_tag_frame(const uint8_t* frame, const Mp3FrameHeader& header) {
+    const bool has_crc = (frame[1] & 0x01) == 0;
+    const size_t xing_offset = 4 + (has_crc ? 2 : 0) + side_info_bytes(header);
+    if (xing_offset + 4 <= static_cast<size_t>(header.frame_bytes) &&
+        (std::memcmp(frame + xing_offset, "Xing", 4) == 0 || std::memcmp(frame + xing_offset, "Info", 4) == 0)) {
+        return true;
+    }
+    return header.frame_bytes >= 40 && std::memcmp(frame + 36, "VBRI", 4) == 0;
+}
+
+/**
+ * Frames to decode ahead of first_frame so its reservoir and overlap are intact
+ */
+int warmup_frames(const uint8_t* data, const Mp3StreamInfo& info, size_t first_frame) {
+    int reservoir_bytes = info.samples_per_frame == 1152 ? MPEG1_RESERVOIR_BYTES : MPEG2_RESERVOIR_BYTES;
+    int frames = 0;
+    size_t frame = first_frame;
+    while (frame > 0 && reservoir_bytes > 0) {
+        --frame;
+        ++frames;
+        Mp3FrameHeader header;
+        Mp3Decoder::parse_frame_header(data + info.frame_offsets[frame], header);
+        reservoir_bytes -= header.frame_bytes - 4 - side_info_bytes(header);
+    }
+
+    // One more for the IMDCT overlap with the frame before
+    return frame > 0 ? frames + 1 : frames;
+}
+
+} // namespace
+
+bool Mp3Decoder::parse_frame_header(const uint8_t* data, Mp3FrameHeader& header) {
+    if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0) {
+        return false;
+    }
+
+    const int version_bits = (data[1] >> 3) & 0x03;
+    const int layer_bits = (data[1] >> 1) & 0x03;
+    const int bitrate_index = (data[2] >> 4) & 0x0f;
+    const int rate_index = (data[2] >> 2) & 0x03;
+    const int padding = (data[2] >> 1) & 0x01;
+    const int mode = (data[3] >> 6) & 0x03;
+
+    if (version_bits == 1 || layer_bits != 1 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) {
+        return false;
+    }
+
+    const bool mpeg1 = version_bits == 3;
+    header.version = mpeg1 ? 10 : (version_bits == 2 ? 20 : 25);
+    header.bitrate_kbps = mpeg1 ? MPEG1_BITRATES[bitrate_index] : MPEG2_BITRATES[bitrate_index];
+    header.sample_rate = MPEG1_SAMPLE_RATES[rate_index] / (mpeg1 ? 1 : (version_bits == 2 ? 2 : 4));
+    header.channels = mode == 3 ? 1 : 2;
+    header.samples_per_frame = mpeg1 ? 1152 : 576;
+    header.frame_bytes = (mpeg1 ? 144 : 72) * header.bitrate_kbps * 1000 / header.sample_rate + padding;
+    return true;
+}
+
+Mp3StreamInfo Mp3Decoder::scan(const uint8_t* data, size_t size) {
+    Mp3StreamInfo info;
+    Mp3FrameHeader first;
+
+    // Find the first frame confirmed by its successor
+    size_t pos = skip_id3v2(data, size);
+    while (pos + 4 <= size && !confirmed_frame(data, size, pos, first)) {
+        ++pos;
+    }
+    if (pos + 4 > size) {
+        throw std::invalid_argument("No MP3 frames found");
+    }
+
+    info.sample_rate = first.sample_rate;
+    info.channels = first.channels;
+    info.samples_per_frame = first.samples_per_frame;
+
+    Mp3FrameHeader header;
+    while (pos + 4 <= size) {
+        if (Mp3Decoder::parse_frame_header(data + pos, header) && same_stream(header, first) &&
+            pos + header.frame_bytes <= size) {
+            info.frame_offsets.push_back(pos);
+            pos += header.frame_bytes;
+            continue;
+        }
+
+        // Trailing tags end the audio; anything else is skipped up to the next frame
+        if ((pos + 3 <= size && std::memcmp(data + pos, "TAG", 3) == 0) ||
+            (pos + 8 <= size && std::memcmp(data + pos, "APETAGEX", 8) == 0)) {
+            break;
+        }
+        ++pos;
+        while (pos + 4 <= size && !(confirmed_frame(data, size, pos, header) && same_stream(header, first))) {
+            ++pos;
+        }
+    }
+
+    if (!info.frame_offsets.empty()) {
+        Mp3Decoder::parse_frame_header(data + info.frame_offsets[0], header);
+        if (is_tag_frame(data + info.frame_offsets[0], header)) {
+            info.frame_offsets.erase(info.frame_offsets.begin());
+        }
+    }
+
+    if (info.frame_offsets.empty()) {
+        throw std::invalid_argument("No MP3 audio frames found");
+    }
+
+    info.total_samples = static_cast<int64_t>(info.frame_offsets.size()) * info.samples_per_frame;
+    info.duration_ms = static_cast<int>(info.total_samples * 1000 / info.sample_rate);
+    return info;
+}
+
+bool Mp3Decoder::available() {
+#ifdef HAVE_MINIMP3
+    return true;
+#else
+    return false;
+#endif
+}
+
+Mp3DecodeResult Mp3Decoder::decode(const uint8_t* data, size_t size, const Mp3DecodeOptions& options) {
+    if (options.start_ms < 0 || options.max_duration_ms < 0 || options.target_rate < 0) {
+        throw std::invalid_argument("Decode range and target rate must be non-negative");
+    }
+
+    Mp3StreamInfo info = scan(data, size);
+    if (!available()) {
+        throw std::runtime_error("MP3 decoding is unavailable: the engine was built without minimp3");
+    }
+
+    const int64_t spf = info.samples_per_frame;
+    const int64_t start_sample = static_cast<int64_t>(options.start_ms) * info.sample_rate / 1000;
+    if (start_sample >= info.total_samples) {
+        throw std::invalid_argument("Decode start is beyond the end of the stream (" +
+                                    std::to_string(info.duration_ms) + " ms)");
+    }
+    int64_t end_sample = info.total_samples;
+    if (options.max_duration_ms > 0) {
+        end_sample = std::min(end_sample,
+                              start_sample + static_cast<int64_t>(options.max_duration_ms) * info.sample_rate / 1000);
+    }
+
+    const size_t first_frame = static_cast<size_t>(start_sample / spf);
+    const size_t end_frame = static_cast<size_t>((end_sample + spf - 1) / spf);
+    const size_t decode_from = first_frame - warmup_frames(data, info, first_frame);
+
+    Mp3DecodeResult result;
+    result.frames_skipped = static_cast<int>(info.frame_offsets.size() - (end_frame - decode_from));
+
+    std::vector<float> mono;
+    mono.reserve(static_cast<size_t>((end_frame - first_frame) * spf));
+
+#ifdef HAVE_MINIMP3
+    mp3dec_t decoder;
+    mp3dec_init(&decoder);
+    std::vector<mp3d_sample_t> pcm(MINIMP3_MAX_SAMPLES_PER_FRAME);
+
+    for (size_t frame = decode_from; frame < end_frame; ++frame) {
+        const size_t offset = info.frame_offsets[frame];
+        mp3dec_frame_info_t frame_info;
+        int samples = mp3dec_decode_frame(&decoder, data + offset, static_cast<int>(size - offset),
+                                          pcm.data(), &frame_info);
+        result.frames_decoded++;
+
+        if (frame < first_frame) {
+            continue;  // Warm-up only
+        }
+
+        if (samples <= 0 || frame_info.channels <= 0) {
+            mono.insert(mono.end(), static_cast<size_t>(spf), 0.0f);  // Keep the timing of undecodable frames
+            continue;
+        }
+
+        const float scale = 1.0f / static_cast<float>(frame_info.channels);
+        for (int i = 0; i < samples; ++i) {
+            float sum = 0.0f;
+            for (int c = 0; c < frame_info.channels; ++c) {
+                sum += pcm[static_cast<size_t>(i) * frame_info.channels + c];
+            }
+            mono.push_back(sum * scale);
+        }
+    }
+#endif
+
+    // Trim to the requested samples
+    const size_t begin = static_cast<size_t>(start_sample - static_cast<int64_t>(first_frame) * spf);
+    const size_t count = static_cast<size_t>(end_sample - start_sample);
+    if (begin >= mono.size()) {
+        mono.clear();
+    } else {
+        mono.erase(mono.begin(), mono.begin() + begin);
+        mono.resize(std::min(mono.size(), count));
+    }
+
+    const int rate = options.target_rate > 0 ? options.target_rate : info.sample_rate;
+    if (rate != info.sample_rate) {
+        AudioPreprocessor preprocessor;
+        mono = preprocessor.resample_audio(mono, info.sample_rate, rate);
+    }
+
+    result.audio = AudioSample(mono, rate, 1);
+    return result;
+}
+
+} // namespace AudioFingerprint
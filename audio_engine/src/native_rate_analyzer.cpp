@@ -0,0 +1,107 @@
+#include "native_rate_analyzer.h"
+#include "cancellation.h"
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+
+namespace AudioFingerprint {
+
+namespace {
+
+int next_power_of_two(int value) {
+    int power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+int scale_to_rate(int analysis_samples, int sample_rate) {
+    return static_cast<int>(std::lround(static_cast<double>(analysis_samples) * sample_rate /
+                                        NativeRateAnalyzer::ANALYSIS_RATE));
+}
+
+} // namespace
+
+NativeRateAnalyzer::NativeRateAnalyzer(int sample_rate, int fft_size, int hop_size)
+    : sample_rate_(sample_rate), analysis_bins_(fft_size / 2 + 1),
+      window_size_(scale_to_rate(fft_size, sample_rate)),
+      hop_size_(std::max(1, scale_to_rate(hop_size, sample_rate))),
+      transform_size_(next_power_of_two(window_size_)),
+      level_(window_size_ > 1 ? static_cast<float>(fft_size - 1) / static_cast<float>(window_size_ - 1) : 1.0f),
+      direct_(static_cast<int64_t>(transform_size_) * ANALYSIS_RATE == static_cast<int64_t>(fft_size) * sample_rate),
+      fft_processor_(transform_size_),
+      frame_magnitudes_(transform_size_ / 2 + 1) {
+
+    if (sample_rate < ANALYSIS_RATE) {
+        throw std::invalid_argument("Native-rate analysis needs a sample rate of at least 11025 Hz");
+    }
+
+    if (fft_size <= 0 || (fft_size & (fft_size - 1)) != 0) {
+        throw std::invalid_argument("FFT size must be a positive power of 2");
+    }
+
+    if (hop_size <= 0 || hop_size > fft_size) {
+        throw std::invalid_argument("Invalid hop size");
+    }
+
+    if (!direct_) {
+        // Analysis bin k sits at k * 11025 / fft_size Hz
+        const double transform_bins_per_bin = static_cast<double>(ANALYSIS_RATE) * transform_size_ /
+                                              (static_cast<double>(fft_size) * sample_rate);
+        const int last_bin = transform_size_ / 2;
+        lower_bin_.resize(analysis_bins_);
+        fraction_.resize(analysis_bins_);
+        for (int k = 0; k < analysis_bins_; ++k) {
+            double position = k * transform_bins_per_bin;
+            int lower = std::min(static_cast<int>(position), last_bin - 1);
+            lower_bin_[k] = lower;
+            fraction_[k] = static_cast<float>(std::min(1.0, position - lower));
+        }
+    }
+}
+
+Spectrogram NativeRateAnalyzer::compute_stft(const std::vector<float>& audio_data) {
+    if (audio_data.size() < static_cast<size_t>(window_size_)) {
+        throw std::invalid_argument("Audio data is shorter than one analysis window");
+    }
+
+    const int num_frames = static_cast<int>((audio_data.size() - window_size_) / hop_size_) + 1;
+
+    Spectrogram spectrogram;
+    spectrogram.time_frames = num_frames;
+    spectrogram.frequency_bins = analysis_bins_;
+    spectrogram.time_resolution = static_cast<float>(hop_size_) / static_cast<float>(sample_rate_);
+    spectrogram.freq_resolution = static_cast<float>(ANALYSIS_RATE) / static_cast<float>(2 * (analysis_bins_ - 1));
+    spectrogram.data.resize(num_frames);
+
+    for (int frame = 0; frame < num_frames; ++frame) {
+        if (frame % CancellationToken::CHECK_INTERVAL == 0) {
+            CancellationToken::check("stft");
+        }
+        fft_processor_.compute_magnitude_frame(audio_data.data() + static_cast<size_t>(frame) * hop_size_,
+                                               window_size_, frame_magnitudes_.data());
+
+        std::vector<float>& row = spectrogram.data[frame];
+        row.resize(analysis_bins_);
+        if (direct_) {
+            for (int k = 0; k < analysis_bins_; ++k) {
+                row[k] = frame_magnitudes_[k] * level_;
+            }
+        } else {
+            for (int k = 0; k < analysis_bins_; ++k) {
+                const float low = frame_magnitudes_[lower_bin_[k]];
+                const float high = frame_magnitudes_[lower_bin_[k] + 1];
+                row[k] = (low + fraction_[k] * (high - low)) * level_;
+            }
+        }
+    }
+
+    return spectrogram;
+}
+
+int NativeRateAnalyzer::to_native_samples(int analysis_samples) const {
+    return scale_to_rate(analysis_samples, sample_rate_);
+}
+
+} // namespace AudioFingerprint
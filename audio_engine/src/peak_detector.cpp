@@ -1,4 +1,5 @@
 #include "peak_detector.h"
+#include "cancellation.h"
 #include <algorithm>
 #include <cmath>
 #include <stdexcept>
@@ -8,7 +9,9 @@ namespace AudioFingerprint {
 PeakDetector::PeakDetector(int min_peak_distance, float adaptive_factor, float min_magnitude_threshold)
     : min_peak_distance_(min_peak_distance), 
       adaptive_factor_(adaptive_factor),
-      min_magnitude_threshold_(min_magnitude_threshold) {
+      min_magnitude_threshold_(min_magnitude_threshold),
+      frequency_interpolation_(false),
+      time_interpolation_(false) {
     
     if (min_peak_distance <= 0) {
         throw std::invalid_argument("Minimum peak distance must be positive");
@@ -34,12 +37,41 @@ ConstellationMap PeakDetector::detect_peaks(const Spectrogram& spectrogram) {
     constellation.time_resolution = spectrogram.time_resolution;
     constellation.freq_resolution = spectrogram.freq_resolution;
     
+    std::vector<const float*> rows(spectrogram.time_frames);
+    for (int t = 0; t < spectrogram.time_frames; ++t) {
+        rows[t] = spectrogram.data[t].data();
+    }
+    
+    CancellationToken::check("peaks");
     std::vector<SpectralPeak> candidate_peaks;
+    find_candidate_peaks(rows.data(), spectrogram.time_frames, spectrogram.frequency_bins,
+                         0, spectrogram.time_frames,
+                         spectrogram.time_resolution, spectrogram.freq_resolution,
+                         candidate_peaks);
+    
+    // Filter peaks that are too close together
+    auto filtered_peaks = filter_nearby_peaks(candidate_peaks);
+    
+    // Add filtered peaks to constellation
+    for (const auto& peak : filtered_peaks) {
+        constellation.add_peak(peak);
+    }
+    
+    return constellation;
+}
+
+void PeakDetector::find_candidate_peaks(const float* const* rows, int time_frames, int frequency_bins,
+                                        int t_begin, int t_end,
+                                        float time_resolution, float freq_resolution,
+                                        std::vector<SpectralPeak>& candidates) const {
+    // Border frames and bins never qualify as peaks
+    t_begin = std::max(t_begin, 1);
+    t_end = std::min(t_end, time_frames - 1);
     
     // Scan through spectrogram to find local maxima
-    for (int t = 1; t < spectrogram.time_frames - 1; ++t) {
-        for (int f = 1; f < spectrogram.frequency_bins - 1; ++f) {
-            float magnitude = spectrogram.data[t][f];
+    for (int t = t_begin; t < t_end; ++t) {
+        for (int f = 1; f < frequency_bins - 1; ++f) {
+            float magnitude = rows[t][f];
             
             // Skip if below minimum threshold
             if (magnitude < min_magnitude_threshold_) {
@@ -47,35 +79,31 @@ ConstellationMap PeakDetector::detect_peaks(const Spectrogram& spectrogram) {
             }
             
             // Check if it's a local maximum
-            if (is_local_maximum(spectrogram, t, f)) {
+            if (is_local_maximum(rows, time_frames, frequency_bins, t, f)) {
                 // Calculate adaptive threshold for this region
-                float adaptive_threshold = calculate_adaptive_threshold(spectrogram, t, f);
+                float adaptive_threshold = calculate_adaptive_threshold(rows, time_frames, frequency_bins, t, f);
                 
                 // Check if magnitude exceeds adaptive threshold
                 if (magnitude >= adaptive_threshold) {
                     SpectralPeak peak(t, f, magnitude, 0.0f, 0.0f);
-                    peak = convert_to_physical_units(peak, spectrogram);
-                    candidate_peaks.push_back(peak);
+                    candidates.push_back(convert_to_physical_units(peak, time_resolution, freq_resolution));
+                    if (frequency_interpolation_ || time_interpolation_) {
+                        interpolate_peak(rows, candidates.back(), time_resolution, freq_resolution);
+                    }
                 }
             }
         }
     }
-    
-    // Filter peaks that are too close together
-    auto filtered_peaks = filter_nearby_peaks(candidate_peaks);
-    
-    // Add filtered peaks to constellation
-    for (const auto& peak : filtered_peaks) {
-        constellation.add_peak(peak);
-    }
-    
-    return constellation;
 }
 
-bool PeakDetector::is_local_maximum(const Spectrogram& spectrogram, 
+int PeakDetector::context_frames() {
+    return std::max(LOCAL_MAX_NEIGHBORHOOD / 2, THRESHOLD_REGION / 2);
+}
+
+bool PeakDetector::is_local_maximum(const float* const* rows, int time_frames, int frequency_bins,
                                    int time_frame, int freq_bin, 
                                    int neighborhood_size) const {
-    float center_value = spectrogram.data[time_frame][freq_bin];
+    float center_value = rows[time_frame][freq_bin];
     
     // Check neighborhood around the point
     int half_size = neighborhood_size / 2;
@@ -89,13 +117,13 @@ bool PeakDetector::is_local_maximum(const Spectrogram& spectrogram,
             int f = freq_bin + df;
             
             // Check bounds
-            if (t < 0 || t >= spectrogram.time_frames || 
-                f < 0 || f >= spectrogram.frequency_bins) {
+            if (t < 0 || t >= time_frames || 
+                f < 0 || f >= frequency_bins) {
                 continue;
             }
             
             // If any neighbor is greater or equal, not a local maximum
-            if (spectrogram.data[t][f] >= center_value) {
+            if (rows[t][f] >= center_value) {
                 return false;
             }
         }
@@ -104,7 +132,7 @@ bool PeakDetector::is_local_maximum(const Spectrogram& spectrogram,
     return true;
 }
 
-float PeakDetector::calculate_adaptive_threshold(const Spectrogram& spectrogram,
+float PeakDetector::calculate_adaptive_threshold(const float* const* rows, int time_frames, int frequency_bins,
                                                int time_frame, int freq_bin,
                                                int region_size) const {
     int half_size = region_size / 2;
@@ -118,9 +146,9 @@ float PeakDetector::calculate_adaptive_threshold(const Spectrogram& spectrogram,
             int f = freq_bin + df;
             
             // Check bounds
-            if (t >= 0 && t < spectrogram.time_frames && 
-                f >= 0 && f < spectrogram.frequency_bins) {
-                sum += spectrogram.data[t][f];
+            if (t >= 0 && t < time_frames && 
+                f >= 0 && f < frequency_bins) {
+                sum += rows[t][f];
                 count++;
             }
         }
@@ -153,7 +181,11 @@ std::vector<SpectralPeak> PeakDetector::filter_nearby_peaks(const std::vector<Sp
     
     std::vector<SpectralPeak> filtered_peaks;
     
-    for (const auto& peak : sorted_peaks) {
+    for (size_t i = 0; i < sorted_peaks.size(); ++i) {
+        if (i % CancellationToken::CHECK_INTERVAL == 0) {
+            CancellationToken::check("peaks");
+        }
+        const SpectralPeak& peak = sorted_peaks[i];
         bool too_close = false;
         
         // Check if this peak is too close to any already selected peak
@@ -179,22 +211,64 @@ std::vector<SpectralPeak> PeakDetector::filter_nearby_peaks(const std::vector<Sp
 }
 
 SpectralPeak PeakDetector::convert_to_physical_units(const SpectralPeak& peak, 
-                                                   const Spectrogram& spectrogram) const {
+                                                   float time_resolution, float freq_resolution) const {
     SpectralPeak converted_peak = peak;
     
     // Convert time frame to seconds
-    converted_peak.time_seconds = static_cast<float>(peak.time_frame) * spectrogram.time_resolution;
+    converted_peak.time_seconds = static_cast<float>(peak.time_frame) * time_resolution;
     
     // Convert frequency bin to Hz
-    converted_peak.frequency_hz = static_cast<float>(peak.frequency_bin) * spectrogram.freq_resolution;
+    converted_peak.frequency_hz = static_cast<float>(peak.frequency_bin) * freq_resolution;
     
     return converted_peak;
 }
 
+void PeakDetector::interpolate_peak(const float* const* rows, SpectralPeak& peak,
+                                    float time_resolution, float freq_resolution) const {
+    // Candidates are strict maxima of their 3x3 neighbourhood away from the
+    // borders, so both neighbours exist along each axis
+    const int t = peak.time_frame;
+    const int f = peak.frequency_bin;
+    
+    // A Gaussian-like main lobe is a parabola in log magnitude, which makes the
+    // fit far more accurate than on linear magnitudes
+    auto log_magnitude = [](float value) {
+        return std::log(std::max(value, 1e-12f));
+    };
+    float center = log_magnitude(rows[t][f]);
+    
+    if (frequency_interpolation_) {
+        float df = parabolic_offset(log_magnitude(rows[t][f - 1]), center, log_magnitude(rows[t][f + 1]));
+        peak.frequency_hz = (static_cast<float>(f) + df) * freq_resolution;
+    }
+    
+    if (time_interpolation_) {
+        float dt = parabolic_offset(log_magnitude(rows[t - 1][f]), center, log_magnitude(rows[t + 1][f]));
+        peak.time_seconds = (static_cast<float>(t) + dt) * time_resolution;
+    }
+}
+
+float PeakDetector::parabolic_offset(float before, float center, float after) {
+    float curvature = before - 2.0f * center + after;
+    
+    // Negative for a strict maximum; anything else (non-finite input) keeps the grid point
+    if (!(curvature < 0.0f)) {
+        return 0.0f;
+    }
+    
+    float offset = 0.5f * (before - after) / curvature;
+    return std::max(-0.5f, std::min(0.5f, offset));
+}
+
 std::vector<LandmarkPair> PeakDetector::extract_landmark_pairs(
     const ConstellationMap& constellation,
     int max_time_delta, 
-    float max_freq_delta) {
+    float max_freq_delta,
+    int max_pairs_per_anchor) {
+    
+    if (max_pairs_per_anchor < 0) {
+        throw std::invalid_argument("Maximum pairs per anchor must not be negative");
+    }
     
     if (constellation.empty()) {
         return std::vector<LandmarkPair>();
@@ -211,7 +285,11 @@ std::vector<LandmarkPair> PeakDetector::extract_landmark_pairs(
     
     // Generate pairs from each anchor peak
     for (size_t i = 0; i < sorted_peaks.size(); ++i) {
+        if (i % CancellationToken::CHECK_INTERVAL == 0) {
+            CancellationToken::check("landmarks");
+        }
         const SpectralPeak& anchor = sorted_peaks[i];
+        int pairs = 0;
         
         // Look for target peaks within time and frequency constraints
         for (size_t j = i + 1; j < sorted_peaks.size(); ++j) {
@@ -227,6 +305,9 @@ std::vector<LandmarkPair> PeakDetector::extract_landmark_pairs(
             float freq_diff = std::abs(target.frequency_hz - anchor.frequency_hz);
             if (freq_diff <= max_freq_delta) {
                 landmark_pairs.emplace_back(anchor, target);
+                if (++pairs == max_pairs_per_anchor) {
+                    break;
+                }
             }
         }
     }
@@ -234,6 +315,75 @@ std::vector<LandmarkPair> PeakDetector::extract_landmark_pairs(
     return landmark_pairs;
 }
 
+std::vector<LandmarkTriplet> PeakDetector::extract_landmark_triplets(
+    const ConstellationMap& constellation,
+    int max_time_delta,
+    float max_freq_delta,
+    int max_targets_per_anchor) {
+    
+    if (max_targets_per_anchor <= 0) {
+        throw std::invalid_argument("Maximum targets per anchor must be positive");
+    }
+    
+    std::vector<LandmarkTriplet> landmark_triplets;
+    if (constellation.empty()) {
+        return landmark_triplets;
+    }
+    
+    std::vector<SpectralPeak> sorted_peaks = constellation.peaks;
+    std::sort(sorted_peaks.begin(), sorted_peaks.end(),
+              [](const SpectralPeak& a, const SpectralPeak& b) {
+                  return a.time_seconds < b.time_seconds;
+              });
+    
+    std::vector<size_t> targets;
+    targets.reserve(max_targets_per_anchor);
+    
+    for (size_t i = 0; i < sorted_peaks.size(); ++i) {
+        if (i % CancellationToken::CHECK_INTERVAL == 0) {
+            CancellationToken::check("landmarks");
+        }
+        const SpectralPeak& anchor = sorted_peaks[i];
+        
+        // Same target zone as extract_landmark_pairs()
+        targets.clear();
+        for (size_t j = i + 1; j < sorted_peaks.size(); ++j) {
+            const SpectralPeak& target = sorted_peaks[j];
+            
+            float time_diff_ms = (target.time_seconds - anchor.time_seconds) * 1000.0f;
+            if (time_diff_ms > static_cast<float>(max_time_delta)) {
+                break;
+            }
+            
+            if (std::abs(target.frequency_hz - anchor.frequency_hz) <= max_freq_delta) {
+                targets.push_back(j);
+            }
+        }
+        
+        // Keep the strongest targets, in time order
+        if (targets.size() > static_cast<size_t>(max_targets_per_anchor)) {
+            std::nth_element(targets.begin(), targets.begin() + max_targets_per_anchor - 1, targets.end(),
+                             [&](size_t a, size_t b) {
+                                 return sorted_peaks[a].magnitude > sorted_peaks[b].magnitude;
+                             });
+            targets.resize(max_targets_per_anchor);
+            std::sort(targets.begin(), targets.end());
+        }
+        
+        for (size_t a = 0; a < targets.size(); ++a) {
+            const SpectralPeak& first = sorted_peaks[targets[a]];
+            for (size_t b = a + 1; b < targets.size(); ++b) {
+                const SpectralPeak& second = sorted_peaks[targets[b]];
+                if (second.time_frame > first.time_frame) {
+                    landmark_triplets.emplace_back(anchor, first, second);
+                }
+            }
+        }
+    }
+    
+    return landmark_triplets;
+}
+
 void PeakDetector::set_adaptive_factor(float factor) {
     if (factor < 0.0f || factor > 1.0f) {
         throw std::invalid_argument("Adaptive factor must be between 0.0 and 1.0");
@@ -255,4 +405,12 @@ void PeakDetector::set_min_magnitude_threshold(float threshold) {
     min_magnitude_threshold_ = threshold;
 }
 
+void PeakDetector::set_frequency_interpolation(bool enabled) {
+    frequency_interpolation_ = enabled;
+}
+
+void PeakDetector::set_time_interpolation(bool enabled) {
+    time_interpolation_ = enabled;
+}
+
 } // namespace AudioFingerprint
\ No newline at end of file
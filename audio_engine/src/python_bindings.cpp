@@ -4,8 +4,25 @@
 #include "audio_types.h"
 #include "audio_preprocessor.h"
 #include "fft_processor.h"
+#include "native_rate_analyzer.h"
+#include "mp3_decoder.h"
 #include "peak_detector.h"
 #include "hash_generator.h"
+#include "engine_pool.h"
+#include "corpus_reader.h"
+#include "cpu_pool.h"
+#include "streaming_fingerprinter.h"
+#include "realtime_audit.h"
+#include "cancellation.h"
+#include "fingerprint_index.h"
+#include "fingerprint_pruner.h"
+#include "fingerprint_profile.h"
+#include "query_log.h"
+#include "tiered_query.h"
+#include "matcher_sidecar.h"
+#include "synthetic_catalog.h"
+#include "engine_tuning.h"
+#include <chrono>
 
 namespace py = pybind11;
 using namespace AudioFingerprint;
@@ -37,60 +54,124 @@ py::array_t<float> audio_sample_to_numpy(const AudioSample& sample) {
     );
 }
 
+/**
+ * Convert fingerprints to the column-oriented dict returned to Python
+ */
+py::dict fingerprints_to_dict(const std::vector<Fingerprint>& fingerprints) {
+    std::vector<uint32_t> hash_values;
+    std::vector<int> time_offsets;
+    std::vector<float> anchor_frequencies;
+    std::vector<float> target_frequencies;
+    std::vector<int> time_deltas;
+    std::vector<float> peak_strengths;
+    
+    hash_values.reserve(fingerprints.size());
+    time_offsets.reserve(fingerprints.size());
+    anchor_frequencies.reserve(fingerprints.size());
+    target_frequencies.reserve(fingerprints.size());
+    time_deltas.reserve(fingerprints.size());
+    peak_strengths.reserve(fingerprints.size());
+    
+    for (const auto& fp : fingerprints) {
+        hash_values.push_back(fp.hash_value);
+        time_offsets.push_back(fp.time_offset_ms);
+        anchor_frequencies.push_back(fp.anchor_freq_hz);
+        target_frequencies.push_back(fp.target_freq_hz);
+        time_deltas.push_back(fp.time_delta_ms);
+        peak_strengths.push_back(fp.peak_strength);
+    }
+    
+    py::dict result;
+    result["hash_values"] = hash_values;
+    result["time_offsets"] = time_offsets;
+    result["anchor_frequencies"] = anchor_frequencies;
+    result["target_frequencies"] = target_frequencies;
+    result["time_deltas"] = time_deltas;
+    result["peak_strengths"] = peak_strengths;
+    result["count"] = fingerprints.size();
+    
+    return result;
+}
+
+/**
+ * Install an optional cancellation token on the calling thread
+ */
+std::unique_ptr<CancellationScope> cancellation_scope(const CancellationToken* cancel_token) {
+    return cancel_token ? std::make_unique<CancellationScope>(*cancel_token) : nullptr;
+}
+
 /**
  * High-level fingerprinting function for Python interface
  */
 py::dict generate_fingerprint_from_audio(py::array_t<float> audio_data, 
                                         int sample_rate, 
-                                        int channels = 1) {
+                                        int channels = 1,
+                                        const FingerprintProfile* profile = nullptr,
+                                        const CancellationToken* cancel_token = nullptr) {
     try {
         // Convert numpy array to AudioSample
         AudioSample sample = numpy_to_audio_sample(audio_data, sample_rate, channels);
         
-        // Generate fingerprints
-        HashGenerator generator;
-        auto fingerprints = generator.process_audio_sample(sample);
-        
-        // Convert to Python-friendly format
-        std::vector<uint32_t> hash_values;
-        std::vector<int> time_offsets;
-        std::vector<float> anchor_frequencies;
-        std::vector<float> target_frequencies;
-        std::vector<int> time_deltas;
-        
-        hash_values.reserve(fingerprints.size());
-        time_offsets.reserve(fingerprints.size());
-        anchor_frequencies.reserve(fingerprints.size());
-        target_frequencies.reserve(fingerprints.size());
-        time_deltas.reserve(fingerprints.size());
-        
-        for (const auto& fp : fingerprints) {
-            hash_values.push_back(fp.hash_value);
-            time_offsets.push_back(fp.time_offset_ms);
-            anchor_frequencies.push_back(fp.anchor_freq_hz);
-            target_frequencies.push_back(fp.target_freq_hz);
-            time_deltas.push_back(fp.time_delta_ms);
+        // Generate fingerprints; without the GIL so other threads can cancel
+        std::vector<Fingerprint> fingerprints;
+        {
+            py::gil_scoped_release release;
+            auto cancellation = cancellation_scope(cancel_token);
+            HashGenerator generator;
+            fingerprints = profile ? generator.process_audio_sample(sample, *profile)
+                                   : generator.process_audio_sample(sample);
         }
         
-        py::dict result;
-        result["hash_values"] = hash_values;
-        result["time_offsets"] = time_offsets;
-        result["anchor_frequencies"] = anchor_frequencies;
-        result["target_frequencies"] = target_frequencies;
-        result["time_deltas"] = time_deltas;
-        result["count"] = fingerprints.size();
+        // Convert to Python-friendly format
+        py::dict result = fingerprints_to_dict(fingerprints);
         
         return result;
         
+    } catch (const OperationCancelled&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(std::string("Fingerprinting failed: ") + e.what());
     }
 }
 
+/**
+ * Convert batch processing results to a list of Python dicts
+ */
+py::list batch_results_to_list(const std::vector<BatchProcessingResult>& results) {
+    py::list py_results;
+    for (const auto& result : results) {
+        py::dict py_result;
+        py_result["song_id"] = result.song_id;
+        py_result["success"] = result.success;
+        py_result["error_message"] = result.error_message;
+        py_result["total_duration_ms"] = result.total_duration_ms;
+        py_result["processing_time_ms"] = result.processing_time_ms;
+        
+        if (result.success) {
+            std::vector<uint32_t> hash_values;
+            std::vector<int> time_offsets;
+            
+            for (const auto& fp : result.fingerprints) {
+                hash_values.push_back(fp.hash_value);
+                time_offsets.push_back(fp.time_offset_ms);
+            }
+            
+            py_result["hash_values"] = hash_values;
+            py_result["time_offsets"] = time_offsets;
+            py_result["fingerprint_count"] = result.fingerprints.size();
+        }
+        
+        py_results.append(py_result);
+    }
+    
+    return py_results;
+}
+
 /**
  * Batch processing function for reference songs
  */
-py::list batch_process_reference_songs(py::list audio_samples_list, py::list song_ids_list) {
+py::list batch_process_reference_songs(py::list audio_samples_list, py::list song_ids_list,
+                                       const CancellationToken* cancel_token) {
     try {
         std::vector<AudioSample> audio_samples;
         std::vector<std::string> song_ids;
@@ -110,43 +191,71 @@ py::list batch_process_reference_songs(py::list audio_samples_list, py::list son
         }
         
         // Process batch
-        HashGenerator generator;
-        auto results = generator.batch_process_reference_songs(audio_samples, song_ids);
-        
-        // Convert results to Python format
-        py::list py_results;
-        for (const auto& result : results) {
-            py::dict py_result;
-            py_result["song_id"] = result.song_id;
-            py_result["success"] = result.success;
-            py_result["error_message"] = result.error_message;
-            py_result["total_duration_ms"] = result.total_duration_ms;
-            py_result["processing_time_ms"] = result.processing_time_ms;
-            
-            if (result.success) {
-                std::vector<uint32_t> hash_values;
-                std::vector<int> time_offsets;
-                
-                for (const auto& fp : result.fingerprints) {
-                    hash_values.push_back(fp.hash_value);
-                    time_offsets.push_back(fp.time_offset_ms);
-                }
-                
-                py_result["hash_values"] = hash_values;
-                py_result["time_offsets"] = time_offsets;
-                py_result["fingerprint_count"] = result.fingerprints.size();
-            }
-            
-            py_results.append(py_result);
+        std::vector<BatchProcessingResult> results;
+        {
+            py::gil_scoped_release release;
+            auto cancellation = cancellation_scope(cancel_token);
+            HashGenerator generator;
+            results = generator.batch_process_reference_songs(audio_samples, song_ids);
         }
         
-        return py_results;
+        // Convert results to Python format
+        return batch_results_to_list(results);
         
+    } catch (const OperationCancelled&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(std::string("Batch processing failed: ") + e.what());
     }
 }
 
+/**
+ * Read, decode and fingerprint reference audio files straight from disk
+ */
+py::dict batch_process_audio_files(const std::vector<std::string>& file_paths,
+                                   const std::vector<std::string>& song_ids,
+                                   int compute_threads,
+                                   int queue_depth,
+                                   int io_threads,
+                                   bool use_io_uring,
+                                   const std::string& thread_pool,
+                                   const CancellationToken* cancel_token) {
+    CorpusReaderConfig config;
+    config.queue_depth = queue_depth;
+    config.io_threads = io_threads;
+    config.use_io_uring = use_io_uring;
+    config.thread_pool = thread_pool;
+    
+    CorpusReaderStats stats;
+    std::vector<BatchProcessingResult> results;
+    try {
+        // File I/O and fingerprinting are all native; release the GIL for the run
+        py::gil_scoped_release release;
+        auto cancellation = cancellation_scope(cancel_token);
+        results = batch_process_files(file_paths, song_ids, compute_threads, config, stats);
+    } catch (const OperationCancelled&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Batch file processing failed: ") + e.what());
+    }
+    
+    py::dict io_stats;
+    io_stats["backend"] = stats.backend;
+    io_stats["files_read"] = stats.files_read;
+    io_stats["files_failed"] = stats.files_failed;
+    io_stats["bytes_read"] = stats.bytes_read;
+    io_stats["io_wait_ms"] = stats.io_wait_ms;
+    io_stats["compute_ms"] = stats.compute_ms;
+    io_stats["compute_idle_ms"] = stats.compute_idle_ms;
+    io_stats["wall_time_ms"] = stats.wall_time_ms;
+    
+    py::dict result;
+    result["results"] = batch_results_to_list(results);
+    result["io_stats"] = io_stats;
+    
+    return result;
+}
+
 /**
  * Preprocess audio function
  */
@@ -171,16 +280,24 @@ py::dict preprocess_audio(py::array_t<float> audio_data, int sample_rate, int ch
 }
 
 /**
- * Compute spectrogram function
+ * Compute spectrogram function; audio at a sample rate above 11.025 kHz is
+ * analysed at that rate with NativeRateAnalyzer
  */
-py::dict compute_spectrogram(py::array_t<float> audio_data, int fft_size = 2048, int hop_size = 1024) {
+py::dict compute_spectrogram(py::array_t<float> audio_data, int fft_size = 2048, int hop_size = 1024,
+                             int sample_rate = NativeRateAnalyzer::ANALYSIS_RATE) {
     try {
         py::buffer_info buf = audio_data.request();
         std::vector<float> data(static_cast<float*>(buf.ptr), 
                                static_cast<float*>(buf.ptr) + buf.size);
         
-        FFTProcessor fft_processor(fft_size);
-        auto spectrogram = fft_processor.compute_stft(data, fft_size, hop_size);
+        Spectrogram spectrogram;
+        if (sample_rate > NativeRateAnalyzer::ANALYSIS_RATE) {
+            NativeRateAnalyzer analyzer(sample_rate, fft_size, hop_size);
+            spectrogram = analyzer.compute_stft(data);
+        } else {
+            FFTProcessor fft_processor(fft_size);
+            spectrogram = fft_processor.compute_stft(data, fft_size, hop_size);
+        }
         
         // Convert spectrogram to numpy array
         py::array_t<float> spec_array = py::array_t<float>(
@@ -210,18 +327,962 @@ py::dict compute_spectrogram(py::array_t<float> audio_data, int fft_size = 2048,
     }
 }
 
+/**
+ * Detect peaks in a spectrogram dict as returned by compute_spectrogram()
+ */
+std::vector<SpectralPeak> detect_spectrogram_peaks(PeakDetector& detector, const py::dict& spectrogram) {
+    auto data = spectrogram["data"].cast<py::array_t<float, py::array::c_style | py::array::forcecast>>();
+    if (data.ndim() != 2) {
+        throw std::invalid_argument("Spectrogram data must be two-dimensional");
+    }
+    
+    Spectrogram input;
+    input.time_frames = static_cast<int>(data.shape(0));
+    input.frequency_bins = static_cast<int>(data.shape(1));
+    input.time_resolution = spectrogram["time_resolution"].cast<float>();
+    input.freq_resolution = spectrogram["freq_resolution"].cast<float>();
+    input.data.resize(input.time_frames);
+    for (int t = 0; t < input.time_frames; ++t) {
+        input.data[t].assign(data.data(t, 0), data.data(t, 0) + input.frequency_bins);
+    }
+    
+    return detector.detect_peaks(input).peaks;
+}
+
+/**
+ * Parse a priority name ("interactive" or "batch")
+ */
+RequestPriority parse_priority(const std::string& priority) {
+    if (priority == "interactive") {
+        return RequestPriority::INTERACTIVE;
+    }
+    if (priority == "batch") {
+        return RequestPriority::BATCH;
+    }
+    throw std::invalid_argument("Unknown priority: " + priority);
+}
+
+/**
+ * Create an engine pool from keyword arguments
+ */
+std::unique_ptr<EnginePool> create_engine_pool(int num_workers,
+                                               int interactive_slo_ms,
+                                               int batch_slo_ms,
+                                               bool allow_downgrade,
+                                               int reduced_max_duration_ms,
+                                               int max_queue_depth,
+                                               const std::string& thread_pool) {
+    AdmissionPolicy policy;
+    policy.interactive_slo_ms = interactive_slo_ms;
+    policy.batch_slo_ms = batch_slo_ms;
+    policy.allow_downgrade = allow_downgrade;
+    policy.reduced_max_duration_ms = reduced_max_duration_ms;
+    policy.max_queue_depth = max_queue_depth;
+    
+    return std::make_unique<EnginePool>(num_workers, policy, thread_pool);
+}
+
+/**
+ * Fingerprint through the engine pool with admission control
+ */
+py::dict engine_pool_process(EnginePool& pool, py::array_t<float> audio_data,
+                             int sample_rate, int channels, const std::string& priority,
+                             const FingerprintProfile* profile, const CancellationToken* cancel_token) {
+    AudioSample sample = numpy_to_audio_sample(audio_data, sample_rate, channels);
+    RequestPriority request_priority = parse_priority(priority);
+    FingerprintProfile request_profile = profile ? *profile : FingerprintProfile();
+    CancellationToken token = cancel_token ? *cancel_token : CancellationToken();
+    
+    PoolRequestResult pool_result;
+    {
+        // Workers do not need the GIL; let other Python threads run while we wait
+        py::gil_scoped_release release;
+        pool_result = pool.process(sample, request_priority, request_profile, token);
+    }
+    
+    if (!pool_result.cancelled_at.empty()) {
+        throw OperationCancelled(pool_result.cancelled_at, token.deadline_expired());
+    }
+    
+    if (pool_result.status != AdmissionStatus::REJECTED && !pool_result.success) {
+        throw std::runtime_error(std::string("Fingerprinting failed: ") + pool_result.error_message);
+    }
+    
+    py::dict result = fingerprints_to_dict(pool_result.fingerprints);
+    switch (pool_result.status) {
+        case AdmissionStatus::ADMITTED:   result["status"] = "admitted"; break;
+        case AdmissionStatus::DOWNGRADED: result["status"] = "downgraded"; break;
+        case AdmissionStatus::REJECTED:   result["status"] = "rejected"; break;
+    }
+    result["mode"] = pool_result.mode == ProcessingMode::REDUCED ? "reduced" : "full";
+    result["retry_after_ms"] = pool_result.retry_after_ms;
+    result["estimated_ms"] = pool_result.estimated_ms;
+    result["queue_wait_ms"] = pool_result.queue_wait_ms;
+    result["processing_time_ms"] = pool_result.processing_time_ms;
+    
+    return result;
+}
+
+/**
+ * Estimate the cost of a request without submitting it
+ */
+py::dict engine_pool_estimate_cost(const EnginePool& pool, py::array_t<float> audio_data,
+                                   int sample_rate, int channels) {
+    AudioSample sample = numpy_to_audio_sample(audio_data, sample_rate, channels);
+    CostEstimate estimate = pool.estimate_cost(sample);
+    
+    py::dict result;
+    result["cost_units"] = estimate.cost_units;
+    result["estimated_ms"] = estimate.estimated_ms;
+    result["active_fraction"] = estimate.active_fraction;
+    result["duration_ms"] = estimate.duration_ms;
+    
+    return result;
+}
+
+/**
+ * Engine pool statistics keyed by priority name
+ */
+py::dict engine_pool_statistics(const EnginePool& pool) {
+    PoolStatistics stats = pool.get_statistics();
+    
+    py::dict result;
+    const char* names[2] = {"interactive", "batch"};
+    for (int p = 0; p < 2; ++p) {
+        py::dict per_priority;
+        per_priority["admitted"] = stats.admitted[p];
+        per_priority["downgraded"] = stats.downgraded[p];
+        per_priority["rejected"] = stats.rejected[p];
+        per_priority["completed"] = stats.completed[p];
+        per_priority["cancelled"] = stats.cancelled[p];
+        per_priority["queue_depth"] = stats.queue_depth[p];
+        per_priority["avg_queue_wait_ms"] = stats.avg_queue_wait_ms[p];
+        per_priority["projected_wait_ms"] = stats.projected_wait_ms[p];
+        result[names[p]] = per_priority;
+    }
+    result["ms_per_cost_unit"] = stats.ms_per_cost_unit;
+    result["num_workers"] = stats.num_workers;
+    
+    return result;
+}
+
+/**
+ * Create a streaming fingerprinter, defaulting the profile
+ */
+std::unique_ptr<StreamingFingerprinter> create_streaming_fingerprinter(int sample_rate, int channels, int ring_ms,
+                                                                       int hop_ms, int context_ms, int poll_interval_ms,
+                                                                       const FingerprintProfile* profile) {
+    StreamingConfig config;
+    config.sample_rate = sample_rate;
+    config.channels = channels;
+    config.ring_ms = ring_ms;
+    config.hop_ms = hop_ms;
+    config.context_ms = context_ms;
+    config.poll_interval_ms = poll_interval_ms;
+    if (profile) {
+        config.profile = *profile;
+    }
+    
+    return std::make_unique<StreamingFingerprinter>(config);
+}
+
+/**
+ * Check interleaved audio against the stream's channel count
+ * @return Number of frames
+ */
+size_t stream_frames(const StreamingFingerprinter& stream, const py::buffer_info& buf) {
+    if (buf.ndim != 1) {
+        throw std::runtime_error("Audio data must be 1-dimensional");
+    }
+    
+    const size_t channels = static_cast<size_t>(stream.get_config().channels);
+    if (static_cast<size_t>(buf.size) % channels != 0) {
+        throw std::invalid_argument("Audio data must hold whole interleaved frames");
+    }
+    return static_cast<size_t>(buf.size) / channels;
+}
+
+/**
+ * Push interleaved audio into a streaming fingerprinter
+ */
+size_t streaming_push(StreamingFingerprinter& stream, py::array_t<float, py::array::c_style | py::array::forcecast> audio_data) {
+    py::buffer_info buf = audio_data.request();
+    const size_t frames = stream_frames(stream, buf);
+    return stream.push(static_cast<const float*>(buf.ptr), frames);
+}
+
+/**
+ * Streaming fingerprinter counters as a Python dict
+ */
+py::dict streaming_statistics(const StreamingFingerprinter& stream) {
+    StreamingStats stats = stream.get_stats();
+    
+    py::dict result;
+    result["frames_pushed"] = stats.frames_pushed;
+    result["frames_dropped"] = stats.frames_dropped;
+    result["passes"] = stats.passes;
+    result["failed_passes"] = stats.failed_passes;
+    result["fingerprints_emitted"] = stats.fingerprints_emitted;
+    result["ring_capacity_frames"] = stats.ring_capacity_frames;
+    result["ring_high_water_frames"] = stats.ring_high_water_frames;
+    result["max_pass_ms"] = stats.max_pass_ms;
+    result["last_error"] = stats.last_error;
+    
+    return result;
+}
+
+/**
+ * Push audio in callback-sized blocks, as an audio callback would, while
+ * auditing the pushing thread for allocations and locks
+ * @param speed Pace pushes at this multiple of realtime (0 = as fast as possible)
+ */
+py::dict audit_stream_push(StreamingFingerprinter& stream,
+                           py::array_t<float, py::array::c_style | py::array::forcecast> audio_data,
+                           size_t block_frames, double speed) {
+    if (block_frames == 0 || speed < 0.0) {
+        throw std::invalid_argument("Block size must be positive and speed non-negative");
+    }
+    
+    py::buffer_info buf = audio_data.request();
+    const size_t frames = stream_frames(stream, buf);
+    const float* samples = static_cast<const float*>(buf.ptr);
+    const size_t channels = static_cast<size_t>(stream.get_config().channels);
+    const double sample_rate = stream.get_config().sample_rate;
+    
+    RealtimeAuditCounts counts;
+    size_t accepted = 0;
+    size_t pushes = 0;
+    double max_push_us = 0.0;
+    {
+        py::gil_scoped_release release;
+        auto start = std::chrono::steady_clock::now();
+        RealtimeAudit audit;
+        
+        for (size_t frame = 0; frame < frames; frame += block_frames) {
+            const size_t count = std::min(block_frames, frames - frame);
+            auto push_start = std::chrono::steady_clock::now();
+            accepted += stream.push(samples + frame * channels, count);
+            max_push_us = std::max(max_push_us, std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - push_start).count());
+            pushes++;
+            
+            if (speed > 0.0) {
+                // Stands in for the wait between callbacks
+                std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(
+                    (frame + count) * 1e6 / (sample_rate * speed))));
+            }
+        }
+        counts = audit.counts();
+    }
+    
+    py::dict result;
+    result["frames_accepted"] = accepted;
+    result["pushes"] = pushes;
+    result["allocations"] = counts.allocations;
+    result["deallocations"] = counts.deallocations;
+    result["lock_acquisitions"] = counts.lock_acquisitions;
+    result["max_push_us"] = max_push_us;
+    result["tracking_active"] = RealtimeAudit::allocation_tracking();
+    
+    return result;
+}
+
+/**
+ * Build fingerprints from parallel hash and time offset lists
+ */
+std::vector<Fingerprint> lists_to_fingerprints(const std::vector<uint32_t>& hash_values,
+                                               const std::vector<int>& time_offsets) {
+    if (hash_values.size() != time_offsets.size()) {
+        throw std::invalid_argument("Hash values and time offsets must have same size");
+    }
+    
+    std::vector<Fingerprint> fingerprints;
+    fingerprints.reserve(hash_values.size());
+    for (size_t i = 0; i < hash_values.size(); ++i) {
+        fingerprints.emplace_back(hash_values[i], time_offsets[i], 0.0f, 0.0f, 0);
+    }
+    
+    return fingerprints;
+}
+
+/**
+ * Copy an optional column of a fingerprint dict into the fingerprints
+ */
+template <typename T>
+void copy_column(const py::dict& fingerprint_dict, const char* key, T Fingerprint::*member,
+                 std::vector<Fingerprint>& fingerprints) {
+    if (!fingerprint_dict.contains(key)) {
+        return;
+    }
+    
+    auto column = fingerprint_dict[key].cast<std::vector<T>>();
+    for (size_t i = 0; i < std::min(column.size(), fingerprints.size()); ++i) {
+        fingerprints[i].*member = column[i];
+    }
+}
+
+/**
+ * Convert a fingerprint dict (as returned by generate_fingerprint) back to fingerprints
+ */
+std::vector<Fingerprint> dict_to_fingerprints(const py::dict& fingerprint_dict) {
+    auto hash_values = fingerprint_dict["hash_values"].cast<std::vector<uint32_t>>();
+    auto time_offsets = fingerprint_dict["time_offsets"].cast<std::vector<int>>();
+    std::vector<Fingerprint> fingerprints = lists_to_fingerprints(hash_values, time_offsets);
+    
+    // Optional columns
+    copy_column(fingerprint_dict, "anchor_frequencies", &Fingerprint::anchor_freq_hz, fingerprints);
+    copy_column(fingerprint_dict, "target_frequencies", &Fingerprint::target_freq_hz, fingerprints);
+    copy_column(fingerprint_dict, "time_deltas", &Fingerprint::time_delta_ms, fingerprints);
+    copy_column(fingerprint_dict, "peak_strengths", &Fingerprint::peak_strength, fingerprints);
+    
+    return fingerprints;
+}
+
+/**
+ * Prune a fingerprint dict, keeping its shape
+ */
+py::dict pruner_prune(FingerprintPruner& pruner, const py::dict& fingerprint_dict) {
+    return fingerprints_to_dict(pruner.prune(dict_to_fingerprints(fingerprint_dict)));
+}
+
+/**
+ * Pruning totals as a Python dict
+ */
+py::dict pruner_statistics(const FingerprintPruner& pruner) {
+    const PruningStats& stats = pruner.get_stats();
+    
+    py::dict result;
+    result["songs"] = stats.songs;
+    result["input_fingerprints"] = stats.input_fingerprints;
+    result["kept_fingerprints"] = stats.kept_fingerprints;
+    result["shrink_factor"] = stats.shrink_factor();
+    
+    return result;
+}
+
+/**
+ * Add a song to the index from hash and time offset lists
+ */
+void index_add_song(FingerprintIndex& index, uint32_t song_id,
+                    const std::vector<uint32_t>& hash_values, const std::vector<int>& time_offsets,
+                    const std::string& title, const std::string& artist, const std::string& album,
+                    int duration_ms) {
+    std::vector<Fingerprint> fingerprints = lists_to_fingerprints(hash_values, time_offsets);
+    SongMetadata metadata(title, artist, album, duration_ms);
+    
+    // Durable ingest blocks on the write-ahead log
+    py::gil_scoped_release release;
+    index.add_song(song_id, fingerprints, metadata);
+}
+
+/**
+ * Song metadata as a Python dict
+ */
+py::dict song_metadata_to_dict(const SongMetadata& metadata) {
+    py::dict result;
+    result["title"] = metadata.title;
+    result["artist"] = metadata.artist;
+    result["album"] = metadata.album;
+    result["duration_ms"] = metadata.duration_ms;
+    
+    return result;
+}
+
+/**
+ * Look up a song in the index's song tables
+ */
+py::object index_lookup_song(const FingerprintIndex& index, uint32_t song_id) {
+    SongMetadata metadata;
+    if (!index.lookup_song(song_id, metadata)) {
+        return py::none();
+    }
+    
+    return song_metadata_to_dict(metadata);
+}
+
+/**
+ * Convert index matches to a list of Python dicts
+ */
+py::list matches_to_list(const std::vector<IndexMatch>& matches) {
+    py::list result;
+    for (const auto& match : matches) {
+        py::dict py_match;
+        py_match["song_id"] = match.song_id;
+        py_match["match_count"] = match.match_count;
+        py_match["time_offset_ms"] = match.time_offset_ms;
+        py_match["confidence"] = match.confidence;
+        if (!match.song.empty()) {
+            py_match["title"] = match.song.title;
+            py_match["artist"] = match.song.artist;
+            py_match["album"] = match.song.album;
+            py_match["duration_ms"] = match.song.duration_ms;
+        }
+        result.append(py_match);
+    }
+    
+    return result;
+}
+
+/**
+ * Query the index with hash and time offset lists
+ */
+py::list index_query(const FingerprintIndex& index,
+                     const std::vector<uint32_t>& hash_values, const std::vector<int>& time_offsets,
+                     int max_results, int min_matches, const CancellationToken* cancel_token) {
+    std::vector<Fingerprint> query = lists_to_fingerprints(hash_values, time_offsets);
+    
+    std::vector<IndexMatch> matches;
+    {
+        py::gil_scoped_release release;
+        auto cancellation = cancellation_scope(cancel_token);
+        matches = index.query(query, max_results, min_matches);
+    }
+    
+    return matches_to_list(matches);
+}
+
+/**
+ * Create a matcher sidecar serving an index
+ */
+std::unique_ptr<MatcherSidecar> create_matcher_sidecar(const std::string& name, const FingerprintIndex& index,
+                                                       int slots, int max_query_hashes, int max_results,
+                                                       int workers, int spin_us) {
+    SidecarConfig config;
+    config.slots = slots;
+    config.max_query_hashes = max_query_hashes;
+    config.max_results = max_results;
+    config.workers = workers;
+    config.spin_us = spin_us;
+    
+    return std::make_unique<MatcherSidecar>(name, index, config);
+}
+
+/**
+ * Matcher sidecar counters as a Python dict
+ */
+py::dict sidecar_statistics(const MatcherSidecar& sidecar) {
+    SidecarStats stats = sidecar.get_stats();
+    
+    py::dict result;
+    result["requests"] = stats.requests;
+    result["failed"] = stats.failed;
+    result["abandoned"] = stats.abandoned;
+    result["reclaimed_slots"] = stats.reclaimed_slots;
+    result["sleeps"] = stats.sleeps;
+    result["avg_service_us"] = stats.requests ? stats.total_service_us / stats.requests : 0.0;
+    result["max_service_us"] = stats.max_service_us;
+    
+    return result;
+}
+
+/**
+ * Query an index through its matcher sidecar
+ */
+py::list matcher_client_query(const MatcherClient& client,
+                              const std::vector<uint32_t>& hash_values, const std::vector<int>& time_offsets,
+                              int max_results, int min_matches, const CancellationToken* cancel_token) {
+    std::vector<Fingerprint> query = lists_to_fingerprints(hash_values, time_offsets);
+    
+    std::vector<IndexMatch> matches;
+    {
+        py::gil_scoped_release release;
+        auto cancellation = cancellation_scope(cancel_token);
+        matches = client.query(query, max_results, min_matches);
+    }
+    
+    return matches_to_list(matches);
+}
+
+/**
+ * Create a synthetic catalog
+ */
+std::unique_ptr<SyntheticCatalog> create_synthetic_catalog(uint32_t songs, int fingerprints_per_song,
+                                                           uint32_t distinct_hashes, double zipf_exponent,
+                                                           int song_duration_ms, uint64_t seed) {
+    SyntheticCatalogConfig config;
+    config.songs = songs;
+    config.fingerprints_per_song = fingerprints_per_song;
+    config.distinct_hashes = distinct_hashes;
+    config.zipf_exponent = zipf_exponent;
+    config.song_duration_ms = song_duration_ms;
+    config.seed = seed;
+    
+    return std::make_unique<SyntheticCatalog>(config);
+}
+
+/**
+ * Build an index from a synthetic catalog
+ */
+py::dict synthetic_catalog_build(const SyntheticCatalog& catalog, FingerprintIndex& index,
+                                 uint32_t songs_per_segment) {
+    CatalogBuildStats stats;
+    {
+        py::gil_scoped_release release;
+        stats = catalog.build(index, songs_per_segment);
+    }
+    
+    py::dict result;
+    result["songs"] = stats.songs;
+    result["postings"] = stats.postings;
+    result["segments_flushed"] = stats.segments_flushed;
+    result["add_ms"] = stats.add_ms;
+    result["flush_ms"] = stats.flush_ms;
+    result["merge_ms"] = stats.merge_ms;
+    result["top_percent_share"] = stats.top_percent_share;
+    
+    return result;
+}
+
+/**
+ * Run a query benchmark against an index built from a synthetic catalog
+ */
+py::dict synthetic_catalog_benchmark(const SyntheticCatalog& catalog, const FingerprintIndex& index,
+                                     int queries, int concurrency, int query_ms, double noise_fraction,
+                                     int max_results, int min_matches, uint64_t seed) {
+    QueryBenchmarkConfig config;
+    config.queries = queries;
+    config.concurrency = concurrency;
+    config.query_ms = query_ms;
+    config.noise_fraction = noise_fraction;
+    config.max_results = max_results;
+    config.min_matches = min_matches;
+    config.seed = seed;
+    
+    QueryBenchmarkResult benchmark;
+    {
+        py::gil_scoped_release release;
+        benchmark = catalog.benchmark_queries(index, config);
+    }
+    
+    py::dict result;
+    result["latencies_ms"] = benchmark.latencies_ms;
+    result["wall_ms"] = benchmark.wall_ms;
+    result["top1_accuracy"] = benchmark.top1_accuracy;
+    result["avg_query_fingerprints"] = benchmark.avg_query_fingerprints;
+    
+    return result;
+}
+
+/**
+ * Benchmark candidate tuning values on this machine
+ */
+py::dict run_autotune(const std::string& work_dir, int repetitions, double tolerance, bool quick) {
+    AutotuneConfig config;
+    config.work_dir = work_dir;
+    config.repetitions = repetitions;
+    config.tolerance = tolerance;
+    config.quick = quick;
+    
+    AutotuneResult tuned;
+    {
+        py::gil_scoped_release release;
+        tuned = EngineAutotuner(config).run();
+    }
+    
+    py::list trials;
+    for (const auto& trial : tuned.trials) {
+        py::dict entry;
+        entry["parameter"] = trial.parameter;
+        entry["value"] = trial.value;
+        entry["median_ms"] = trial.median_ms;
+        trials.append(entry);
+    }
+    
+    py::dict result;
+    result["tuning"] = tuned.tuning;
+    result["trials"] = trials;
+    result["elapsed_ms"] = tuned.elapsed_ms;
+    
+    return result;
+}
+
+/**
+ * Append a captured query to a query log
+ */
+void query_log_append(QueryLog& log,
+                      const std::vector<uint32_t>& hash_values, const std::vector<int>& time_offsets,
+                      const py::list& matches, const py::dict& stage_ms,
+                      int max_results, int min_matches) {
+    QueryLogRecord record;
+    record.timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record.max_results = max_results;
+    record.min_matches = min_matches;
+    record.fingerprints = lists_to_fingerprints(hash_values, time_offsets);
+    
+    for (const auto& item : matches) {
+        py::dict py_match = item.cast<py::dict>();
+        IndexMatch match;
+        match.song_id = py_match["song_id"].cast<uint32_t>();
+        match.match_count = py_match["match_count"].cast<int>();
+        match.time_offset_ms = py_match["time_offset_ms"].cast<int>();
+        match.confidence = py_match.contains("confidence") ? py_match["confidence"].cast<float>() : 0.0f;
+        record.matches.push_back(match);
+    }
+    
+    for (const auto& stage : stage_ms) {
+        record.stage_ms.emplace_back(stage.first.cast<std::string>(), stage.second.cast<float>());
+    }
+    
+    py::gil_scoped_release release;
+    log.append(record);
+}
+
+/**
+ * Capture counters as a Python dict
+ */
+py::dict query_log_statistics(const QueryLog& log) {
+    QueryLogStats stats = log.get_stats();
+    
+    py::dict result;
+    result["offered"] = stats.offered;
+    result["captured"] = stats.captured;
+    result["bytes"] = stats.bytes;
+    result["sample_rate"] = log.get_sample_rate();
+    
+    return result;
+}
+
+/**
+ * Read a query log as a list of Python dicts
+ */
+py::list read_query_log(const std::string& path) {
+    std::vector<QueryLogRecord> records;
+    {
+        py::gil_scoped_release release;
+        records = QueryLog::read(path);
+    }
+    
+    py::list result;
+    for (const auto& record : records) {
+        std::vector<uint32_t> hash_values;
+        std::vector<int> time_offsets;
+        hash_values.reserve(record.fingerprints.size());
+        time_offsets.reserve(record.fingerprints.size());
+        for (const auto& fp : record.fingerprints) {
+            hash_values.push_back(fp.hash_value);
+            time_offsets.push_back(fp.time_offset_ms);
+        }
+        
+        py::dict stage_ms;
+        for (const auto& stage : record.stage_ms) {
+            stage_ms[py::str(stage.first)] = stage.second;
+        }
+        
+        py::dict py_record;
+        py_record["timestamp_ms"] = record.timestamp_ms;
+        py_record["max_results"] = record.max_results;
+        py_record["min_matches"] = record.min_matches;
+        py_record["hash_values"] = hash_values;
+        py_record["time_offsets"] = time_offsets;
+        py_record["matches"] = matches_to_list(record.matches);
+        py_record["stage_ms"] = stage_ms;
+        result.append(py_record);
+    }
+    
+    return result;
+}
+
+/**
+ * Index manifest as a Python dict
+ */
+py::dict index_manifest(const FingerprintIndex& index) {
+    IndexManifest manifest = index.get_manifest();
+    
+    py::list segments;
+    for (const auto& entry : manifest.segments) {
+        py::dict segment;
+        segment["segment_id"] = entry.segment_id;
+        segment["file_name"] = entry.file_name;
+        segment["size_bytes"] = entry.size_bytes;
+        segment["crc32"] = entry.crc32;
+        segment["song_count"] = entry.song_count;
+        segment["posting_count"] = entry.posting_count;
+        segments.append(segment);
+    }
+    
+    py::dict result;
+    result["generation"] = manifest.generation;
+    result["committed_at_ms"] = manifest.committed_at_ms;
+    result["next_segment_id"] = manifest.next_segment_id;
+    result["wal_lsn"] = manifest.wal_lsn;
+    result["profile_set"] = manifest.profile_set;
+    result["hash_signature"] = manifest.hash_signature;
+    result["segments"] = segments;
+    
+    return result;
+}
+
+/**
+ * Posting codec measurements as a Python dict
+ */
+py::dict posting_codec_to_dict(const PostingCodecStats& stats) {
+    py::dict result;
+    result["postings"] = stats.postings;
+    result["id_bytes_per_posting"] = stats.id_bytes_per_posting();
+    result["bytes_per_posting"] = stats.bytes_per_posting();
+    result["decode_ms"] = stats.decode_ms;
+    result["decode_mpostings_per_s"] = stats.decode_mpostings_per_s();
+    
+    return result;
+}
+
+/**
+ * Renumber the index's songs by graph bisection and report the effect
+ */
+py::dict index_reorder_songs(FingerprintIndex& index, int max_iterations, int min_partition, int max_depth) {
+    SongOrderConfig config;
+    config.max_iterations = max_iterations;
+    config.min_partition = min_partition;
+    config.max_depth = max_depth;
+    
+    SongReorderReport report;
+    {
+        py::gil_scoped_release release;
+        report = index.reorder_songs(config);
+    }
+    
+    py::dict result;
+    result["segment_id"] = report.segment_id;
+    result["songs"] = report.songs;
+    result["bisection_ms"] = report.bisection_ms;
+    result["before"] = posting_codec_to_dict(report.before);
+    result["after"] = posting_codec_to_dict(report.after);
+    
+    return result;
+}
+
+/**
+ * Define a named CPU pool
+ */
+void define_cpu_pool(const std::string& name, const std::vector<int>& cpus, int nice) {
+    CpuPoolConfig config;
+    config.cpus = cpus;
+    config.nice = nice;
+    CpuPools::define(name, config);
+}
+
+/**
+ * Utilisation of every CPU pool keyed by name
+ */
+py::dict cpu_pool_statistics() {
+    py::dict result;
+    for (const CpuPoolStats& stats : CpuPools::stats()) {
+        py::dict pool;
+        pool["cpus"] = stats.config.cpus;
+        pool["nice"] = stats.config.nice;
+        pool["threads_entered"] = stats.threads_entered;
+        pool["active_threads"] = stats.active_threads;
+        pool["placement_failures"] = stats.placement_failures;
+        pool["cpu_ms"] = stats.cpu_ms;
+        pool["busy_ms"] = stats.busy_ms;
+        pool["elapsed_ms"] = stats.elapsed_ms;
+        pool["utilisation"] = stats.utilisation;
+        result[py::str(stats.name)] = pool;
+    }
+    
+    return result;
+}
+
+/**
+ * Process-wide cancellation counters as a Python dict
+ */
+py::dict cancellation_statistics() {
+    CancellationStats stats = CancellationToken::stats();
+    
+    py::dict result;
+    result["tokens_cancelled"] = stats.tokens_cancelled;
+    result["deadlines_expired"] = stats.deadlines_expired;
+    result["operations_cancelled"] = stats.operations_cancelled;
+    result["queued_dropped"] = stats.queued_dropped;
+    result["by_stage"] = stats.by_stage;
+    
+    return result;
+}
+
+/**
+ * Index size information as a Python dict
+ */
+py::dict index_statistics(const FingerprintIndex& index) {
+    IndexStats stats = index.get_stats();
+    
+    py::dict result;
+    result["generation"] = stats.generation;
+    result["segment_count"] = stats.segment_count;
+    result["segment_songs"] = stats.segment_songs;
+    result["segment_postings"] = stats.segment_postings;
+    result["segment_bytes"] = stats.segment_bytes;
+    result["mutable_songs"] = stats.mutable_songs;
+    result["mutable_postings"] = stats.mutable_postings;
+    result["wal_records"] = stats.wal.records;
+    result["wal_syncs"] = stats.wal.syncs;
+    result["wal_replayed"] = stats.wal.replayed;
+    result["wal_sync_ms"] = stats.wal.sync_ms;
+    result["wal_bytes"] = stats.wal_bytes;
+    
+    return result;
+}
+
+/**
+ * Create a two-tier query processor, defaulting either profile
+ */
+std::unique_ptr<TieredQueryProcessor> create_tiered_query_processor(
+    const FingerprintIndex& index, const FingerprintProfile* sparse, const FingerprintProfile* dense,
+    float min_margin, int min_votes, int max_results, int min_matches) {
+    TieredQueryConfig config;
+    if (dense) {
+        config.dense = *dense;
+        config.sparse = sparse_profile(*dense);
+    }
+    if (sparse) {
+        config.sparse = *sparse;
+    }
+    config.min_margin = min_margin;
+    config.min_votes = min_votes;
+    config.max_results = max_results;
+    config.min_matches = min_matches;
+    
+    return std::make_unique<TieredQueryProcessor>(index, config);
+}
+
+/**
+ * Identify audio with the two-tier processor
+ */
+py::dict tiered_identify(TieredQueryProcessor& processor, py::array_t<float> audio_data,
+                         int sample_rate, int channels, const CancellationToken* cancel_token) {
+    AudioSample sample = numpy_to_audio_sample(audio_data, sample_rate, channels);
+    
+    TieredQueryResult result;
+    {
+        py::gil_scoped_release release;
+        auto cancellation = cancellation_scope(cancel_token);
+        result = processor.identify(sample);
+    }
+    
+    py::dict py_result;
+    py_result["matches"] = matches_to_list(result.matches);
+    py_result["escalated"] = result.escalated;
+    py_result["sparse_margin"] = result.sparse_margin;
+    py_result["sparse_fingerprints"] = result.sparse_fingerprints;
+    py_result["dense_fingerprints"] = result.dense_fingerprints;
+    py_result["analysis_ms"] = result.analysis_ms;
+    py_result["sparse_ms"] = result.sparse_ms;
+    py_result["dense_ms"] = result.dense_ms;
+    
+    return py_result;
+}
+
+/**
+ * Two-tier counters as a Python dict
+ */
+py::dict tiered_statistics(const TieredQueryProcessor& processor) {
+    TieredQueryStats stats = processor.get_stats();
+    
+    py::dict result;
+    result["queries"] = stats.queries;
+    result["escalated"] = stats.escalated;
+    result["escalation_rate"] = stats.escalation_rate();
+    result["analysis_ms"] = stats.analysis_ms;
+    result["sparse_ms"] = stats.sparse_ms;
+    result["dense_ms"] = stats.dense_ms;
+    result["estimated_saved_ms"] = processor.estimated_saved_ms();
+    
+    return result;
+}
+
+/**
+ * Frame layout of an MP3 stream as a dict
+ */
+py::dict mp3_stream_info(const py::bytes& data) {
+    std::string bytes = data;
+    Mp3StreamInfo info = Mp3Decoder::scan(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+    
+    py::dict result;
+    result["sample_rate"] = info.sample_rate;
+    result["channels"] = info.channels;
+    result["frames"] = info.frame_offsets.size();
+    result["samples_per_frame"] = info.samples_per_frame;
+    result["duration_ms"] = info.duration_ms;
+    
+    return result;
+}
+
+/**
+ * Decode part of an MP3 stream to mono float
+ */
+py::dict decode_mp3(const py::bytes& data, int start_ms, int max_duration_ms, int target_rate) {
+    std::string bytes = data;
+    Mp3DecodeOptions options;
+    options.start_ms = start_ms;
+    options.max_duration_ms = max_duration_ms;
+    options.target_rate = target_rate;
+    
+    Mp3DecodeResult decoded;
+    {
+        py::gil_scoped_release release;
+        decoded = Mp3Decoder::decode(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), options);
+    }
+    
+    py::dict result;
+    result["data"] = audio_sample_to_numpy(decoded.audio);
+    result["sample_rate"] = decoded.audio.sample_rate;
+    result["channels"] = decoded.audio.channels;
+    result["duration_ms"] = decoded.audio.duration_ms;
+    result["frames_decoded"] = decoded.frames_decoded;
+    result["frames_skipped"] = decoded.frames_skipped;
+    
+    return result;
+}
+
 PYBIND11_MODULE(audio_fingerprint_engine, m) {
     m.doc() = "Audio fingerprinting engine for music identification";
     
+    // Cancellation of native work, accepted by the entry points below
+    py::register_exception<OperationCancelled>(m, "OperationCancelled", PyExc_RuntimeError);
+    py::class_<CancellationToken>(m, "CancellationToken")
+        .def(py::init<>())
+        .def("cancel", &CancellationToken::cancel,
+             "Cancel the work running under this token; it stops at its next checkpoint")
+        .def("set_deadline", &CancellationToken::set_deadline,
+             "Cancel once timeout_ms have passed from now (negative = no deadline)",
+             py::arg("timeout_ms"))
+        .def_property_readonly("cancelled", &CancellationToken::is_cancelled)
+        .def_property_readonly("deadline_expired", &CancellationToken::deadline_expired);
+    m.def("cancellation_stats", &cancellation_statistics,
+          "Cancelled tokens, expired deadlines and abandoned operations per checkpoint");
+    m.def("reset_cancellation_stats", &CancellationToken::reset_stats,
+          "Reset the cancellation counters");
+    
     // Main fingerprinting function
     m.def("generate_fingerprint", &generate_fingerprint_from_audio,
           "Generate audio fingerprint from numpy array",
-          py::arg("audio_data"), py::arg("sample_rate"), py::arg("channels") = 1);
+          py::arg("audio_data"), py::arg("sample_rate"), py::arg("channels") = 1,
+          py::arg("profile") = py::none(), py::arg("cancel_token") = py::none());
     
     // Batch processing function
     m.def("batch_process_songs", &batch_process_reference_songs,
           "Batch process reference songs for database population",
-          py::arg("audio_samples"), py::arg("song_ids"));
+          py::arg("audio_samples"), py::arg("song_ids"), py::arg("cancel_token") = py::none());
+    
+    // Bulk ingest from files on disk
+    m.def("batch_process_files", &batch_process_audio_files,
+          "Read and fingerprint reference audio files with overlapped I/O",
+          py::arg("file_paths"), py::arg("song_ids"), py::arg("compute_threads") = 0,
+          py::arg("queue_depth") = 64, py::arg("io_threads") = 8, py::arg("use_io_uring") = true,
+          py::arg("thread_pool") = "", py::arg("cancel_token") = py::none());
+    m.def("io_uring_available", &CorpusReader::io_uring_compiled,
+          "Check whether the corpus reader was built with io_uring support");
+    
+    // CPU partitioning between thread pools
+    m.def("define_cpu_pool", &define_cpu_pool,
+          "Define a named CPU pool: the CPUs its threads run on (empty = any) and their niceness",
+          py::arg("name"), py::arg("cpus") = std::vector<int>(), py::arg("nice") = 0);
+    m.def("cpu_pool_stats", &cpu_pool_statistics,
+          "CPU time and utilisation of each CPU pool");
+    m.def("reset_cpu_pool_stats", &CpuPools::reset_stats,
+          "Restart the statistics of every CPU pool");
+    m.def("cpu_placement_supported", &CpuPools::placement_supported,
+          "Check whether CPU pools apply affinity and priorities on this platform");
     
     // Preprocessing function
     m.def("preprocess_audio", &preprocess_audio,
@@ -231,7 +1292,8 @@ PYBIND11_MODULE(audio_fingerprint_engine, m) {
     // Spectrogram computation
     m.def("compute_spectrogram", &compute_spectrogram,
           "Compute spectrogram from audio data",
-          py::arg("audio_data"), py::arg("fft_size") = 2048, py::arg("hop_size") = 1024);
+          py::arg("audio_data"), py::arg("fft_size") = 2048, py::arg("hop_size") = 1024,
+          py::arg("sample_rate") = static_cast<int>(NativeRateAnalyzer::ANALYSIS_RATE));
     
     // AudioSample class
     py::class_<AudioSample>(m, "AudioSample")
@@ -270,7 +1332,8 @@ PYBIND11_MODULE(audio_fingerprint_engine, m) {
         .def("stereo_to_mono", &AudioPreprocessor::stereo_to_mono)
         .def("resample_audio", &AudioPreprocessor::resample_audio)
         .def("normalize_audio", &AudioPreprocessor::normalize_audio)
-        .def("preprocess_for_fingerprinting", &AudioPreprocessor::preprocess_for_fingerprinting);
+        .def("preprocess_for_fingerprinting", &AudioPreprocessor::preprocess_for_fingerprinting)
+        .def("preprocess_at_native_rate", &AudioPreprocessor::preprocess_at_native_rate);
     
     // FFTProcessor class
     py::class_<FFTProcessor>(m, "FFTProcessor")
@@ -284,22 +1347,323 @@ PYBIND11_MODULE(audio_fingerprint_engine, m) {
              py::arg("min_peak_distance") = 3,
              py::arg("adaptive_factor") = 0.7f,
              py::arg("min_magnitude_threshold") = 0.01f)
+        .def("detect_peaks", &detect_spectrogram_peaks, py::arg("spectrogram"))
         .def("set_adaptive_factor", &PeakDetector::set_adaptive_factor)
         .def("set_min_peak_distance", &PeakDetector::set_min_peak_distance)
-        .def("set_min_magnitude_threshold", &PeakDetector::set_min_magnitude_threshold);
+        .def("set_min_magnitude_threshold", &PeakDetector::set_min_magnitude_threshold)
+        .def("set_frequency_interpolation", &PeakDetector::set_frequency_interpolation, py::arg("enabled"))
+        .def("set_time_interpolation", &PeakDetector::set_time_interpolation, py::arg("enabled"))
+        .def("frequency_interpolation", &PeakDetector::frequency_interpolation)
+        .def("time_interpolation", &PeakDetector::time_interpolation);
+    
+    // FingerprintProfile class
+    py::class_<FingerprintProfile>(m, "FingerprintProfile")
+        .def(py::init<>())
+        .def_static("reference", &FingerprintProfile::reference)
+        .def_static("query", &FingerprintProfile::query)
+        .def_static("coarse_reference", &FingerprintProfile::coarse_reference)
+        .def_static("coarse_query", &FingerprintProfile::coarse_query)
+        .def_static("fine_reference", &FingerprintProfile::fine_reference)
+        .def_static("fine_query", &FingerprintProfile::fine_query)
+        .def_readwrite("name", &FingerprintProfile::name)
+        .def_readwrite("fft_size", &FingerprintProfile::fft_size)
+        .def_readwrite("hop_size", &FingerprintProfile::hop_size)
+        .def_readwrite("freq_quantization", &FingerprintProfile::freq_quantization)
+        .def_readwrite("time_quantization", &FingerprintProfile::time_quantization)
+        .def_readwrite("landmark_size", &FingerprintProfile::landmark_size)
+        .def_readwrite("interpolate_frequency", &FingerprintProfile::interpolate_frequency)
+        .def_readwrite("interpolate_time", &FingerprintProfile::interpolate_time)
+        .def_readwrite("min_peak_distance", &FingerprintProfile::min_peak_distance)
+        .def_readwrite("adaptive_factor", &FingerprintProfile::adaptive_factor)
+        .def_readwrite("min_magnitude_threshold", &FingerprintProfile::min_magnitude_threshold)
+        .def_readwrite("max_time_delta_ms", &FingerprintProfile::max_time_delta_ms)
+        .def_readwrite("max_freq_delta_hz", &FingerprintProfile::max_freq_delta_hz)
+        .def_readwrite("max_pairs_per_anchor", &FingerprintProfile::max_pairs_per_anchor)
+        .def_readwrite("analysis_phases", &FingerprintProfile::analysis_phases)
+        .def_readwrite("native_rate", &FingerprintProfile::native_rate)
+        .def("hash_signature", &FingerprintProfile::hash_signature)
+        .def("validate", &FingerprintProfile::validate);
+    
+    // ProfileSet class
+    py::class_<ProfileSet>(m, "ProfileSet")
+        .def(py::init<>())
+        .def_static("parse", &ProfileSet::parse, py::arg("text"))
+        .def_static("load", &ProfileSet::load, py::arg("path"))
+        .def_static("triplets", &ProfileSet::triplets)
+        .def_static("coarse", &ProfileSet::coarse)
+        .def_static("fine", &ProfileSet::fine)
+        .def_readwrite("name", &ProfileSet::name)
+        .def_readwrite("version", &ProfileSet::version)
+        .def_readwrite("reference", &ProfileSet::reference)
+        .def_readwrite("query", &ProfileSet::query)
+        .def("id", &ProfileSet::id)
+        .def("validate", &ProfileSet::validate)
+        .def("serialize", &ProfileSet::serialize);
+    
+    // Host-specific kernel and scheduling parameters
+    py::class_<EngineTuning>(m, "EngineTuning")
+        .def(py::init<>())
+        .def_readwrite("tile_frames", &EngineTuning::tile_frames)
+        .def_readwrite("prefetch_distance", &EngineTuning::prefetch_distance)
+        .def_readwrite("parallel_query_min_hashes", &EngineTuning::parallel_query_min_hashes)
+        .def_readwrite("query_threads", &EngineTuning::query_threads)
+        .def_readwrite("pool_workers", &EngineTuning::pool_workers)
+        .def_readwrite("commit_window_us", &EngineTuning::commit_window_us)
+        .def("validate", &EngineTuning::validate)
+        .def("serialize", &EngineTuning::serialize)
+        .def("save", &EngineTuning::save, py::arg("path"))
+        .def_static("parse", &EngineTuning::parse, py::arg("text"))
+        .def_static("load", &EngineTuning::load, py::arg("path"))
+        .def_static("current", &EngineTuning::current,
+                    "Settings in effect, loaded from this host's wisdom file on first use")
+        .def_static("install", &EngineTuning::install,
+                    "Replace the settings in effect for components created afterwards",
+                    py::arg("tuning"), py::arg("source") = "installed")
+        .def_static("source", &EngineTuning::source)
+        .def_static("wisdom_path", &EngineTuning::wisdom_path)
+        .def_static("host_name", &EngineTuning::host_name);
+    
+    m.def("autotune", &run_autotune,
+          "Benchmark candidate tuning values on this machine; returns the winners and every trial",
+          py::arg("work_dir"), py::arg("repetitions") = 5, py::arg("tolerance") = 0.03, py::arg("quick") = false);
+    
+    m.def("profiles_compatible", [](const FingerprintProfile& reference, const FingerprintProfile& query) {
+              return profiles_compatible(reference, query);
+          },
+          "Check whether query fingerprints of one profile match references of another",
+          py::arg("reference"), py::arg("query"));
     
     // HashGenerator class
     py::class_<HashGenerator>(m, "HashGenerator")
         .def(py::init<float, int>(), 
              py::arg("freq_quantization") = 10.0f,
              py::arg("time_quantization") = 50)
-        .def("process_audio_sample", &HashGenerator::process_audio_sample)
+        .def("process_audio_sample",
+             py::overload_cast<const AudioSample&>(&HashGenerator::process_audio_sample))
+        .def("process_audio_sample",
+             py::overload_cast<const AudioSample&, const FingerprintProfile&>(&HashGenerator::process_audio_sample),
+             py::arg("audio_sample"), py::arg("profile"))
         .def("serialize_fingerprints", &HashGenerator::serialize_fingerprints)
         .def("deserialize_fingerprints", &HashGenerator::deserialize_fingerprints)
         .def("set_frequency_quantization", &HashGenerator::set_frequency_quantization)
         .def("set_time_quantization", &HashGenerator::set_time_quantization)
+        .def("set_fused_analysis", &HashGenerator::set_fused_analysis)
+        .def("get_profile", &HashGenerator::get_profile)
         .def("get_fingerprint_statistics", &HashGenerator::get_fingerprint_statistics);
     
+    // EnginePool class
+    py::class_<EnginePool>(m, "EnginePool")
+        .def(py::init(&create_engine_pool),
+             py::arg("num_workers") = 0,
+             py::arg("interactive_slo_ms") = 2000,
+             py::arg("batch_slo_ms") = 60000,
+             py::arg("allow_downgrade") = true,
+             py::arg("reduced_max_duration_ms") = 8000,
+             py::arg("max_queue_depth") = 256,
+             py::arg("thread_pool") = "")
+        .def("process", &engine_pool_process,
+             "Fingerprint audio with admission control",
+             py::arg("audio_data"), py::arg("sample_rate"), py::arg("channels") = 1,
+             py::arg("priority") = "interactive", py::arg("profile") = py::none(),
+             py::arg("cancel_token") = py::none())
+        .def("estimate_cost", &engine_pool_estimate_cost,
+             py::arg("audio_data"), py::arg("sample_rate"), py::arg("channels") = 1)
+        .def("get_statistics", &engine_pool_statistics);
+    
+    // StreamingFingerprinter class
+    py::class_<StreamingFingerprinter>(m, "StreamingFingerprinter")
+        .def(py::init(&create_streaming_fingerprinter),
+             py::arg("sample_rate") = 44100,
+             py::arg("channels") = 2,
+             py::arg("ring_ms") = 2000,
+             py::arg("hop_ms") = 2000,
+             py::arg("context_ms") = 0,
+             py::arg("poll_interval_ms") = 5,
+             py::arg("profile") = py::none())
+        .def("push", &streaming_push,
+             "Queue interleaved audio without blocking; returns the frames accepted",
+             py::arg("audio_data"))
+        .def("finish", &StreamingFingerprinter::finish,
+             "Fingerprint the remaining audio and stop the worker",
+             py::call_guard<py::gil_scoped_release>())
+        .def("take_fingerprints", [](StreamingFingerprinter& stream) {
+                 return fingerprints_to_dict(stream.take_fingerprints());
+             })
+        .def("get_stats", &streaming_statistics);
+    
+    m.def("audit_stream_push", &audit_stream_push,
+          "Push audio in callback-sized blocks and count allocations and locks on the pushing thread",
+          py::arg("stream"), py::arg("audio_data"), py::arg("block_frames") = 256, py::arg("speed") = 0.0);
+    m.def("realtime_allocation_tracking", &RealtimeAudit::allocation_tracking,
+          "Check that realtime audits can see allocations in this build");
+    
+    // FingerprintIndex class
+    py::class_<FingerprintIndex>(m, "FingerprintIndex")
+        .def(py::init<const std::string&, bool, int>(),
+             py::arg("directory"), py::arg("durable_ingest") = false, py::arg("commit_window_us") = -1)
+        .def("add_song", &index_add_song,
+             "Add a reference song, optionally with metadata for the segment's song table",
+             py::arg("song_id"), py::arg("hash_values"), py::arg("time_offsets"),
+             py::arg("title") = "", py::arg("artist") = "", py::arg("album") = "",
+             py::arg("duration_ms") = 0)
+        .def("flush", &FingerprintIndex::flush, py::call_guard<py::gil_scoped_release>())
+        .def("merge_segments", &FingerprintIndex::merge_segments, py::call_guard<py::gil_scoped_release>())
+        .def("reorder_songs", &index_reorder_songs,
+             "Merge segments into one with songs renumbered by hash co-occurrence; "
+             "reports posting bytes and decode speed before and after",
+             py::arg("max_iterations") = 20, py::arg("min_partition") = 16, py::arg("max_depth") = 32)
+        .def("reload", &FingerprintIndex::reload, py::call_guard<py::gil_scoped_release>())
+        .def("bind_profiles", &FingerprintIndex::bind_profiles, py::arg("profiles"))
+        .def("check_query_profile", &FingerprintIndex::check_query_profile, py::arg("profile"))
+        .def("set_query_threads", &FingerprintIndex::set_query_threads,
+             "Limit the threads scoring a long query (0 = one per core, 1 = serial)",
+             py::arg("threads"))
+        .def("get_query_threads", &FingerprintIndex::get_query_threads)
+        .def("set_thread_pools", &FingerprintIndex::set_thread_pools,
+             "Run query scoring and flush/merge/reorder work in named CPU pools (empty = none)",
+             py::arg("query_pool") = "", py::arg("maintenance_pool") = "")
+        .def_property_readonly("query_pool", &FingerprintIndex::get_query_pool)
+        .def_property_readonly("maintenance_pool", &FingerprintIndex::get_maintenance_pool)
+        .def("query", &index_query,
+             "Find reference songs matching query fingerprints",
+             py::arg("hash_values"), py::arg("time_offsets"),
+             py::arg("max_results") = 5, py::arg("min_matches") = 5, py::arg("cancel_token") = py::none())
+        .def("lookup_song", &index_lookup_song,
+             "Metadata of a song from the song tables, or None",
+             py::arg("song_id"))
+        .def("get_manifest", &index_manifest)
+        .def("get_stats", &index_statistics)
+        .def_property_readonly("directory", &FingerprintIndex::get_directory);
+    
+    // Shared-memory matcher sidecar and its client
+    py::class_<MatcherSidecar>(m, "MatcherSidecar")
+        .def(py::init(&create_matcher_sidecar),
+             py::arg("name"), py::arg("index"),
+             py::arg("slots") = 64,
+             py::arg("max_query_hashes") = 32768,
+             py::arg("max_results") = 32,
+             py::arg("workers") = 1,
+             py::arg("spin_us") = 50,
+             py::keep_alive<1, 3>())
+        .def("stop", &MatcherSidecar::stop,
+             "Stop serving and remove the shared segment",
+             py::call_guard<py::gil_scoped_release>())
+        .def("get_stats", &sidecar_statistics)
+        .def_property_readonly("name", &MatcherSidecar::get_name)
+        .def_static("supported", &MatcherSidecar::supported);
+    
+    py::class_<MatcherClient>(m, "MatcherClient")
+        .def(py::init<const std::string&, int>(),
+             py::arg("name"), py::arg("timeout_ms") = 5000)
+        .def("query", &matcher_client_query,
+             "Find matching songs through the sidecar",
+             py::arg("hash_values"), py::arg("time_offsets"),
+             py::arg("max_results") = 5, py::arg("min_matches") = 5, py::arg("cancel_token") = py::none())
+        .def("connected", &MatcherClient::connected)
+        .def_property_readonly("max_query_hashes", &MatcherClient::get_max_query_hashes)
+        .def_property_readonly("max_results", &MatcherClient::get_max_results);
+    
+    // Synthetic catalogs for index scaling benchmarks
+    py::class_<SyntheticCatalog>(m, "SyntheticCatalog")
+        .def(py::init(&create_synthetic_catalog),
+             py::arg("songs") = 10000,
+             py::arg("fingerprints_per_song") = 500,
+             py::arg("distinct_hashes") = 1u << 24,
+             py::arg("zipf_exponent") = 0.8,
+             py::arg("song_duration_ms") = 200000,
+             py::arg("seed") = 1)
+        .def("song_fingerprints", [](const SyntheticCatalog& catalog, uint32_t song_id) {
+                 return fingerprints_to_dict(catalog.song_fingerprints(song_id));
+             },
+             "Fingerprints of a song, generated from the seed and song ID",
+             py::arg("song_id"))
+        .def("build", &synthetic_catalog_build,
+             "Add every song to an empty index, flushing every songs_per_segment songs, then merge",
+             py::arg("index"), py::arg("songs_per_segment") = 10000)
+        .def("benchmark_queries", &synthetic_catalog_benchmark,
+             "Time index queries cut from random songs with noise hashes mixed in",
+             py::arg("index"), py::arg("queries") = 1000, py::arg("concurrency") = 1,
+             py::arg("query_ms") = 10000, py::arg("noise_fraction") = 0.5,
+             py::arg("max_results") = 5, py::arg("min_matches") = 5, py::arg("seed") = 7)
+        .def_property_readonly("songs", [](const SyntheticCatalog& catalog) { return catalog.get_config().songs; });
+    
+    // TieredQueryProcessor class
+    py::class_<TieredQueryProcessor>(m, "TieredQueryProcessor")
+        .def(py::init(&create_tiered_query_processor),
+             py::keep_alive<1, 2>(),
+             py::arg("index"), py::arg("sparse") = py::none(), py::arg("dense") = py::none(),
+             py::arg("min_margin") = 0.5f, py::arg("min_votes") = 10,
+             py::arg("max_results") = 5, py::arg("min_matches") = 5)
+        .def("identify", &tiered_identify,
+             "Match a sparse fingerprint set first and escalate to the dense one when ambiguous",
+             py::arg("audio_data"), py::arg("sample_rate"), py::arg("channels") = 1,
+             py::arg("cancel_token") = py::none())
+        .def("get_stats", &tiered_statistics);
+    
+    m.def("sparse_profile", &sparse_profile,
+          "Thinned-out first-pass counterpart of a query profile",
+          py::arg("dense"));
+    
+    // QueryLog class
+    py::class_<QueryLog, std::shared_ptr<QueryLog>>(m, "QueryLog")
+        .def(py::init<const std::string&, double, uint64_t>(),
+             py::arg("path"), py::arg("sample_rate") = 0.01, py::arg("seed") = 0)
+        .def("should_capture", &QueryLog::should_capture,
+             "Decide whether the current query is sampled")
+        .def("append", &query_log_append,
+             "Append a captured query with its matches and stage timings",
+             py::arg("hash_values"), py::arg("time_offsets"), py::arg("matches"),
+             py::arg("stage_ms") = py::dict(), py::arg("max_results") = 5, py::arg("min_matches") = 5)
+        .def("flush", &QueryLog::flush, py::call_guard<py::gil_scoped_release>())
+        .def("get_stats", &query_log_statistics)
+        .def_property_readonly("path", &QueryLog::get_path)
+        .def_property_readonly("sample_rate", &QueryLog::get_sample_rate);
+    
+    m.def("read_query_log", &read_query_log,
+          "Read every intact record of a query log",
+          py::arg("path"));
+    
+    // MP3 decoding
+    m.def("mp3_decoder_available", &Mp3Decoder::available,
+          "Check whether MP3 frame decoding was compiled in");
+    m.def("mp3_stream_info", &mp3_stream_info,
+          "Read the frame layout of an MP3 stream from its headers",
+          py::arg("data"));
+    m.def("decode_mp3", &decode_mp3,
+          "Decode part of an MP3 stream to mono float",
+          py::arg("data"), py::arg("start_ms") = 0, py::arg("max_duration_ms") = 0, py::arg("target_rate") = 0);
+    
+    // FingerprintPruner class
+    py::class_<FingerprintPruner>(m, "FingerprintPruner")
+        .def(py::init([](float keep_fraction, int min_per_second, float rarity_weight,
+                         float strength_weight, float redundancy_weight, int redundancy_window_ms) {
+                 PruningConfig config;
+                 config.keep_fraction = keep_fraction;
+                 config.min_per_second = min_per_second;
+                 config.rarity_weight = rarity_weight;
+                 config.strength_weight = strength_weight;
+                 config.redundancy_weight = redundancy_weight;
+                 config.redundancy_window_ms = redundancy_window_ms;
+                 return new FingerprintPruner(config);
+             }),
+             py::arg("keep_fraction") = 0.3f, py::arg("min_per_second") = 4,
+             py::arg("rarity_weight") = 1.0f, py::arg("strength_weight") = 0.5f,
+             py::arg("redundancy_weight") = 1.0f, py::arg("redundancy_window_ms") = 1000)
+        .def("count_postings", [](FingerprintPruner& pruner, const py::dict& fingerprint_dict) {
+                 pruner.count_postings(dict_to_fingerprints(fingerprint_dict));
+             },
+             "First pass: count posting-list lengths from a song's fingerprint dict",
+             py::arg("fingerprints"))
+        .def("score", [](const FingerprintPruner& pruner, const py::dict& fingerprint_dict) {
+                 return pruner.score(dict_to_fingerprints(fingerprint_dict));
+             },
+             py::arg("fingerprints"))
+        .def("prune", &pruner_prune,
+             "Second pass: keep the most useful fingerprints of a song",
+             py::arg("fingerprints"))
+        .def("posting_count", &FingerprintPruner::posting_count)
+        .def("get_stats", &pruner_statistics);
+    
     // Version information
     m.attr("__version__") = "0.1.0";
 }
\ No newline at end of file
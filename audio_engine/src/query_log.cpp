@@ -0,0 +1,258 @@
+#include "query_log.h"
+#include "index_segment.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace AudioFingerprint {
+
+namespace {
+
+const char LOG_MAGIC[8] = {'A', 'F', 'Q', 'L', 'O', 'G', '0', '1'};
+const size_t LOG_HEADER_SIZE = 8;
+const size_t RECORD_HEADER_SIZE = 8;       // Payload length + CRC
+const size_t RECORD_FIXED_PAYLOAD = 25;    // Timestamp, limits, counts
+const size_t FINGERPRINT_SIZE = 8;
+const size_t MATCH_SIZE = 16;
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+    put_u32(out, static_cast<uint32_t>(value));
+    put_u32(out, static_cast<uint32_t>(value >> 32));
+}
+
+void put_f32(std::vector<uint8_t>& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u32(out, bits);
+}
+
+void set_u32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t get_u64(const uint8_t* p) {
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+float get_f32(const uint8_t* p) {
+    uint32_t bits = get_u32(p);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Decode one payload; returns false if it is inconsistent
+ */
+bool decode_payload(const uint8_t* p, size_t length, QueryLogRecord& record) {
+    if (length < RECORD_FIXED_PAYLOAD) {
+        return false;
+    }
+    const uint8_t* end = p + length;
+
+    record.timestamp_ms = static_cast<int64_t>(get_u64(p));
+    record.max_results = static_cast<int32_t>(get_u32(p + 8));
+    record.min_matches = static_cast<int32_t>(get_u32(p + 12));
+    uint32_t fingerprint_count = get_u32(p + 16);
+    uint32_t match_count = get_u32(p + 20);
+    uint8_t stage_count = p[24];
+    p += RECORD_FIXED_PAYLOAD;
+
+    if (static_cast<uint64_t>(fingerprint_count) * FINGERPRINT_SIZE +
+        static_cast<uint64_t>(match_count) * MATCH_SIZE > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+
+    record.fingerprints.reserve(fingerprint_count);
+    for (uint32_t i = 0; i < fingerprint_count; ++i, p += FINGERPRINT_SIZE) {
+        record.fingerprints.emplace_back(get_u32(p), static_cast<int32_t>(get_u32(p + 4)), 0.0f, 0.0f, 0);
+    }
+
+    record.matches.reserve(match_count);
+    for (uint32_t i = 0; i < match_count; ++i, p += MATCH_SIZE) {
+        IndexMatch match;
+        match.song_id = get_u32(p);
+        match.match_count = static_cast<int32_t>(get_u32(p + 4));
+        match.time_offset_ms = static_cast<int32_t>(get_u32(p + 8));
+        match.confidence = get_f32(p + 12);
+        record.matches.push_back(match);
+    }
+
+    for (uint8_t i = 0; i < stage_count; ++i) {
+        if (end - p < 1 || end - p < 1 + p[0] + 4) {
+            return false;
+        }
+        std::string name(reinterpret_cast<const char*>(p + 1), p[0]);
+        record.stage_ms.emplace_back(std::move(name), get_f32(p + 1 + p[0]));
+        p += 1 + p[0] + 4;
+    }
+
+    return p == end;
+}
+
+} // namespace
+
+QueryLog::QueryLog(const std::string& path, double sample_rate, uint64_t seed)
+    : path_(path), sample_rate_(sample_rate), file_(nullptr),
+      rng_(seed != 0 ? seed : std::random_device{}()) {
+
+    if (sample_rate < 0.0 || sample_rate > 1.0) {
+        throw std::invalid_argument("Sample rate must be between 0.0 and 1.0");
+    }
+
+    file_ = std::fopen(path.c_str(), "ab");
+    if (file_ == nullptr) {
+        throw std::runtime_error("Cannot open query log " + path + ": " + std::strerror(errno));
+    }
+
+    // Unbuffered, so each write_buffer() reaches the file as one O_APPEND write
+    // and whole records from concurrent processes do not interleave
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+
+    if (std::ftell(file_) == 0) {
+        if (std::fwrite(LOG_MAGIC, 1, LOG_HEADER_SIZE, file_) != LOG_HEADER_SIZE || std::fflush(file_) != 0) {
+            std::fclose(file_);
+            throw std::runtime_error("Cannot write query log " + path);
+        }
+    }
+
+    buffer_.reserve(FLUSH_BYTES);
+}
+
+QueryLog::~QueryLog() {
+    try {
+        flush();
+    } catch (const std::exception&) {
+    }
+    std::fclose(file_);
+}
+
+bool QueryLog::should_capture() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.offered++;
+    return sample_rate_ >= 1.0 ||
+           (sample_rate_ > 0.0 && std::generate_canonical<double, 53>(rng_) < sample_rate_);
+}
+
+std::vector<uint8_t> QueryLog::encode(const QueryLogRecord& record) {
+    if (record.stage_ms.size() > 255) {
+        throw std::invalid_argument("A query log record holds at most 255 stages");
+    }
+
+    std::vector<uint8_t> out;
+    out.reserve(RECORD_HEADER_SIZE + RECORD_FIXED_PAYLOAD +
+                record.fingerprints.size() * FINGERPRINT_SIZE + record.matches.size() * MATCH_SIZE);
+
+    out.resize(RECORD_HEADER_SIZE);  // Filled in below
+    put_u64(out, static_cast<uint64_t>(record.timestamp_ms));
+    put_u32(out, static_cast<uint32_t>(record.max_results));
+    put_u32(out, static_cast<uint32_t>(record.min_matches));
+    put_u32(out, static_cast<uint32_t>(record.fingerprints.size()));
+    put_u32(out, static_cast<uint32_t>(record.matches.size()));
+    out.push_back(static_cast<uint8_t>(record.stage_ms.size()));
+
+    for (const auto& fp : record.fingerprints) {
+        put_u32(out, fp.hash_value);
+        put_u32(out, static_cast<uint32_t>(fp.time_offset_ms));
+    }
+
+    for (const auto& match : record.matches) {
+        put_u32(out, match.song_id);
+        put_u32(out, static_cast<uint32_t>(match.match_count));
+        put_u32(out, static_cast<uint32_t>(match.time_offset_ms));
+        put_f32(out, match.confidence);
+    }
+
+    for (const auto& stage : record.stage_ms) {
+        size_t name_length = std::min<size_t>(stage.first.size(), 255);
+        out.push_back(static_cast<uint8_t>(name_length));
+        out.insert(out.end(), stage.first.begin(), stage.first.begin() + name_length);
+        put_f32(out, stage.second);
+    }
+
+    const size_t payload_size = out.size() - RECORD_HEADER_SIZE;
+    set_u32(out.data(), static_cast<uint32_t>(payload_size));
+    set_u32(out.data() + 4, crc32(out.data() + RECORD_HEADER_SIZE, payload_size));
+    return out;
+}
+
+void QueryLog::append(const QueryLogRecord& record) {
+    std::vector<uint8_t> encoded = encode(record);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_.insert(buffer_.end(), encoded.begin(), encoded.end());
+    stats_.captured++;
+    stats_.bytes += encoded.size();
+
+    if (buffer_.size() >= FLUSH_BYTES) {
+        write_buffer();
+    }
+}
+
+void QueryLog::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_buffer();
+}
+
+void QueryLog::write_buffer() {
+    if (buffer_.empty()) {
+        return;
+    }
+
+    const size_t size = buffer_.size();
+    size_t written = std::fwrite(buffer_.data(), 1, size, file_);
+    buffer_.clear();
+    if (written != size || std::fflush(file_) != 0) {
+        throw std::runtime_error("Write failed for query log " + path_ + ": " + std::strerror(errno));
+    }
+}
+
+QueryLogStats QueryLog::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::vector<QueryLogRecord> QueryLog::read(const std::string& path) {
+    std::vector<uint8_t> data = read_binary_file(path);
+    if (data.size() < LOG_HEADER_SIZE || std::memcmp(data.data(), LOG_MAGIC, LOG_HEADER_SIZE) != 0) {
+        throw std::runtime_error("Not a query log: " + path);
+    }
+
+    // A record is accepted only if its length fits, its CRC matches and its
+    // payload decodes; anywhere else the reader slides forward a byte at a
+    // time until those line up again, skipping the torn or corrupt span
+    std::vector<QueryLogRecord> records;
+    size_t pos = LOG_HEADER_SIZE;
+    while (pos + RECORD_HEADER_SIZE <= data.size()) {
+        uint32_t length = get_u32(data.data() + pos);
+        uint32_t stored_crc = get_u32(data.data() + pos + 4);
+        const uint8_t* payload = data.data() + pos + RECORD_HEADER_SIZE;
+
+        QueryLogRecord record;
+        if (length < RECORD_FIXED_PAYLOAD || length > data.size() - pos - RECORD_HEADER_SIZE ||
+            crc32(payload, length) != stored_crc || !decode_payload(payload, length, record)) {
+            pos++;
+            continue;
+        }
+        records.push_back(std::move(record));
+        pos += RECORD_HEADER_SIZE + length;
+    }
+
+    return records;
+}
+
+} // namespace AudioFingerprint
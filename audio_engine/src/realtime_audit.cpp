@@ -0,0 +1,46 @@
+#include "realtime_audit.h"
+#include <new>
+
+namespace AudioFingerprint {
+
+namespace {
+
+// Counts of the innermost audit on this thread, or null
+thread_local RealtimeAuditCounts* active_counts = nullptr;
+
+} // namespace
+
+RealtimeAudit::RealtimeAudit() : previous_(active_counts) {
+    active_counts = &counts_;
+}
+
+RealtimeAudit::~RealtimeAudit() {
+    active_counts = previous_;
+}
+
+bool RealtimeAudit::allocation_tracking() {
+    RealtimeAudit audit;
+    // Called directly, unlike a new-expression, so the allocation cannot be elided
+    ::operator delete(::operator new(16));
+    return audit.counts().allocations == 1 && audit.counts().deallocations == 1;
+}
+
+void RealtimeAudit::note_lock() {
+    if (active_counts) {
+        active_counts->lock_acquisitions++;
+    }
+}
+
+void RealtimeAudit::note_allocation() {
+    if (active_counts) {
+        active_counts->allocations++;
+    }
+}
+
+void RealtimeAudit::note_deallocation() {
+    if (active_counts) {
+        active_counts->deallocations++;
+    }
+}
+
+} // namespace AudioFingerprint
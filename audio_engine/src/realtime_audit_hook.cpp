@@ -0,0 +1,70 @@
+// Allocation counting for RealtimeAudit. Linked only into audit builds
+// (AUDIO_ENGINE_ALLOCATION_AUDIT); never part of the shipped library, since
+// replacing the global allocation functions affects the whole host process.
+
+#include "realtime_audit.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+void* counted_allocate(std::size_t size) {
+    AudioFingerprint::RealtimeAudit::note_allocation();
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void counted_free(void* pointer) {
+    if (pointer) {
+        AudioFingerprint::RealtimeAudit::note_deallocation();
+    }
+    std::free(pointer);
+}
+
+} // namespace
+
+// The over-aligned forms are left to the standard library, whose matching
+// deallocation differs by platform.
+
+void* operator new(std::size_t size) {
+    void* pointer = counted_allocate(size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    counted_free(pointer);
+}
@@ -0,0 +1,287 @@
+#include "song_reorder.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+namespace AudioFingerprint {
+
+namespace {
+
+const int DECODE_RUNS = 3;
+
+size_t varint_size(uint32_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void put_varint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t get_varint(const uint8_t*& p) {
+    uint32_t value = *p & 0x7f;
+    int shift = 7;
+    while (*p++ & 0x80) {
+        value |= static_cast<uint32_t>(*p & 0x7f) << shift;
+        shift += 7;
+    }
+    return value;
+}
+
+uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+/**
+ * Song-hash graph restricted to hashes shared by two or more songs, with the
+ * recursion state of the bisection
+ */
+class Bisection {
+public:
+    Bisection(const IndexSegment& segment, const SongOrderConfig& config)
+        : config_(config), documents_(segment.song_count()) {
+        const auto& songs = segment.songs();
+        auto document_of = [&](uint32_t song_id) {
+            uint32_t external = segment.external_id(song_id);
+            return static_cast<uint32_t>(std::lower_bound(songs.begin(), songs.end(), external,
+                                                          [](const SegmentSong& song, uint32_t value) {
+                                                              return song.song_id < value;
+                                                          }) - songs.begin());
+        };
+
+        // Each hash's distinct songs; postings of a list are grouped by song
+        std::vector<std::pair<uint32_t, uint32_t>> edges;  // (document, term)
+        std::vector<uint32_t> list;
+        uint32_t terms = 0;
+        for (const auto& hash_entry : segment.hashes()) {
+            list.clear();
+            const Posting* postings = segment.postings().data() + hash_entry.first;
+            for (uint32_t i = 0; i < hash_entry.count; ++i) {
+                list.push_back(document_of(postings[i].song_id));
+            }
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+            if (list.size() < 2) {
+                continue;
+            }
+            for (uint32_t document : list) {
+                edges.emplace_back(document, terms);
+            }
+            ++terms;
+        }
+
+        // Forward index: terms of each document
+        std::sort(edges.begin(), edges.end());
+        term_begin_.assign(documents_ + 1, 0);
+        terms_.reserve(edges.size());
+        for (const auto& edge : edges) {
+            term_begin_[edge.first + 1]++;
+            terms_.push_back(edge.second);
+        }
+        for (size_t d = 0; d < documents_; ++d) {
+            term_begin_[d + 1] += term_begin_[d];
+        }
+
+        left_degree_.assign(terms, 0);
+        right_degree_.assign(terms, 0);
+        log2_.resize(documents_ + 2);
+        for (size_t k = 1; k < log2_.size(); ++k) {
+            log2_[k] = std::log2(static_cast<double>(k));
+        }
+        gains_.resize(documents_);
+    }
+
+    std::vector<uint32_t> run() {
+        std::vector<uint32_t> order(documents_);
+        for (size_t d = 0; d < documents_; ++d) {
+            order[d] = static_cast<uint32_t>(d);
+        }
+        split(order.data(), order.size(), 0);
+        return order;
+    }
+
+private:
+    SongOrderConfig config_;
+    size_t documents_;
+    std::vector<uint32_t> term_begin_;
+    std::vector<uint32_t> terms_;
+    std::vector<uint32_t> left_degree_;
+    std::vector<uint32_t> right_degree_;
+    std::vector<double> log2_;
+    std::vector<double> gains_;   // By document
+
+    // Estimated bits for the gaps of a term with degree songs among n
+    double cost(uint32_t degree, size_t n) const {
+        return degree * (log2_[n] - log2_[degree + 1]);
+    }
+
+    // Saving from moving a document out of a side of size from_n with degrees from_degree
+    double move_gain(uint32_t document, const std::vector<uint32_t>& from_degree, size_t from_n,
+                     const std::vector<uint32_t>& to_degree, size_t to_n) const {
+        double gain = 0.0;
+        for (uint32_t i = term_begin_[document]; i < term_begin_[document + 1]; ++i) {
+            uint32_t from = from_degree[terms_[i]];
+            uint32_t to = to_degree[terms_[i]];
+            gain += cost(from, from_n) + cost(to, to_n) - cost(from - 1, from_n) - cost(to + 1, to_n);
+        }
+        return gain;
+    }
+
+    void reset_degrees(const uint32_t* documents, size_t count) {
+        for (size_t d = 0; d < count; ++d) {
+            for (uint32_t i = term_begin_[documents[d]]; i < term_begin_[documents[d] + 1]; ++i) {
+                left_degree_[terms_[i]] = 0;
+                right_degree_[terms_[i]] = 0;
+            }
+        }
+    }
+
+    void add_degrees(const uint32_t* documents, size_t count, std::vector<uint32_t>& degree) {
+        for (size_t d = 0; d < count; ++d) {
+            for (uint32_t i = term_begin_[documents[d]]; i < term_begin_[documents[d] + 1]; ++i) {
+                degree[terms_[i]]++;
+            }
+        }
+    }
+
+    void split(uint32_t* documents, size_t count, int depth) {
+        if (count <= static_cast<size_t>(config_.min_partition) || depth >= config_.max_depth) {
+            return;
+        }
+
+        const size_t left_n = count / 2;
+        const size_t right_n = count - left_n;
+        uint32_t* left = documents;
+        uint32_t* right = documents + left_n;
+        auto by_gain = [this](uint32_t a, uint32_t b) {
+            if (gains_[a] != gains_[b]) return gains_[a] > gains_[b];
+            return a < b;
+        };
+
+        for (int iteration = 0; iteration < config_.max_iterations; ++iteration) {
+            reset_degrees(documents, count);
+            add_degrees(left, left_n, left_degree_);
+            add_degrees(right, right_n, right_degree_);
+
+            for (size_t d = 0; d < left_n; ++d) {
+                gains_[left[d]] = move_gain(left[d], left_degree_, left_n, right_degree_, right_n);
+            }
+            for (size_t d = 0; d < right_n; ++d) {
+                gains_[right[d]] = move_gain(right[d], right_degree_, right_n, left_degree_, left_n);
+            }
+            std::sort(left, left + left_n, by_gain);
+            std::sort(right, right + right_n, by_gain);
+
+            size_t swaps = 0;
+            while (swaps < left_n && swaps < right_n && gains_[left[swaps]] + gains_[right[swaps]] > 0.0) {
+                std::swap(left[swaps], right[swaps]);
+                ++swaps;
+            }
+            if (swaps == 0) {
+                break;
+            }
+        }
+
+        split(left, left_n, depth + 1);
+        split(right, right_n, depth + 1);
+    }
+};
+
+} // namespace
+
+void SongOrderConfig::validate() const {
+    if (max_iterations < 0) {
+        throw std::invalid_argument("Bisection iterations must not be negative");
+    }
+
+    if (min_partition < 1 || max_depth < 0) {
+        throw std::invalid_argument("Partition size must be positive and depth non-negative");
+    }
+}
+
+SongOrderOptimizer::SongOrderOptimizer(const SongOrderConfig& config) : config_(config) {
+    config_.validate();
+}
+
+std::vector<uint32_t> SongOrderOptimizer::order(const IndexSegment& segment) const {
+    std::vector<uint32_t> documents = Bisection(segment, config_).run();
+
+    std::vector<uint32_t> order(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        order[i] = segment.songs()[documents[i]].song_id;
+    }
+    return order;
+}
+
+PostingCodecStats SongOrderOptimizer::measure(const IndexSegment& segment) {
+    PostingCodecStats stats;
+    stats.postings = segment.posting_count();
+
+    // Per hash: song ID gap, then the offset as a gap within the same song or zigzag-coded
+    std::vector<uint8_t> encoded;
+    encoded.reserve(stats.postings * 4);
+    for (const auto& hash_entry : segment.hashes()) {
+        const Posting* postings = segment.postings().data() + hash_entry.first;
+        uint32_t previous_song = 0;
+        int32_t previous_offset = 0;
+        for (uint32_t i = 0; i < hash_entry.count; ++i) {
+            uint32_t gap = postings[i].song_id - previous_song;
+            stats.id_bytes += varint_size(gap);
+            put_varint(encoded, gap);
+            if (i > 0 && gap == 0) {
+                put_varint(encoded, static_cast<uint32_t>(postings[i].time_offset_ms - previous_offset));
+            } else {
+                put_varint(encoded, zigzag(postings[i].time_offset_ms));
+            }
+            previous_song = postings[i].song_id;
+            previous_offset = postings[i].time_offset_ms;
+        }
+    }
+    stats.total_bytes = encoded.size();
+
+    std::vector<Posting> decoded(stats.postings);
+    for (int run = 0; run < DECODE_RUNS; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* p = encoded.data();
+        Posting* out = decoded.data();
+        for (const auto& hash_entry : segment.hashes()) {
+            uint32_t song = 0;
+            int32_t offset = 0;
+            for (uint32_t i = 0; i < hash_entry.count; ++i, ++out) {
+                uint32_t gap = get_varint(p);
+                song += gap;
+                uint32_t value = get_varint(p);
+                offset = (i > 0 && gap == 0) ? offset + static_cast<int32_t>(value) : unzigzag(value);
+                out->song_id = song;
+                out->time_offset_ms = offset;
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.decode_ms = run == 0 ? ms : std::min(stats.decode_ms, ms);
+    }
+
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        if (decoded[i].song_id != segment.postings()[i].song_id ||
+            decoded[i].time_offset_ms != segment.postings()[i].time_offset_ms) {
+            throw std::logic_error("Posting codec round trip failed");
+        }
+    }
+
+    return stats;
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,266 @@
+#include "streaming_fingerprinter.h"
+#include "native_rate_analyzer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace AudioFingerprint {
+
+namespace {
+
+static_assert(std::atomic<size_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<bool>::is_always_lock_free,
+              "push() relies on lock-free atomics");
+
+const StreamingConfig& validated(const StreamingConfig& config) {
+    config.validate();
+    return config;
+}
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+SpscRing::SpscRing(size_t capacity)
+    : buffer_(round_up_pow2(std::max<size_t>(capacity, 1))), mask_(buffer_.size() - 1), head_(0), tail_(0) {
+}
+
+size_t SpscRing::write(const float* samples, size_t count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    count = std::min(count, buffer_.size() - (head - tail));
+
+    // At most two contiguous pieces around the end of the buffer
+    const size_t offset = head & mask_;
+    const size_t first = std::min(count, buffer_.size() - offset);
+    std::copy(samples, samples + first, buffer_.data() + offset);
+    std::copy(samples + first, samples + count, buffer_.data());
+
+    head_.store(head + count, std::memory_order_release);
+    return count;
+}
+
+size_t SpscRing::read(float* samples, size_t max_count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t count = std::min(max_count, head - tail);
+
+    const size_t offset = tail & mask_;
+    const size_t first = std::min(count, buffer_.size() - offset);
+    std::copy(buffer_.data() + offset, buffer_.data() + offset + first, samples);
+    std::copy(buffer_.data(), buffer_.data() + (count - first), samples + first);
+
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+size_t SpscRing::size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+}
+
+void StreamingConfig::validate() const {
+    if (sample_rate <= 0 || channels <= 0) {
+        throw std::invalid_argument("Sample rate and channel count must be positive");
+    }
+
+    if (ring_ms <= 0 || hop_ms <= 0 || context_ms < 0 || poll_interval_ms <= 0) {
+        throw std::invalid_argument("Ring, hop and poll durations must be positive and context non-negative");
+    }
+
+    if (static_cast<int64_t>(ring_ms) * sample_rate / 1000 == 0) {
+        throw std::invalid_argument("Ring must hold at least one frame");
+    }
+
+    profile.validate();
+}
+
+StreamingFingerprinter::StreamingFingerprinter(const StreamingConfig& config, EmitCallback on_fingerprints)
+    : config_(validated(config)), on_fingerprints_(std::move(on_fingerprints)),
+      ring_(static_cast<size_t>(static_cast<int64_t>(config.ring_ms) * config.sample_rate / 1000) * config.channels),
+      frames_pushed_(0), frames_dropped_(0), ring_high_water_(0), finishing_(false),
+      mono_start_(0), next_step_(0), passes_(0), failed_passes_(0), fingerprints_emitted_(0), max_pass_ms_(0.0) {
+
+    const FingerprintProfile& profile = config_.profile;
+    const double analysis_rate = static_cast<double>(NativeRateAnalyzer::ANALYSIS_RATE);
+    step_frames_ = profile.hop_size * config_.sample_rate / analysis_rate;
+    step_ms_ = profile.hop_size * 1000.0 / analysis_rate;
+
+    // Targets reach max_time_delta_ms past their anchor, plus one STFT frame
+    const double context_ms = config_.context_ms > 0
+        ? config_.context_ms
+        : profile.max_time_delta_ms + profile.fft_size * 1000.0 / analysis_rate;
+    hop_steps_ = std::max<int64_t>(1, std::llround(config_.hop_ms / step_ms_));
+    context_steps_ = static_cast<int64_t>(std::ceil(context_ms / step_ms_));
+
+    worker_ = std::thread(&StreamingFingerprinter::worker_loop, this);
+}
+
+StreamingFingerprinter::~StreamingFingerprinter() {
+    finish();
+}
+
+size_t StreamingFingerprinter::push(const float* samples, size_t frames) {
+    const size_t channels = static_cast<size_t>(config_.channels);
+    size_t accepted = 0;
+
+    if (!finishing_.load(std::memory_order_relaxed)) {
+        accepted = std::min(frames, (ring_.capacity() - ring_.size()) / channels);
+        ring_.write(samples, accepted * channels);
+
+        // Only this thread stores the high-water mark
+        const size_t fill = ring_.size() / channels;
+        if (fill > ring_high_water_.load(std::memory_order_relaxed)) {
+            ring_high_water_.store(fill, std::memory_order_relaxed);
+        }
+    }
+
+    frames_pushed_.fetch_add(accepted, std::memory_order_relaxed);
+    if (accepted < frames) {
+        frames_dropped_.fetch_add(frames - accepted, std::memory_order_relaxed);
+    }
+    return accepted;
+}
+
+void StreamingFingerprinter::finish() {
+    finishing_.store(true, std::memory_order_release);
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+std::vector<Fingerprint> StreamingFingerprinter::take_fingerprints() {
+    std::lock_guard<AuditedMutex> lock(mutex_);
+    std::vector<Fingerprint> fingerprints;
+    fingerprints.swap(queued_);
+    return fingerprints;
+}
+
+StreamingStats StreamingFingerprinter::get_stats() const {
+    StreamingStats stats;
+    stats.frames_pushed = frames_pushed_.load(std::memory_order_relaxed);
+    stats.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+    stats.ring_capacity_frames = ring_.capacity() / static_cast<size_t>(config_.channels);
+    stats.ring_high_water_frames = ring_high_water_.load(std::memory_order_relaxed);
+
+    std::lock_guard<AuditedMutex> lock(mutex_);
+    stats.passes = passes_;
+    stats.failed_passes = failed_passes_;
+    stats.fingerprints_emitted = fingerprints_emitted_;
+    stats.max_pass_ms = max_pass_ms_;
+    stats.last_error = last_error_;
+    return stats;
+}
+
+void StreamingFingerprinter::worker_loop() {
+    const FingerprintProfile& profile = config_.profile;
+    HashGenerator generator(profile.freq_quantization, profile.time_quantization);
+    const size_t channels = static_cast<size_t>(config_.channels);
+    std::vector<float> interleaved((ring_.capacity() / channels) * channels);
+
+    while (true) {
+        // Checked before draining, so everything pushed before finish() is read
+        const bool finishing = finishing_.load(std::memory_order_acquire);
+        const size_t count = ring_.read(interleaved.data(), interleaved.size());
+
+        for (size_t i = 0; i < count; i += channels) {
+            float sum = 0.0f;
+            for (size_t c = 0; c < channels; ++c) {
+                sum += interleaved[i + c];
+            }
+            mono_.push_back(sum / static_cast<float>(channels));
+        }
+
+        while (mono_start_ + static_cast<int64_t>(mono_.size()) >=
+               step_frame(next_step_ + hop_steps_ + context_steps_)) {
+            run_pass(generator, false);
+        }
+
+        if (count == 0) {
+            if (finishing) {
+                run_pass(generator, true);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(config_.poll_interval_ms));
+        }
+    }
+}
+
+int64_t StreamingFingerprinter::step_frame(int64_t step) const {
+    return std::llround(static_cast<double>(step) * step_frames_);
+}
+
+void StreamingFingerprinter::run_pass(HashGenerator& generator, bool final_pass) {
+    const FingerprintProfile& profile = config_.profile;
+    const int64_t mono_end = mono_start_ + static_cast<int64_t>(mono_.size());
+    const int64_t begin = step_frame(std::max<int64_t>(0, next_step_ - context_steps_));
+    const int64_t end = final_pass ? mono_end : step_frame(next_step_ + hop_steps_ + context_steps_);
+
+    // Anchors sit on the frame grid (or its sub-hop phases); boundaries between
+    // them keep rounding from assigning an anchor to two passes or none
+    const double guard_ms = step_ms_ / (2.0 * profile.analysis_phases);
+    const double emit_from_ms = next_step_ * step_ms_ - guard_ms;
+    const double emit_to_ms = final_pass ? std::numeric_limits<double>::infinity()
+                                         : (next_step_ + hop_steps_) * step_ms_ - guard_ms;
+    const int64_t min_frames = static_cast<int64_t>(
+        std::ceil(profile.fft_size * step_frames_ / profile.hop_size));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Fingerprint> emitted;
+    std::string error;
+
+    if (end - begin >= min_frames && end > step_frame(next_step_)) {
+        try {
+            AudioSample window(std::vector<float>(mono_.begin() + (begin - mono_start_),
+                                                  mono_.begin() + (end - mono_start_)),
+                               config_.sample_rate, 1);
+            const double window_ms = begin * 1000.0 / config_.sample_rate;
+
+            for (const Fingerprint& fp : generator.process_audio_sample(window, profile)) {
+                const double anchor_ms = window_ms + fp.time_offset_ms;
+                if (anchor_ms >= emit_from_ms && anchor_ms < emit_to_ms) {
+                    emitted.push_back(fp);
+                    emitted.back().time_offset_ms = static_cast<int>(std::llround(anchor_ms));
+                }
+            }
+
+            if (on_fingerprints_ && !emitted.empty()) {
+                on_fingerprints_(emitted);
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+    }
+
+    const double pass_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Keep only the leading context of the next pass
+    next_step_ += hop_steps_;
+    const int64_t keep_from = std::min(mono_end, step_frame(std::max<int64_t>(0, next_step_ - context_steps_)));
+    if (keep_from > mono_start_) {
+        mono_.erase(mono_.begin(), mono_.begin() + (keep_from - mono_start_));
+        mono_start_ = keep_from;
+    }
+
+    std::lock_guard<AuditedMutex> lock(mutex_);
+    passes_++;
+    max_pass_ms_ = std::max(max_pass_ms_, pass_ms);
+    if (!error.empty()) {
+        failed_passes_++;
+        last_error_ = error;
+        return;
+    }
+    fingerprints_emitted_ += emitted.size();
+    if (!on_fingerprints_) {
+        queued_.insert(queued_.end(), emitted.begin(), emitted.end());
+    }
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,309 @@
+#include "synthetic_catalog.h"
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+namespace AudioFingerprint {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Seed for a stream of draws that depends only on the catalog seed and a key
+ */
+uint64_t stream_seed(uint64_t seed, uint64_t stream, uint64_t key) {
+    return splitmix64(splitmix64(seed ^ (stream << 32)) ^ key);
+}
+
+// log1p(x) / x, accurate near zero
+double log1p_over_x(double x) {
+    return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+// expm1(x) / x, accurate near zero
+double expm1_over_x(double x) {
+    return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+}
+
+const uint64_t SONG_STREAM = 1;
+const uint64_t QUERY_STREAM = 2;
+
+} // namespace
+
+ZipfSampler::ZipfSampler(uint64_t n, double exponent) : n_(n), exponent_(exponent) {
+    if (n == 0) {
+        throw std::invalid_argument("Zipf sampler needs at least one rank");
+    }
+    if (!(exponent >= 0.0)) {
+        throw std::invalid_argument("Zipf exponent must not be negative");
+    }
+
+    h_integral_x1_ = h_integral(1.5) - 1.0;
+    h_integral_n_ = h_integral(static_cast<double>(n_) + 0.5);
+    s_ = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+}
+
+double ZipfSampler::h(double x) const {
+    return std::exp(-exponent_ * std::log(x));
+}
+
+double ZipfSampler::h_integral(double x) const {
+    double log_x = std::log(x);
+    return expm1_over_x((1.0 - exponent_) * log_x) * log_x;
+}
+
+double ZipfSampler::h_integral_inverse(double x) const {
+    double t = x * (1.0 - exponent_);
+    if (t < -1.0) {
+        // Rounding can push t just past the pole at -1
+        t = -1.0;
+    }
+    return std::exp(log1p_over_x(t) * x);
+}
+
+uint64_t ZipfSampler::operator()(std::mt19937_64& rng) const {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    while (true) {
+        double u = h_integral_n_ + uniform(rng) * (h_integral_x1_ - h_integral_n_);
+        double x = h_integral_inverse(u);
+
+        double k = std::floor(x + 0.5);
+        if (k < 1.0) {
+            k = 1.0;
+        } else if (k > static_cast<double>(n_)) {
+            k = static_cast<double>(n_);
+        }
+
+        // Accept when u falls under the histogram bar of k, which the first
+        // test settles without evaluating h_integral for most draws
+        if (k - x <= s_ || u >= h_integral(k + 0.5) - h(k)) {
+            return static_cast<uint64_t>(k);
+        }
+    }
+}
+
+void SyntheticCatalogConfig::validate() const {
+    if (songs == 0) {
+        throw std::invalid_argument("Synthetic catalog needs at least one song");
+    }
+    if (fingerprints_per_song <= 0) {
+        throw std::invalid_argument("fingerprints_per_song must be positive");
+    }
+    if (distinct_hashes == 0) {
+        throw std::invalid_argument("distinct_hashes must be positive");
+    }
+    if (!(zipf_exponent >= 0.0) || zipf_exponent > 10.0) {
+        throw std::invalid_argument("zipf_exponent must be in [0, 10]");
+    }
+    if (song_duration_ms <= 0) {
+        throw std::invalid_argument("song_duration_ms must be positive");
+    }
+}
+
+void QueryBenchmarkConfig::validate() const {
+    if (queries <= 0) {
+        throw std::invalid_argument("queries must be positive");
+    }
+    if (concurrency <= 0 || concurrency > 1024) {
+        throw std::invalid_argument("concurrency must be in [1, 1024]");
+    }
+    if (query_ms <= 0) {
+        throw std::invalid_argument("query_ms must be positive");
+    }
+    if (!(noise_fraction >= 0.0) || noise_fraction > 1.0) {
+        throw std::invalid_argument("noise_fraction must be in [0, 1]");
+    }
+    if (max_results <= 0) {
+        throw std::invalid_argument("max_results must be positive");
+    }
+    if (min_matches <= 0) {
+        throw std::invalid_argument("min_matches must be positive");
+    }
+}
+
+SyntheticCatalog::SyntheticCatalog(const SyntheticCatalogConfig& config)
+    : config_((config.validate(), config)), ranks_(config.distinct_hashes, config.zipf_exponent) {
+}
+
+uint32_t SyntheticCatalog::rank_hash(uint64_t rank) const {
+    // Bijective on 32 bits, so distinct ranks never share a hash
+    uint32_t h = static_cast<uint32_t>(rank) ^ static_cast<uint32_t>(config_.seed);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+std::vector<Fingerprint> SyntheticCatalog::generate_song(uint32_t song_id, uint64_t* top_rank_postings) const {
+    std::mt19937_64 rng(stream_seed(config_.seed, SONG_STREAM, song_id));
+    std::uniform_int_distribution<int> offset(0, config_.song_duration_ms - 1);
+    std::uniform_int_distribution<int> delta(1, 2000);
+    const uint64_t top_rank = std::max<uint64_t>(1, config_.distinct_hashes / 100);
+
+    std::vector<Fingerprint> fingerprints;
+    fingerprints.reserve(config_.fingerprints_per_song);
+    for (int i = 0; i < config_.fingerprints_per_song; ++i) {
+        uint64_t rank = ranks_(rng);
+        if (top_rank_postings && rank <= top_rank) {
+            ++*top_rank_postings;
+        }
+        fingerprints.emplace_back(rank_hash(rank), offset(rng), 0.0f, 0.0f, delta(rng));
+    }
+
+    std::sort(fingerprints.begin(), fingerprints.end(), [](const Fingerprint& a, const Fingerprint& b) {
+        return a.time_offset_ms < b.time_offset_ms;
+    });
+    return fingerprints;
+}
+
+std::vector<Fingerprint> SyntheticCatalog::song_fingerprints(uint32_t song_id) const {
+    if (song_id == 0 || song_id > config_.songs) {
+        throw std::invalid_argument("Song ID outside the catalog");
+    }
+    return generate_song(song_id, nullptr);
+}
+
+CatalogBuildStats SyntheticCatalog::build(FingerprintIndex& index, uint32_t songs_per_segment) const {
+    if (songs_per_segment == 0) {
+        throw std::invalid_argument("songs_per_segment must be positive");
+    }
+
+    CatalogBuildStats stats;
+    uint64_t top_rank_postings = 0;
+
+    for (uint32_t song_id = 1; song_id <= config_.songs; ++song_id) {
+        auto start = Clock::now();
+        std::vector<Fingerprint> fingerprints = generate_song(song_id, &top_rank_postings);
+        index.add_song(song_id, fingerprints);
+        stats.add_ms += elapsed_ms(start);
+        stats.postings += fingerprints.size();
+        ++stats.songs;
+
+        if (song_id % songs_per_segment == 0 || song_id == config_.songs) {
+            start = Clock::now();
+            if (index.flush() != 0) {
+                ++stats.segments_flushed;
+            }
+            stats.flush_ms += elapsed_ms(start);
+        }
+    }
+
+    auto start = Clock::now();
+    index.merge_segments();
+    stats.merge_ms = elapsed_ms(start);
+
+    stats.top_percent_share = stats.postings > 0
+        ? static_cast<double>(top_rank_postings) / static_cast<double>(stats.postings) : 0.0;
+    return stats;
+}
+
+std::vector<Fingerprint> SyntheticCatalog::make_query(std::mt19937_64& rng, const QueryBenchmarkConfig& config,
+                                                      uint32_t& song_id) const {
+    song_id = std::uniform_int_distribution<uint32_t>(1, config_.songs)(rng);
+    std::vector<Fingerprint> song = generate_song(song_id, nullptr);
+
+    int length = std::min(config.query_ms, config_.song_duration_ms);
+    int start = std::uniform_int_distribution<int>(0, config_.song_duration_ms - length)(rng);
+
+    auto first = std::lower_bound(song.begin(), song.end(), start, [](const Fingerprint& fp, int t) {
+        return fp.time_offset_ms < t;
+    });
+    auto last = std::lower_bound(first, song.end(), start + length, [](const Fingerprint& fp, int t) {
+        return fp.time_offset_ms < t;
+    });
+
+    std::bernoulli_distribution noise(config.noise_fraction);
+    std::vector<Fingerprint> query(first, last);
+    for (auto& fp : query) {
+        fp.time_offset_ms -= start;
+        if (noise(rng)) {
+            // Noise hashes follow the catalog's distribution, so the common
+            // ones cost as much to look up as they would in real noise
+            fp.hash_value = rank_hash(ranks_(rng));
+        }
+    }
+    return query;
+}
+
+QueryBenchmarkResult SyntheticCatalog::benchmark_queries(const FingerprintIndex& index,
+                                                         const QueryBenchmarkConfig& config) const {
+    config.validate();
+
+    QueryBenchmarkResult result;
+    result.latencies_ms.reserve(config.queries);
+
+    std::atomic<int> next(0);
+    std::atomic<int> correct(0);
+    std::atomic<uint64_t> query_fingerprints(0);
+    std::mutex latencies_mutex;
+    std::exception_ptr error;
+
+    auto run = [&]() {
+        std::vector<double> latencies;
+        try {
+            for (int i = next.fetch_add(1); i < config.queries; i = next.fetch_add(1)) {
+                // Seeded per query, so the load does not depend on the concurrency
+                std::mt19937_64 rng(stream_seed(config.seed, QUERY_STREAM, static_cast<uint64_t>(i)));
+                uint32_t song_id = 0;
+                std::vector<Fingerprint> query = make_query(rng, config, song_id);
+
+                auto start = Clock::now();
+                std::vector<IndexMatch> matches = index.query(query, config.max_results, config.min_matches);
+                latencies.push_back(elapsed_ms(start));
+
+                query_fingerprints.fetch_add(query.size());
+                if (!matches.empty() && matches[0].song_id == song_id) {
+                    correct.fetch_add(1);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(latencies_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            next.store(config.queries);
+        }
+
+        std::lock_guard<std::mutex> lock(latencies_mutex);
+        result.latencies_ms.insert(result.latencies_ms.end(), latencies.begin(), latencies.end());
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 1; t < config.concurrency; ++t) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    result.wall_ms = elapsed_ms(start);
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    result.top1_accuracy = static_cast<double>(correct.load()) / config.queries;
+    result.avg_query_fingerprints = static_cast<double>(query_fingerprints.load()) / config.queries;
+    return result;
+}
+
+} // namespace AudioFingerprint
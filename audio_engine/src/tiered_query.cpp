@@ -0,0 +1,187 @@
+#include "tiered_query.h"
+#include "audio_preprocessor.h"
+#include "fft_processor.h"
+#include "peak_detector.h"
+#include "hash_generator.h"
+#include "native_rate_analyzer.h"
+#include "cancellation.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+
+namespace AudioFingerprint {
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+FingerprintProfile sparse_profile(const FingerprintProfile& dense) {
+    FingerprintProfile sparse = dense;
+    sparse.name = dense.name + "-sparse";
+    sparse.min_peak_distance = std::max(dense.min_peak_distance, 6);
+    sparse.adaptive_factor = 1.0f;
+    sparse.max_pairs_per_anchor = 3;
+    return sparse;
+}
+
+TieredQueryConfig::TieredQueryConfig()
+    : sparse(sparse_profile(FingerprintProfile::query())), dense(FingerprintProfile::query()),
+      min_margin(0.5f), min_votes(10), max_results(5), min_matches(5) {}
+
+void TieredQueryConfig::validate() const {
+    sparse.validate();
+    dense.validate();
+
+    std::string reason;
+    if (!profiles_compatible(dense, sparse, &reason)) {
+        throw std::invalid_argument("Sparse and dense passes must hash alike: " + reason);
+    }
+
+    if (sparse.analysis_phases != dense.analysis_phases || sparse.native_rate != dense.native_rate) {
+        throw std::invalid_argument("Sparse and dense passes must use the same analysis front end");
+    }
+
+    if (min_margin < 0.0f || min_margin > 1.0f) {
+        throw std::invalid_argument("Minimum margin must be between 0.0 and 1.0");
+    }
+
+    if (min_votes < 0 || max_results <= 0 || min_matches <= 0) {
+        throw std::invalid_argument("Vote and result limits must be positive");
+    }
+}
+
+TieredQueryProcessor::TieredQueryProcessor(const FingerprintIndex& index, const TieredQueryConfig& config)
+    : index_(index), config_(config), unescalated_audio_ms_(0.0) {
+    config_.validate();
+}
+
+TieredQueryResult TieredQueryProcessor::identify(const AudioSample& sample) {
+    if (sample.empty()) {
+        throw std::invalid_argument("Audio sample is empty");
+    }
+
+    TieredQueryResult result;
+
+    // Shared analysis: both profiles have the same FFT size, hop and front end
+    auto start = std::chrono::steady_clock::now();
+    const FingerprintProfile& analysis = config_.dense;
+    const bool native_rate = analysis.native_rate && sample.sample_rate > NativeRateAnalyzer::ANALYSIS_RATE;
+    AudioPreprocessor preprocessor;
+    auto preprocessed = native_rate ? preprocessor.preprocess_at_native_rate(sample)
+                                    : preprocessor.preprocess_for_fingerprinting(sample);
+    CancellationToken::check("preprocess");
+    std::vector<PhaseSpectrogram> spectrograms;
+    if (native_rate) {
+        NativeRateAnalyzer analyzer(preprocessed.sample_rate, analysis.fft_size, analysis.hop_size);
+        for (int phase = 0; phase < analysis.analysis_phases; ++phase) {
+            const int shift = analyzer.to_native_samples(analysis.phase_shift(phase));
+            if (phase > 0 && static_cast<size_t>(shift) >= preprocessed.data.size()) {
+                break;
+            }
+            std::vector<float> shifted(preprocessed.data.begin() + shift, preprocessed.data.end());
+            spectrograms.push_back({shift, analyzer.compute_stft(shifted)});
+        }
+    } else {
+        FFTProcessor fft_processor(analysis.fft_size);
+        for (int phase = 0; phase < analysis.analysis_phases; ++phase) {
+            const int shift = analysis.phase_shift(phase);
+            if (phase > 0 && static_cast<size_t>(shift) >= preprocessed.data.size()) {
+                break;
+            }
+            std::vector<float> shifted(preprocessed.data.begin() + shift, preprocessed.data.end());
+            spectrograms.push_back({shift, fft_processor.compute_stft(shifted, analysis.fft_size,
+                                                                      analysis.hop_size)});
+        }
+    }
+    result.analysis_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<IndexMatch> sparse_matches = run_pass(spectrograms, preprocessed.sample_rate, config_.sparse,
+                                                      result.sparse_fingerprints);
+    result.sparse_ms = elapsed_ms(start);
+    result.sparse_margin = margin(sparse_matches);
+
+    result.escalated = sparse_matches.empty() ||
+                       sparse_matches[0].match_count < config_.min_votes ||
+                       result.sparse_margin < config_.min_margin;
+
+    if (result.escalated) {
+        start = std::chrono::steady_clock::now();
+        result.matches = run_pass(spectrograms, preprocessed.sample_rate, config_.dense,
+                                  result.dense_fingerprints);
+        result.dense_ms = elapsed_ms(start);
+    } else {
+        result.matches = std::move(sparse_matches);
+    }
+
+    if (result.matches.size() > static_cast<size_t>(config_.max_results)) {
+        result.matches.resize(config_.max_results);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.queries++;
+        stats_.analysis_ms += result.analysis_ms;
+        stats_.sparse_ms += result.sparse_ms;
+        if (result.escalated) {
+            stats_.escalated++;
+            stats_.dense_ms += result.dense_ms;
+            stats_.escalated_audio_ms += sample.duration_ms;
+        } else {
+            unescalated_audio_ms_ += sample.duration_ms;
+        }
+    }
+
+    return result;
+}
+
+std::vector<IndexMatch> TieredQueryProcessor::run_pass(const std::vector<PhaseSpectrogram>& spectrograms,
+                                                       int sample_rate, const FingerprintProfile& profile,
+                                                       size_t& fingerprint_count) const {
+    PeakDetector peak_detector(profile.min_peak_distance, profile.adaptive_factor,
+                               profile.min_magnitude_threshold);
+    peak_detector.set_frequency_interpolation(profile.interpolate_frequency);
+    peak_detector.set_time_interpolation(profile.interpolate_time);
+    HashGenerator generator(profile.freq_quantization, profile.time_quantization);
+
+    std::vector<Fingerprint> fingerprints;
+    for (const auto& phase : spectrograms) {
+        ConstellationMap constellation = peak_detector.detect_peaks(phase.spectrogram);
+        HashGenerator::append_phase(fingerprints, generator.hash_constellation(peak_detector, constellation, profile),
+                                    phase.shift, sample_rate);
+    }
+    fingerprint_count = fingerprints.size();
+
+    // At least two results so the margin to the runner-up is known
+    return index_.query(fingerprints, std::max(2, config_.max_results), config_.min_matches);
+}
+
+float TieredQueryProcessor::margin(const std::vector<IndexMatch>& matches) {
+    if (matches.empty() || matches[0].match_count <= 0) {
+        return 0.0f;
+    }
+
+    int runner_up = matches.size() > 1 ? matches[1].match_count : 0;
+    return static_cast<float>(matches[0].match_count - runner_up) / static_cast<float>(matches[0].match_count);
+}
+
+TieredQueryStats TieredQueryProcessor::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+double TieredQueryProcessor::estimated_saved_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.escalated_audio_ms <= 0.0) {
+        return 0.0;
+    }
+
+    double dense_ms_per_audio_ms = stats_.dense_ms / stats_.escalated_audio_ms;
+    return unescalated_audio_ms_ * dense_ms_per_audio_ms - stats_.sparse_ms;
+}
+
+} // namespace AudioFingerprint
@@ -0,0 +1,100 @@
+#include "tiled_peak_pipeline.h"
+#include "cancellation.h"
+#include "engine_tuning.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace AudioFingerprint {
+
+TiledPeakPipeline::TiledPeakPipeline(int fft_size, int hop_size, int tile_frames)
+    : fft_processor_(fft_size), hop_size_(hop_size),
+      tile_frames_(tile_frames == 0 ? EngineTuning::current().tile_frames : tile_frames) {
+
+    if (hop_size <= 0 || hop_size > fft_size) {
+        throw std::invalid_argument("Invalid hop size");
+    }
+
+    if (tile_frames < 0) {
+        throw std::invalid_argument("Tile size must be positive");
+    }
+}
+
+int TiledPeakPipeline::ring_capacity() const {
+    // A tile plus the context on both sides of the frames being scanned
+    return tile_frames_ + 2 * PeakDetector::context_frames();
+}
+
+size_t TiledPeakPipeline::working_set_bytes() const {
+    int freq_bins = fft_processor_.get_fft_size() / 2 + 1;
+    return static_cast<size_t>(ring_capacity()) * freq_bins * sizeof(float);
+}
+
+ConstellationMap TiledPeakPipeline::detect_peaks(const std::vector<float>& audio_data,
+                                                 const PeakDetector& peak_detector) {
+    const int window_size = fft_processor_.get_fft_size();
+
+    if (audio_data.empty()) {
+        throw std::invalid_argument("Audio data is empty");
+    }
+
+    if (audio_data.size() < static_cast<size_t>(window_size)) {
+        throw std::invalid_argument("Audio data is shorter than one analysis window");
+    }
+
+    const int num_frames = static_cast<int>((audio_data.size() - window_size) / hop_size_) + 1;
+    const int freq_bins = window_size / 2 + 1;
+    const int context = PeakDetector::context_frames();
+    const int capacity = ring_capacity();
+
+    // Same resolutions as FFTProcessor::compute_stft
+    const float time_resolution = static_cast<float>(hop_size_) / 11025.0f;
+    const float freq_resolution = 11025.0f / static_cast<float>(window_size);
+
+    ring_.resize(static_cast<size_t>(capacity) * freq_bins);
+    rows_.assign(num_frames, nullptr);
+
+    std::vector<SpectralPeak> candidate_peaks;
+    int scanned_end = 0;
+
+    for (int tile_start = 0; tile_start < num_frames; tile_start += tile_frames_) {
+        int tile_end = std::min(num_frames, tile_start + tile_frames_);
+        CancellationToken::check("stft");
+
+        // Compute the tile into the ring, evicting the oldest frames
+        for (int t = tile_start; t < tile_end; ++t) {
+            float* row = ring_.data() + static_cast<size_t>(t % capacity) * freq_bins;
+            if (t >= capacity) {
+                rows_[t - capacity] = nullptr;
+            }
+
+            fft_processor_.compute_magnitude_frame(audio_data.data() + static_cast<size_t>(t) * hop_size_,
+                                                   window_size, row);
+            rows_[t] = row;
+        }
+
+        // Scan every frame whose context is now complete; the last tile has no
+        // frames after it, so it can be scanned to the end
+        int ready_end = tile_end == num_frames ? num_frames : tile_end - context;
+        if (ready_end > scanned_end) {
+            peak_detector.find_candidate_peaks(rows_.data(), num_frames, freq_bins,
+                                               scanned_end, ready_end,
+                                               time_resolution, freq_resolution,
+                                               candidate_peaks);
+            scanned_end = ready_end;
+        }
+    }
+
+    ConstellationMap constellation;
+    constellation.total_time_frames = num_frames;
+    constellation.total_frequency_bins = freq_bins;
+    constellation.time_resolution = time_resolution;
+    constellation.freq_resolution = freq_resolution;
+
+    // Suppression is greedy in magnitude order across the whole signal, so it runs
+    // once over the sparse candidate list rather than per tile
+    constellation.peaks = peak_detector.filter_nearby_peaks(candidate_peaks);
+
+    return constellation;
+}
+
+} // namespace AudioFingerprint
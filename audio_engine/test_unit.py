@@ -14,6 +14,13 @@ import numpy as np
 import sys
 import os
 import time
+import tempfile
+import wave
+import subprocess
+import json
+import struct
+import threading
+import collections
 from typing import List, Dict, Tuple
 
 # Add current directory to path
@@ -157,6 +164,23 @@ class TestFingerprintConsistency(unittest.TestCase):
         if result1.count > 0:
             self.assertEqual(result1.hash_values, result2.hash_values)
             self.assertEqual(result1.hash_values, result3.hash_values)
+    
+    def test_fused_matches_two_pass_analysis(self):
+        """Test that the tiled STFT + peak pipeline reproduces the two-pass result"""
+        rng = np.random.default_rng(7)
+        audio = (self.test_audio + 0.2 * rng.standard_normal(len(self.test_audio))).astype(np.float32)
+        sample = afe.AudioSample(audio.tolist(), self.sample_rate, 1)
+        
+        fused_generator = afe.HashGenerator()
+        fused = fused_generator.process_audio_sample(sample)
+        
+        two_pass_generator = afe.HashGenerator()
+        two_pass_generator.set_fused_analysis(False)
+        two_pass = two_pass_generator.process_audio_sample(sample)
+        
+        self.assertGreater(len(fused), 0)
+        self.assertEqual([fp.hash_value for fp in fused], [fp.hash_value for fp in two_pass])
+        self.assertEqual([fp.time_offset_ms for fp in fused], [fp.time_offset_ms for fp in two_pass])
 
 
 class TestPeakDetectionAccuracy(unittest.TestCase):
@@ -409,6 +433,1828 @@ class TestEnginePerformance(unittest.TestCase):
                            f"Too many fingerprints per second: {fingerprints_per_second}")
 
 
+class TestEnginePool(unittest.TestCase):
+    """Test admission control and prioritization of the engine worker pool"""
+    
+    def setUp(self):
+        self.sample_rate = 44100
+        t = np.linspace(0, 5.0, int(self.sample_rate * 5.0), False)
+        self.test_audio = np.sin(2 * np.pi * 440.0 * t).astype(np.float32)
+    
+    def test_pool_matches_direct_fingerprinting(self):
+        """Test that an admitted request produces the same hashes as the direct path"""
+        pool = afe.EnginePool(num_workers=2)
+        pooled = pool.process(self.test_audio, self.sample_rate, 1, "interactive")
+        direct = afe.generate_fingerprint(self.test_audio, self.sample_rate, 1)
+        
+        self.assertEqual(pooled['status'], 'admitted')
+        self.assertEqual(pooled['mode'], 'full')
+        self.assertEqual(pooled['hash_values'], direct['hash_values'])
+    
+    def test_cost_estimate_tracks_duration_and_energy(self):
+        """Test that longer and louder inputs are estimated as more expensive"""
+        pool = afe.EnginePool(num_workers=1)
+        short = pool.estimate_cost(self.test_audio[:self.sample_rate], self.sample_rate, 1)
+        full = pool.estimate_cost(self.test_audio, self.sample_rate, 1)
+        silence = pool.estimate_cost(np.zeros_like(self.test_audio), self.sample_rate, 1)
+        
+        self.assertGreater(full['estimated_ms'], short['estimated_ms'])
+        self.assertGreater(full['estimated_ms'], silence['estimated_ms'])
+        self.assertEqual(silence['active_fraction'], 0.0)
+    
+    def test_overload_rejects_with_retry_hint(self):
+        """Test that requests whose projected latency exceeds the SLO are shed"""
+        pool = afe.EnginePool(num_workers=1, interactive_slo_ms=1, allow_downgrade=False)
+        result = pool.process(self.test_audio, self.sample_rate, 1, "interactive")
+        
+        self.assertEqual(result['status'], 'rejected')
+        self.assertGreater(result['retry_after_ms'], 0)
+        self.assertEqual(result['count'], 0)
+        
+        stats = pool.get_statistics()
+        self.assertEqual(stats['interactive']['rejected'], 1)
+    
+    def test_overload_downgrades_long_queries(self):
+        """Test that long interactive queries fall back to the reduced mode"""
+        t = np.linspace(0, 30.0, int(self.sample_rate * 30.0), False)
+        long_audio = np.sin(2 * np.pi * 440.0 * t).astype(np.float32)
+        
+        probe = afe.EnginePool(num_workers=1)
+        full_ms = probe.estimate_cost(long_audio, self.sample_rate, 1)['estimated_ms']
+        
+        pool = afe.EnginePool(num_workers=1, interactive_slo_ms=max(1, int(full_ms / 2)),
+                              reduced_max_duration_ms=5000)
+        result = pool.process(long_audio, self.sample_rate, 1, "interactive")
+        
+        self.assertEqual(result['status'], 'downgraded')
+        self.assertEqual(result['mode'], 'reduced')
+        self.assertLessEqual(max(result['time_offsets']), 5000)
+
+
+class TestCpuPools(unittest.TestCase):
+    """Test CPU partitioning between interactive queries and background ingest"""
+
+    sample_rate = 22050
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.cpus = sorted(os.sched_getaffinity(0)) if hasattr(os, 'sched_getaffinity') else []
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def test_pools_account_cpu_time(self):
+        """Test that work placed in a pool is accounted to it and unknown pools are rejected"""
+        afe.define_cpu_pool("test_engine", cpus=self.cpus[:1])
+        afe.reset_cpu_pool_stats()
+
+        pool = afe.EnginePool(num_workers=2, thread_pool="test_engine")
+        audio = np.sin(2 * np.pi * 440.0 * np.arange(self.sample_rate * 5) / self.sample_rate).astype(np.float32)
+        result = pool.process(audio, self.sample_rate, 1)
+        self.assertTrue(result['success'])
+        del pool
+
+        stats = afe.cpu_pool_stats()['test_engine']
+        self.assertEqual(stats['threads_entered'], 2)
+        self.assertEqual(stats['active_threads'], 0)
+        self.assertEqual(stats['placement_failures'], 0)
+        self.assertGreater(stats['cpu_ms'], 0.0)
+        self.assertGreater(stats['utilisation'], 0.0)
+
+        with self.assertRaises(ValueError):
+            afe.EnginePool(num_workers=1, thread_pool="undefined_pool")
+        with self.assertRaises(ValueError):
+            afe.FingerprintIndex(os.path.join(self.temp_dir.name, "index")).set_thread_pools("undefined_pool")
+        with self.assertRaises(ValueError):
+            afe.define_cpu_pool("bad", nice=40)
+
+    def test_query_workers_enter_pool_once(self):
+        """Test that query scoring threads are placed in the query pool when they start, not per query"""
+        rng = np.random.default_rng(3)
+        index = afe.FingerprintIndex(os.path.join(self.temp_dir.name, "index"))
+        offsets = list(range(0, 300 * 40, 40))
+        catalog = {}
+        for song_id in range(50):
+            catalog[song_id] = [int(h) for h in rng.integers(1, 2**31, size=300)]
+            index.add_song(song_id, catalog[song_id], offsets)
+        index.flush()
+
+        afe.define_cpu_pool("test_query", cpus=self.cpus[:1])
+        index.set_thread_pools(query_pool="test_query")
+        index.set_query_threads(1)
+        afe.reset_cpu_pool_stats()
+
+        for n in range(20):
+            song_id = (n * 7) % len(catalog)
+            matches = index.query(catalog[song_id][100:200], offsets[100:200])
+            self.assertEqual(matches[0]['song_id'], song_id)
+
+        # One persistent worker scored every query; the callers never entered the pool
+        stats = afe.cpu_pool_stats()['test_query']
+        self.assertEqual(index.query_pool, "test_query")
+        self.assertEqual(stats['threads_entered'], 1)
+        self.assertEqual(stats['active_threads'], 1)
+        self.assertEqual(stats['placement_failures'], 0)
+
+        del index
+        self.assertEqual(afe.cpu_pool_stats()['test_query']['active_threads'], 0)
+
+
+class TestCorpusReader(unittest.TestCase):
+    """Test bulk ingest of reference files through the asynchronous corpus reader"""
+    
+    def setUp(self):
+        self.sample_rate = 22050
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.paths = []
+        self.signals = []
+        
+        for i, freq in enumerate([330.0, 523.25, 880.0]):
+            t = np.linspace(0, 3.0, int(self.sample_rate * 3.0), False)
+            signal = 0.5 * np.sin(2 * np.pi * freq * t) + 0.25 * np.sin(2 * np.pi * freq * 2.7 * t)
+            pcm = (signal * 32767).astype(np.int16)
+            
+            path = os.path.join(self.temp_dir.name, f"song_{i}.wav")
+            with wave.open(path, 'wb') as wav_file:
+                wav_file.setnchannels(1)
+                wav_file.setsampwidth(2)
+                wav_file.setframerate(self.sample_rate)
+                wav_file.writeframes(pcm.tobytes())
+            
+            self.paths.append(path)
+            self.signals.append(pcm.astype(np.float32) / 32768.0)
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def test_files_match_in_memory_fingerprinting(self):
+        """Test that fingerprints read from disk equal those from decoded arrays"""
+        song_ids = [f"song_{i}" for i in range(len(self.paths))]
+        output = afe.batch_process_files(self.paths, song_ids, compute_threads=2)
+        
+        for result, signal in zip(output['results'], self.signals):
+            direct = afe.generate_fingerprint(signal, self.sample_rate, 1)
+            self.assertTrue(result['success'], result['error_message'])
+            self.assertEqual(result['hash_values'], direct['hash_values'])
+            self.assertEqual(result['time_offsets'], direct['time_offsets'])
+        
+        self.assertEqual([r['song_id'] for r in output['results']], song_ids)
+    
+    def test_pread_fallback_reports_io_stats(self):
+        """Test that the pread backend reads everything and reports I/O accounting"""
+        output = afe.batch_process_files(self.paths, ["a", "b", "c"], use_io_uring=False)
+        stats = output['io_stats']
+        
+        self.assertEqual(stats['backend'], 'pread')
+        self.assertEqual(stats['files_read'], len(self.paths))
+        self.assertEqual(stats['bytes_read'], sum(os.path.getsize(p) for p in self.paths))
+        self.assertGreaterEqual(stats['io_wait_ms'], 0.0)
+        self.assertGreater(stats['compute_ms'], 0.0)
+    
+    def test_missing_and_unsupported_files_fail_individually(self):
+        """Test that unreadable or undecodable files do not abort the batch"""
+        bogus = os.path.join(self.temp_dir.name, "not_audio.wav")
+        with open(bogus, 'wb') as f:
+            f.write(b"definitely not a RIFF file")
+        missing = os.path.join(self.temp_dir.name, "missing.wav")
+        
+        output = afe.batch_process_files([self.paths[0], missing, bogus], ["ok", "missing", "bogus"])
+        results = output['results']
+        
+        self.assertTrue(results[0]['success'])
+        self.assertFalse(results[1]['success'])
+        self.assertFalse(results[2]['success'])
+        self.assertEqual(output['io_stats']['files_failed'], 1)
+
+
+class TestIndexReplication(unittest.TestCase):
+    """Test incremental segment shipping from a primary index to a read replica"""
+    
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.primary_dir = os.path.join(self.temp_dir.name, "primary")
+        self.replica_dir = os.path.join(self.temp_dir.name, "replica")
+        self.tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "index_replication.py")
+        self.rng = np.random.default_rng(7)
+        self.songs = {}
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def add_song(self, index, song_id):
+        hashes = [int(h) for h in self.rng.integers(1, 2**31, size=200)]
+        offsets = list(range(0, 200 * 50, 50))
+        index.add_song(song_id, hashes, offsets)
+        self.songs[song_id] = (hashes, offsets)
+    
+    def run_tool(self, *args):
+        completed = subprocess.run([sys.executable, self.tool, *args],
+                                   capture_output=True, text=True, check=True)
+        return json.loads(completed.stdout.strip().splitlines()[-1])
+    
+    def segment_files(self, directory):
+        return sorted(f for f in os.listdir(directory) if f.endswith(".afs"))
+    
+    def test_replica_serves_primary_snapshot(self):
+        """Test that a replicated directory opens and answers queries"""
+        primary = afe.FingerprintIndex(self.primary_dir)
+        self.add_song(primary, 11)
+        self.add_song(primary, 12)
+        primary.flush()
+        
+        report = self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        self.assertEqual(report['segments_copied'], 1)
+        self.assertEqual(report['replica_generation_after'], primary.get_manifest()['generation'])
+        
+        replica = afe.FingerprintIndex(self.replica_dir)
+        hashes, offsets = self.songs[12]
+        matches = replica.query(hashes[50:150], [o - offsets[50] for o in offsets[50:150]])
+        self.assertEqual(matches[0]['song_id'], 12)
+        self.assertEqual(matches[0]['time_offset_ms'], offsets[50])
+    
+    def test_only_new_segments_are_copied(self):
+        """Test that a second pass ships just the segment flushed since the first"""
+        primary = afe.FingerprintIndex(self.primary_dir)
+        self.add_song(primary, 1)
+        primary.flush()
+        self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        
+        self.add_song(primary, 2)
+        primary.flush()
+        report = self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        
+        newest = primary.get_manifest()['segments'][-1]
+        self.assertEqual(report['segments_copied'], 1)
+        self.assertEqual(report['bytes_copied'], newest['size_bytes'])
+        self.assertEqual(self.segment_files(self.replica_dir), self.segment_files(self.primary_dir))
+        
+        # Nothing changed on the primary: nothing to copy
+        report = self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        self.assertEqual(report['segments_copied'], 0)
+    
+    def test_merge_replaces_replica_segments(self):
+        """Test that compaction on the primary is mirrored and old segments removed"""
+        primary = afe.FingerprintIndex(self.primary_dir)
+        for song_id in (1, 2, 3):
+            self.add_song(primary, song_id)
+            primary.flush()
+        self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        self.assertEqual(len(self.segment_files(self.replica_dir)), 3)
+        
+        primary.merge_segments()
+        report = self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        
+        self.assertEqual(report['segments_copied'], 1)
+        self.assertEqual(report['segments_removed'], 3)
+        self.assertEqual(self.segment_files(self.replica_dir), self.segment_files(self.primary_dir))
+        
+        replica = afe.FingerprintIndex(self.replica_dir)
+        self.assertEqual(replica.get_stats()['segment_songs'], 3)
+    
+    def test_status_reports_lag(self):
+        """Test that status reports generations and time behind the primary"""
+        primary = afe.FingerprintIndex(self.primary_dir)
+        self.add_song(primary, 1)
+        primary.flush()
+        self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        
+        time.sleep(0.01)
+        self.add_song(primary, 2)
+        primary.flush()
+        
+        status = self.run_tool("status", self.primary_dir, self.replica_dir)
+        self.assertEqual(status['generations_behind'], 1)
+        self.assertEqual(status['missing_segments'], 1)
+        self.assertGreater(status['lag_ms'], 0)
+        
+        self.run_tool("replicate", self.primary_dir, self.replica_dir)
+        status = self.run_tool("status", self.primary_dir, self.replica_dir)
+        self.assertEqual(status['generations_behind'], 0)
+        self.assertEqual(status['lag_ms'], 0)
+
+
+class TestDurableIngest(unittest.TestCase):
+    """Test the write-ahead log behind durable live ingest"""
+    
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.index_dir = os.path.join(self.temp_dir.name, "index")
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def song(self, song_id, count=200):
+        rng = np.random.default_rng(song_id)
+        hashes = [int(h) for h in rng.integers(1, 2**31, size=count)]
+        return hashes, list(range(0, count * 50, 50))
+    
+    def test_unflushed_songs_survive_crash(self):
+        """Test that songs acknowledged before a crash are replayed on open"""
+        script = (
+            "import os, sys\n"
+            f"sys.path.insert(0, {os.path.dirname(os.path.abspath(__file__))!r})\n"
+            "import numpy as np\n"
+            "import audio_fingerprint_engine as afe\n"
+            f"index = afe.FingerprintIndex({self.index_dir!r}, durable_ingest=True)\n"
+            "for song_id in range(1, 7):\n"
+            "    rng = np.random.default_rng(song_id)\n"
+            "    hashes = [int(h) for h in rng.integers(1, 2**31, size=200)]\n"
+            "    index.add_song(song_id, hashes, list(range(0, 200 * 50, 50)))\n"
+            "    if song_id == 3:\n"
+            "        index.flush()\n"
+            "os._exit(0)\n"
+        )
+        subprocess.run([sys.executable, "-c", script], check=True)
+        
+        index = afe.FingerprintIndex(self.index_dir, durable_ingest=True)
+        stats = index.get_stats()
+        
+        self.assertEqual(stats['segment_songs'], 3)
+        self.assertEqual(stats['mutable_songs'], 3)
+        self.assertEqual(stats['wal_replayed'], 3)
+        
+        hashes, offsets = self.song(5)
+        matches = index.query(hashes[:100], offsets[:100])
+        self.assertEqual(matches[0]['song_id'], 5)
+    
+    def test_flush_truncates_log(self):
+        """Test that flushed songs are dropped from the log and not replayed twice"""
+        index = afe.FingerprintIndex(self.index_dir, durable_ingest=True)
+        for song_id in (1, 2):
+            index.add_song(song_id, *self.song(song_id))
+        self.assertGreater(index.get_stats()['wal_bytes'], 2 * 200 * 8)
+        
+        index.flush()
+        self.assertLess(index.get_stats()['wal_bytes'], 200 * 8)
+        del index
+        
+        reopened = afe.FingerprintIndex(self.index_dir, durable_ingest=True)
+        stats = reopened.get_stats()
+        self.assertEqual(stats['wal_replayed'], 0)
+        self.assertEqual(stats['mutable_songs'], 0)
+        self.assertEqual(stats['segment_postings'], 2 * 200)
+    
+    def test_concurrent_writers_replay_after_reopen(self):
+        """Test that songs group-committed by concurrent writers are all replayed on reopen"""
+        threads, songs_per_thread = 4, 10
+        total = threads * songs_per_thread
+        index = afe.FingerprintIndex(self.index_dir, durable_ingest=True, commit_window_us=2000)
+        
+        def ingest(worker):
+            for i in range(songs_per_thread):
+                song_id = worker * songs_per_thread + i + 1
+                index.add_song(song_id, *self.song(song_id))
+        
+        workers = [threading.Thread(target=ingest, args=(w,)) for w in range(threads)]
+        for worker in workers:
+            worker.start()
+        for worker in workers:
+            worker.join()
+        
+        stats = index.get_stats()
+        self.assertEqual(stats['wal_records'], total)
+        self.assertLessEqual(stats['wal_syncs'], total)
+        del index
+        
+        reopened = afe.FingerprintIndex(self.index_dir, durable_ingest=True)
+        stats = reopened.get_stats()
+        self.assertEqual(stats['wal_replayed'], total)
+        self.assertEqual(stats['mutable_songs'], total)
+        for song_id in (1, songs_per_thread + 1, total):
+            hashes, offsets = self.song(song_id)
+            self.assertEqual(reopened.query(hashes[:100], offsets[:100])[0]['song_id'], song_id)
+
+
+class TestSongTable(unittest.TestCase):
+    """Test song metadata carried in index segments"""
+    
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.index_dir = os.path.join(self.temp_dir.name, "index")
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def song(self, song_id, count=200):
+        rng = np.random.default_rng(song_id)
+        hashes = [int(h) for h in rng.integers(1, 2**31, size=count)]
+        return hashes, list(range(0, count * 50, 50))
+    
+    def test_matches_carry_metadata_through_flush_and_merge(self):
+        """Test that query results are complete match records at every stage"""
+        index = afe.FingerprintIndex(self.index_dir, durable_ingest=True)
+        index.add_song(1, *self.song(1), title="First", artist="Band", album="LP", duration_ms=180000)
+        index.add_song(2, *self.song(2))
+        
+        hashes, offsets = self.song(1)
+        self.assertEqual(index.query(hashes[:100], offsets[:100])[0]['title'], "First")
+        del index
+        
+        # Replayed from the write-ahead log
+        index = afe.FingerprintIndex(self.index_dir, durable_ingest=True)
+        self.assertEqual(index.lookup_song(1)['duration_ms'], 180000)
+        index.flush()
+        index.add_song(3, *self.song(3), title="Third", artist="Band", album="LP", duration_ms=200000)
+        index.flush()
+        index.merge_segments()
+        del index
+        
+        index = afe.FingerprintIndex(self.index_dir)
+        match = index.query(*[column[:100] for column in self.song(3)])[0]
+        self.assertEqual((match['song_id'], match['title'], match['artist'], match['album'], match['duration_ms']),
+                         (3, "Third", "Band", "LP", 200000))
+        self.assertEqual(index.lookup_song(1)['title'], "First")
+        
+        # Songs added without metadata match as before
+        match = index.query(*[column[:100] for column in self.song(2)])[0]
+        self.assertEqual(match['song_id'], 2)
+        self.assertNotIn('title', match)
+        self.assertIsNone(index.lookup_song(2))
+    
+    def test_segments_without_metadata_keep_version_1(self):
+        """Test that only segments carrying a song table are written in the new format"""
+        def versions():
+            names = sorted(f for f in os.listdir(self.index_dir) if f.endswith(".afs"))
+            result = []
+            for name in names:
+                with open(os.path.join(self.index_dir, name), "rb") as f:
+                    header = f.read(16)
+                result.append(struct.unpack('<II', header[8:16]))
+            return result
+        
+        index = afe.FingerprintIndex(self.index_dir)
+        index.add_song(1, *self.song(1))
+        index.flush()
+        self.assertEqual(versions(), [(1, 0)])
+        
+        index.add_song(2, *self.song(2), title="Second", artist="Band")
+        index.flush()
+        self.assertEqual(versions(), [(1, 0), (2, 1)])
+
+
+class TestSongReordering(unittest.TestCase):
+    """Test renumbering songs by hash co-occurrence"""
+    
+    def test_reordering_shrinks_postings_and_keeps_matches(self):
+        """Test that reordered segments code smaller and answer queries alike"""
+        groups, songs = 20, 600
+        song_ids = np.random.default_rng(0).permutation(songs) + 1000
+        catalog = {}
+        for i, song_id in enumerate(song_ids):
+            rng = np.random.default_rng(i)
+            shared = (i % groups) * 100000 + rng.integers(0, 2000, size=180)
+            unique = rng.integers(2**31, 2**32, size=120)
+            catalog[int(song_id)] = [int(h) for h in np.concatenate([shared, unique])]
+        offsets = list(range(0, 300 * 40, 40))
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            for n, (song_id, hashes) in enumerate(catalog.items()):
+                index.add_song(song_id, hashes, offsets, title=f"Song {song_id}")
+                if n % 200 == 199:
+                    index.flush()
+            
+            probes = list(catalog)[::37]
+            expected = [index.query(catalog[song_id][100:200], offsets[100:200]) for song_id in probes]
+            
+            report = index.reorder_songs()
+            self.assertEqual(report['songs'], songs)
+            self.assertLess(report['after']['id_bytes_per_posting'], report['before']['id_bytes_per_posting'])
+            self.assertEqual(index.get_stats()['segment_count'], 1)
+            
+            # Compaction keeps the order and numbers new songs after it
+            rng = np.random.default_rng(songs)
+            extra = [int(h) for h in rng.integers(2**31, 2**32, size=300)]
+            index.add_song(9999, extra, offsets)
+            index.flush()
+            index.merge_segments()
+            again = index.reorder_songs()
+            self.assertEqual(again['songs'], songs + 1)
+            self.assertLess(again['before']['id_bytes_per_posting'], report['before']['id_bytes_per_posting'])
+            self.assertEqual(index.query(extra[100:200], offsets[100:200])[0]['song_id'], 9999)
+            
+            reopened = afe.FingerprintIndex(temp_dir)
+            for song_id, matches in zip(probes, expected):
+                reordered = reopened.query(catalog[song_id][100:200], offsets[100:200])
+                self.assertEqual(reordered, matches)
+                self.assertEqual(reordered[0]['song_id'], song_id)
+                self.assertEqual(reordered[0]['title'], f"Song {song_id}")
+
+
+class TestDistributedIngest(unittest.TestCase):
+    """Test bulk ingest by worker processes leasing chunks of a file manifest"""
+
+    sample_rate = 22050
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "distributed_ingest.py")
+        self.manifest = os.path.join(self.temp_dir.name, "files.jsonl")
+        self.signals = {}
+
+        with open(self.manifest, "w") as f:
+            for song_id in range(100, 109):
+                rng = np.random.default_rng(song_id)
+                t = np.arange(int(self.sample_rate * 2.0)) / self.sample_rate
+                signal = sum(0.3 * np.sin(2 * np.pi * freq * t) for freq in rng.uniform(200, 3000, size=3))
+                pcm = (signal / 1.5 * 32767).astype(np.int16)
+
+                path = os.path.join(self.temp_dir.name, f"song_{song_id}.wav")
+                with wave.open(path, 'wb') as wav_file:
+                    wav_file.setnchannels(1)
+                    wav_file.setsampwidth(2)
+                    wav_file.setframerate(self.sample_rate)
+                    wav_file.writeframes(pcm.tobytes())
+                self.signals[song_id] = pcm.astype(np.float32) / 32768.0
+                f.write(json.dumps({"song_id": song_id, "path": path, "title": f"Song {song_id}"}) + "\n")
+            f.write(json.dumps({"song_id": 109, "path": os.path.join(self.temp_dir.name, "missing.wav")}) + "\n")
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def run_tool(self, *args, check=True):
+        completed = subprocess.run([sys.executable, self.tool, *args], capture_output=True, text=True)
+        if check:
+            self.assertEqual(completed.returncode, 0, completed.stderr)
+        return json.loads(completed.stdout.strip().splitlines()[-1])
+
+    def stale_lease(self, job_dir, chunk):
+        """Lease left behind by a worker that died an hour ago"""
+        path = os.path.join(job_dir, "leases", f"chunk_{chunk:06d}.1")
+        with open(path, "w") as f:
+            f.write('{"worker": "crashed"}')
+        os.utime(path, (time.time() - 3600, time.time() - 3600))
+
+    def ingest(self, name, chunk_size, workers):
+        job_dir = os.path.join(self.temp_dir.name, f"job_{name}")
+        index_dir = os.path.join(self.temp_dir.name, f"index_{name}")
+        self.run_tool("plan", self.manifest, job_dir, "--chunk-size", str(chunk_size), "--lease-seconds", "30")
+        self.stale_lease(job_dir, 1)
+
+        status = self.run_tool("run", job_dir, "--workers", str(workers))
+        self.assertEqual(status['done'], status['chunks'])
+        self.assertEqual(status['retried_chunks'], 1)
+        self.assertTrue(os.path.exists(os.path.join(job_dir, "leases", "chunk_000001.2")))
+
+        report = self.run_tool("collect", job_dir, index_dir)
+        with open(os.path.join(index_dir, report['segment_file']), "rb") as f:
+            return report, index_dir, f.read()
+
+    def test_workers_retry_and_merge_deterministically(self):
+        """Test that a dead worker's chunk is retried and the merged index does not depend on the workers"""
+        report, index_dir, segment = self.ingest("three_workers", chunk_size=2, workers=3)
+        self.assertEqual(report['chunks'], 5)
+        self.assertEqual(report['songs'], 9)
+        self.assertEqual([f['song_id'] for f in report['failed_files']], [109])
+
+        index = afe.FingerprintIndex(index_dir)
+        self.assertEqual(index.get_stats()['segment_count'], 1)
+        for song_id in (100, 103, 108):
+            clip = self.signals[song_id][self.sample_rate // 2:]
+            fingerprint = afe.generate_fingerprint(clip, self.sample_rate, 1)
+            match = index.query(fingerprint['hash_values'], fingerprint['time_offsets'])[0]
+            self.assertEqual(match['song_id'], song_id)
+            self.assertEqual(match['title'], f"Song {song_id}")
+
+        other_report, _, other_segment = self.ingest("one_worker", chunk_size=3, workers=1)
+        self.assertEqual(other_report['segment_crc32'], report['segment_crc32'])
+        self.assertEqual(other_segment, segment)
+
+    def test_chunk_fails_after_max_attempts(self):
+        """Test that a chunk whose attempts are used up fails the job instead of looping"""
+        job_dir = os.path.join(self.temp_dir.name, "job")
+        self.run_tool("plan", self.manifest, job_dir, "--chunk-size", "5", "--max-attempts", "1")
+        self.stale_lease(job_dir, 0)
+
+        status = self.run_tool("run", job_dir, "--workers", "2", check=False)
+        self.assertEqual((status['done'], status['failed']), (1, 1))
+
+        completed = subprocess.run([sys.executable, self.tool, "collect", job_dir,
+                                    os.path.join(self.temp_dir.name, "index")],
+                                   capture_output=True, text=True)
+        self.assertNotEqual(completed.returncode, 0)
+        self.assertIn("not complete", completed.stderr)
+
+
+class TestFingerprintPruning(unittest.TestCase):
+    """Test discriminativeness pruning and its effect on index size and recall"""
+    
+    sample_rate = 22050
+    
+    @staticmethod
+    def synthetic_song(seed, duration=15.0, sample_rate=22050):
+        """Sequence of decaying chords with random pitches and lengths"""
+        rng = np.random.default_rng(seed)
+        audio = np.zeros(int(duration * sample_rate), dtype=np.float32)
+        start = 0.0
+        while start < duration:
+            note_length = 0.15 + 0.3 * rng.random()
+            begin = int(start * sample_rate)
+            end = min(len(audio), int((start + note_length) * sample_rate))
+            t = np.arange(end - begin) / sample_rate
+            for _ in range(rng.integers(2, 5)):
+                freq = 120.0 * 2 ** (5 * rng.random())
+                audio[begin:end] += (0.2 + 0.3 * rng.random()) * np.exp(-3 * t) * np.sin(2 * np.pi * freq * t)
+            start += note_length
+        return audio
+    
+    def test_redundant_repeats_are_pruned_first(self):
+        """Test that a hash repeated within the window loses to distinct hashes"""
+        pruner = afe.FingerprintPruner(keep_fraction=0.625, min_per_second=0)
+        song = {
+            'hash_values': [7, 7, 7, 7, 11, 12, 13, 14],
+            'time_offsets': [0, 100, 200, 300, 400, 500, 600, 700],
+            'peak_strengths': [1.0] * 8,
+        }
+        pruner.count_postings(song)
+        
+        kept = pruner.prune(song)
+        
+        self.assertEqual(kept['hash_values'], [7, 11, 12, 13, 14])
+        self.assertAlmostEqual(pruner.get_stats()['shrink_factor'], 1.6)
+    
+    def test_common_hashes_are_pruned_first(self):
+        """Test that hashes with long posting lists across the catalog are dropped"""
+        pruner = afe.FingerprintPruner(keep_fraction=0.5, min_per_second=0, strength_weight=0.0)
+        for other_song in range(20):
+            pruner.count_postings({'hash_values': [99, 98], 'time_offsets': [0, 50]})
+        song = {'hash_values': [99, 1, 98, 2], 'time_offsets': [0, 10, 20, 30]}
+        pruner.count_postings(song)
+        
+        kept = pruner.prune(song)
+        
+        self.assertEqual(sorted(kept['hash_values']), [1, 2])
+        self.assertEqual(pruner.posting_count(99), 21)
+    
+    def test_pruned_index_shrinks_without_losing_recall(self):
+        """Test that keeping 30% of fingerprints shrinks a 12-song index 3.3x and keeps recall@1 at 0 dB SNR"""
+        songs = [self.synthetic_song(seed) for seed in range(1, 13)]
+        fingerprints = [afe.generate_fingerprint(song, self.sample_rate, 1) for song in songs]
+        
+        pruner = afe.FingerprintPruner()
+        for fp in fingerprints:
+            pruner.count_postings(fp)
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            full = afe.FingerprintIndex(os.path.join(temp_dir, "full"))
+            pruned = afe.FingerprintIndex(os.path.join(temp_dir, "pruned"))
+            for song_id, fp in enumerate(fingerprints, 1):
+                full.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                kept = pruner.prune(fp)
+                pruned.add_song(song_id, kept['hash_values'], kept['time_offsets'])
+            
+            rng = np.random.default_rng(42)
+            hits = {'full': 0, 'pruned': 0}
+            queries = 0
+            for song_id, song in enumerate(songs, 1):
+                for start_s in (2.0, 8.5):
+                    excerpt = song[int(start_s * self.sample_rate):int((start_s + 5.0) * self.sample_rate)]
+                    noise = rng.normal(0, np.sqrt(np.mean(excerpt ** 2)), len(excerpt))  # 0 dB SNR
+                    query = afe.generate_fingerprint((excerpt + noise).astype(np.float32), self.sample_rate, 1)
+                    queries += 1
+                    
+                    for name, index in (('full', full), ('pruned', pruned)):
+                        matches = index.query(query['hash_values'], query['time_offsets'], 1, 1)
+                        hits[name] += bool(matches) and matches[0]['song_id'] == song_id
+            
+            shrink = full.get_stats()['mutable_postings'] / pruned.get_stats()['mutable_postings']
+            self.assertAlmostEqual(shrink, 1 / 0.3, delta=0.3)
+            self.assertGreaterEqual(hits['full'] / queries, 0.9)
+            self.assertGreaterEqual(hits['pruned'], hits['full'])
+
+
+class TestFingerprintProfiles(unittest.TestCase):
+    """Test asymmetric reference/query profiles and their compatibility checks"""
+    
+    sample_rate = 22050
+    
+    def test_reference_is_sparser_than_query(self):
+        """Test that both profiles hash alike but differ in density"""
+        song = TestFingerprintPruning.synthetic_song(1)
+        profiles = afe.ProfileSet()
+        
+        symmetric = afe.generate_fingerprint(song, self.sample_rate, 1)
+        reference = afe.generate_fingerprint(song, self.sample_rate, 1, profiles.reference)
+        query = afe.generate_fingerprint(song, self.sample_rate, 1, profiles.query)
+        
+        self.assertLess(reference['count'], query['count'])
+        self.assertLessEqual(query['count'], symmetric['count'])
+        self.assertTrue(set(reference['hash_values']) <= set(query['hash_values']))
+        self.assertEqual(profiles.reference.hash_signature(), profiles.query.hash_signature())
+        self.assertTrue(afe.profiles_compatible(profiles.reference, profiles.query))
+    
+    def test_profile_set_round_trip(self):
+        """Test serialization and rejection of sets whose profiles hash differently"""
+        profiles = afe.ProfileSet()
+        profiles.version = 3
+        profiles.query.max_pairs_per_anchor = 30
+        
+        parsed = afe.ProfileSet.parse(profiles.serialize())
+        self.assertEqual(parsed.id(), "default/3")
+        self.assertEqual(parsed.query.max_pairs_per_anchor, 30)
+        self.assertEqual(parsed.reference.max_pairs_per_anchor, profiles.reference.max_pairs_per_anchor)
+        
+        profiles.query.freq_quantization = 20.0
+        self.assertFalse(afe.profiles_compatible(profiles.reference, profiles.query))
+        with self.assertRaises(ValueError):
+            profiles.validate()
+        with self.assertRaises(ValueError):
+            afe.ProfileSet.parse(profiles.serialize())
+    
+    def test_index_records_profiles(self):
+        """Test that an index remembers its reference hashes and rejects mismatches"""
+        profiles = afe.ProfileSet()
+        other = afe.ProfileSet()
+        other.name = "coarse"
+        other.reference.time_quantization = 100
+        other.query.time_quantization = 100
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            index.bind_profiles(profiles)
+            index.add_song(1, [1, 2, 3], [0, 100, 200])
+            index.flush()
+            
+            manifest = index.get_manifest()
+            self.assertEqual(manifest['profile_set'], "default/1")
+            self.assertEqual(manifest['hash_signature'], profiles.reference.hash_signature())
+            
+            reopened = afe.FingerprintIndex(temp_dir)
+            reopened.check_query_profile(profiles.query)
+            with self.assertRaises(ValueError):
+                reopened.check_query_profile(other.query)
+            with self.assertRaises(RuntimeError):
+                reopened.bind_profiles(other)
+    
+    def test_dense_queries_recover_votes_on_sparse_index(self):
+        """Test that query-profile queries align more votes than reference-profile ones at -6 dB SNR"""
+        profiles = afe.ProfileSet()
+        songs = [TestFingerprintPruning.synthetic_song(seed) for seed in range(1, 5)]
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            index.bind_profiles(profiles)
+            for song_id, song in enumerate(songs, 1):
+                fp = afe.generate_fingerprint(song, self.sample_rate, 1, profiles.reference)
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+            
+            rng = np.random.default_rng(7)
+            for song_id, song in enumerate(songs, 1):
+                excerpt = song[2 * self.sample_rate:7 * self.sample_rate]
+                noise = rng.normal(0, 2.0 * np.sqrt(np.mean(excerpt ** 2)), len(excerpt))  # -6 dB SNR
+                noisy = (excerpt + noise).astype(np.float32)
+                
+                votes = {}
+                for name in ('reference', 'query'):
+                    query = afe.generate_fingerprint(noisy, self.sample_rate, 1, getattr(profiles, name))
+                    matches = index.query(query['hash_values'], query['time_offsets'], len(songs), 1)
+                    votes[name] = next((m['match_count'] for m in matches if m['song_id'] == song_id), 0)
+                    if name == 'query':
+                        self.assertEqual(matches[0]['song_id'], song_id)
+                self.assertGreater(votes['query'], votes['reference'])
+
+
+class TestLandmarkTriplets(unittest.TestCase):
+    """Test three-peak landmark hashes against pair hashes"""
+    
+    sample_rate = 22050
+    
+    def test_triplet_profiles(self):
+        """Test that triplet profiles hash differently from pairs and need a fan-out"""
+        pairs = afe.ProfileSet()
+        triplets = afe.ProfileSet.triplets()
+        triplets.validate()
+        
+        self.assertEqual(triplets.reference.landmark_size, 3)
+        self.assertTrue(triplets.reference.hash_signature().endswith("-lm3"))
+        self.assertFalse(afe.profiles_compatible(pairs.reference, triplets.query))
+        self.assertEqual(afe.ProfileSet.parse(triplets.serialize()).query.landmark_size, 3)
+        
+        triplets.query.max_pairs_per_anchor = 0
+        with self.assertRaises(ValueError):
+            triplets.query.validate()
+        triplets.query.landmark_size = 4
+        with self.assertRaises(ValueError):
+            triplets.query.validate()
+    
+    def test_triplets_shorten_postings_without_losing_recall(self):
+        """Test that triplet queries scan fewer postings than pair queries and still find their songs"""
+        songs = [TestFingerprintPruning.synthetic_song(seed) for seed in range(1, 5)]
+        profile_sets = {'pairs': afe.ProfileSet(), 'triplets': afe.ProfileSet.triplets()}
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            scanned = {}
+            for name, profiles in profile_sets.items():
+                index = afe.FingerprintIndex(os.path.join(temp_dir, name))
+                postings = {}
+                for song_id, song in enumerate(songs, 1):
+                    fp = afe.generate_fingerprint(song, self.sample_rate, 1, profiles.reference)
+                    index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                    for h in fp['hash_values']:
+                        postings.setdefault(h, set()).add(song_id)
+                
+                rng = np.random.default_rng(3)
+                scanned[name] = 0
+                for song_id, song in enumerate(songs, 1):
+                    excerpt = song[2 * self.sample_rate:7 * self.sample_rate]
+                    noise = rng.normal(0, np.sqrt(np.mean(excerpt ** 2)), len(excerpt))  # 0 dB SNR
+                    query = afe.generate_fingerprint((excerpt + noise).astype(np.float32), self.sample_rate, 1,
+                                                     profiles.query)
+                    scanned[name] += sum(len(postings.get(h, ())) for h in query['hash_values'])
+                    
+                    matches = index.query(query['hash_values'], query['time_offsets'], 1, 1)
+                    self.assertEqual(matches[0]['song_id'], song_id)
+            
+            self.assertLess(scanned['triplets'] * 2, scanned['pairs'])
+
+
+class TestTieredQuery(unittest.TestCase):
+    """Test sparse-first query processing with dense escalation"""
+    
+    sample_rate = 22050
+    
+    def test_sparse_pass_must_hash_like_dense(self):
+        """Test that a sparse profile with different hashing is rejected"""
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            sparse = afe.sparse_profile(afe.FingerprintProfile.query())
+            self.assertEqual(sparse.hash_signature(), afe.FingerprintProfile.query().hash_signature())
+            self.assertEqual(sparse.max_pairs_per_anchor, 3)
+            
+            sparse.freq_quantization = 20.0
+            with self.assertRaises(ValueError):
+                afe.TieredQueryProcessor(index, sparse=sparse)
+            with self.assertRaises(ValueError):
+                afe.TieredQueryProcessor(index, min_margin=1.5)
+    
+    def test_escalates_only_ambiguous_queries(self):
+        """Test that clean queries stop after the sparse pass and very noisy ones escalate"""
+        songs = [TestFingerprintPruning.synthetic_song(seed) for seed in range(1, 5)]
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            for song_id, song in enumerate(songs, 1):
+                fp = afe.generate_fingerprint(song, self.sample_rate, 1, afe.FingerprintProfile.reference())
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+            
+            tiered = afe.TieredQueryProcessor(index)
+            rng = np.random.default_rng(9)
+            for song_id, song in enumerate(songs, 1):
+                excerpt = song[2 * self.sample_rate:7 * self.sample_rate]
+                noise = rng.normal(0, 6.0 * np.sqrt(np.mean(excerpt ** 2)), len(excerpt))  # -16 dB SNR
+                for clip, escalated in ((excerpt, False), ((excerpt + noise).astype(np.float32), True)):
+                    result = tiered.identify(clip, self.sample_rate)
+                    self.assertEqual(result['escalated'], escalated)
+                    self.assertEqual(result['matches'][0]['song_id'], song_id)
+            
+            stats = tiered.get_stats()
+            self.assertEqual(stats['queries'], 2 * len(songs))
+            self.assertEqual(stats['escalated'], len(songs))
+            self.assertGreater(stats['estimated_saved_ms'], 0.0)
+
+
+class TestQueryPhases(unittest.TestCase):
+    """Test sub-hop phase analysis of queries against a coarse-hop reference"""
+    
+    sample_rate = 22050
+    
+    def test_phases_extend_single_pass(self):
+        """Test that later phases append to the unshifted analysis and hash alike"""
+        profile = afe.FingerprintProfile.coarse_query()
+        self.assertEqual(profile.analysis_phases, 2)
+        self.assertTrue(afe.profiles_compatible(afe.FingerprintProfile.coarse_reference(), profile))
+        afe.ProfileSet.coarse().validate()
+        
+        for invalid in (0, profile.hop_size + 1):
+            profile.analysis_phases = invalid
+            with self.assertRaises(ValueError):
+                profile.validate()
+        
+        clip = TestFingerprintPruning.synthetic_song(3, duration=5.0)
+        single = afe.FingerprintProfile.coarse_query()
+        single.analysis_phases = 1
+        one = afe.generate_fingerprint(clip, self.sample_rate, 1, single)
+        two = afe.generate_fingerprint(clip, self.sample_rate, 1, afe.FingerprintProfile.coarse_query())
+        
+        count = len(one['hash_values'])
+        self.assertGreater(len(two['hash_values']), count)
+        self.assertEqual(two['hash_values'][:count], one['hash_values'])
+        self.assertEqual(two['time_offsets'][:count], one['time_offsets'])
+    
+    def test_coarse_reference_recall(self):
+        """Test that a second query phase aligns more votes against a coarse reference off its frame grid"""
+        songs = [TestFingerprintPruning.synthetic_song(seed) for seed in range(1, 5)]
+        
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            for song_id, song in enumerate(songs, 1):
+                fp = afe.generate_fingerprint(song, self.sample_rate, 1, afe.FingerprintProfile.coarse_reference())
+                index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+            
+            rng = np.random.default_rng(13)
+            for song_id, song in enumerate(songs, 1):
+                start = 2 * self.sample_rate + 2048  # Half a coarse hop off the frame grid
+                excerpt = song[start:start + 5 * self.sample_rate]
+                noise = rng.normal(0, np.sqrt(np.mean(excerpt ** 2)), len(excerpt))  # 0 dB SNR
+                clip = (excerpt + noise).astype(np.float32)
+                
+                votes = {}
+                for phases in (1, 2):
+                    query = afe.FingerprintProfile.coarse_query()
+                    query.analysis_phases = phases
+                    fp = afe.generate_fingerprint(clip, self.sample_rate, 1, query)
+                    matches = index.query(fp['hash_values'], fp['time_offsets'], 5, 5)
+                    self.assertEqual(matches[0]['song_id'], song_id)
+                    votes[phases] = matches[0]['match_count']
+                self.assertGreater(votes[2], votes[1])
+
+
+class TestPeakInterpolation(unittest.TestCase):
+    """Test sub-bin peak interpolation and the 1024-point fine profile set"""
+    
+    sample_rate = 11025
+    
+    @classmethod
+    def tone_bursts(cls, frequency, duration=2.0, period=0.25):
+        """Gaussian tone bursts centred every period seconds"""
+        t = np.arange(int(duration * cls.sample_rate)) / cls.sample_rate
+        phase = np.mod(t, period) - period / 2
+        return (0.5 * np.sin(2 * np.pi * frequency * t) * np.exp(-phase ** 2 / 0.002)).astype(np.float32)
+    
+    def test_interpolated_peaks_between_bins(self):
+        """Test that interpolation locates a tone between bins and a burst between frames"""
+        frequency, period = 2503.7, 0.25
+        spectrogram = afe.compute_spectrogram(self.tone_bursts(frequency, period=period), 1024, 512)
+        
+        grid = afe.PeakDetector()
+        self.assertFalse(grid.frequency_interpolation() or grid.time_interpolation())
+        interpolated = afe.PeakDetector()
+        interpolated.set_frequency_interpolation(True)
+        interpolated.set_time_interpolation(True)
+        
+        grid_peaks = grid.detect_peaks(spectrogram)
+        peaks = interpolated.detect_peaks(spectrogram)
+        self.assertGreater(len(peaks), 0)
+        self.assertEqual([(p.time_frame, p.frequency_bin) for p in peaks],
+                         [(p.time_frame, p.frequency_bin) for p in grid_peaks])
+        
+        # Frame times are window starts; a burst peaks half a window later
+        def time_error(peak):
+            start = np.mod(peak.time_seconds + 512 / self.sample_rate, period) - period / 2
+            return abs(start)
+        
+        self.assertGreater(max(abs(p.frequency_hz - frequency) for p in grid_peaks), 1.0)
+        self.assertLess(max(abs(p.frequency_hz - frequency) for p in peaks), 0.5)
+        self.assertLess(np.mean([time_error(p) for p in peaks]),
+                        np.mean([time_error(p) for p in grid_peaks]))
+    
+    def test_interpolation_changes_hashes(self):
+        """Test that interpolation is part of the hash signature and the profile file"""
+        profiles = afe.ProfileSet.fine()
+        profiles.validate()
+        self.assertEqual(profiles.reference.fft_size, 1024)
+        self.assertTrue(profiles.reference.hash_signature().endswith("-it"))
+        self.assertFalse(afe.profiles_compatible(afe.FingerprintProfile.reference(), profiles.query))
+        
+        profiles.reference.interpolate_frequency = True
+        self.assertFalse(afe.profiles_compatible(profiles.reference, profiles.query))
+        profiles.query.interpolate_frequency = True
+        parsed = afe.ProfileSet.parse(profiles.serialize())
+        self.assertEqual(parsed.query.hash_signature(), profiles.query.hash_signature())
+        self.assertTrue(parsed.query.interpolate_frequency and parsed.query.interpolate_time)
+        
+        clip = TestFingerprintPruning.synthetic_song(5, duration=5.0)
+        plain = afe.FingerprintProfile.fine_query()
+        plain.interpolate_time = False
+        self.assertNotEqual(afe.generate_fingerprint(clip, 22050, 1, plain)['time_offsets'],
+                            afe.generate_fingerprint(clip, 22050, 1, afe.FingerprintProfile.fine_query())['time_offsets'])
+    
+    def test_fine_profile_recall(self):
+        """Test that the fine set hashes off-grid excerpts more stably than 2048-point analysis"""
+        sample_rate = 22050
+        songs = [TestFingerprintPruning.synthetic_song(seed) for seed in range(1, 5)]
+        starts = (2 * sample_rate + 700, 4 * sample_rate + 1900)  # Off the frame grid
+        
+        stability = {}
+        for name, profiles in (('baseline', afe.ProfileSet()), ('fine', afe.ProfileSet.fine())):
+            with tempfile.TemporaryDirectory() as temp_dir:
+                index = afe.FingerprintIndex(temp_dir)
+                shares = []
+                for song_id, song in enumerate(songs, 1):
+                    fp = afe.generate_fingerprint(song, sample_rate, 1, profiles.reference)
+                    index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                    song_hashes = set(fp['hash_values'])
+                    for start in starts:
+                        excerpt = song[start:start + 2 * sample_rate]
+                        # Share of the excerpt's hashes that the song has
+                        hashes = afe.generate_fingerprint(excerpt, sample_rate, 1, profiles.reference)['hash_values']
+                        shares.append(np.mean([h in song_hashes for h in hashes]))
+                        if name == 'fine':
+                            query = afe.generate_fingerprint(excerpt, sample_rate, 1, profiles.query)
+                            matches = index.query(query['hash_values'], query['time_offsets'], 5, 5)
+                            self.assertEqual(matches[0]['song_id'], song_id)
+                stability[name] = np.mean(shares)
+        
+        self.assertGreater(stability['fine'], stability['baseline'])
+
+
+class TestNativeRateAnalysis(unittest.TestCase):
+    """Test STFT analysis at the input sample rate without resampling"""
+    
+    def test_native_spectrogram_matches_analysis_grid(self):
+        """Test that a native-rate spectrogram has the 11.025 kHz bin grid and level"""
+        for sample_rate in (44100, 48000):
+            t = np.arange(3 * sample_rate) / sample_rate
+            tone = (0.5 * np.sin(2 * np.pi * 3000.0 * t)).astype(np.float32)
+            
+            resampled = afe.preprocess_audio(tone, sample_rate, 1)
+            expected = afe.compute_spectrogram(resampled['data'])
+            native = afe.compute_spectrogram(tone, sample_rate=sample_rate)
+            
+            self.assertEqual(native['frequency_bins'], expected['frequency_bins'])
+            self.assertAlmostEqual(native['freq_resolution'], expected['freq_resolution'], places=4)
+            self.assertAlmostEqual(native['time_resolution'], expected['time_resolution'], places=4)
+            self.assertEqual(int(np.argmax(native['data'][10])), int(np.argmax(expected['data'][10])))
+            self.assertAlmostEqual(native['data'][10].max() / expected['data'][10].max(), 1.0, delta=0.1)
+    
+    def test_native_queries_match_resampled_index(self):
+        """Test that native-rate queries find their songs in an index built from resampled audio"""
+        native_profile = afe.FingerprintProfile.query()
+        native_profile.native_rate = True
+        
+        for sample_rate in (44100, 48000):
+            songs = [TestFingerprintPruning.synthetic_song(seed, sample_rate=sample_rate) for seed in range(1, 5)]
+            with tempfile.TemporaryDirectory() as temp_dir:
+                index = afe.FingerprintIndex(temp_dir)
+                for song_id, song in enumerate(songs, 1):
+                    fp = afe.generate_fingerprint(song, sample_rate, 1, afe.FingerprintProfile.reference())
+                    index.add_song(song_id, fp['hash_values'], fp['time_offsets'])
+                
+                rng = np.random.default_rng(17)
+                for song_id, song in enumerate(songs, 1):
+                    excerpt = song[2 * sample_rate:7 * sample_rate]
+                    noise = rng.normal(0, 0.5 * np.sqrt(np.mean(excerpt ** 2)), len(excerpt))  # 6 dB SNR
+                    fp = afe.generate_fingerprint((excerpt + noise).astype(np.float32), sample_rate, 1, native_profile)
+                    matches = index.query(fp['hash_values'], fp['time_offsets'], 5, 5)
+                    self.assertEqual(matches[0]['song_id'], song_id)
+
+
+class TestMp3Decoding(unittest.TestCase):
+    """Test MP3 stream indexing and windowed decoding"""
+    
+    @staticmethod
+    def silent_mp3(frames, info_frame=True):
+        """MPEG-1 Layer III, 128 kbps, 44.1 kHz joint stereo frames with empty side info"""
+        data = bytearray(b'ID3\x03\x00\x00\x00\x00\x00\x14' + bytes(20))
+        for i in range(frames + (1 if info_frame else 0)):
+            padding = 1 if i % 3 == 1 else 0
+            frame = bytearray(144 * 128000 // 44100 + padding)
+            frame[0:4] = bytes([0xff, 0xfb, 0x90 | (padding << 1), 0x40])
+            if info_frame and i == 0:
+                frame[36:40] = b'Info'
+            data += frame
+        return bytes(data + b'TAG' + bytes(125))
+    
+    @staticmethod
+    def tone_mp3(frames, line=26, global_gain=200):
+        """MPEG-1 Layer III, 128 kbps, 44.1 kHz mono frames with one spectral line set
+        
+        Each granule codes its only non-zero value in the count1 region with
+        table B: line // 4 empty quads (codeword 1111), then the quad holding
+        the line and its sign bit. Scalefactors are empty and the main data
+        starts in its own frame, so every frame decodes on its own. The tone
+        sits at (line + 0.5) * 44100 / 1152 Hz.
+        """
+        quad = 1 << (3 - line % 4)
+        granule = '1111' * (line // 4) + format(15 - quad, '04b') + '0'
+        
+        side = '0' * 9 + '0' * 5 + '0' * 4   # main_data_begin, private bits, scfsi
+        for _ in range(2):
+            side += format(len(granule), '012b') + '0' * 9 + format(global_gain, '08b')
+            side += '0000' + '0' + '0' * 15 + '0000' + '000' + '0' + '0' + '1'
+        
+        bits = side + granule + granule
+        payload = int(bits + '0' * (-len(bits) % 8), 2).to_bytes((len(bits) + 7) // 8, 'big')
+        
+        data = bytearray()
+        for i in range(frames):
+            padding = 1 if i % 3 == 1 else 0
+            frame = bytearray(144 * 128000 // 44100 + padding)
+            frame[0:4] = bytes([0xff, 0xfb, 0x90 | (padding << 1), 0xc0])
+            frame[4:4 + len(payload)] = payload
+            data += frame
+        return bytes(data)
+    
+    def test_stream_info_from_headers(self):
+        """Test that frames are counted past tags and the Info frame"""
+        info = afe.mp3_stream_info(self.silent_mp3(200))
+        self.assertEqual(info['sample_rate'], 44100)
+        self.assertEqual(info['channels'], 2)
+        self.assertEqual(info['frames'], 200)
+        self.assertEqual(info['duration_ms'], 200 * 1152 * 1000 // 44100)
+        
+        with self.assertRaises(ValueError):
+            afe.mp3_stream_info(b'RIFF' + bytes(1000))
+    
+    def test_partial_decode_skips_frames(self):
+        """Test that decoding a window skips the frames outside it"""
+        data = self.silent_mp3(400)
+        if not afe.mp3_decoder_available():
+            with self.assertRaises(RuntimeError):
+                afe.decode_mp3(data)
+            return
+        
+        full = afe.decode_mp3(data)
+        self.assertEqual(len(full['data']), 400 * 1152)
+        self.assertEqual(full['frames_skipped'], 0)
+        
+        window = afe.decode_mp3(data, start_ms=2000, max_duration_ms=3000, target_rate=11025)
+        self.assertEqual(window['sample_rate'], 11025)
+        self.assertEqual(window['channels'], 1)
+        self.assertAlmostEqual(len(window['data']), 3 * 11025, delta=2)
+        self.assertLess(window['frames_decoded'], 140)
+        self.assertGreater(window['frames_skipped'], 250)
+        
+        with self.assertRaises(ValueError):
+            afe.decode_mp3(data, start_ms=60000)
+    
+    @unittest.skipUnless(afe.mp3_decoder_available(), "engine built without minimp3")
+    def test_decodes_tone_fixture(self):
+        """Test that a coded tone decodes to that tone, whole or from a window"""
+        data = self.tone_mp3(100)
+        full = np.array(afe.decode_mp3(data)['data'])
+        self.assertEqual(len(full), 100 * 1152)
+        
+        # Past the first frame the output is a steady tone inside subband 1 (689-1378 Hz)
+        steady = full[1152:]
+        self.assertGreater(np.sqrt(np.mean(steady ** 2)), 1e-3)
+        spectrum = np.abs(np.fft.rfft(steady)) ** 2
+        frequencies = np.fft.rfftfreq(len(steady), 1.0 / 44100)
+        self.assertAlmostEqual(frequencies[np.argmax(spectrum)], 26.5 * 44100 / 1152, delta=80)
+        in_band = spectrum[(frequencies >= 689) & (frequencies <= 1378)].sum()
+        self.assertGreater(in_band / spectrum.sum(), 0.8)
+        
+        # The warm-up frame restores the overlap state, so a window matches the full decode
+        window = np.array(afe.decode_mp3(data, start_ms=1000, max_duration_ms=1000)['data'])
+        self.assertEqual(len(window), 44100)
+        np.testing.assert_allclose(window, full[44100:88200], atol=1e-6)
+
+
+class TestParallelQuery(unittest.TestCase):
+    """Test intra-query parallel scoring of long queries"""
+    
+    def test_parallel_scoring_matches_serial(self):
+        """Test that splitting a long query across threads gives identical matches"""
+        rng = np.random.default_rng(5)
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            target_hashes = target_offsets = None
+            for song_id in range(1, 301):
+                hashes = rng.integers(0, 1 << 20, 2000).tolist()
+                offsets = rng.integers(0, 240000, 2000).tolist()
+                index.add_song(song_id, hashes, offsets)
+                if song_id == 42:
+                    target_hashes, target_offsets = hashes, offsets
+            index.flush()
+            
+            # 60 s broadcast window: a third of the hashes align with song 42
+            query_hashes = rng.integers(0, 1 << 20, 30000).tolist()
+            query_offsets = rng.integers(0, 60000, 30000).tolist()
+            for i in range(0, 30000, 3):
+                query_hashes[i] = target_hashes[i % 2000]
+                query_offsets[i] = target_offsets[i % 2000] - 7000
+            
+            results = {}
+            for threads in (1, 4):
+                index.set_query_threads(threads)
+                results[threads] = index.query(query_hashes, query_offsets, 10, 5)
+            
+            self.assertEqual(results[1], results[4])
+            self.assertEqual(results[1][0]['song_id'], 42)
+            self.assertIn(results[1][0]['time_offset_ms'], (6900, 7000))
+            
+            with self.assertRaises(ValueError):
+                index.set_query_threads(-1)
+
+
+class TestQueryCapture(unittest.TestCase):
+    """Test sampled query capture and offline replay against index builds"""
+    
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.log_path = os.path.join(self.temp_dir.name, "queries.afq")
+        self.tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "query_replay.py")
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def build_index(self, directory, song_ids, rng):
+        index = afe.FingerprintIndex(directory)
+        songs = {}
+        for song_id in song_ids:
+            hashes = [int(h) for h in rng.integers(1, 2**31, size=300)]
+            offsets = list(range(0, 300 * 50, 50))
+            index.add_song(song_id, hashes, offsets)
+            songs[song_id] = (hashes, offsets)
+        index.flush()
+        return index, songs
+    
+    def test_log_round_trip(self):
+        """Test that captured records read back intact and a torn tail is ignored"""
+        log = afe.QueryLog(self.log_path, sample_rate=1.0, seed=3)
+        match = {'song_id': 7, 'match_count': 40, 'time_offset_ms': -1500, 'confidence': 0.25}
+        for i in range(3):
+            self.assertTrue(log.should_capture())
+            log.append([i, 2**32 - 1], [0, 50], [match], {'fingerprint': 12.5, 'search': 1.5}, 5, 4)
+        del log
+        
+        with open(self.log_path, "ab") as f:
+            f.write(b"\x40\x00\x00\x00\x01\x02")
+        
+        records = afe.read_query_log(self.log_path)
+        self.assertEqual(len(records), 3)
+        self.assertEqual(records[2]['hash_values'], [2, 2**32 - 1])
+        self.assertEqual(records[0]['time_offsets'], [0, 50])
+        self.assertEqual(records[1]['matches'][0]['time_offset_ms'], -1500)
+        self.assertEqual(records[1]['stage_ms'], {'fingerprint': 12.5, 'search': 1.5})
+        self.assertEqual(records[0]['min_matches'], 4)
+    
+    def test_reader_resyncs_after_corrupt_record(self):
+        """Test that a corrupt record in the middle of a log loses only that record"""
+        for writer in range(2):
+            # Two writers appending to one file, as separate server processes do
+            log = afe.QueryLog(self.log_path, sample_rate=1.0)
+            for i in range(3):
+                log.append([writer * 10 + i], [0], [], {'search': 1.0})
+            del log
+        
+        with open(self.log_path, "r+b") as f:
+            data = bytearray(f.read())
+            record_size = (len(data) - 8) // 6
+            data[8 + record_size + 20] ^= 0xff
+            f.seek(0)
+            f.write(data)
+        
+        records = afe.read_query_log(self.log_path)
+        self.assertEqual([r['hash_values'][0] for r in records], [0, 2, 10, 11, 12])
+    
+    def test_sampling_rate(self):
+        """Test that only the configured fraction of queries is captured"""
+        never = afe.QueryLog(self.log_path, sample_rate=0.0)
+        self.assertFalse(any(never.should_capture() for _ in range(1000)))
+        
+        sampled = afe.QueryLog(self.log_path, sample_rate=0.1, seed=1)
+        captured = sum(sampled.should_capture() for _ in range(10000))
+        self.assertGreater(captured, 800)
+        self.assertLess(captured, 1200)
+        self.assertEqual(sampled.get_stats()['offered'], 10000)
+        
+        with self.assertRaises(ValueError):
+            afe.QueryLog(self.log_path, sample_rate=1.5)
+    
+    def test_replay_compares_builds(self):
+        """Test that replaying one log against two builds reports the changed queries"""
+        rng = np.random.default_rng(11)
+        baseline_dir = os.path.join(self.temp_dir.name, "baseline")
+        candidate_dir = os.path.join(self.temp_dir.name, "candidate")
+        baseline, songs = self.build_index(baseline_dir, [1, 2, 3], rng)
+        
+        # The candidate build lost song 3
+        candidate = afe.FingerprintIndex(candidate_dir)
+        for song_id in (1, 2):
+            candidate.add_song(song_id, *songs[song_id])
+        candidate.flush()
+        
+        log = afe.QueryLog(self.log_path, sample_rate=1.0)
+        for song_id in (1, 2, 3):
+            hashes, offsets = songs[song_id]
+            query_offsets = [o - offsets[100] for o in offsets[100:200]]
+            matches = baseline.query(hashes[100:200], query_offsets)
+            log.append(hashes[100:200], query_offsets, matches, {'search': 1.0})
+        log.flush()
+        
+        reports = []
+        for name, directory in (("baseline", baseline_dir), ("candidate", candidate_dir)):
+            output = os.path.join(self.temp_dir.name, name + ".json")
+            subprocess.run([sys.executable, self.tool, "run", self.log_path, directory,
+                            "--concurrency", "2", "--output", output],
+                           capture_output=True, text=True, check=True)
+            reports.append(output)
+        
+        with open(reports[0]) as f:
+            baseline_report = json.load(f)
+        self.assertEqual(baseline_report['queries'], 3)
+        self.assertEqual(baseline_report['agreement_with_log'], 1.0)
+        self.assertEqual(baseline_report['top_songs'], [1, 2, 3])
+        self.assertIn('p99', baseline_report['latency_ms'])
+        
+        completed = subprocess.run([sys.executable, self.tool, "compare", *reports,
+                                    "--max-p99-regression", "1000"],
+                                   capture_output=True, text=True)
+        self.assertEqual(completed.returncode, 1)
+        comparison = json.loads(completed.stdout.strip().splitlines()[-1])
+        self.assertEqual(comparison['changed_queries'], 1)
+        self.assertEqual(comparison['changed'][0], {'query': 2, 'baseline': 3, 'candidate': None})
+
+
+class TestStreamingFingerprinter(unittest.TestCase):
+    """Test the realtime-safe streaming front end"""
+
+    sample_rate = 44100
+
+    def setUp(self):
+        rng = np.random.default_rng(11)
+        t = np.arange(self.sample_rate * 20) / self.sample_rate
+        self.mono = (0.4 * np.sin(2 * np.pi * (300 + 200 * np.sin(0.7 * t)) * t)
+                     + 0.3 * np.sin(2 * np.pi * 1250 * t) * ((np.arange(len(t)) // 16000) % 2)
+                     + 0.05 * rng.standard_normal(len(t))).astype(np.float32)
+        self.stereo = np.repeat(self.mono, 2)
+
+    def test_push_is_realtime_safe(self):
+        """Test that pushing never allocates or locks and that paced audio is not dropped"""
+        stream = afe.StreamingFingerprinter(sample_rate=self.sample_rate, channels=2)
+
+        audit = afe.audit_stream_push(stream, self.stereo, block_frames=256, speed=8.0)
+        stream.finish()
+        stats = stream.get_stats()
+
+        # Allocations are only visible in builds that link the allocation hook
+        self.assertEqual(audit['tracking_active'], afe.realtime_allocation_tracking())
+        if audit['tracking_active']:
+            self.assertEqual(audit['allocations'], 0)
+            self.assertEqual(audit['deallocations'], 0)
+        self.assertEqual(audit['lock_acquisitions'], 0)
+        self.assertEqual(audit['frames_accepted'], len(self.mono))
+        self.assertEqual(stats['frames_dropped'], 0)
+        self.assertEqual(stats['failed_passes'], 0)
+        self.assertLessEqual(stats['ring_high_water_frames'], stats['ring_capacity_frames'])
+
+    def test_stream_matches_batch(self):
+        """Test that streamed fingerprints agree with fingerprinting the whole recording"""
+        stream = afe.StreamingFingerprinter(sample_rate=self.sample_rate, channels=2)
+        afe.audit_stream_push(stream, self.stereo, block_frames=512, speed=8.0)
+        stream.finish()
+        streamed = stream.take_fingerprints()
+        batch = afe.generate_fingerprint(self.mono, self.sample_rate, 1)
+
+        streamed_hashes = collections.Counter(streamed['hash_values'])
+        batch_hashes = collections.Counter(batch['hash_values'])
+        common = sum((streamed_hashes & batch_hashes).values())
+        self.assertGreater(common, 0.98 * len(batch['hash_values']))
+        self.assertEqual(stream.get_stats()['fingerprints_emitted'], len(streamed['hash_values']))
+        self.assertEqual(stream.take_fingerprints()['hash_values'], [])
+
+        with tempfile.TemporaryDirectory() as directory:
+            index = afe.FingerprintIndex(directory)
+            index.add_song(7, batch['hash_values'], batch['time_offsets'])
+            index.flush()
+            match = index.query(streamed['hash_values'][:2000], streamed['time_offsets'][:2000])[0]
+            self.assertEqual(match['song_id'], 7)
+
+    def test_full_ring_drops(self):
+        """Test that a full ring drops audio instead of blocking and that bad formats are rejected"""
+        stream = afe.StreamingFingerprinter(sample_rate=self.sample_rate, channels=2, ring_ms=50,
+                                            poll_interval_ms=200)
+        accepted = stream.push(self.stereo)
+        stats = stream.get_stats()
+        self.assertEqual(accepted, stats['ring_capacity_frames'])
+        self.assertEqual(stats['frames_dropped'], len(self.mono) - accepted)
+        stream.finish()
+        self.assertEqual(stream.push(self.stereo[:512]), 0)
+
+        with self.assertRaises(ValueError):
+            stream.push(self.stereo[:3])
+        with self.assertRaises(ValueError):
+            afe.StreamingFingerprinter(channels=0)
+        with self.assertRaises(ValueError):
+            afe.StreamingFingerprinter(hop_ms=0)
+
+
+class TestCancellation(unittest.TestCase):
+    """Test that cancelled and timed-out requests stop consuming CPU"""
+
+    sample_rate = 44100
+
+    def setUp(self):
+        rng = np.random.default_rng(17)
+        t = np.arange(self.sample_rate * 120) / self.sample_rate
+        self.long_audio = (0.4 * np.sin(2 * np.pi * (400 + 300 * np.sin(0.3 * t)) * t)
+                           + 0.1 * rng.standard_normal(len(t))).astype(np.float32)
+        self.stats_before = afe.cancellation_stats()
+
+    def stats_since_setup(self):
+        """Cancellation counters accumulated by this test; the counters are process-wide"""
+        after = afe.cancellation_stats()
+        delta = {key: after[key] - self.stats_before[key] for key in after if key != 'by_stage'}
+        delta['by_stage'] = {stage: count - self.stats_before['by_stage'].get(stage, 0)
+                             for stage, count in after['by_stage'].items()
+                             if count != self.stats_before['by_stage'].get(stage, 0)}
+        return delta
+
+    def cancel_after(self, token, delay_s):
+        timer = threading.Timer(delay_s, token.cancel)
+        timer.start()
+        return timer
+
+    def test_cancel_stops_fingerprinting(self):
+        """Test that a token cancelled from another thread abandons the work promptly"""
+        token = afe.CancellationToken()
+        self.cancel_after(token, 0.05)
+        with self.assertRaises(afe.OperationCancelled) as context:
+            afe.generate_fingerprint(self.long_audio, self.sample_rate, 1, cancel_token=token)
+
+        # The message names the checkpoint that observed the token
+        message, stage = str(context.exception).rsplit(" at ", 1)
+        self.assertEqual(message, "Operation cancelled")
+        self.assertIn(stage, ("preprocess", "stft", "peaks", "landmarks"))
+        self.assertTrue(token.cancelled)
+        self.assertFalse(token.deadline_expired)
+
+        stats = self.stats_since_setup()
+        self.assertEqual(stats['tokens_cancelled'], 1)
+        self.assertEqual(stats['operations_cancelled'], 1)
+        self.assertEqual(stats['by_stage'], {stage: 1})
+
+    def test_deadline(self):
+        """Test that an expired deadline cancels the work and is reported as such"""
+        token = afe.CancellationToken()
+        token.set_deadline(0)
+        with self.assertRaises(afe.OperationCancelled) as context:
+            afe.generate_fingerprint(self.long_audio, self.sample_rate, 1, cancel_token=token)
+        self.assertIn("Deadline expired", str(context.exception))
+        self.assertTrue(token.cancelled)
+        self.assertTrue(token.deadline_expired)
+        self.assertEqual(self.stats_since_setup()['deadlines_expired'], 1)
+
+        # A distant deadline changes nothing
+        token = afe.CancellationToken()
+        token.set_deadline(600000)
+        short = self.long_audio[:self.sample_rate * 10]
+        self.assertEqual(afe.generate_fingerprint(short, self.sample_rate, 1, cancel_token=token),
+                         afe.generate_fingerprint(short, self.sample_rate, 1))
+
+    def test_pool_drops_cancelled_requests(self):
+        """Test that cancelled pool requests are dropped from the queue or stopped while running"""
+        pool = afe.EnginePool(num_workers=1, interactive_slo_ms=600000, batch_slo_ms=600000)
+        running = afe.CancellationToken()
+        queued = afe.CancellationToken()
+        errors = {}
+
+        def process(name, token):
+            try:
+                pool.process(self.long_audio, self.sample_rate, 1, "batch", cancel_token=token)
+            except afe.OperationCancelled as e:
+                errors[name] = str(e)
+
+        threads = [threading.Thread(target=process, args=("running", running))]
+        threads[0].start()
+        time.sleep(0.05)
+        threads.append(threading.Thread(target=process, args=("queued", queued)))
+        threads[1].start()
+        time.sleep(0.05)
+
+        queued.cancel()
+        threads[1].join(timeout=5)
+        self.assertFalse(threads[1].is_alive())
+        running.cancel()
+        threads[0].join(timeout=5)
+        self.assertFalse(threads[0].is_alive())
+
+        self.assertTrue(errors['queued'].endswith("at queue"))
+        self.assertNotIn("queue", errors['running'])
+        self.assertEqual(pool.get_statistics()['batch']['cancelled'], 2)
+        self.assertEqual(self.stats_since_setup()['queued_dropped'], 1)
+
+        # The worker is free again
+        result = pool.process(self.long_audio[:self.sample_rate * 5], self.sample_rate, 1, "batch")
+        self.assertGreater(result['count'], 0)
+
+    def test_index_query_cancellation(self):
+        """Test that index queries observe the token"""
+        rng = np.random.default_rng(3)
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index = afe.FingerprintIndex(temp_dir)
+            for song_id in range(1, 51):
+                index.add_song(song_id, rng.integers(0, 1 << 20, 2000).tolist(),
+                               rng.integers(0, 240000, 2000).tolist())
+            index.flush()
+            hashes = rng.integers(0, 1 << 20, 5000).tolist()
+            offsets = rng.integers(0, 60000, 5000).tolist()
+
+            token = afe.CancellationToken()
+            self.assertEqual(index.query(hashes, offsets, 5, 1, cancel_token=token),
+                             index.query(hashes, offsets, 5, 1))
+
+            token.cancel()
+            with self.assertRaises(afe.OperationCancelled):
+                index.query(hashes, offsets, 5, 1, cancel_token=token)
+            self.assertTrue(any(stage.startswith("index") for stage in self.stats_since_setup()['by_stage']))
+
+
+@unittest.skipUnless(afe.MatcherSidecar.supported(), "matcher sidecar needs POSIX shared memory")
+class TestMatcherSidecar(unittest.TestCase):
+    """Test index queries served to other processes through shared memory"""
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.index_dir = self.temp_dir.name
+        self.name = f"test-{os.getpid()}"
+        self.tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "matcher_sidecar.py")
+
+        rng = np.random.default_rng(8)
+        index = afe.FingerprintIndex(self.index_dir)
+        target = None
+        for song_id in range(1, 101):
+            hashes = rng.integers(0, 1 << 20, 2000).tolist()
+            offsets = rng.integers(0, 240000, 2000).tolist()
+            index.add_song(song_id, hashes, offsets, title=f"Song {song_id}", artist="Artist")
+            if song_id == 17:
+                target = (hashes, offsets)
+        index.flush()
+
+        self.query_hashes = target[0][:500]
+        self.query_offsets = [offset - 3000 for offset in target[1][:500]]
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def test_in_process_round_trip(self):
+        """Test that sidecar results equal direct queries"""
+        index = afe.FingerprintIndex(self.index_dir)
+        sidecar = afe.MatcherSidecar(self.name, index, slots=4)
+        client = afe.MatcherClient(self.name)
+
+        direct = index.query(self.query_hashes, self.query_offsets, 5, 5)
+        self.assertEqual(client.query(self.query_hashes, self.query_offsets, 5, 5), direct)
+        self.assertEqual(direct[0]['song_id'], 17)
+        self.assertEqual(client.query([], [], 1, 1), [])
+
+        with self.assertRaises(ValueError):
+            client.query([1] * (client.max_query_hashes + 1), [0] * (client.max_query_hashes + 1))
+        with self.assertRaises(RuntimeError):
+            afe.MatcherSidecar(self.name, index)
+
+        token = afe.CancellationToken()
+        token.cancel()
+        with self.assertRaises(afe.OperationCancelled):
+            client.query(self.query_hashes, self.query_offsets, cancel_token=token)
+        self.assertEqual(client.query(self.query_hashes, self.query_offsets, 5, 5), direct)
+        self.assertGreaterEqual(sidecar.get_stats()['requests'], 3)
+
+        sidecar.stop()
+        self.assertFalse(client.connected())
+        with self.assertRaises(RuntimeError):
+            client.query(self.query_hashes, self.query_offsets)
+        with self.assertRaises(RuntimeError):
+            afe.MatcherClient(self.name)
+
+    def test_song_metadata(self):
+        """Test that matches carry song metadata, long fields cut at a character boundary"""
+        index = afe.FingerprintIndex(self.index_dir)
+        index.add_song(200, self.query_hashes, [offset + 5000 for offset in self.query_offsets],
+                       title="\u00e9" * 100, artist="Artist 200", album="Album", duration_ms=180000)
+        sidecar = afe.MatcherSidecar(self.name, index, slots=4)
+        client = afe.MatcherClient(self.name)
+
+        matches = {match['song_id']: match for match in client.query(self.query_hashes, self.query_offsets, 5, 5)}
+        self.assertEqual((matches[17]['title'], matches[17]['artist']), ("Song 17", "Artist"))
+        self.assertEqual(matches[200]['title'], "\u00e9" * 63)
+        self.assertEqual((matches[200]['artist'], matches[200]['album'], matches[200]['duration_ms']),
+                         ("Artist 200", "Album", 180000))
+        sidecar.stop()
+
+    def test_concurrent_clients(self):
+        """Test that more client threads than slots all get their results"""
+        index = afe.FingerprintIndex(self.index_dir)
+        sidecar = afe.MatcherSidecar(self.name, index, slots=2, workers=2)
+        client = afe.MatcherClient(self.name)
+        expected = index.query(self.query_hashes, self.query_offsets, 5, 5)
+        results = []
+
+        def run():
+            for _ in range(20):
+                results.append(client.query(self.query_hashes, self.query_offsets, 5, 5) == expected)
+
+        threads = [threading.Thread(target=run) for _ in range(6)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        self.assertEqual(results, [True] * 120)
+        sidecar.stop()
+
+    def test_sidecar_process(self):
+        """Test the sidecar tool serving another process and shutting down cleanly"""
+        process = subprocess.Popen([sys.executable, self.tool, "serve", self.index_dir, "--name", self.name,
+                                    "--reload-interval", "0.2"], stdout=subprocess.PIPE, text=True)
+        try:
+            sys.path.insert(0, os.path.dirname(self.tool))
+            import matcher_sidecar
+            matcher = matcher_sidecar.wait_for_sidecar(self.name)
+
+            direct = afe.FingerprintIndex(self.index_dir).query(self.query_hashes, self.query_offsets, 5, 5)
+            self.assertEqual(matcher.query(self.query_hashes, self.query_offsets, 5, 5), direct)
+            self.assertLess(matcher.ping(), 1e6)
+
+            # Songs committed after start are picked up by the reload
+            writer = afe.FingerprintIndex(self.index_dir)
+            writer.add_song(500, self.query_hashes, [offset + 9000 for offset in self.query_offsets])
+            writer.flush()
+            deadline = time.monotonic() + 10
+            song_ids = []
+            while 500 not in song_ids and time.monotonic() < deadline:
+                time.sleep(0.1)
+                song_ids = [m['song_id'] for m in matcher.query(self.query_hashes, self.query_offsets, 5, 5)]
+            self.assertIn(500, song_ids)
+        finally:
+            process.terminate()
+            output, _ = process.communicate(timeout=30)
+
+        self.assertEqual(process.returncode, 0)
+        self.assertGreater(json.loads(output)['requests'], 0)
+        with self.assertRaises(RuntimeError):
+            afe.MatcherClient(self.name)
+
+
+class TestIndexBenchmark(unittest.TestCase):
+    """Test synthetic catalogs and the catalog-scale index benchmark"""
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "index_benchmark.py")
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def test_catalog_is_deterministic_and_skewed(self):
+        """Test that songs regenerate identically and hash frequencies follow the Zipf skew"""
+        catalog = afe.SyntheticCatalog(songs=200, fingerprints_per_song=300, distinct_hashes=1 << 16)
+        song = catalog.song_fingerprints(42)
+        self.assertEqual(song, afe.SyntheticCatalog(songs=200, fingerprints_per_song=300,
+                                                    distinct_hashes=1 << 16).song_fingerprints(42))
+        self.assertEqual(len(song['hash_values']), 300)
+        self.assertEqual(song['time_offsets'], sorted(song['time_offsets']))
+        self.assertNotEqual(song['hash_values'], catalog.song_fingerprints(43)['hash_values'])
+
+        counts = collections.Counter()
+        for song_id in range(1, 201):
+            counts.update(catalog.song_fingerprints(song_id)['hash_values'])
+        frequencies = sorted(counts.values(), reverse=True)
+        self.assertGreater(frequencies[0], 20 * frequencies[len(frequencies) // 2])
+
+        with self.assertRaises(ValueError):
+            catalog.song_fingerprints(201)
+        with self.assertRaises(ValueError):
+            afe.SyntheticCatalog(songs=0)
+
+    def test_build_and_query(self):
+        """Test that a built catalog finds the excerpted songs at any concurrency"""
+        catalog = afe.SyntheticCatalog(songs=2000, fingerprints_per_song=500)
+        index = afe.FingerprintIndex(self.temp_dir.name)
+        build = catalog.build(index, songs_per_segment=500)
+
+        self.assertEqual(build['postings'], 2000 * 500)
+        self.assertEqual(build['segments_flushed'], 4)
+        self.assertEqual(index.get_stats()['segment_count'], 1)
+        self.assertGreater(build['top_percent_share'], 0.1)
+
+        serial = catalog.benchmark_queries(index, queries=100, concurrency=1)
+        parallel = catalog.benchmark_queries(index, queries=100, concurrency=4)
+        self.assertEqual(len(serial['latencies_ms']), 100)
+        self.assertGreater(serial['top1_accuracy'], 0.9)
+        self.assertEqual(serial['top1_accuracy'], parallel['top1_accuracy'])
+
+    def test_scaling_report(self):
+        """Test the benchmark tool measuring small scales and extrapolating one over budget"""
+        sys.path.insert(0, os.path.dirname(self.tool))
+        import index_benchmark
+
+        report = index_benchmark.run_benchmark(self.temp_dir.name, scales=[1000, 4000, 1000000],
+                                               concurrency=[1, 2], max_index_bytes=64 << 20,
+                                               fingerprints_per_song=100, queries=50)
+        measured = [scale for scale in report.scales if scale.measured]
+        self.assertEqual([scale.songs for scale in measured], [1000, 4000])
+        self.assertFalse(report.scales[2].measured)
+        self.assertIn("byte budget", report.scales[2].skip_reason)
+        self.assertGreater(report.scales[2].index_bytes, measured[1].index_bytes)
+        self.assertEqual(len(report.scales[2].queries), 2)
+        self.assertAlmostEqual(report.exponents['index_bytes'], 1.0, delta=0.2)
+        self.assertEqual(os.listdir(self.temp_dir.name), [])
+
+        output_path = os.path.join(self.temp_dir.name, "report.json")
+        result = subprocess.run([sys.executable, self.tool, "run", os.path.join(self.temp_dir.name, "work"),
+                                 "--scales", "500", "--concurrency", "1", "--queries", "20",
+                                 "--fingerprints-per-song", "100", "--output", output_path],
+                                capture_output=True, text=True, timeout=300)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(json.loads(result.stdout)['scales'][0]['songs'], 500)
+
+        table = subprocess.run([sys.executable, self.tool, "report", output_path],
+                               capture_output=True, text=True, timeout=60)
+        self.assertEqual(table.returncode, 0, table.stderr)
+        self.assertIn("c1 p99", table.stdout)
+
+
+class TestEngineTuning(unittest.TestCase):
+    """Test host wisdom files and the parameters they tune"""
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "autotune.py")
+        self.previous = afe.EngineTuning.current()
+        self.previous_source = afe.EngineTuning.source()
+
+    def tearDown(self):
+        afe.EngineTuning.install(self.previous, self.previous_source)
+        self.temp_dir.cleanup()
+
+    def test_wisdom_round_trip(self):
+        """Test that wisdom survives a save and load and is refused on other hosts"""
+        tuning = afe.EngineTuning()
+        tuning.tile_frames = 16
+        tuning.prefetch_distance = 4
+        tuning.commit_window_us = 500
+        path = os.path.join(self.temp_dir.name, "nested", "wisdom.conf")
+        tuning.save(path)
+
+        loaded = afe.EngineTuning.load(path)
+        self.assertEqual((loaded.tile_frames, loaded.prefetch_distance, loaded.commit_window_us), (16, 4, 500))
+        self.assertEqual(loaded.parallel_query_min_hashes, afe.EngineTuning().parallel_query_min_hashes)
+
+        text = tuning.serialize()
+        foreign = text.replace(f"host {afe.EngineTuning.host_name()}\n", "host elsewhere\n")
+        with self.assertRaises(RuntimeError):
+            afe.EngineTuning.parse(foreign)
+        with self.assertRaises(RuntimeError):
+            afe.EngineTuning.parse(text + "unknown_key 1\n")
+
+        tuning.tile_frames = 0
+        with self.assertRaises(ValueError):
+            afe.EngineTuning.install(tuning)
+
+    def test_tuned_values_keep_results(self):
+        """Test that tile size, prefetch distance and query threads change speed only"""
+        rng = np.random.default_rng(11)
+        t = np.arange(0, 10.0, 1.0 / 11025)
+        audio = (np.sin(2 * np.pi * 440 * t) + 0.5 * np.sin(2 * np.pi * 1320 * t) +
+                 0.2 * rng.standard_normal(len(t))).astype(np.float32)
+        sample = afe.AudioSample(audio.tolist(), 11025, 1)
+
+        index = afe.FingerprintIndex(self.temp_dir.name)
+        for song_id in range(1, 201):
+            index.add_song(song_id, rng.integers(0, 1 << 16, 1000).tolist(), rng.integers(0, 240000, 1000).tolist())
+        index.flush()
+        query = (rng.integers(0, 1 << 16, 6000).tolist(), rng.integers(0, 240000, 6000).tolist())
+
+        outcomes = []
+        for tile_frames, prefetch_distance, query_threads in ((32, 0, 1), (8, 4, 2), (128, 16, 4)):
+            tuning = afe.EngineTuning()
+            tuning.tile_frames = tile_frames
+            tuning.prefetch_distance = prefetch_distance
+            tuning.query_threads = query_threads
+            tuning.parallel_query_min_hashes = 1024
+            afe.EngineTuning.install(tuning, "test")
+
+            fingerprints = afe.HashGenerator().process_audio_sample(sample)
+            outcomes.append(([fp.hash_value for fp in fingerprints], index.query(*query, 10, 2)))
+
+        self.assertGreater(len(outcomes[0][0]), 0)
+        self.assertEqual(outcomes[0], outcomes[1])
+        self.assertEqual(outcomes[0], outcomes[2])
+        self.assertEqual(afe.EngineTuning.source(), "test")
+
+    def test_autotune_tool(self):
+        """Test a quick tuning run writing wisdom that a new process loads"""
+        wisdom = os.path.join(self.temp_dir.name, "wisdom.conf")
+        env = dict(os.environ, FINGERPRINT_WISDOM=wisdom)
+
+        result = subprocess.run([sys.executable, self.tool, "run", "--quick", "--repetitions", "1",
+                                 "--work-dir", self.temp_dir.name],
+                                capture_output=True, text=True, timeout=600, env=env)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        report = json.loads(result.stdout)
+        self.assertEqual(report['wisdom_path'], wisdom)
+        self.assertIn('tile_frames', {trial['parameter'] for trial in report['trials']})
+        self.assertEqual(sorted(os.listdir(self.temp_dir.name)), ["wisdom.conf"])
+
+        shown = subprocess.run([sys.executable, self.tool, "show"], capture_output=True, text=True,
+                               timeout=60, env=env)
+        self.assertEqual(shown.returncode, 0, shown.stderr)
+        self.assertEqual(json.loads(shown.stdout)['source'], wisdom)
+        self.assertEqual(json.loads(shown.stdout)['tuning'], report['tuning'])
+
+        # Wisdom from another host falls back to the defaults
+        with open(wisdom) as f:
+            text = f.read()
+        with open(wisdom, "w") as f:
+            f.write(text.replace(f"host {report['host']}\n", "host elsewhere\n"))
+        shown = subprocess.run([sys.executable, self.tool, "show"], capture_output=True, text=True,
+                               timeout=60, env=env)
+        self.assertTrue(json.loads(shown.stdout)['source'].startswith("defaults"))
+        self.assertEqual(json.loads(shown.stdout)['tuning'], report['defaults'])
+
+
 def create_test_suite():
     """Create a test suite with all test classes"""
     suite = unittest.TestSuite()
@@ -419,7 +2265,30 @@ def create_test_suite():
         TestFingerprintConsistency,
         TestPeakDetectionAccuracy,
         TestKnownFingerprintValidation,
-        TestEnginePerformance
+        TestEnginePerformance,
+        TestEnginePool,
+        TestCpuPools,
+        TestStreamingFingerprinter,
+        TestCancellation,
+        TestCorpusReader,
+        TestIndexReplication,
+        TestDurableIngest,
+        TestSongTable,
+        TestSongReordering,
+        TestDistributedIngest,
+        TestFingerprintPruning,
+        TestFingerprintProfiles,
+        TestLandmarkTriplets,
+        TestTieredQuery,
+        TestQueryPhases,
+        TestPeakInterpolation,
+        TestNativeRateAnalysis,
+        TestMp3Decoding,
+        TestParallelQuery,
+        TestMatcherSidecar,
+        TestIndexBenchmark,
+        TestEngineTuning,
+        TestQueryCapture
     ]
     
     for test_class in test_classes:
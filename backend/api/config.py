@@ -61,6 +61,10 @@ class Settings(BaseSettings):
     )
     max_fingerprint_matches: int = Field(default=1000, env="MAX_FINGERPRINT_MATCHES")
     
+    # Ingest Configuration
+    near_duplicate_overlap: Optional[float] = Field(default=None, env="NEAR_DUPLICATE_OVERLAP")  # None disables the check
+    near_duplicate_action: str = Field(default="flag", env="NEAR_DUPLICATE_ACTION")  # flag, skip or link
+    
     # Logging Configuration
     log_level: str = Field(default="INFO", env="LOG_LEVEL")
     log_format: str = Field(default="json", env="LOG_FORMAT")
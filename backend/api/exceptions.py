@@ -52,6 +52,23 @@ class MatchingError(DatabaseError):
     pass
 
 
+class ServiceOverloadedError(AudioFingerprintingException):
+    """Exception raised when the audio engine sheds load under overload."""
+    
+    def __init__(self, message: str, retry_after_ms: int, details: dict = None):
+        super().__init__(message, details)
+        self.retry_after_ms = retry_after_ms
+
+
+class RequestCancelledError(AudioFingerprintingException):
+    """Exception raised when a request's engine work was abandoned."""
+    
+    def __init__(self, message: str, stage: str, deadline_expired: bool, details: dict = None):
+        super().__init__(message, details)
+        self.stage = stage
+        self.deadline_expired = deadline_expired
+
+
 class ConfigurationError(AudioFingerprintingException):
     """Exception raised for configuration-related errors."""
     pass
\ No newline at end of file
@@ -463,6 +463,13 @@ def setup_routes(app: FastAPI) -> None:
             }
         }
         
+        # Engine work abandoned because clients disconnected or timed out
+        try:
+            from audio_engine.fingerprint_api import get_engine
+            metrics_summary["cancellations"] = get_engine().get_cancellation_statistics()
+        except Exception as e:
+            logger.warning("Cancellation statistics unavailable", error=str(e))
+        
         return metrics_summary
 
 
@@ -29,7 +29,7 @@ from backend.api.exceptions import (
 )
 from backend.api.config import get_settings
 from backend.database.connection import get_db_session
-from backend.database.repositories import SongRepository, FingerprintRepository, MatchRepository
+from backend.database.repositories import SongRepository, FingerprintRepository, MatchRepository, song_table
 from backend.database.population_utils import DatabasePopulator, DatabaseSeeder
 from backend.models.song import Song
 from backend.models.audio import Fingerprint
@@ -160,7 +160,9 @@ async def add_reference_song(
         
         # Generate fingerprints
         engine = get_engine()
-        fingerprint_result = engine.generate_fingerprint(audio_array, sample_rate, channels)
+        fingerprint_result = engine.generate_fingerprint(
+            audio_array, sample_rate, channels, priority="batch", profile="reference"
+        )
         
         if fingerprint_result.count == 0:
             logger.warning("No fingerprints generated from reference audio", request_id=request_id)
@@ -186,7 +188,10 @@ async def add_reference_song(
             fingerprints.append(fingerprint)
         
         # Add song to database using population utilities
-        populator = DatabasePopulator()
+        populator = DatabasePopulator(
+            near_duplicate_overlap=settings.near_duplicate_overlap,
+            near_duplicate_action=settings.near_duplicate_action
+        )
         song_id = populator.add_song_with_fingerprints(
             title=title.strip(),
             artist=artist.strip(),
@@ -199,7 +204,32 @@ async def add_reference_song(
         # Calculate total processing time
         total_processing_time = int((time.time() - start_time) * 1000)
         
-        if song_id:
+        near_duplicate = populator.last_near_duplicate
+        if song_id and near_duplicate and populator.near_duplicate_action == 'link':
+            # Linked songs store no fingerprints; they resolve to the canonical song
+            logger.info(
+                "Reference song linked to canonical song",
+                request_id=request_id,
+                song_id=song_id,
+                canonical_song_id=near_duplicate.song_id,
+                title=title,
+                artist=artist,
+                overlap=near_duplicate.overlap,
+                processing_time_ms=total_processing_time
+            )
+            
+            return AddSongResponse(
+                success=True,
+                song_id=near_duplicate.song_id,
+                fingerprint_count=0,
+                processing_time_ms=total_processing_time,
+                message=(
+                    f"Song '{title}' by '{artist}' linked to song {near_duplicate.song_id} "
+                    f"({near_duplicate.overlap:.0%} of fingerprints aligned)"
+                ),
+                request_id=request_id
+            )
+        elif song_id:
             logger.info(
                 "Reference song added successfully",
                 request_id=request_id,
@@ -300,11 +330,12 @@ async def health_check(
         # Check database connectivity
         try:
             with get_db_session() as session:
-                match_repo = MatchRepository(session)
+                match_repo = MatchRepository(session, song_index=song_table)
                 db_stats = match_repo.get_database_stats()
                 components["database"] = "healthy"
                 components["database_songs"] = str(db_stats.get('total_songs', 0))
                 components["database_fingerprints"] = str(db_stats.get('total_fingerprints', 0))
+                components["song_table_songs"] = str(len(song_table))
         except Exception as e:
             logger.error("Database health check failed", error=str(e))
             components["database"] = "unhealthy"
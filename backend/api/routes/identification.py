@@ -2,6 +2,7 @@
 Audio identification endpoint implementation.
 """
 
+import math
 import time
 import uuid
 import logging
@@ -9,7 +10,7 @@ from typing import Optional
 import asyncio
 from io import BytesIO
 
-from fastapi import APIRouter, File, UploadFile, HTTPException, Depends, Form
+from fastapi import APIRouter, File, UploadFile, HTTPException, Depends, Form, Request
 from fastapi.responses import JSONResponse
 import structlog
 
@@ -21,18 +22,33 @@ from backend.api.exceptions import (
     AudioFormatError,
     AudioSizeError,
     FingerprintGenerationError,
-    MatchingError
+    MatchingError,
+    ServiceOverloadedError,
+    RequestCancelledError
 )
 from backend.api.config import get_settings
 from backend.database.connection import get_db_session
-from backend.database.repositories import MatchRepository, FingerprintRepository
+from backend.database.repositories import MatchRepository, FingerprintRepository, song_table
 from backend.models.audio import AudioSample, Fingerprint
 from backend.models.match import MatchResult
-from audio_engine.fingerprint_api import get_engine, AudioFingerprintEngine
+from audio_engine.fingerprint_api import (
+    get_engine, AudioFingerprintEngine, EngineOverloadedError, decode_mp3, mp3_stream_info,
+    CancellationToken, OperationCancelled
+)
 
 logger = structlog.get_logger()
 router = APIRouter()
 
+# Compressed uploads are decoded straight to mono at the engine's analysis rate
+DECODE_SAMPLE_RATE = 11025
+
+# How often a running identification checks whether its client went away
+DISCONNECT_POLL_SECONDS = 0.05
+
+# Non-standard status for a request the client abandoned (nginx convention);
+# the client never reads it, but it keeps these out of the 5xx error rates
+CLIENT_CLOSED_REQUEST = 499
+
 
 def validate_audio_file(file: UploadFile, settings) -> None:
     """Validate uploaded audio file."""
@@ -58,8 +74,14 @@ def validate_audio_file(file: UploadFile, settings) -> None:
             raise AudioFormatError(f"Unsupported file extension: {extension}")
 
 
-async def process_audio_file(file: UploadFile) -> AudioSample:
-    """Process uploaded audio file into AudioSample."""
+async def process_audio_file(file: UploadFile, max_duration_ms: Optional[int] = None) -> AudioSample:
+    """
+    Process uploaded audio file into AudioSample.
+    
+    MP3 uploads are only indexed from their frame headers here; their
+    duration is capped at max_duration_ms so that decoding later stops at the
+    fingerprinting window.
+    """
     try:
         # Read file content
         audio_data = await file.read()
@@ -97,12 +119,25 @@ async def process_audio_file(file: UploadFile) -> AudioSample:
                 sample_rate = 44100
                 channels = 2
         
-        # Calculate duration more accurately (assume 16-bit PCM payload)
-        bytes_per_sample = 2
-        # For WAV payload, skip 44-byte header
-        payload = audio_data[44:] if format_name == "wav" and len(audio_data) >= 44 else audio_data
-        total_samples = len(payload) // (channels * bytes_per_sample)
-        duration_ms = max(1, int((total_samples / sample_rate) * 1000))  # Ensure at least 1ms
+        if format_name == "mp3":
+            try:
+                stream = mp3_stream_info(audio_data)
+            except ValueError as e:
+                raise AudioFormatError(f"Invalid MP3 data: {e}")
+            
+            sample_rate = DECODE_SAMPLE_RATE
+            channels = 1
+            duration_ms = stream["duration_ms"]
+            if max_duration_ms:
+                duration_ms = min(duration_ms, max_duration_ms)
+            duration_ms = max(1, duration_ms)
+        else:
+            # Calculate duration more accurately (assume 16-bit PCM payload)
+            bytes_per_sample = 2
+            # For WAV payload, skip 44-byte header
+            payload = audio_data[44:] if format_name == "wav" and len(audio_data) >= 44 else audio_data
+            total_samples = len(payload) // (channels * bytes_per_sample)
+            duration_ms = max(1, int((total_samples / sample_rate) * 1000))  # Ensure at least 1ms
         
         return AudioSample(
             data=audio_data,
@@ -139,6 +174,14 @@ def convert_audio_to_numpy(audio_sample: AudioSample):
                 audio_array = audio_array.reshape(-1, 2).mean(axis=1)
             
             return audio_array
+        elif audio_sample.format == "mp3":
+            # Decode only the frames covering the fingerprinting window
+            decoded = decode_mp3(
+                audio_sample.data,
+                max_duration_ms=audio_sample.duration_ms,
+                target_rate=audio_sample.sample_rate
+            )
+            return decoded["data"]
         else:
             # For other formats, we'd need proper decoding
             # For now, create dummy data for testing
@@ -150,19 +193,61 @@ def convert_audio_to_numpy(audio_sample: AudioSample):
         raise AudioProcessingError(f"Failed to convert audio data: {str(e)}")
 
 
-async def generate_fingerprints(audio_sample: AudioSample, engine: AudioFingerprintEngine) -> list[Fingerprint]:
-    """Generate fingerprints from audio sample."""
+def check_cancelled(cancel_token: CancellationToken, stage: str) -> None:
+    """Stop between stages once the request has been cancelled."""
+    if cancel_token.cancelled:
+        raise RequestCancelledError(
+            f"Request cancelled before {stage}",
+            stage=stage,
+            deadline_expired=cancel_token.deadline_expired
+        )
+
+
+async def cancel_on_disconnect(request: Request, cancel_token: CancellationToken) -> None:
+    """Cancel the request's engine work once its client disconnects."""
+    while not cancel_token.cancelled:
+        if await request.is_disconnected():
+            cancel_token.cancel()
+            return
+        await asyncio.sleep(DISCONNECT_POLL_SECONDS)
+
+
+async def generate_fingerprints(
+    audio_sample: AudioSample,
+    engine: AudioFingerprintEngine,
+    cancel_token: Optional[CancellationToken] = None,
+    stage_ms: Optional[dict] = None
+) -> list[Fingerprint]:
+    """
+    Generate fingerprints from audio sample.
+    
+    The engine runs on a worker thread so the event loop keeps noticing client
+    disconnects; cancelling cancel_token abandons the work inside the engine.
+    The decode and fingerprint durations are added to stage_ms when given.
+    """
     try:
-        # Convert audio to numpy array
-        audio_array = convert_audio_to_numpy(audio_sample)
+        # Convert audio to numpy array; MP3 decoding is CPU-bound, so it runs on
+        # the worker thread too
+        decode_start = time.time()
+        audio_array = await asyncio.to_thread(convert_audio_to_numpy, audio_sample)
+        fingerprint_start = time.time()
         
-        # Generate fingerprints using the engine
-        fingerprint_result = engine.generate_fingerprint(
+        # Generate fingerprints through the engine pool so interactive queries
+        # overtake batch ingest and are shed early under overload
+        fingerprint_result = await asyncio.to_thread(
+            engine.generate_fingerprint,
             audio_array, 
             audio_sample.sample_rate, 
-            1  # Always use mono for fingerprinting
+            1,  # Always use mono for fingerprinting
+            priority="interactive",
+            profile="query",
+            cancel_token=cancel_token
         )
         
+        if stage_ms is not None:
+            stage_ms["decode"] = stage_ms.get("decode", 0.0) + (fingerprint_start - decode_start) * 1000
+            stage_ms["fingerprint"] = (time.time() - fingerprint_start) * 1000
+        
         # Limit the number of fingerprints to prevent database overload
         max_fingerprints = 10000  # Reasonable limit for identification
         actual_count = min(fingerprint_result.count, max_fingerprints)
@@ -185,6 +270,14 @@ async def generate_fingerprints(audio_sample: AudioSample, engine: AudioFingerpr
         logger.info(f"Generated {len(fingerprints)} fingerprints from audio sample")
         return fingerprints
         
+    except EngineOverloadedError as e:
+        raise ServiceOverloadedError(str(e), retry_after_ms=e.retry_after_ms)
+    except OperationCancelled as e:
+        raise RequestCancelledError(
+            str(e),
+            stage="fingerprint",
+            deadline_expired=bool(cancel_token and cancel_token.deadline_expired)
+        )
     except Exception as e:
         logger.error("Fingerprint generation failed", error=str(e))
         raise FingerprintGenerationError(f"Failed to generate fingerprints: {str(e)}")
@@ -194,7 +287,7 @@ async def find_matching_song(fingerprints: list[Fingerprint]) -> Optional[MatchR
     """Find matching song in database."""
     try:
         with get_db_session() as session:
-            match_repo = MatchRepository(session)
+            match_repo = MatchRepository(session, song_index=song_table)
             
             # Use only a subset of fingerprints for faster matching
             # Take every 5th fingerprint to reduce database load
@@ -223,8 +316,34 @@ async def find_matching_song(fingerprints: list[Fingerprint]) -> Optional[MatchR
         raise MatchingError(f"Failed to find matching song: {str(e)}")
 
 
+def capture_query(
+    engine: AudioFingerprintEngine,
+    fingerprints: list[Fingerprint],
+    match_result: Optional[MatchResult],
+    stage_ms: dict
+) -> None:
+    """Capture a sampled query to the engine's query log for offline replay."""
+    matches = []
+    if match_result:
+        matches.append({
+            "song_id": match_result.song_id,
+            "match_count": match_result.match_count,
+            "time_offset_ms": match_result.time_offset_ms,
+            "confidence": match_result.confidence
+        })
+    
+    engine.capture_query(
+        [fp.hash_value for fp in fingerprints],
+        [fp.time_offset_ms for fp in fingerprints],
+        matches,
+        stage_ms,
+        max_results=1
+    )
+
+
 @router.post("/identify", response_model=AudioIdentificationResponse)
 async def identify_audio(
+    request: Request,
     audio_file: UploadFile = File(..., description="Audio file to identify (WAV, MP3, FLAC, M4A)"),
     format: Optional[str] = Form(None, description="Audio format override"),
     settings = Depends(get_settings)
@@ -243,9 +362,15 @@ async def identify_audio(
     - 2.4: Response time requirements (10 second total processing)
     - 3.1: Song identification results with metadata
     - 3.2: Confidence scoring for matches
+    
+    Engine work is cancelled when the client disconnects or the request
+    timeout passes, so abandoned requests stop using CPU.
     """
     request_id = str(uuid.uuid4())
     start_time = time.time()
+    cancel_token = CancellationToken()
+    cancel_token.set_deadline(int(settings.request_timeout_seconds * 1000))
+    disconnect_watcher = None
     
     logger.info(
         "Audio identification request started",
@@ -260,16 +385,20 @@ async def identify_audio(
         validate_audio_file(audio_file, settings)
         
         # Process audio file
-        audio_sample = await process_audio_file(audio_file)
+        audio_sample = await process_audio_file(audio_file, settings.max_audio_duration_ms)
         
         # Check processing time limit
         processing_time = (time.time() - start_time) * 1000
         if processing_time > settings.audio_processing_timeout_seconds * 1000:
             raise AudioProcessingError("Audio processing timeout exceeded")
         
-        # Generate fingerprints
+        # The upload has been read, so polling for a disconnect consumes no body
+        disconnect_watcher = asyncio.create_task(cancel_on_disconnect(request, cancel_token))
+        
+        # Generate fingerprints; decode covers reading the upload and decoding it
         engine = get_engine()
-        fingerprints = await generate_fingerprints(audio_sample, engine)
+        stage_ms = {"decode": processing_time}
+        fingerprints = await generate_fingerprints(audio_sample, engine, cancel_token, stage_ms)
         
         if not fingerprints:
             logger.warning("No fingerprints generated from audio sample", request_id=request_id)
@@ -282,7 +411,13 @@ async def identify_audio(
             )
         
         # Find matching song
+        check_cancelled(cancel_token, "search")
+        search_start = time.time()
         match_result = await find_matching_song(fingerprints)
+        stage_ms["search"] = (time.time() - search_start) * 1000
+        
+        # The log write and its flush block, so they stay off the event loop
+        await asyncio.to_thread(capture_query, engine, fingerprints, match_result, stage_ms)
         
         # Calculate total processing time
         total_processing_time = int((time.time() - start_time) * 1000)
@@ -347,6 +482,40 @@ async def identify_audio(
         )
         raise HTTPException(status_code=400, detail=str(e))
     
+    except ServiceOverloadedError as e:
+        processing_time = int((time.time() - start_time) * 1000)
+        logger.warning(
+            "Audio identification shed by admission control",
+            request_id=request_id,
+            retry_after_ms=e.retry_after_ms,
+            processing_time_ms=processing_time
+        )
+        raise HTTPException(
+            status_code=503,
+            detail="Service overloaded, please retry",
+            headers={"Retry-After": str(max(1, math.ceil(e.retry_after_ms / 1000)))}
+        )
+    
+    except RequestCancelledError as e:
+        processing_time = int((time.time() - start_time) * 1000)
+        logger.info(
+            "Audio identification cancelled",
+            request_id=request_id,
+            stage=e.stage,
+            reason="deadline" if e.deadline_expired else "client_disconnected",
+            error=str(e),
+            processing_time_ms=processing_time
+        )
+        if e.deadline_expired:
+            raise HTTPException(status_code=504, detail="Request processing timeout exceeded")
+        raise HTTPException(status_code=CLIENT_CLOSED_REQUEST, detail="Client closed request")
+    
+    except asyncio.CancelledError:
+        # The timeout middleware gave up on the request; stop the engine work too
+        cancel_token.cancel()
+        logger.info("Audio identification cancelled", request_id=request_id, reason="timeout")
+        raise
+    
     except (AudioProcessingError, FingerprintGenerationError) as e:
         processing_time = int((time.time() - start_time) * 1000)
         logger.error(
@@ -377,4 +546,8 @@ async def identify_audio(
             processing_time_ms=processing_time,
             exc_info=True
         )
-        raise HTTPException(status_code=500, detail="Internal server error")
\ No newline at end of file
+        raise HTTPException(status_code=500, detail="Internal server error")
+    
+    finally:
+        if disconnect_watcher is not None:
+            disconnect_watcher.cancel()
\ No newline at end of file
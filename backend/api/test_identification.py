@@ -4,6 +4,7 @@ Tests for the audio identification endpoint.
 
 import pytest
 import io
+import time
 from fastapi.testclient import TestClient
 from unittest.mock import patch, MagicMock
 from backend.models.audio import Fingerprint
@@ -86,6 +87,13 @@ def test_identify_audio_success(mock_db_session, mock_get_engine, client, sample
     assert data["match"]["confidence"] == 0.85
     assert "request_id" in data
     assert "processing_time_ms" in data
+    
+    # The query is offered to the query log with its result and stage timings
+    args, kwargs = mock_engine.capture_query.call_args
+    assert args[0] == [12345, 67890]
+    assert args[1] == [1000, 2000]
+    assert args[2][0]["song_id"] == 1
+    assert set(args[3]) == {"decode", "fingerprint", "search"}
 
 
 @patch('backend.api.routes.identification.get_engine')
@@ -157,5 +165,99 @@ def test_identify_audio_engine_error(mock_get_engine, client, sample_audio_file)
     assert response.status_code == 500
 
 
+@patch('backend.api.routes.identification.get_engine')
+def test_identify_audio_engine_overloaded(mock_get_engine, client, sample_audio_file):
+    """Test that admission control rejections map to 503 with a Retry-After hint."""
+    from audio_engine.fingerprint_api import EngineOverloadedError
+    
+    mock_engine = MagicMock()
+    mock_engine.generate_fingerprint.side_effect = EngineOverloadedError(
+        "Audio engine overloaded, retry later", retry_after_ms=2500
+    )
+    mock_get_engine.return_value = mock_engine
+    
+    files = {"audio_file": ("test.wav", io.BytesIO(sample_audio_file), "audio/wav")}
+    response = client.post("/api/v1/identify", files=files)
+    
+    assert response.status_code == 503
+    assert response.headers["Retry-After"] == "3"
+
+
+@patch('backend.api.routes.identification.get_engine')
+def test_identify_audio_cancelled(mock_get_engine, client, sample_audio_file):
+    """Test that abandoned engine work maps to 499 on disconnect and 504 on deadline."""
+    from audio_engine.fingerprint_api import OperationCancelled
+    
+    def disconnected(*args, cancel_token=None, **kwargs):
+        cancel_token.cancel()
+        raise OperationCancelled("Operation cancelled at stft")
+    
+    def timed_out(*args, cancel_token=None, **kwargs):
+        cancel_token.set_deadline(0)
+        raise OperationCancelled("Deadline expired at stft")
+    
+    mock_engine = MagicMock()
+    mock_get_engine.return_value = mock_engine
+    
+    for side_effect, status_code in ((disconnected, 499), (timed_out, 504)):
+        mock_engine.generate_fingerprint.side_effect = side_effect
+        files = {"audio_file": ("test.wav", io.BytesIO(sample_audio_file), "audio/wav")}
+        response = client.post("/api/v1/identify", files=files)
+        
+        assert response.status_code == status_code
+        assert mock_engine.generate_fingerprint.call_args[1]["cancel_token"] is not None
+
+
+@patch('backend.api.routes.identification.decode_mp3')
+@patch('backend.api.routes.identification.mp3_stream_info')
+@patch('backend.api.routes.identification.get_engine')
+@patch('backend.api.routes.identification.get_db_session')
+def test_identify_mp3_decodes_only_the_window(mock_db_session, mock_get_engine, mock_stream_info,
+                                              mock_decode_mp3, client):
+    """Test that MP3 uploads are decoded natively, bounded by the fingerprinting window."""
+    import numpy as np
+    
+    mock_engine = MagicMock()
+    mock_fingerprint_result = MagicMock()
+    mock_fingerprint_result.count = 2
+    mock_fingerprint_result.hash_values = [12345, 67890]
+    mock_fingerprint_result.time_offsets = [1000, 2000]
+    mock_fingerprint_result.anchor_frequencies = [440.0, 880.0]
+    mock_fingerprint_result.target_frequencies = [660.0, 1320.0]
+    mock_fingerprint_result.time_deltas = [500, 500]
+    mock_engine.generate_fingerprint.return_value = mock_fingerprint_result
+    mock_get_engine.return_value = mock_engine
+    
+    mock_stream_info.return_value = {"sample_rate": 44100, "channels": 2, "frames": 10000,
+                                     "samples_per_frame": 1152, "duration_ms": 261224}
+    decoded = np.zeros(11025 * 30, dtype=np.float32)
+    
+    def slow_decode(*args, **kwargs):
+        time.sleep(0.05)
+        return {"data": decoded, "sample_rate": 11025, "channels": 1,
+                "duration_ms": 30000, "frames_decoded": 1152, "frames_skipped": 8848}
+    mock_decode_mp3.side_effect = slow_decode
+    
+    files = {"audio_file": ("query.mp3", io.BytesIO(b"\xff\xfb\x90\x40" + b"\x00" * 413), "audio/mpeg")}
+    with patch('backend.api.routes.identification.MatchRepository') as mock_match_repo:
+        mock_match_repo.return_value.find_best_match.return_value = None
+        response = client.post("/api/v1/identify", files=files)
+    
+    assert response.status_code == 200
+    args, kwargs = mock_decode_mp3.call_args
+    assert kwargs["max_duration_ms"] == 30000
+    assert kwargs["target_rate"] == 11025
+    
+    audio, sample_rate, channels = mock_engine.generate_fingerprint.call_args[0][:3]
+    assert audio is decoded
+    assert sample_rate == 11025
+    assert channels == 1
+    
+    # The frame decode is timed as the decode stage, not as fingerprinting
+    stage_ms = mock_engine.capture_query.call_args[0][3]
+    assert stage_ms["decode"] >= 50
+    assert stage_ms["fingerprint"] < 50
+
+
 if __name__ == "__main__":
     pytest.main([__file__])
\ No newline at end of file
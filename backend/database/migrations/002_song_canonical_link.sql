@@ -0,0 +1,16 @@
+-- Migration 002: Canonical song links
+-- Near-duplicate releases (single, album, compilation) found at ingest can be
+-- stored as a link to the canonical song instead of a second copy of its fingerprints
+
+BEGIN;
+
+ALTER TABLE songs
+    ADD COLUMN IF NOT EXISTS canonical_song_id INTEGER REFERENCES songs(id) ON DELETE SET NULL;
+
+CREATE INDEX IF NOT EXISTS idx_songs_canonical ON songs(canonical_song_id);
+
+-- Record this migration
+INSERT INTO schema_migrations (version) VALUES ('002_song_canonical_link')
+ON CONFLICT (version) DO NOTHING;
+
+COMMIT;
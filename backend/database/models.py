@@ -20,6 +20,7 @@ class SongModel(Base):
     artist = Column(String(255), nullable=False)
     album = Column(String(255), nullable=True)
     duration_seconds = Column(Integer, nullable=True)
+    canonical_song_id = Column(Integer, ForeignKey('songs.id', ondelete='SET NULL'), nullable=True)
     created_at = Column(DateTime, default=func.now(), nullable=False)
     
     # Relationship to fingerprints
@@ -36,6 +37,7 @@ class SongModel(Base):
             'artist': self.artist,
             'album': self.album,
             'duration_seconds': self.duration_seconds,
+            'canonical_song_id': self.canonical_song_id,
             'created_at': self.created_at.isoformat() if self.created_at else None
         }
 
@@ -78,4 +80,5 @@ class FingerprintModel(Base):
 
 # Additional indexes on songs table
 Index('idx_songs_artist_title', SongModel.artist, SongModel.title)
+Index('idx_songs_canonical', SongModel.canonical_song_id)
 Index('idx_songs_created_at', SongModel.created_at)
\ No newline at end of file
@@ -6,27 +6,109 @@ import logging
 from pathlib import Path
 from typing import List, Optional, Tuple, Dict, Any
 import hashlib
+from collections import defaultdict
+from dataclasses import dataclass
 from datetime import datetime
 
 from backend.database.connection import get_db_session
-from backend.database.repositories import SongRepository, FingerprintRepository
+from backend.database.repositories import SongRepository, FingerprintRepository, song_table
 from backend.models.song import Song
 from backend.models.audio import Fingerprint
 
 logger = logging.getLogger(__name__)
 
+# What to do with a song whose fingerprints overlap an indexed song
+NEAR_DUPLICATE_ACTIONS = ('flag', 'skip', 'link')
+
+
+@dataclass
+class NearDuplicate:
+    """An indexed song that a new song's fingerprints largely overlap."""
+    song_id: int
+    overlap: float          # Fraction of the new song's sampled fingerprints that align
+    aligned_matches: int
+
 
 class DuplicateDetector:
     """Handles duplicate detection and prevention for songs and fingerprints."""
     
-    def __init__(self, song_repo: SongRepository):
+    def __init__(self, song_repo: SongRepository, fingerprint_repo: Optional[FingerprintRepository] = None):
         self.song_repo = song_repo
+        self.fingerprint_repo = fingerprint_repo
+        self.max_query_fingerprints = 2000
+        self.offset_bin_ms = 100
+        # Hashes indexed more often than this are skipped as stop words
+        self.max_postings_per_hash = 1000
+        # Sampled query fingerprints in the last lookup, and how many had a stop-word hash
+        self.last_sampled = 0
+        self.last_skipped = 0
     
     def is_duplicate_song(self, title: str, artist: str) -> bool:
         """Check if a song already exists in the database."""
         existing_song = self.song_repo.find_song_by_title_artist(title, artist)
         return existing_song is not None
     
+    def find_near_duplicate(self, fingerprints: List[Fingerprint], min_overlap: float) -> Optional[NearDuplicate]:
+        """
+        Query the index with a new song's own fingerprints.
+        
+        Another release of the same recording shares most hashes at one
+        consistent time offset, so the share of fingerprints that align with
+        an indexed song measures how much of the new song is already there.
+        Returns the best match if its overlap reaches min_overlap, resolved
+        to its canonical song.
+        
+        Overlap is measured over the sampled fingerprints whose hash is not a
+        stop word; last_sampled and last_skipped record the sample size and how
+        many of its fingerprints were left out.
+        """
+        self.last_sampled = 0
+        self.last_skipped = 0
+        if not fingerprints or self.fingerprint_repo is None:
+            return None
+        
+        # Sample evenly across the song so edits at either end do not dominate
+        step = max(1, len(fingerprints) // self.max_query_fingerprints)
+        sample = fingerprints[::step][:self.max_query_fingerprints]
+        
+        query_times = defaultdict(list)
+        for fp in sample:
+            query_times[fp.hash_value].append(fp.time_offset_ms)
+        
+        postings, skipped_hashes = self.fingerprint_repo.find_postings_for_hashes(
+            list(query_times), self.max_postings_per_hash
+        )
+        self.last_sampled = len(sample)
+        self.last_skipped = sum(len(query_times.get(hash_value, ())) for hash_value in skipped_hashes)
+        informative = self.last_sampled - self.last_skipped
+        
+        # Histogram of (song, offset bin) votes
+        votes = defaultdict(int)
+        for song_id, hash_value, db_time in postings:
+            for query_time in query_times.get(hash_value, ()):
+                votes[(song_id, (db_time - query_time) // self.offset_bin_ms)] += 1
+        
+        # Best pair of adjacent bins per song absorbs offsets that straddle a boundary
+        best_by_song = defaultdict(int)
+        for (song_id, offset_bin), count in votes.items():
+            aligned = count + votes.get((song_id, offset_bin + 1), 0)
+            best_by_song[song_id] = max(best_by_song[song_id], aligned)
+        
+        if not best_by_song or informative <= 0:
+            return None
+        
+        song_id, aligned_matches = max(best_by_song.items(), key=lambda item: (item[1], -item[0]))
+        overlap = min(1.0, aligned_matches / informative)
+        if overlap < min_overlap:
+            return None
+        
+        # Link to the canonical entry rather than to another linked copy
+        song = self.song_repo.get_song_by_id(song_id)
+        if song is not None and song.canonical_song_id:
+            song_id = song.canonical_song_id
+        
+        return NearDuplicate(song_id=song_id, overlap=overlap, aligned_matches=aligned_matches)
+    
     def generate_audio_hash(self, audio_data: bytes) -> str:
         """Generate a hash for audio data to detect duplicates."""
         return hashlib.sha256(audio_data).hexdigest()
@@ -96,7 +178,23 @@ class BatchFingerprintInserter:
 class DatabasePopulator:
     """Main class for populating the database with songs and fingerprints."""
     
-    def __init__(self):
+    def __init__(self, near_duplicate_overlap: Optional[float] = None, near_duplicate_action: str = 'flag'):
+        """
+        Args:
+            near_duplicate_overlap: Fingerprint overlap (0-1) with an indexed song above which a
+                                    new song is a near-duplicate; None disables the check
+            near_duplicate_action: 'flag' to index it anyway and report it, 'skip' to drop it,
+                                   'link' to store it as a link to the canonical song without fingerprints
+        """
+        if near_duplicate_overlap is not None and not 0.0 < near_duplicate_overlap <= 1.0:
+            raise ValueError("Near-duplicate overlap must be in (0, 1]")
+        if near_duplicate_action not in NEAR_DUPLICATE_ACTIONS:
+            raise ValueError(f"Near-duplicate action must be one of {NEAR_DUPLICATE_ACTIONS}")
+        
+        self.near_duplicate_overlap = near_duplicate_overlap
+        self.near_duplicate_action = near_duplicate_action
+        self.last_near_duplicate: Optional[NearDuplicate] = None
+        
         self.duplicate_detector = None
         self.batch_inserter = None
         self.song_repo = None
@@ -106,7 +204,7 @@ class DatabasePopulator:
         """Initialize repository instances with the current session."""
         self.song_repo = SongRepository(session)
         self.fingerprint_repo = FingerprintRepository(session)
-        self.duplicate_detector = DuplicateDetector(self.song_repo)
+        self.duplicate_detector = DuplicateDetector(self.song_repo, self.fingerprint_repo)
         self.batch_inserter = BatchFingerprintInserter(self.fingerprint_repo)
     
     def add_song_with_fingerprints(
@@ -121,7 +219,12 @@ class DatabasePopulator:
         """
         Add a song with its fingerprints to the database.
         Returns the song ID if successful, None if skipped due to duplicates.
+        
+        With near-duplicate detection enabled, the fingerprints are first
+        queried against the index; the outcome is left in last_near_duplicate.
         """
+        self.last_near_duplicate = None
+        
         with get_db_session() as session:
             self._initialize_repositories(session)
             
@@ -137,26 +240,57 @@ class DatabasePopulator:
                     logger.error(f"No valid fingerprints for song '{title}' by '{artist}'")
                     return None
                 
+                # Check whether the recording is already indexed under another release
+                canonical_song_id = None
+                if self.near_duplicate_overlap is not None:
+                    near_duplicate = self.duplicate_detector.find_near_duplicate(
+                        valid_fingerprints, self.near_duplicate_overlap
+                    )
+                    self.last_near_duplicate = near_duplicate
+                    
+                    if self.duplicate_detector.last_skipped:
+                        logger.warning(
+                            f"Near-duplicate check for '{title}' by '{artist}' left out "
+                            f"{self.duplicate_detector.last_skipped} of {self.duplicate_detector.last_sampled} "
+                            f"sampled fingerprints whose hashes are stop words"
+                        )
+                    
+                    if near_duplicate:
+                        logger.warning(
+                            f"'{title}' by '{artist}' overlaps song {near_duplicate.song_id} "
+                            f"({near_duplicate.overlap:.0%} of fingerprints aligned), action: {self.near_duplicate_action}"
+                        )
+                        if self.near_duplicate_action == 'skip':
+                            return None
+                        if self.near_duplicate_action == 'link':
+                            canonical_song_id = near_duplicate.song_id
+                
                 # Create song
                 song = Song(
                     id=None,
                     title=title,
                     artist=artist,
                     album=album,
-                    duration_seconds=duration_seconds
+                    duration_seconds=duration_seconds,
+                    canonical_song_id=canonical_song_id
                 )
                 
                 created_song = self.song_repo.create_song(song)
                 logger.info(f"Created song: '{created_song.title}' by '{created_song.artist}' (ID: {created_song.id})")
                 
-                # Insert fingerprints
-                fingerprint_count = self.batch_inserter.insert_fingerprints_batch(
-                    created_song.id, valid_fingerprints
-                )
+                # Linked songs are matched through their canonical song's fingerprints
+                fingerprint_count = 0
+                if canonical_song_id is None:
+                    fingerprint_count = self.batch_inserter.insert_fingerprints_batch(
+                        created_song.id, valid_fingerprints
+                    )
                 
                 # Commit the transaction
                 self.song_repo.commit()
                 
+                # Matches on this song are reported without reading it back
+                song_table.remember(created_song)
+                
                 logger.info(f"Successfully added song '{title}' with {fingerprint_count} fingerprints")
                 return created_song.id
             
@@ -180,6 +314,8 @@ class DatabasePopulator:
             'total_songs': len(songs_data),
             'added_songs': 0,
             'skipped_duplicates': 0,
+            'near_duplicates': 0,
+            'linked_songs': 0,
             'failed_songs': 0,
             'total_fingerprints': 0,
             'errors': []
@@ -202,7 +338,13 @@ class DatabasePopulator:
                     skip_duplicates=True
                 )
                 
-                if song_id:
+                if self.last_near_duplicate:
+                    stats['near_duplicates'] += 1
+                
+                if song_id and self.last_near_duplicate and self.near_duplicate_action == 'link':
+                    stats['added_songs'] += 1
+                    stats['linked_songs'] += 1
+                elif song_id:
                     stats['added_songs'] += 1
                     stats['total_fingerprints'] += len(fingerprints)
                 else:
@@ -237,6 +379,7 @@ class DatabasePopulator:
                 
                 if deleted:
                     self.song_repo.commit()
+                    song_table.forget(song_id)
                     logger.info(f"Removed song '{song.title}' by '{song.artist}' and {fingerprint_count} fingerprints")
                     return True
                 else:
@@ -255,7 +398,7 @@ class DatabasePopulator:
             
             try:
                 from backend.database.repositories import MatchRepository
-                match_repo = MatchRepository(session)
+                match_repo = MatchRepository(session, song_index=song_table)
                 return match_repo.get_database_stats()
             
             except Exception as e:
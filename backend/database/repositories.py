@@ -2,6 +2,8 @@
 Repository classes for database operations with performance optimization.
 """
 import logging
+import threading
+from collections import OrderedDict
 from typing import List, Optional, Tuple, Dict, Any
 from datetime import datetime
 from sqlalchemy.orm import Session
@@ -46,7 +48,8 @@ class SongRepository(BaseRepository):
                 title=song.title,
                 artist=song.artist,
                 album=song.album,
-                duration_seconds=song.duration_seconds
+                duration_seconds=song.duration_seconds,
+                canonical_song_id=song.canonical_song_id
             )
             
             self.session.add(song_model)
@@ -59,7 +62,8 @@ class SongRepository(BaseRepository):
                 artist=song_model.artist,
                 album=song_model.album,
                 duration_seconds=song_model.duration_seconds,
-                created_at=song_model.created_at
+                created_at=song_model.created_at,
+                canonical_song_id=song_model.canonical_song_id
             )
         
         except IntegrityError as e:
@@ -85,7 +89,8 @@ class SongRepository(BaseRepository):
                 artist=song_model.artist,
                 album=song_model.album,
                 duration_seconds=song_model.duration_seconds,
-                created_at=song_model.created_at
+                created_at=song_model.created_at,
+                canonical_song_id=song_model.canonical_song_id
             )
         
         except SQLAlchemyError as e:
@@ -111,7 +116,8 @@ class SongRepository(BaseRepository):
                 artist=song_model.artist,
                 album=song_model.album,
                 duration_seconds=song_model.duration_seconds,
-                created_at=song_model.created_at
+                created_at=song_model.created_at,
+                canonical_song_id=song_model.canonical_song_id
             )
         
         except SQLAlchemyError as e:
@@ -134,7 +140,8 @@ class SongRepository(BaseRepository):
                     artist=model.artist,
                     album=model.album,
                     duration_seconds=model.duration_seconds,
-                    created_at=model.created_at
+                    created_at=model.created_at,
+                    canonical_song_id=model.canonical_song_id
                 )
                 for model in song_models
             ]
@@ -180,7 +187,8 @@ class SongRepository(BaseRepository):
                 artist=song_model.artist,
                 album=song_model.album,
                 duration_seconds=song_model.duration_seconds,
-                created_at=song_model.created_at
+                created_at=song_model.created_at,
+                canonical_song_id=song_model.canonical_song_id
             )
             
             return SongMetadata(
@@ -264,6 +272,63 @@ class FingerprintRepository(BaseRepository):
             logger.error(f"Database error finding matching fingerprints: {e}")
             raise
     
+    def find_postings_for_hashes(
+        self,
+        hash_values: List[int],
+        max_postings_per_hash: int = 1000
+    ) -> Tuple[List[Tuple[int, int, int]], List[int]]:
+        """
+        Find every indexed occurrence of the given hashes.
+        
+        Hashes indexed more than max_postings_per_hash times are stop words:
+        they occur in too many songs to tell any of them apart, so they are
+        skipped as a whole. Every other hash returns all of its postings.
+        Returns (postings, skipped_hashes), postings being a list of
+        (song_id, hash_value, time_offset_ms) tuples.
+        """
+        if not hash_values:
+            return [], []
+        
+        try:
+            unique_hashes = list(set(hash_values))
+            batch_size = 500
+            
+            # Document frequency of each hash, from the hash_value index alone
+            kept_hashes = []
+            skipped_hashes = []
+            for i in range(0, len(unique_hashes), batch_size):
+                batch_hashes = unique_hashes[i:i + batch_size]
+                
+                counts = self.session.query(
+                    FingerprintModel.hash_value,
+                    func.count()
+                ).filter(FingerprintModel.hash_value.in_(batch_hashes))\
+                 .group_by(FingerprintModel.hash_value).all()
+                
+                for hash_value, count in counts:
+                    if count > max_postings_per_hash:
+                        skipped_hashes.append(hash_value)
+                    else:
+                        kept_hashes.append(hash_value)
+            
+            postings = []
+            for i in range(0, len(kept_hashes), batch_size):
+                batch_hashes = kept_hashes[i:i + batch_size]
+                
+                batch_postings = self.session.query(
+                    FingerprintModel.song_id,
+                    FingerprintModel.hash_value,
+                    FingerprintModel.time_offset_ms
+                ).filter(FingerprintModel.hash_value.in_(batch_hashes)).all()
+                
+                postings.extend(batch_postings)
+            
+            return [(song_id, hash_value, time_offset) for song_id, hash_value, time_offset in postings], skipped_hashes
+        
+        except SQLAlchemyError as e:
+            logger.error(f"Database error finding postings for hashes: {e}")
+            raise
+    
     def get_fingerprints_for_song(self, song_id: int, limit: int = 1000) -> List[Fingerprint]:
         """Get fingerprints for a specific song."""
         try:
@@ -313,13 +378,72 @@ class FingerprintRepository(BaseRepository):
             raise
 
 
+class SongTable:
+    """
+    In-process song metadata table with the lookup_song() interface of the
+    engine's FingerprintIndex, so matches can be reported without a songs
+    table query. Ingest adds the songs it creates and MatchRepository adds
+    the ones it had to read from the database; the least recently used are
+    evicted beyond max_songs. Safe to share between threads.
+    """
+    
+    def __init__(self, max_songs: int = 100000):
+        self.max_songs = max_songs
+        self._songs: "OrderedDict[int, Dict[str, Any]]" = OrderedDict()
+        self._lock = threading.Lock()
+    
+    def lookup_song(self, song_id: int) -> Optional[Dict[str, Any]]:
+        """Metadata of a song as title, artist, album and duration_ms, or None."""
+        with self._lock:
+            metadata = self._songs.get(song_id)
+            if metadata is not None:
+                self._songs.move_to_end(song_id)
+            return metadata
+    
+    def remember(self, song: Song) -> None:
+        """Add or replace a song's metadata."""
+        metadata = {
+            'title': song.title,
+            'artist': song.artist,
+            'album': song.album or "",
+            'duration_ms': (song.duration_seconds or 0) * 1000,
+        }
+        with self._lock:
+            self._songs[song.id] = metadata
+            self._songs.move_to_end(song.id)
+            while len(self._songs) > self.max_songs:
+                self._songs.popitem(last=False)
+    
+    def forget(self, song_id: int) -> None:
+        """Drop a song, e.g. once it is deleted."""
+        with self._lock:
+            self._songs.pop(song_id, None)
+    
+    def __len__(self) -> int:
+        with self._lock:
+            return len(self._songs)
+
+
+# Song table shared by the repositories of this process
+song_table = SongTable()
+
+
 class MatchRepository(BaseRepository):
     """Repository for song matching operations with performance optimization."""
     
-    def __init__(self, session: Session):
+    def __init__(self, session: Session, song_index=None):
+        """
+        Args:
+            session: Database session
+            song_index: Optional object with lookup_song(song_id) returning a
+                dict with title, artist and album or None, such as the
+                engine's FingerprintIndex or song_table; consulted before the
+                songs table. A SongTable also keeps the songs read from there.
+        """
         super().__init__(session)
         self.song_repo = SongRepository(session)
         self.fingerprint_repo = FingerprintRepository(session)
+        self.song_index = song_index
     
     def find_best_match(self, query_fingerprints: List[Fingerprint], min_matches: int = 5) -> Optional[MatchResult]:
         """
@@ -400,8 +524,15 @@ class MatchRepository(BaseRepository):
             if best_confidence < min_confidence:
                 return None
             
-            # Get song details
-            song = self.song_repo.get_song_by_id(best_song_id)
+            # Get song details, from the index's song table when it has them
+            indexed = self.song_index.lookup_song(best_song_id) if self.song_index is not None else None
+            if indexed:
+                song = Song(id=best_song_id, title=indexed['title'], artist=indexed['artist'],
+                            album=indexed['album'] or None)
+            else:
+                song = self.song_repo.get_song_by_id(best_song_id)
+                if song and isinstance(self.song_index, SongTable):
+                    self.song_index.remember(song)
             if not song:
                 return None
             
@@ -8,6 +8,7 @@ CREATE TABLE IF NOT EXISTS songs (
     artist VARCHAR(255) NOT NULL,
     album VARCHAR(255),
     duration_seconds INTEGER,
+    canonical_song_id INTEGER REFERENCES songs(id) ON DELETE SET NULL,  -- Set for near-duplicate releases
     created_at TIMESTAMP DEFAULT NOW(),
     
     -- Constraints
@@ -36,6 +37,7 @@ CREATE INDEX IF NOT EXISTS idx_fingerprints_hash_time ON fingerprints(hash_value
 
 -- Additional performance indexes
 CREATE INDEX IF NOT EXISTS idx_songs_created_at ON songs(created_at);
+CREATE INDEX IF NOT EXISTS idx_songs_canonical ON songs(canonical_song_id);
 CREATE INDEX IF NOT EXISTS idx_fingerprints_created_at ON fingerprints(created_at);
 
 -- Statistics for query optimization
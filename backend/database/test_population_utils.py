@@ -0,0 +1,145 @@
+"""
+Unit tests for ingest-time duplicate detection.
+"""
+import pytest
+from unittest.mock import MagicMock, patch
+
+from backend.database.population_utils import DuplicateDetector, DatabasePopulator, NearDuplicate
+from backend.models.song import Song
+from backend.models.audio import Fingerprint
+
+
+def make_fingerprints(count: int, seed: int, start_ms: int = 0):
+    """Deterministic fingerprints spaced 50 ms apart."""
+    return [
+        Fingerprint(hash_value=(seed * 1000003 + i * 7919) & 0x7FFFFFFF, time_offset_ms=start_ms + i * 50)
+        for i in range(count)
+    ]
+
+
+def postings_for(song_id: int, fingerprints, shift_ms: int = 0):
+    """Index rows for a song whose copy of the fingerprints starts shift_ms later."""
+    return [(song_id, fp.hash_value, fp.time_offset_ms + shift_ms) for fp in fingerprints]
+
+
+class TestNearDuplicateDetection:
+    """Test the fingerprint self-query used to find other releases of a recording."""
+    
+    def setup_method(self):
+        self.song_repo = MagicMock()
+        self.song_repo.get_song_by_id.side_effect = lambda song_id: Song(id=song_id, title="T", artist="A")
+        self.fingerprint_repo = MagicMock()
+        self.detector = DuplicateDetector(self.song_repo, self.fingerprint_repo)
+    
+    def test_shifted_release_is_detected(self):
+        """Test that an album copy with extra lead-in silence aligns with the single."""
+        single = make_fingerprints(400, seed=1)
+        self.fingerprint_repo.find_postings_for_hashes.return_value = (postings_for(7, single, shift_ms=1530), [])
+        
+        result = self.detector.find_near_duplicate(single, min_overlap=0.5)
+        
+        assert result == NearDuplicate(song_id=7, overlap=1.0, aligned_matches=400)
+    
+    def test_unaligned_hash_collisions_are_ignored(self):
+        """Test that shared hashes at scattered offsets do not count as overlap."""
+        query = make_fingerprints(400, seed=2)
+        scattered = [(9, fp.hash_value, (i * 7331) % 200000) for i, fp in enumerate(query)]
+        self.fingerprint_repo.find_postings_for_hashes.return_value = (scattered, [])
+        
+        assert self.detector.find_near_duplicate(query, min_overlap=0.5) is None
+    
+    def test_partial_overlap_below_threshold(self):
+        """Test that a song sharing only a short excerpt is not a near-duplicate."""
+        query = make_fingerprints(400, seed=3)
+        self.fingerprint_repo.find_postings_for_hashes.return_value = (postings_for(4, query[:100]), [])
+        
+        assert self.detector.find_near_duplicate(query, min_overlap=0.5) is None
+        assert self.detector.find_near_duplicate(query, min_overlap=0.2).song_id == 4
+    
+    def test_resolves_to_canonical_song(self):
+        """Test that a match on a linked copy points at its canonical song."""
+        query = make_fingerprints(200, seed=4)
+        self.fingerprint_repo.find_postings_for_hashes.return_value = (postings_for(12, query), [])
+        self.song_repo.get_song_by_id.side_effect = lambda song_id: Song(
+            id=song_id, title="T", artist="A", canonical_song_id=3
+        )
+        
+        assert self.detector.find_near_duplicate(query, min_overlap=0.5).song_id == 3
+    
+    def test_stop_words_are_left_out_of_the_overlap(self):
+        """Test that hashes skipped as stop words do not count against the overlap."""
+        query = make_fingerprints(400, seed=7)
+        common = [fp.hash_value for fp in query[300:]]
+        self.fingerprint_repo.find_postings_for_hashes.return_value = (postings_for(8, query[:300]), common)
+        
+        result = self.detector.find_near_duplicate(query, min_overlap=0.9)
+        
+        assert result == NearDuplicate(song_id=8, overlap=1.0, aligned_matches=300)
+        assert (self.detector.last_sampled, self.detector.last_skipped) == (400, 100)
+        assert self.fingerprint_repo.find_postings_for_hashes.call_args[0][1] == self.detector.max_postings_per_hash
+    
+    def test_query_is_sampled(self):
+        """Test that long songs are sampled evenly rather than queried in full."""
+        query = make_fingerprints(10000, seed=5)
+        self.fingerprint_repo.find_postings_for_hashes.return_value = ([], [])
+        
+        self.detector.find_near_duplicate(query, min_overlap=0.5)
+        
+        queried = self.fingerprint_repo.find_postings_for_hashes.call_args[0][0]
+        assert len(queried) <= self.detector.max_query_fingerprints
+
+
+class TestNearDuplicateIngest:
+    """Test the flag, skip and link actions of the ingest path."""
+    
+    def add_song(self, action: str, near_duplicate):
+        populator = DatabasePopulator(near_duplicate_overlap=0.5, near_duplicate_action=action)
+        fingerprints = make_fingerprints(100, seed=6, start_ms=10)
+        
+        with patch('backend.database.population_utils.get_db_session'), \
+             patch('backend.database.population_utils.SongRepository') as song_repo_class, \
+             patch('backend.database.population_utils.FingerprintRepository'), \
+             patch.object(DuplicateDetector, 'find_near_duplicate', return_value=near_duplicate), \
+             patch('backend.database.population_utils.BatchFingerprintInserter') as inserter_class:
+            
+            song_repo = song_repo_class.return_value
+            song_repo.find_song_by_title_artist.return_value = None
+            song_repo.create_song.side_effect = lambda song: Song(
+                id=42, title=song.title, artist=song.artist, canonical_song_id=song.canonical_song_id
+            )
+            inserter = inserter_class.return_value
+            inserter.validate_fingerprints.side_effect = lambda fps: fps
+            inserter.insert_fingerprints_batch.return_value = len(fingerprints)
+            
+            song_id = populator.add_song_with_fingerprints("Song (Album Version)", "Artist", fingerprints)
+            return song_id, song_repo, inserter
+    
+    def test_link_stores_reference_without_fingerprints(self):
+        """Test that a linked duplicate points at the canonical song and adds no postings."""
+        song_id, song_repo, inserter = self.add_song('link', NearDuplicate(5, 0.9, 90))
+        
+        assert song_id == 42
+        assert song_repo.create_song.call_args[0][0].canonical_song_id == 5
+        inserter.insert_fingerprints_batch.assert_not_called()
+    
+    def test_skip_drops_duplicate(self):
+        """Test that a skipped duplicate is not stored."""
+        song_id, song_repo, inserter = self.add_song('skip', NearDuplicate(5, 0.9, 90))
+        
+        assert song_id is None
+        song_repo.create_song.assert_not_called()
+    
+    def test_flag_indexes_normally(self):
+        """Test that a flagged duplicate is indexed with its own fingerprints."""
+        song_id, song_repo, inserter = self.add_song('flag', NearDuplicate(5, 0.9, 90))
+        
+        assert song_id == 42
+        assert song_repo.create_song.call_args[0][0].canonical_song_id is None
+        inserter.insert_fingerprints_batch.assert_called_once()
+    
+    def test_invalid_configuration(self):
+        """Test that bad thresholds and actions are rejected."""
+        with pytest.raises(ValueError):
+            DatabasePopulator(near_duplicate_overlap=1.5)
+        with pytest.raises(ValueError):
+            DatabasePopulator(near_duplicate_overlap=0.5, near_duplicate_action='merge')
@@ -0,0 +1,82 @@
+"""
+Unit tests for match lookups that use the engine index's song table.
+"""
+from unittest.mock import MagicMock
+
+from backend.database.repositories import MatchRepository, SongTable
+from backend.models.song import Song
+from backend.models.audio import Fingerprint
+
+
+def make_repository(song_index=None):
+    """Match repository whose fingerprint lookup returns 50 aligned hits on song 7."""
+    repo = MatchRepository(MagicMock(), song_index=song_index)
+    repo.fingerprint_repo = MagicMock()
+    repo.fingerprint_repo.find_matching_fingerprints.return_value = [
+        (7, i * 50, 12000 + i * 50) for i in range(50)
+    ]
+    repo.song_repo = MagicMock()
+    repo.song_repo.get_song_by_id.return_value = Song(id=7, title="From DB", artist="DB Artist")
+    return repo
+
+
+QUERY = [Fingerprint(hash_value=i + 1, time_offset_ms=i * 50) for i in range(100)]
+
+
+class TestMatchSongTable:
+    """Test that song details come from the index song table when available."""
+    
+    def test_song_table_avoids_database_lookup(self):
+        """Test that an indexed song is reported without a songs table query."""
+        song_index = MagicMock()
+        song_index.lookup_song.return_value = {
+            'title': "Indexed", 'artist': "Index Artist", 'album': "", 'duration_ms': 180000
+        }
+        repo = make_repository(song_index)
+        
+        result = repo.find_best_match(QUERY)
+        
+        song_index.lookup_song.assert_called_once_with(7)
+        repo.song_repo.get_song_by_id.assert_not_called()
+        assert (result.song_id, result.title, result.artist, result.album) == (7, "Indexed", "Index Artist", None)
+        assert result.time_offset_ms == 12000
+    
+    def test_falls_back_to_database(self):
+        """Test that songs missing from the song table are read from the database."""
+        song_index = MagicMock()
+        song_index.lookup_song.return_value = None
+        
+        result = make_repository(song_index).find_best_match(QUERY)
+        
+        assert result.title == "From DB"
+        assert make_repository().find_best_match(QUERY).title == "From DB"
+
+
+class TestSongTable:
+    """Test the in-process song table used as the match repository's song index."""
+    
+    def test_keeps_songs_read_from_database(self):
+        """Test that a song read from the database is not read again."""
+        table = SongTable()
+        
+        first = make_repository(table).find_best_match(QUERY)
+        repo = make_repository(table)
+        second = repo.find_best_match(QUERY)
+        
+        repo.song_repo.get_song_by_id.assert_not_called()
+        assert (first.title, second.title, second.artist) == ("From DB", "From DB", "DB Artist")
+    
+    def test_evicts_least_recently_used(self):
+        """Test that the table stays within max_songs, keeping recently used songs."""
+        table = SongTable(max_songs=2)
+        for song_id in (1, 2):
+            table.remember(Song(id=song_id, title=f"Song {song_id}", artist="Artist", duration_seconds=200))
+        assert table.lookup_song(1)['duration_ms'] == 200000
+        
+        table.remember(Song(id=3, title="Song 3", artist="Artist"))
+        
+        assert table.lookup_song(2) is None
+        assert table.lookup_song(1)['title'] == "Song 1"
+        assert table.lookup_song(3)['album'] == ""
+        table.forget(1)
+        assert table.lookup_song(1) is None and len(table) == 1
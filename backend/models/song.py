@@ -15,6 +15,7 @@ class Song:
     album: Optional[str] = None
     duration_seconds: Optional[int] = None
     created_at: Optional[datetime] = None
+    canonical_song_id: Optional[int] = None  # Set when this song is a near-duplicate release
     
     def __post_init__(self):
         """Validate song parameters."""
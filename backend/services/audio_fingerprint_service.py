@@ -119,31 +119,18 @@ class AudioFingerprintService(AudioProcessorInterface):
         try:
             self.logger.info(f"Batch processing {len(audio_files)} audio files")
             
-            # Load audio files (this is a simplified implementation)
-            # In a real implementation, you'd use a proper audio library like librosa
-            audio_samples = []
             song_ids = []
-            
             for i, file_path in enumerate(audio_files):
                 if not Path(file_path).exists():
                     raise AudioProcessingError(f"Audio file not found: {file_path}")
-                
-                # For now, create dummy audio data
-                # In production, load actual audio files
-                sample_rate = 44100
-                duration = 30  # 30 seconds
-                t = np.linspace(0, duration, sample_rate * duration, False)
-                audio_data = np.sin(2 * np.pi * 440 * t).astype(np.float32)
-                
-                audio_samples.append({
-                    'data': audio_data,
-                    'sample_rate': sample_rate,
-                    'channels': 1
-                })
                 song_ids.append(f"song_{i}_{Path(file_path).stem}")
             
-            # Process using C++ engine
-            results = self.engine.batch_process_reference_songs(audio_samples, song_ids)
+            # Read, decode and fingerprint natively with overlapped file I/O
+            results, io_stats = self.engine.batch_process_files(audio_files, song_ids)
+            self.logger.debug(
+                f"Corpus read via {io_stats['backend']}: {io_stats['bytes_read']} bytes, "
+                f"io wait {io_stats['io_wait_ms']:.1f}ms, compute idle {io_stats['compute_idle_ms']:.1f}ms"
+            )
             
             # Convert results to backend format
             all_fingerprints = []